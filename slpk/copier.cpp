@@ -0,0 +1,325 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/path.hpp"
+
+#include "jsoncpp/io.hpp"
+
+#include "copier.hpp"
+#include "detail/files.hpp"
+
+namespace fs = boost::filesystem;
+namespace bio = boost::iostreams;
+
+namespace slpk {
+
+namespace {
+
+bool gzipped(const fs::path &path)
+{
+    return path.extension() == detail::constants::ext::gz;
+}
+
+fs::path logicalPath(const fs::path &realPath)
+{
+    return gzipped(realPath) ? realPath.parent_path() / realPath.stem()
+        : realPath;
+}
+
+void pushGunzip(bio::filtering_istream &fis)
+{
+    bio::zlib_params p;
+    p.window_bits |= 16;
+    fis.push(bio::zlib_decompressor(p));
+}
+
+std::string relocate(const std::string &path, const std::string &srcDir
+                     , const std::string &dstDir)
+{
+    if (srcDir.empty() || path.compare(0, srcDir.size(), srcDir)) {
+        return path;
+    }
+    return dstDir + path.substr(srcDir.size());
+}
+
+std::string dirPath(const std::string &path)
+{
+    if (path.empty() || (path.back() == '/')) { return path; }
+    return path + "/";
+}
+
+/** Keeps only array items whose index is not in given set.
+ */
+Json::Value filter(const Json::Value &array
+                   , const std::set<Json::ArrayIndex> &drop)
+{
+    if (!array.isArray()) { return array; }
+
+    Json::Value out(Json::arrayValue);
+    for (Json::ArrayIndex i(0), e(array.size()); i != e; ++i) {
+        if (!drop.count(i)) { out.append(array[i]); }
+    }
+    return out;
+}
+
+} // namespace
+
+Copier::Copier(const Archive &archive, Writer &writer)
+    : archive_(archive), writer_(writer)
+    , passthrough_(), recoded_(), missing_()
+{
+    for (const auto &file : archive_.fileList()) {
+        files_.insert(file.generic_string());
+    }
+}
+
+void Copier::stripEncodings(const std::set<std::string> &mimes)
+{
+    strip_ = mimes;
+}
+
+bool Copier::stripped(const Resource &resource) const
+{
+    return resource.encoding && strip_.count(resource.encoding->mime);
+}
+
+fs::path Copier::find(const std::string &path
+                      , const std::vector<std::string> &extensions) const
+{
+    const auto probe([&](const std::string &p) -> fs::path
+    {
+        if (files_.count(p)) { return p; }
+        const auto gz(p + detail::constants::ext::gz.string());
+        if (files_.count(gz)) { return gz; }
+        return {};
+    });
+
+    if (extensions.empty()) { return probe(path); }
+
+    for (const auto &extension : extensions) {
+        const auto found(probe(path + extension));
+        if (!found.empty()) { return found; }
+    }
+    return {};
+}
+
+void Copier::copy(const fs::path &realPath, const fs::path &dst)
+{
+    claim(realPath);
+    transfer(realPath, dst);
+}
+
+bool Copier::claim(const fs::path &realPath)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return copied_.insert(realPath.generic_string()).second;
+}
+
+void Copier::transfer(const fs::path &realPath, const fs::path &dst)
+{
+    const bool gz(gzipped(realPath));
+    const auto target(dst.empty() ? logicalPath(realPath) : dst);
+    const bool gzTarget(writer_.metadata().resourceCompressionType
+                        == ResourceCompressionType::gzip);
+
+    auto is(archive_.rawistream(realPath));
+
+    if (gz == gzTarget) {
+        writer_.copy(gz ? utility::addExtension
+                     (target, detail::constants::ext::gz) : target
+                     , is->get());
+        ++passthrough_;
+    } else if (gz) {
+        bio::filtering_istream fis;
+        pushGunzip(fis);
+        fis.push(is->get());
+        writer_.write(target, fis);
+        ++recoded_;
+    } else {
+        writer_.write(target, is->get());
+        ++recoded_;
+    }
+}
+
+Json::Value Copier::load(const fs::path &realPath) const
+{
+    auto is(archive_.rawistream(realPath));
+    if (!gzipped(realPath)) {
+        return Json::read(is->get(), realPath, "JSON document");
+    }
+
+    bio::filtering_istream fis;
+    pushGunzip(fis);
+    fis.push(is->get());
+    return Json::read(fis, realPath, "JSON document");
+}
+
+void Copier::store(const fs::path &path, const Json::Value &value)
+{
+    std::stringstream ss;
+    Json::write(ss, value, false);
+    writer_.write(path, ss);
+}
+
+Json::Value Copier::nodeIndex(const Node &node, const std::string &dir)
+    const
+{
+    const auto path(dirPath(dir) + detail::constants::NodeIndex);
+    const auto realPath(find(path));
+    if (realPath.empty()) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Node index document " << path << " not found.";
+    }
+
+    auto value(load(realPath));
+    if (strip_.empty()) { return value; }
+
+    std::set<Json::ArrayIndex> drop;
+    for (std::size_t i(0); i < node.textureData.size(); ++i) {
+        if (stripped(node.textureData[i])) { drop.insert(i); }
+    }
+
+    if (!drop.empty()) {
+        value["textureData"] = filter(value["textureData"], drop);
+        if (!value["textureData"].size()) {
+            value.removeMember("textureData");
+        }
+    }
+    return value;
+}
+
+void Copier::copyIfExists(const fs::path &realPath, const std::string &path
+                          , const std::string &srcDir
+                          , const std::string &dstDir)
+{
+    if (realPath.empty()) {
+        LOG(warn2) << "File " << path << " referenced from the tree not "
+            "found in the source archive; skipped.";
+        ++missing_;
+        return;
+    }
+
+    if (!claim(realPath)) { return; }
+    transfer(realPath, relocate(logicalPath(realPath).generic_string()
+                            , srcDir, dstDir));
+}
+
+void Copier::copyResources(const Node &node, const std::string &srcDir
+                           , const std::string &dstDir)
+{
+    if (node.sharedResource) {
+        const auto path(dirPath(node.sharedResource->href)
+                        + detail::constants::SharedResource);
+        const auto realPath(find(path));
+
+        if (strip_.empty() || realPath.empty()) {
+            copyIfExists(realPath, path, srcDir, dstDir);
+        } else if (claim(realPath)) {
+            // drop stripped encodings and their image versions
+            auto value(load(realPath));
+            auto &definitions(value["textureDefinitions"]);
+            for (const auto &key : definitions.getMemberNames()) {
+                auto &definition(definitions[key]);
+
+                std::set<Json::ArrayIndex> drop;
+                const auto &encoding(definition["encoding"]);
+                for (Json::ArrayIndex i(0), e(encoding.size()); i != e; ++i)
+                {
+                    if (encoding[i].isString()
+                        && strip_.count(encoding[i].asString()))
+                    {
+                        drop.insert(i);
+                    }
+                }
+                if (drop.empty()) { continue; }
+
+                definition["encoding"] = filter(encoding, drop);
+                for (auto &image : definition["images"]) {
+                    for (const char *member
+                             : { "href", "byteOffset", "length" })
+                    {
+                        if (image.isMember(member)) {
+                            image[member] = filter(image[member], drop);
+                        }
+                    }
+                }
+            }
+
+            store(relocate(path, srcDir, dstDir), value);
+        }
+    }
+
+    for (const auto &resource : node.geometryData) {
+        copyIfExists(find(resource.href, { ".bin" }), resource.href
+                     , srcDir, dstDir);
+    }
+
+    for (const auto &resource : node.textureData) {
+        std::vector<std::string> extensions{ ".bin" };
+        if (resource.encoding && !resource.encoding->ext.empty()) {
+            extensions.push_back(resource.encoding->ext);
+        }
+        const auto realPath(find(resource.href, extensions));
+
+        if (stripped(resource)) {
+            // handled, never copy
+            if (!realPath.empty()) { claim(realPath); }
+            continue;
+        }
+        copyIfExists(realPath, resource.href, srcDir, dstDir);
+    }
+
+    for (const auto &resource : node.featureData) {
+        copyIfExists(find(resource.href, { ".json" }), resource.href
+                     , srcDir, dstDir);
+    }
+}
+
+bool Copier::copied(const fs::path &realPath) const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return copied_.count(realPath.generic_string());
+}
+
+Copier::Stats Copier::stats() const
+{
+    Stats stats;
+    stats.passthrough = passthrough_;
+    stats.recoded = recoded_;
+    stats.missing = missing_;
+    return stats;
+}
+
+} // namespace slpk
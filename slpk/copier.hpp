@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef slpk_copier_hpp_included_
+#define slpk_copier_hpp_included_
+
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+#include "jsoncpp/json.hpp"
+
+#include "reader.hpp"
+#include "writer.hpp"
+
+/** Passthrough copying of archive files into a writer.
+ */
+
+namespace slpk {
+
+/** Copies files from an archive to a writer. File content is passed through
+ *  as stored (gzipped resources stay gzipped, nothing is decoded) whenever
+ *  source file and writer resource compression match; otherwise it is
+ *  gunzipped/gzipped on the fly.
+ *
+ *  Paths are either real (as stored in the archive, possibly with .gz
+ *  extension) or logical (without .gz, as used by Archive::istream).
+ *
+ *  Thread safe.
+ */
+class Copier {
+public:
+    Copier(const Archive &archive, Writer &writer);
+
+    /** Texture encodings (MIME types) to strip: such textures are not
+     *  copied and are dropped from node index documents and shared
+     *  resources passed through nodeIndex() and copyResources().
+     */
+    void stripEncodings(const std::set<std::string> &mimes);
+
+    /** Finds file with given logical path, each extension is tried in given
+     *  order, plain and gzipped. Returns real path or empty path if not
+     *  found.
+     */
+    boost::filesystem::path
+    find(const std::string &path
+         , const std::vector<std::string> &extensions
+         = std::vector<std::string>()) const;
+
+    /** Copies file at given real path to given logical destination path
+     *  (same path if empty).
+     */
+    void copy(const boost::filesystem::path &realPath
+              , const boost::filesystem::path &dst
+              = boost::filesystem::path());
+
+    /** Loads JSON document at given real path.
+     */
+    Json::Value load(const boost::filesystem::path &realPath) const;
+
+    /** Stores JSON document at given logical path.
+     */
+    void store(const boost::filesystem::path &path, const Json::Value &value);
+
+    /** Loads index document of given node (from node directory) with
+     *  stripped textures removed.
+     */
+    Json::Value nodeIndex(const Node &node, const std::string &dir) const;
+
+    /** Copies all resources of given node: shared resource, geometries,
+     *  textures (except stripped encodings) and feature data; the node
+     *  index document itself is not copied. Resources living under srcDir
+     *  are relocated to dstDir (both node directories ending with slash),
+     *  everything else keeps its path.
+     */
+    void copyResources(const Node &node, const std::string &srcDir = ""
+                       , const std::string &dstDir = "");
+
+    /** Marks file as handled without copying it (e.g. when rewritten by
+     *  the caller). Returns false if it already was handled.
+     */
+    bool claim(const boost::filesystem::path &realPath);
+
+    /** Real paths already copied (or dropped as stripped textures).
+     */
+    bool copied(const boost::filesystem::path &realPath) const;
+
+    struct Stats {
+        /** Files copied as stored.
+         */
+        std::size_t passthrough;
+
+        /** Files (un)gzipped on the way.
+         */
+        std::size_t recoded;
+
+        /** Referenced files not found in source archive (skipped).
+         */
+        std::size_t missing;
+
+        Stats() : passthrough(), recoded(), missing() {}
+    };
+
+    Stats stats() const;
+
+private:
+    /** Copies file if present, counts missing ones.
+     */
+    void copyIfExists(const boost::filesystem::path &realPath
+                      , const std::string &path, const std::string &srcDir
+                      , const std::string &dstDir);
+
+    bool stripped(const Resource &resource) const;
+
+    /** Does the actual copy.
+     */
+    void transfer(const boost::filesystem::path &realPath
+                  , const boost::filesystem::path &dst);
+
+    const Archive &archive_;
+    Writer &writer_;
+    std::set<std::string> files_;
+    std::set<std::string> strip_;
+
+    mutable std::mutex mutex_;
+    std::set<std::string> copied_;
+
+    std::atomic<std::size_t> passthrough_;
+    std::atomic<std::size_t> recoded_;
+    std::atomic<std::size_t> missing_;
+};
+
+} // namespace slpk
+
+#endif // slpk_copier_hpp_included_
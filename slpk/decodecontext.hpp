@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef slpk_decodecontext_hpp_included_
+#define slpk_decodecontext_hpp_included_
+
+#include <memory>
+
+namespace slpk {
+
+/** Reusable geometry decoding state: stream buffers, inflate state, vertex
+ *  and texture coordinate indices and face lists. Everything is cleared but
+ *  not freed between decodes, so once the context has grown to the largest
+ *  decoded mesh, geometry decoding does not allocate.
+ *
+ *  Not thread safe: use one context per thread (see local()). Using one
+ *  context from two threads at once throws std::logic_error.
+ */
+class DecodeContext {
+public:
+    DecodeContext();
+    ~DecodeContext();
+
+    DecodeContext(const DecodeContext&) = delete;
+    DecodeContext& operator=(const DecodeContext&) = delete;
+
+    /** Default context of the calling thread. Used by Archive::loadGeometry
+     *  when no context is given, including batch loading in pool workers.
+     */
+    static DecodeContext& local();
+
+    /** Frees retained memory.
+     */
+    void shrink();
+
+    struct Detail;
+    Detail& detail() { return *detail_; }
+
+private:
+    std::unique_ptr<Detail> detail_;
+};
+
+} // namespace slpk
+
+#endif // slpk_decodecontext_hpp_included_
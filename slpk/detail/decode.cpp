@@ -0,0 +1,206 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <zlib.h>
+
+#include <algorithm>
+
+#include "dbglog/dbglog.hpp"
+
+#include "../trace.hpp"
+#include "decode.hpp"
+
+namespace slpk {
+
+namespace detail { namespace decode {
+
+Scratch::Scratch(const allocator_type &alloc)
+    : faces(alloc), facesNormal(alloc), facesTc(alloc)
+    , vertices(alloc), normals(alloc), tc(alloc)
+    , tcList(alloc), regionTc(alloc), regionMap(alloc), regions(alloc)
+{}
+
+void Scratch::clear()
+{
+    faces.clear();
+    facesNormal.clear();
+    facesTc.clear();
+    vertices.clear();
+    normals.clear();
+    tc.clear();
+    tcList.clear();
+    regionTc.clear();
+    regionMap.clear();
+    regions.clear();
+}
+
+void Scratch::shrink()
+{
+    clear();
+    faces.shrink_to_fit();
+    facesNormal.shrink_to_fit();
+    facesTc.shrink_to_fit();
+    vertices.shrink();
+    normals.shrink();
+    tc.shrink();
+    tcList.shrink_to_fit();
+    regionTc.shrink();
+    regionMap.shrink();
+    regions.shrink_to_fit();
+}
+
+struct Inflater::Stream {
+    ::z_stream z;
+};
+
+Inflater::Inflater()
+    : stream_(new Stream())
+{
+    // 32: detect gzip or zlib header automatically
+    if (::inflateInit2(&stream_->z, 15 + 32) != Z_OK) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Cannot initialize zlib inflate state.";
+    }
+}
+
+Inflater::~Inflater()
+{
+    ::inflateEnd(&stream_->z);
+}
+
+std::size_t Inflater::inflate(const char *data, std::size_t size
+                              , std::vector<char> &out, const char *what)
+{
+    trace::Span span("inflate", "reader");
+
+    auto &z(stream_->z);
+    ::inflateReset(&z);
+
+    // gzip trailer holds uncompressed size (modulo 2^32)
+    std::size_t expected(4 * size);
+    if ((size >= 18) && (static_cast<unsigned char>(data[0]) == 0x1f)
+        && (static_cast<unsigned char>(data[1]) == 0x8b))
+    {
+        const auto *t(reinterpret_cast<const unsigned char*>
+                      (data + size - 4));
+        expected = std::size_t(t[0]) | (std::size_t(t[1]) << 8)
+            | (std::size_t(t[2]) << 16) | (std::size_t(t[3]) << 24);
+    }
+    // do not trust corrupted trailer, deflate ratio is at most 1032:1
+    expected = std::min(expected, 1032 * size);
+    if (out.size() < expected + 1) {
+        out.resize(std::max<std::size_t>(expected + 1, 4096));
+    }
+
+    z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    z.avail_in = uInt(size);
+
+    std::size_t used(0);
+    for (;;) {
+        if (used == out.size()) { out.resize(2 * out.size()); }
+        z.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+        z.avail_out = uInt(out.size() - used);
+
+        const auto res(::inflate(&z, Z_NO_FLUSH));
+        used = out.size() - z.avail_out;
+
+        if (res == Z_STREAM_END) { break; }
+        if (res == Z_OK) { continue; }
+
+        if ((res == Z_BUF_ERROR) && !z.avail_in) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Cannot inflate " << what << ": truncated data.";
+        }
+        LOGTHROW(err1, std::runtime_error)
+            << "Cannot inflate " << what << ": "
+            << (z.msg ? z.msg : "unknown error") << ".";
+    }
+
+    return used;
+}
+
+} } // namespace detail::decode
+
+void DecodeContext::Detail::read(std::istream &is, std::size_t sizeHint)
+{
+    // one extra byte to hit EOF without growing
+    if (raw.size() < sizeHint + 1) { raw.resize(sizeHint + 1); }
+    if (raw.size() < 4096) { raw.resize(4096); }
+
+    rawSize = 0;
+    for (;;) {
+        is.read(raw.data() + rawSize, raw.size() - rawSize);
+        rawSize += is.gcount();
+        if (!is) { break; }
+        raw.resize(2 * raw.size());
+    }
+
+    if (is.bad()) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Error reading resource data.";
+    }
+}
+
+std::istream& DecodeContext::Detail::stream(const char *data
+                                            , std::size_t size
+                                            , bool gzipped
+                                            , const char *what)
+{
+    if (gzipped) {
+        const auto inflated(inflater.inflate(data, size, this->data, what));
+        buf.reset(this->data.data(), inflated);
+    } else {
+        buf.reset(data, size);
+    }
+    in.clear();
+    return in;
+}
+
+DecodeContext::DecodeContext()
+    : detail_(new Detail())
+{}
+
+DecodeContext::~DecodeContext() {}
+
+DecodeContext& DecodeContext::local()
+{
+    thread_local DecodeContext context;
+    return context;
+}
+
+void DecodeContext::shrink()
+{
+    auto &d(*detail_);
+    d.scratch.shrink();
+    d.raw.clear();
+    d.raw.shrink_to_fit();
+    d.rawSize = 0;
+    d.data.clear();
+    d.data.shrink_to_fit();
+}
+
+} // namespace slpk
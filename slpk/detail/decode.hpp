@@ -0,0 +1,314 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef slpk_detail_decode_hpp_included_
+#define slpk_detail_decode_hpp_included_
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <streambuf>
+#include <istream>
+
+#include "../reader.hpp"
+#include "../decodecontext.hpp"
+
+namespace slpk { namespace detail { namespace decode {
+
+/** Hashes of values indexed during decoding. Doubles are hashed by their
+ *  bits with -0.0 folded to 0.0 to stay consistent with Equal.
+ */
+struct Hash {
+    static std::uint64_t mix(std::uint64_t h) {
+        // murmur3 finalizer
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static std::uint64_t combine(std::uint64_t seed, double value) {
+        value += 0.0;
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return mix(seed ^ (bits + 0x9e3779b97f4a7c15ULL
+                           + (seed << 6) + (seed >> 2)));
+    }
+
+    std::size_t operator()(const math::Point2d &p) const {
+        return combine(combine(0, p(0)), p(1));
+    }
+
+    std::size_t operator()(const math::Point3d &p) const {
+        return combine(combine(combine(0, p(0)), p(1)), p(2));
+    }
+
+    std::size_t operator()(const Region &r) const {
+        return combine(combine(operator()(r.ll), r.ur(0)), r.ur(1));
+    }
+
+    std::size_t operator()(const std::tuple<math::Point2d, int> &v) const {
+        return combine(operator()(std::get<0>(v)), std::get<1>(v));
+    }
+};
+
+/** Equality matching ordering used by the original std::map indices.
+ */
+struct Equal {
+    bool operator()(const math::Point2d &a, const math::Point2d &b) const {
+        return (a(0) == b(0)) && (a(1) == b(1));
+    }
+
+    bool operator()(const math::Point3d &a, const math::Point3d &b) const {
+        return (a(0) == b(0)) && (a(1) == b(1)) && (a(2) == b(2));
+    }
+
+    bool operator()(const Region &a, const Region &b) const {
+        return operator()(a.ll, b.ll) && operator()(a.ur, b.ur);
+    }
+
+    bool operator()(const std::tuple<math::Point2d, int> &a
+                    , const std::tuple<math::Point2d, int> &b) const
+    {
+        return (std::get<1>(a) == std::get<1>(b))
+            && operator()(std::get<0>(a), std::get<0>(b));
+    }
+};
+
+/** Open addressing hash index of values to their positions. clear() keeps
+ *  allocated storage: slots are invalidated by bumping a generation.
+ */
+template <typename Key>
+class Index {
+public:
+    typedef pmr::polymorphic_allocator<char> allocator_type;
+
+    explicit Index(const allocator_type &alloc = allocator_type())
+        : slots_(alloc), entries_(alloc), generation_(1)
+    {}
+
+    std::size_t size() const { return entries_.size(); }
+
+    /** Finds value of given key. Inserts key with given value if not found.
+     *  Returns found/inserted value and whether the key was inserted.
+     */
+    std::pair<int, bool> insert(const Key &key, int value);
+
+    void clear();
+
+    void shrink();
+
+private:
+    struct Slot {
+        std::uint32_t generation;
+        std::uint32_t entry;
+    };
+
+    struct Entry {
+        Key key;
+        int value;
+    };
+
+    void rehash(std::size_t size);
+
+    pmr::vector<Slot> slots_;
+    pmr::vector<Entry> entries_;
+    std::uint32_t generation_;
+};
+
+typedef pmr::vector<Face> Faces;
+typedef pmr::vector<FaceTc> FacesTc;
+
+/** Temporaries of per-attribute array fusing.
+ */
+struct Scratch {
+    typedef pmr::polymorphic_allocator<char> allocator_type;
+
+    Faces faces;
+    Faces facesNormal;
+    FacesTc facesTc;
+    Index<math::Point3d> vertices;
+    Index<math::Point3d> normals;
+
+    /** Texture coordinate index (simple meshes).
+     */
+    Index<math::Point2d> tc;
+
+    /** Raw texture coordinates, texture coordinate index per region and
+     *  region index (meshes with texture regions).
+     */
+    pmr::vector<math::Point2d> tcList;
+    Index<std::tuple<math::Point2d, int>> regionTc;
+    Index<Region> regionMap;
+    pmr::vector<int> regions;
+
+    explicit Scratch(const allocator_type &alloc = allocator_type());
+
+    void clear();
+
+    void shrink();
+};
+
+/** Inflates gzip/zlib data; z_stream is reset, not reinitialized, between
+ *  calls.
+ */
+class Inflater {
+public:
+    Inflater();
+    ~Inflater();
+
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+
+    /** Inflates whole gzip (or zlib) stream to out and returns inflated
+     *  size. Out is grown as needed and never shrunk.
+     */
+    std::size_t inflate(const char *data, std::size_t size
+                        , std::vector<char> &out, const char *what);
+
+private:
+    struct Stream;
+    std::unique_ptr<Stream> stream_;
+};
+
+/** Read-only stream buffer over external memory.
+ */
+class ArrayBuf : public std::streambuf {
+public:
+    void reset(const char *data, std::size_t size) {
+        auto d(const_cast<char*>(data));
+        setg(d, d, d + size);
+    }
+};
+
+} } // namespace detail::decode
+
+struct DecodeContext::Detail {
+    detail::decode::Scratch scratch;
+    detail::decode::Inflater inflater;
+
+    /** Raw (possibly compressed) resource and inflated resource. Buffers
+     *  are never shrunk, valid size of raw is kept in rawSize.
+     */
+    std::vector<char> raw;
+    std::size_t rawSize;
+    std::vector<char> data;
+
+    detail::decode::ArrayBuf buf;
+    std::istream in;
+
+    /** Set while decoding; nested decode on the same thread falls back to
+     *  a temporary context, other threads get std::logic_error.
+     */
+    std::atomic<bool> busy;
+
+    Detail() : rawSize(), in(&buf), busy(false) {}
+
+    /** Reads whole stream to raw.
+     */
+    void read(std::istream &is, std::size_t sizeHint);
+
+    /** Returns stream over data, data are inflated to this->data first if
+     *  gzipped.
+     */
+    std::istream& stream(const char *data, std::size_t size, bool gzipped
+                         , const char *what);
+};
+
+// inlines
+
+namespace detail { namespace decode {
+
+template <typename Key>
+std::pair<int, bool> Index<Key>::insert(const Key &key, int value)
+{
+    if ((entries_.size() + 1) * 2 > slots_.size()) {
+        rehash(slots_.empty() ? 64 : (2 * slots_.size()));
+    }
+
+    const std::size_t mask(slots_.size() - 1);
+    for (auto i(Hash()(key) & mask); ; i = (i + 1) & mask) {
+        auto &slot(slots_[i]);
+        if (slot.generation != generation_) {
+            slot.generation = generation_;
+            slot.entry = std::uint32_t(entries_.size());
+            entries_.push_back(Entry{key, value});
+            return { value, true };
+        }
+
+        const auto &entry(entries_[slot.entry]);
+        if (Equal()(entry.key, key)) { return { entry.value, false }; }
+    }
+}
+
+template <typename Key>
+void Index<Key>::rehash(std::size_t size)
+{
+    slots_.assign(size, Slot{0, 0});
+    generation_ = 1;
+
+    const std::size_t mask(size - 1);
+    std::uint32_t e(0);
+    for (const auto &entry : entries_) {
+        auto i(Hash()(entry.key) & mask);
+        while (slots_[i].generation == generation_) { i = (i + 1) & mask; }
+        slots_[i].generation = generation_;
+        slots_[i].entry = e++;
+    }
+}
+
+template <typename Key>
+void Index<Key>::clear()
+{
+    entries_.clear();
+    if (!++generation_) {
+        // wrapped around, invalidate explicitly
+        for (auto &slot : slots_) { slot.generation = 0; }
+        generation_ = 1;
+    }
+}
+
+template <typename Key>
+void Index<Key>::shrink()
+{
+    entries_.clear();
+    entries_.shrink_to_fit();
+    slots_.clear();
+    slots_.shrink_to_fit();
+    generation_ = 1;
+}
+
+} } // namespace detail::decode
+
+} // namespace slpk
+
+#endif // slpk_detail_decode_hpp_included_
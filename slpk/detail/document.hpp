@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef slpk_detail_document_hpp_included_
+#define slpk_detail_document_hpp_included_
+
+#include <string>
+#include <utility>
+#include <istream>
+#include <ostream>
+
+#include <boost/any.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "jsoncpp/json.hpp"
+
+#include "../types.hpp"
+#include "../writer.hpp"
+
+/** Parsers and builders of archive documents and geometry buffers, as used
+ *  by the reader and the writer.
+ */
+
+namespace slpk { namespace detail {
+
+/** Parses node index document; dir is the node directory resource hrefs are
+ *  resolved against.
+ */
+Node loadNodeIndex(std::istream &in, const boost::filesystem::path &path
+                   , const std::string &dir, const Store::pointer &store);
+
+SharedResource loadSharedResource(std::istream &in
+                                  , const boost::filesystem::path &path);
+
+/** Parses scene layer info. Returns parsed info and raw JSON value.
+ */
+std::pair<SceneLayerInfo, boost::any>
+loadSceneLayerInfo(std::istream &in, const boost::filesystem::path &path);
+
+/** Builds node index document. Node without shared resource gets the
+ *  standard one ("./shared") if standardSharedResource is set.
+ */
+void build(Json::Value &value, const Node &node
+           , bool standardSharedResource = false);
+
+void build(Json::Value &value, const SharedResource &sr);
+
+void build(Json::Value &value, const SceneLayerInfo &sli
+           , const Metadata &metadata);
+
+/** Writes mesh as a geometry buffer described by given schema and fills in
+ *  its feature and array buffer view.
+ */
+void saveMesh(std::ostream &os, const Node &node
+              , const MeshSaver &meshSaver
+              , const GeometrySchema &gs
+              , FeatureData::Feature &feature
+              , ArrayBufferView &arrayBufferView);
+
+} } // namespace slpk::detail
+
+#endif // slpk_detail_document_hpp_included_
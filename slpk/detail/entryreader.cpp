@@ -0,0 +1,322 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <deque>
+#include <system_error>
+
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+
+#ifdef SLPK_HAS_LIBURING
+#  include <liburing.h>
+#endif
+
+#include "dbglog/dbglog.hpp"
+
+#include "entryreader.hpp"
+
+namespace bio = boost::iostreams;
+
+namespace slpk { namespace detail {
+
+namespace {
+
+const std::uint32_t LocalHeaderSignature(0x04034b50);
+const std::size_t LocalHeaderSize(30);
+
+std::uint32_t le(const char *data, std::size_t size)
+{
+    std::uint32_t value(0);
+    for (std::size_t i(0); i < size; ++i) {
+        value |= std::uint32_t(static_cast<unsigned char>(data[i]))
+            << (8 * i);
+    }
+    return value;
+}
+
+EntryReader::Data inflateRaw(const EntryReader::Data &raw)
+{
+    // raw deflate stream, no zlib header
+    bio::zlib_params p;
+    p.noheader = true;
+
+    bio::filtering_istream fis;
+    fis.push(bio::zlib_decompressor(p));
+    fis.push(bio::array_source(raw.data(), raw.size()));
+
+    return EntryReader::Data(std::istreambuf_iterator<char>(fis)
+                             , std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+/** Single read request.
+ */
+struct EntryReader::Io {
+    std::uint64_t offset;
+    std::size_t size;
+    char *data;
+    std::size_t done;
+
+    Io(std::uint64_t offset, std::size_t size, char *data)
+        : offset(offset), size(size), data(data), done()
+    {}
+};
+
+/** Reads batch of requests.
+ */
+struct EntryReader::Backend {
+    virtual ~Backend() {}
+    virtual void read(int fd, std::vector<Io> &ios) = 0;
+    virtual const char* name() const = 0;
+};
+
+namespace {
+
+void unexpectedEof(const EntryReader::Io &io)
+{
+    LOGTHROW(err1, std::runtime_error)
+        << "Unexpected end of file when reading " << io.size
+        << " bytes at offset " << io.offset << ".";
+}
+
+class PreadBackend : public EntryReader::Backend {
+public:
+    virtual void read(int fd, std::vector<EntryReader::Io> &ios) {
+        for (auto &io : ios) {
+            while (io.done < io.size) {
+                const auto res(::pread(fd, io.data + io.done
+                                       , io.size - io.done
+                                       , io.offset + io.done));
+                if (res < 0) {
+                    if (errno == EINTR) { continue; }
+                    std::system_error e(errno, std::system_category());
+                    LOGTHROW(err1, std::system_error)
+                        << "pread failed: <" << e.code() << ", "
+                        << e.what() << ">.";
+                }
+                if (!res) { unexpectedEof(io); }
+                io.done += res;
+            }
+        }
+    }
+
+    virtual const char* name() const { return "pread"; }
+};
+
+#ifdef SLPK_HAS_LIBURING
+
+class UringBackend : public EntryReader::Backend {
+public:
+    UringBackend(unsigned int queueDepth)
+        : queueDepth_(queueDepth)
+    {
+        const auto res(::io_uring_queue_init(queueDepth_, &ring_, 0));
+        if (res < 0) {
+            std::system_error e(-res, std::system_category());
+            LOGTHROW(err1, std::system_error)
+                << "io_uring_queue_init failed: <" << e.code() << ", "
+                << e.what() << ">.";
+        }
+    }
+
+    virtual ~UringBackend() { ::io_uring_queue_exit(&ring_); }
+
+    virtual void read(int fd, std::vector<EntryReader::Io> &ios) {
+        std::deque<EntryReader::Io*> pending;
+        for (auto &io : ios) { pending.push_back(&io); }
+
+        unsigned int inflight(0);
+        while (!pending.empty() || inflight) {
+            // fill the ring
+            unsigned int queued(0);
+            while (!pending.empty() && (inflight < queueDepth_)) {
+                auto *sqe(::io_uring_get_sqe(&ring_));
+                if (!sqe) { break; }
+                auto *io(pending.front());
+                pending.pop_front();
+                ::io_uring_prep_read(sqe, fd, io->data + io->done
+                                     , io->size - io->done
+                                     , io->offset + io->done);
+                ::io_uring_sqe_set_data(sqe, io);
+                ++inflight;
+                ++queued;
+            }
+            if (queued) { ::io_uring_submit(&ring_); }
+
+            // reap one completion (and all others already available)
+            ::io_uring_cqe *cqe;
+            auto res(::io_uring_wait_cqe(&ring_, &cqe));
+            while (!res) {
+                auto *io(static_cast<EntryReader::Io*>
+                         (::io_uring_cqe_get_data(cqe)));
+                const auto r(cqe->res);
+                ::io_uring_cqe_seen(&ring_, cqe);
+                --inflight;
+
+                if (r < 0) {
+                    drain(inflight);
+                    std::system_error e(-r, std::system_category());
+                    LOGTHROW(err1, std::system_error)
+                        << "io_uring read failed: <" << e.code() << ", "
+                        << e.what() << ">.";
+                }
+                if (!r) { drain(inflight); unexpectedEof(*io); }
+
+                // short read: queue the rest again
+                io->done += r;
+                if (io->done < io->size) { pending.push_back(io); }
+
+                res = ::io_uring_peek_cqe(&ring_, &cqe);
+            }
+        }
+    }
+
+    virtual const char* name() const { return "io_uring"; }
+
+private:
+    /** Waits for in-flight requests (buffers must not be released before).
+     */
+    void drain(unsigned int inflight) {
+        ::io_uring_cqe *cqe;
+        while (inflight && !::io_uring_wait_cqe(&ring_, &cqe)) {
+            ::io_uring_cqe_seen(&ring_, cqe);
+            --inflight;
+        }
+    }
+
+    unsigned int queueDepth_;
+    ::io_uring ring_;
+};
+
+#endif // SLPK_HAS_LIBURING
+
+std::unique_ptr<EntryReader::Backend> makeBackend(unsigned int queueDepth)
+{
+#ifdef SLPK_HAS_LIBURING
+    try {
+        return std::unique_ptr<EntryReader::Backend>
+            (new UringBackend(std::max(queueDepth, 1u)));
+    } catch (const std::exception &e) {
+        LOG(warn2) << "Cannot use io_uring, falling back to pread: "
+                   << e.what();
+    }
+#else
+    (void) queueDepth;
+#endif
+    return std::unique_ptr<EntryReader::Backend>(new PreadBackend());
+}
+
+} // namespace
+
+EntryReader::EntryReader(const boost::filesystem::path &zipPath
+                         , unsigned int queueDepth)
+    : path_(zipPath), fd_(::open(zipPath.c_str(), O_RDONLY | O_CLOEXEC))
+{
+    if (fd_ < 0) {
+        std::system_error e(errno, std::system_category());
+        LOGTHROW(err1, std::system_error)
+            << "Cannot open zip file " << path_ << ": <" << e.code()
+            << ", " << e.what() << ">.";
+    }
+
+    try {
+        backend_ = makeBackend(queueDepth);
+    } catch (...) {
+        ::close(fd_);
+        throw;
+    }
+}
+
+EntryReader::~EntryReader()
+{
+    backend_.reset();
+    ::close(fd_);
+}
+
+const char* EntryReader::backend() const
+{
+    return backend_->name();
+}
+
+std::vector<EntryReader::Data>
+EntryReader::read(const std::vector<const zip::Entry*> &entries)
+{
+    // phase 1: fixed part of local headers to find where data start
+    std::vector<char> headers(entries.size() * LocalHeaderSize);
+    std::vector<Io> ios;
+    ios.reserve(entries.size());
+    for (std::size_t i(0); i < entries.size(); ++i) {
+        ios.emplace_back(entries[i]->localHeaderOffset, LocalHeaderSize
+                         , headers.data() + i * LocalHeaderSize);
+    }
+    backend_->read(fd_, ios);
+
+    // phase 2: (compressed) data
+    std::vector<Data> raw(entries.size());
+    ios.clear();
+    for (std::size_t i(0); i < entries.size(); ++i) {
+        const auto &entry(*entries[i]);
+        const char *header(headers.data() + i * LocalHeaderSize);
+        if (le(header, 4) != LocalHeaderSignature) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Invalid local header of zip entry <" << entry.path
+                << "> in " << path_ << ".";
+        }
+
+        const auto dataOffset(entry.localHeaderOffset + LocalHeaderSize
+                              + le(header + 26, 2) + le(header + 28, 2));
+        raw[i].resize(entry.compressedSize);
+        ios.emplace_back(dataOffset, raw[i].size(), raw[i].data());
+    }
+    backend_->read(fd_, ios);
+
+    for (std::size_t i(0); i < entries.size(); ++i) {
+        const auto &entry(*entries[i]);
+        switch (entry.method) {
+        case zip::method::store: break;
+
+        case zip::method::deflate:
+            raw[i] = inflateRaw(raw[i]);
+            break;
+
+        default:
+            LOGTHROW(err1, std::runtime_error)
+                << "Unsupported compression method " << entry.method
+                << " of zip entry <" << entry.path << "> in "
+                << path_ << ".";
+        }
+    }
+
+    return raw;
+}
+
+} } // namespace slpk::detail
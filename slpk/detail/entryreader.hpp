@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef slpk_detail_entryreader_hpp_included_
+#define slpk_detail_entryreader_hpp_included_
+
+#include <memory>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+#include "zip.hpp"
+
+namespace slpk { namespace detail {
+
+/** Batch reader of zip entries straight from the zip file.
+ *
+ *  Reads are submitted in batches of up to queueDepth requests via io_uring
+ *  when the library is built with liburing and the kernel allows it,
+ *  otherwise by plain pread(2). Deflated entries are inflated.
+ *
+ *  Not thread safe; use one reader per thread.
+ */
+class EntryReader {
+public:
+    EntryReader(const boost::filesystem::path &zipPath
+                , unsigned int queueDepth = 32);
+    ~EntryReader();
+
+    EntryReader(const EntryReader&) = delete;
+    EntryReader& operator=(const EntryReader&) = delete;
+
+    typedef std::vector<char> Data;
+
+    /** Reads given entries, data are returned in the same order.
+     */
+    std::vector<Data> read(const std::vector<const zip::Entry*> &entries);
+
+    /** Name of used backend ("io_uring" or "pread").
+     */
+    const char* backend() const;
+
+    struct Io;
+    struct Backend;
+
+private:
+    const boost::filesystem::path path_;
+    int fd_;
+    std::unique_ptr<Backend> backend_;
+};
+
+} } // namespace slpk::detail
+
+#endif // slpk_detail_entryreader_hpp_included_
@@ -39,6 +39,7 @@ namespace constants {
     const std::string SceneLayer("3dSceneLayer.json");
     const std::string NodeIndex("3dNodeIndexDocument.json");
     const std::string SharedResource("sharedResource.json");
+    const std::string FlatTreeName("flattree.bin");
     const boost::filesystem::path Nodes("nodes");
     const boost::filesystem::path Shared("shared");
 
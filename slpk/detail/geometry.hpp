@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef slpk_detail_geometry_hpp_included_
+#define slpk_detail_geometry_hpp_included_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <istream>
+#include <stdexcept>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/binaryio.hpp"
+
+#include "../types.hpp"
+
+namespace slpk { namespace detail {
+
+typedef GeometryHeader Header;
+
+/** Reads geometry buffer header described by given header attributes.
+ *  Unknown attributes are skipped.
+ */
+Header loadHeader(std::istream &in, const HeaderAttribute::list &has);
+
+/** Reads geometry buffer header of given schema. Face count missing from the
+ *  header is derived from vertex count for non-indexed triangle meshes.
+ */
+Header loadHeader(std::istream &in, const GeometrySchema &schema);
+
+/** Size of single value of given type in geometry buffer.
+ */
+std::size_t byteCount(DataType type);
+
+/** Size of single element of given attribute in geometry buffer.
+ */
+inline std::size_t byteCount(const GeometryAttribute &ga)
+{
+    return ga.valuesPerElement * byteCount(ga.valueType);
+}
+
+template <bool normalize> struct Normalize {};
+
+template <>
+struct Normalize<true> {
+    template <typename DstT, typename SrcT>
+    static DstT apply(SrcT value) {
+        return DstT(value) / std::numeric_limits<SrcT>::max();
+    }
+};
+
+template <>
+struct Normalize<false> {
+    template <typename DstT, typename SrcT>
+    static DstT apply(SrcT value) {
+        return DstT(value);
+    }
+};
+
+/** Reads single value of given type from geometry buffer and converts it to
+ *  T. Normalized read maps integral values to [0, 1].
+ */
+template <typename T, bool normalize = false>
+void read(std::istream &in, DataType type, T &out)
+{
+#define READ_DATATYPE(ENUM, TYPE)                                       \
+    case DataType::ENUM:                                                \
+        out = Normalize<normalize>::template apply<T>                   \
+            (utility::binaryio::read<TYPE>(in));                        \
+        return
+
+    switch (type) {
+        READ_DATATYPE(uint8, std::uint8_t);
+        READ_DATATYPE(uint16, std::uint16_t);
+        READ_DATATYPE(uint32, std::uint32_t);
+        READ_DATATYPE(uint64, std::uint64_t);
+
+        READ_DATATYPE(int8, std::int8_t);
+        READ_DATATYPE(int16, std::int16_t);
+        READ_DATATYPE(int32, std::int32_t);
+        READ_DATATYPE(int64, std::int64_t);
+
+        READ_DATATYPE(float32, float);
+        READ_DATATYPE(float64, double);
+    }
+#undef READ_DATATYPE
+
+    LOGTHROW(err1, std::logic_error)
+        << "Invalid datatype (int code="
+        << static_cast<int>(type) << ").";
+    throw;
+}
+
+template <typename T, bool normalize = false>
+T read(std::istream &in, DataType type)
+{
+    T out;
+    read<T, normalize>(in, type, out);
+    return out;
+}
+
+} } // namespace slpk::detail
+
+#endif // slpk_detail_geometry_hpp_included_
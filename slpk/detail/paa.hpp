@@ -0,0 +1,418 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef slpk_detail_paa_hpp_included_
+#define slpk_detail_paa_hpp_included_
+
+#include <tuple>
+#include <istream>
+#include <stdexcept>
+
+#include "dbglog/dbglog.hpp"
+
+#include "../reader.hpp"
+#include "geometry.hpp"
+#include "decode.hpp"
+
+/** PerAttributeArray geometry decoding (fusing per-attribute arrays into an
+ *  indexed mesh).
+ */
+
+namespace slpk { namespace detail {
+
+struct MeshFeatures {
+    bool hasRegions = false;
+    bool hasColor = false;
+};
+
+namespace paa {
+
+template <typename AddValueType, typename T>
+void callAddValue(MeshLoader &loader, const AddValueType &addValue
+                  , const T &value)
+{
+    (loader.*addValue)(value);
+}
+
+template <typename AddValueType, typename T1, typename T2>
+void callAddValue(MeshLoader &loader, const AddValueType &addValue
+                  , const std::tuple<T1, T2> &value)
+{
+    (loader.*addValue)(std::get<0>(value));
+}
+
+/** Fuses per-attribute arrays into indexed mesh. All temporaries live in
+ *  provided (cleared) scratch space. Vertex positions are relative to the
+ *  origin (center of the node's bounding sphere).
+ */
+class Fuser {
+public:
+    Fuser(std::istream &in, MeshLoader &loader, const math::Point3 &origin
+          , const Header &header, const MeshFeatures &features
+          , detail::decode::Scratch &scratch)
+        : in_(in), loader_(loader), origin_(origin)
+        , header_(header), features_(features)
+        , scratch_(scratch)
+        , verticesLoaded_(false)
+        , faces_(scratch.faces)
+        , facesNormal_(scratch.facesNormal)
+        , facesTc_(scratch.facesTc)
+        , vertices_(scratch.vertices), normals_(scratch.normals)
+    {
+        if (header.vertexCount % 3) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Invalid number of vertices in PerAttributeArray layout: "
+                "number of vertices (" << header.vertexCount
+                << ") not divisible by 3.";
+        }
+
+        faces_.assign(header.vertexCount / 3, Face());
+        facesNormal_.assign(header.vertexCount / 3, Face());
+        facesTc_.assign(header.vertexCount / 3, FaceTc());
+    }
+
+    virtual ~Fuser() {}
+
+    void operator()(const GeometrySchema &schema) {
+        for (const auto &ga : schema.vertexAttributes) {
+            if (ga.key == "position") {
+                loadFaces(ga);
+                verticesLoaded_ = true;
+            } else if (ga.key == "uv0") {
+                loadTcFaces(ga);
+            } else if (ga.key == "normal") {
+                loadNormals(ga);
+                //ignore(ga);
+            } else if (ga.key == "region") {
+                loadTxRegions(ga);
+            } else {
+                ignore(ga);
+            }
+        }
+
+        if (!verticesLoaded_) {
+            LOGTHROW(err1, std::runtime_error)
+                << "No vertex coordinates defined.";
+        }
+
+#if 0
+        // do we need features?
+        for (const auto &fa : schema.featureAttributes) {
+            if (fa.key == "id") {
+                for (std::size_t i(0); i < header_.featureCount; ++i) {
+                    LOG(info4)
+                        << "id: " << read<std::size_t>(in_, fa.valueType);
+                }
+            } else if (fa.key == "faceRange") {
+                for (std::size_t i(0); i < header_.featureCount; ++i) {
+                    auto rmin(read<std::size_t>(in_, fa.valueType));
+                    auto rmax(read<std::size_t>(in_, fa.valueType));
+                    LOG(info4)
+                        << "range: " << rmin << ", " << rmax;
+                }
+            } else {
+                ignore(fa);
+            }
+        }
+#endif
+
+        // finalize lod
+        finalize();
+
+        // feed loader with faces
+        auto ifacesTc(facesTc_.begin());
+        auto ifacesNormal(facesNormal_.begin());
+        for (const auto &face : faces_) {
+            loader_.addFace(face, *ifacesTc++, *ifacesNormal++);
+        }
+    }
+
+protected:
+    /** Adds new value to an index. Returns position of exiting entry if value
+     *  was already added. Otherwise inserts new entery and returns its
+     *  position in the index.
+     *
+     *  Position is computed from size of index or via provided counter.
+     */
+    template <typename Index, typename AddValueType, typename T>
+    int add(Index &index, const AddValueType &addValue
+            , const T &value, std::size_t *counter = nullptr)
+    {
+        const auto res(index.insert(value, counter ? *counter : index.size()));
+        if (!res.second) { return res.first; }
+        if (counter) { ++*counter; }
+        callAddValue(loader_, addValue, value);
+        return res.first;
+    }
+
+    int vertex(const GeometryAttribute &ga) {
+        math::Point3d point;
+        read(in_, ga.valueType, point(0)); point(0) += origin_(0);
+        read(in_, ga.valueType, point(1)); point(1) += origin_(1);
+        read(in_, ga.valueType, point(2)); point(2) += origin_(2);
+        return add(vertices_, &MeshLoader::addVertex, point);
+    }
+
+    int normal(const GeometryAttribute &ga) {
+        math::Point3d point;
+        read(in_, ga.valueType, point(0));
+        read(in_, ga.valueType, point(1));
+        read(in_, ga.valueType, point(2));
+        return add(normals_, &MeshLoader::addNormal, point);
+    }
+
+    void loadFaces(const GeometryAttribute &ga) {
+        if (ga.valuesPerElement != 3) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Number of vertex elements must be 3, not "
+                << ga.valuesPerElement << ".";
+        }
+
+        LOG(debug) << "Loading data for vertices.";
+        for (auto &face : faces_) {
+            face(0) = vertex(ga);
+            face(1) = vertex(ga);
+            face(2) = vertex(ga);
+        }
+    }
+
+    void loadNormals(const GeometryAttribute &ga) {
+        if (ga.valuesPerElement != 3) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Number of normal elements must be 3, not "
+                << ga.valuesPerElement << ".";
+        }
+
+        LOG(debug) << "Loading data for normals.";
+        for (auto &face : facesNormal_) {
+            face(0) = normal(ga);
+            face(1) = normal(ga);
+            face(2) = normal(ga);
+        }
+    }
+
+    virtual void loadTcFaces(const GeometryAttribute &ga) = 0;
+    virtual void loadTxRegions(const GeometryAttribute &ga) { ignore(ga); }
+    virtual void finalize() = 0;
+
+    void ignore(const GeometryAttribute &ga) {
+        LOG(debug)
+            << "Ignoring data for unsupported vertex attribute <"
+            << ga.key << "> (" << (header_.vertexCount * byteCount(ga))
+            << " bytes).";
+        in_.ignore(header_.vertexCount * byteCount(ga));
+    }
+
+    std::istream &in_;
+    MeshLoader &loader_;
+    const math::Point3 &origin_;
+    const Header &header_;
+    const MeshFeatures &features_;
+    detail::decode::Scratch &scratch_;
+    bool verticesLoaded_;
+
+    typedef detail::decode::Index<math::Point3d> VertexMap;
+    typedef detail::decode::Faces Faces;
+    typedef detail::decode::FacesTc FacesTc;
+
+    Faces &faces_;
+    Faces &facesNormal_;
+    FacesTc &facesTc_;
+    VertexMap &vertices_;
+    VertexMap &normals_;
+};
+
+class SimpleFuser : public Fuser {
+public:
+    SimpleFuser(std::istream &in, MeshLoader &loader
+                , const math::Point3 &origin
+                , const Header &header, const MeshFeatures &features
+                , detail::decode::Scratch &scratch)
+        : Fuser(in, loader, origin, header, features, scratch)
+        , tc_(scratch.tc)
+    {}
+
+private:
+    void loadTcFaces(const GeometryAttribute &ga) {
+        if (ga.valuesPerElement != 2) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Number of UV elements must be 2, not "
+                << ga.valuesPerElement << ".";
+        }
+
+        LOG(debug) << "Loading data for texture coordinates.";
+        for (auto &face : facesTc_) {
+            face(0) = tc(ga);
+            face(1) = tc(ga);
+            face(2) = tc(ga);
+        }
+    }
+
+    void finalize() {}
+
+    int tc(const GeometryAttribute &ga)  {
+        math::Point2d point;
+        read(in_, ga.valueType, point(0));
+        read(in_, ga.valueType, point(1));
+
+        // flip Y coord
+        point(1) = 1.0 - point(1);
+        return add(tc_, &MeshLoader::addTexture, point);
+    }
+
+    detail::decode::Index<math::Point2d> &tc_;
+};
+
+class RegionFuser : public Fuser {
+public:
+    RegionFuser(std::istream &in, MeshLoader &loader
+                , const math::Point3 &origin
+                , const Header &header, const MeshFeatures &features
+                , detail::decode::Scratch &scratch)
+        : Fuser(in, loader, origin, header, features, scratch)
+        , tc_(scratch.tcList), tcMap_(scratch.regionTc)
+        , regionMap_(scratch.regionMap), regions_(scratch.regions)
+    {
+        regions_.assign(header.vertexCount, 0);
+    }
+
+private:
+    void loadTcFaces(const GeometryAttribute &ga) {
+        if (ga.valuesPerElement != 2) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Number of UV elements must be 2, not "
+                << ga.valuesPerElement << ".";
+        }
+
+        LOG(debug) << "Loading data for texture coordinates.";
+        for (auto &face : facesTc_) {
+            face(0) = tc(ga);
+            face(1) = tc(ga);
+            face(2) = tc(ga);
+        }
+    }
+
+    int tc(const GeometryAttribute &ga)  {
+        const auto index(tc_.size());
+        tc_.emplace_back();
+        auto &point(tc_.back());
+
+        read(in_, ga.valueType, point(0));
+        read(in_, ga.valueType, point(1));
+        // flip Y coord
+        point(1) = 1.0 - point(1);
+
+        return index;
+    }
+
+    void loadTxRegions(const GeometryAttribute &ga) {
+        if (ga.valuesPerElement != 4) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Number of region elements must be 4, not "
+                << ga.valuesPerElement << ".";
+        }
+
+        LOG(debug) << "Loading data for texture regions.";
+        for (auto &regionIndex : regions_) {
+            Region region;
+            region.ll(0) = read<double, true>(in_, ga.valueType);
+            region.ll(1) = read<double, true>(in_, ga.valueType);
+            region.ur(0) = read<double, true>(in_, ga.valueType);
+            region.ur(1) = read<double, true>(in_, ga.valueType);
+
+            regionIndex = add(regionMap_, &MeshLoader::addTxRegion, region);
+        }
+#if 0
+        for (const auto &item : regionMap_) {
+            LOG(info4) << item.first << " -> " << item.second;
+        }
+#endif
+    }
+
+    void finalize() {
+        // generate texture coordinates
+
+        // multiple texturing maps, one per region: single index keyed by
+        // (texture coordinates, region)
+        auto itc(tc_.begin());
+        auto iregions(regions_.begin());
+        std::size_t counter(0);
+        for (auto &face : facesTc_) {
+            const auto &region(*iregions++);
+            const auto &region2(*iregions++);
+            const auto &region3(*iregions++);
+
+            face.region = region;
+            face(0) = add(tcMap_, &MeshLoader::addTexture
+                          , std::make_tuple(*itc++, region), &counter);
+            face(1) = add(tcMap_, &MeshLoader::addTexture
+                          , std::make_tuple(*itc++, region), &counter);
+            face(2) = add(tcMap_, &MeshLoader::addTexture
+                          , std::make_tuple(*itc++, region), &counter);
+
+            if ((region != region2) || (region2 != region3)
+                || (region3 != region))
+            {
+                LOG(warn1)
+                    << "Face (" << face(0) << ", " << face(1)
+                    << ", " << face(2) << ") references texture coordinates "
+                    << "inside different texture subregions ("
+                    << region << ", " << region2 << ", " << region3 << ").";
+            }
+        }
+    }
+
+    pmr::vector<math::Point2d> &tc_;
+    detail::decode::Index<std::tuple<math::Point2d, int>> &tcMap_;
+    detail::decode::Index<Region> &regionMap_;
+    pmr::vector<int> &regions_;
+};
+
+inline void load(MeshLoader &loader, std::istream &in
+                 , const math::Point3 &origin, const Header &header
+                 , const MeshFeatures &features
+                 , const GeometrySchema &schema
+                 , detail::decode::Scratch &scratch)
+{
+    // empty mesh?
+    if (!header.vertexCount) { return; }
+
+    scratch.clear();
+    if (features.hasRegions && has(schema.vertexAttributes, "region")) {
+        // we need to take UV (sub) regions into account
+        RegionFuser(in, loader, origin, header, features, scratch)(schema);
+    } else {
+        // good old textured mesh
+        SimpleFuser(in, loader, origin, header, features, scratch)(schema);
+    }
+}
+
+} // namespace paa
+
+} } // namespace slpk::detail
+
+#endif // slpk_detail_paa_hpp_included_
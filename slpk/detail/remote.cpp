@@ -0,0 +1,598 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <map>
+#include <list>
+#include <cctype>
+#include <mutex>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <condition_variable>
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#ifdef SLPK_HAS_CURL
+#include <curl/curl.h>
+#endif
+
+#include "dbglog/dbglog.hpp"
+
+#include "../remote.hpp"
+#include "../trace.hpp"
+#include "files.hpp"
+#include "source.hpp"
+#include "zip.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace slpk { namespace detail {
+
+namespace {
+
+typedef std::shared_ptr<const std::vector<char>> Data;
+
+/** Maps archive path to path relative to the layer URL. Inverse of the
+ *  mapping done by RestApi: service documents are addressed by their
+ *  directory, other resources by their path without extensions.
+ */
+std::string remotePath(const fs::path &path)
+{
+    auto p(path.generic_string());
+    while (!p.empty() && (p.front() == '/')) { p.erase(0, 1); }
+    if (p == constants::SceneLayer) { return {}; }
+
+    const fs::path fp(p);
+    const auto fname(fp.filename().string());
+    const auto base(fname.substr(0, fname.find('.')));
+
+    if ((base == fs::path(constants::NodeIndex).stem().string())
+        || (base == fs::path(constants::SharedResource).stem().string()))
+    {
+        return fp.parent_path().generic_string();
+    }
+    return (fp.parent_path() / base).generic_string();
+}
+
+/** Bounded LRU cache of fetched resources. Null data record a resource
+ *  known not to exist (negative entry). Not thread safe.
+ */
+class MemoryCache {
+public:
+    MemoryCache(std::size_t limit) : limit_(limit), size_() {}
+
+    /** Returns true if url is cached, data are null for negative entry.
+     */
+    bool get(const std::string &url, Data &data) {
+        const auto findex(index_.find(url));
+        if (findex == index_.end()) { return false; }
+        items_.splice(items_.begin(), items_, findex->second);
+        data = findex->second->second;
+        return true;
+    }
+
+    void put(const std::string &url, const Data &data) {
+        const auto size(cost(url, data));
+        if ((size > limit_) || index_.count(url)) { return; }
+
+        items_.emplace_front(url, data);
+        index_.insert(std::make_pair(url, items_.begin()));
+        size_ += size;
+
+        while (size_ > limit_) {
+            const auto &item(items_.back());
+            size_ -= cost(item.first, item.second);
+            index_.erase(item.first);
+            items_.pop_back();
+        }
+    }
+
+private:
+    typedef std::list<std::pair<std::string, Data>> Items;
+
+    /** Negative entries are charged by their key to keep them bounded too.
+     */
+    static std::size_t cost(const std::string &url, const Data &data) {
+        return data ? data->size() : url.size();
+    }
+
+    const std::size_t limit_;
+    std::size_t size_;
+    Items items_;
+    std::map<std::string, Items::iterator> index_;
+};
+
+/** Persistent cache: each URL maps to a directory (one per URL path
+ *  segment) holding single data file. Files are written atomically.
+ */
+class DiskCache {
+public:
+    DiskCache(const fs::path &root) : root_(root) {
+        if (!root_.empty()) { fs::create_directories(root_); }
+    }
+
+    operator bool() const { return !root_.empty(); }
+
+    bool has(const std::string &url) const {
+        boost::system::error_code ec;
+        return fs::exists(file(url), ec);
+    }
+
+    Data get(const std::string &url) const {
+        std::ifstream f(file(url).string()
+                        , std::ios_base::in | std::ios_base::binary);
+        if (!f) { return {}; }
+        return std::make_shared<const std::vector<char>>
+            ((std::istreambuf_iterator<char>(f))
+             , std::istreambuf_iterator<char>());
+    }
+
+    void put(const std::string &url, const std::vector<char> &data) const {
+        const auto path(file(url));
+        fs::create_directories(path.parent_path());
+        const auto tmp(path.parent_path()
+                       / fs::unique_path("@data-%%%%-%%%%.tmp"));
+        {
+            std::ofstream f;
+            f.exceptions(std::ios::badbit | std::ios::failbit);
+            f.open(tmp.string(), std::ios_base::out | std::ios_base::binary
+                   | std::ios_base::trunc);
+            f.write(data.data(), data.size());
+        }
+        fs::rename(tmp, path);
+    }
+
+private:
+    fs::path file(const std::string &url) const {
+        // drop scheme, keep host (and port) as the first segment
+        auto rest(url);
+        const auto scheme(rest.find("://"));
+        if (scheme != std::string::npos) { rest.erase(0, scheme + 3); }
+
+        fs::path path(root_);
+        std::string segment;
+        const auto flush([&]()
+        {
+            if (segment.empty()) { return; }
+            if ((segment == ".") || (segment == "..")) {
+                segment.replace(0, 1, "%2E");
+            }
+            path /= segment;
+            segment.clear();
+        });
+
+        for (char c : rest) {
+            if (c == '/') { flush(); continue; }
+            if (std::isalnum(static_cast<unsigned char>(c))
+                || (c == '-') || (c == '_') || (c == '.'))
+            {
+                segment.push_back(c);
+                continue;
+            }
+            std::ostringstream os;
+            os << '%' << std::hex << std::uppercase << std::setw(2)
+               << std::setfill('0') << int(static_cast<unsigned char>(c));
+            segment += os.str();
+        }
+        flush();
+
+        return path / "@data";
+    }
+
+    const fs::path root_;
+};
+
+#ifdef SLPK_HAS_CURL
+
+/** HTTP client. Easy handles are pooled (one per connection) and share
+ *  connection, DNS and TLS session caches.
+ */
+class Http {
+public:
+    Http(const RemoteOptions &options)
+        : options_(options), share_(), open_()
+    {
+        static std::once_flag once;
+        std::call_once(once, []() { ::curl_global_init(CURL_GLOBAL_ALL); });
+
+        share_ = ::curl_share_init();
+        ::curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &Http::lock);
+        ::curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &Http::unlock);
+        ::curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+        ::curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        ::curl_share_setopt(share_, CURLSHOPT_SHARE
+                            , CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+        ::curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    }
+
+    ~Http() {
+        for (auto *curl : idle_) { ::curl_easy_cleanup(curl); }
+        ::curl_share_cleanup(share_);
+    }
+
+    /** Fetches given URL. Returns null data if there is no such resource
+     *  (HTTP 404 and 410).
+     */
+    Data get(const std::string &url) {
+        trace::Span span("http.get", "remote");
+        Handle handle(*this);
+        auto *curl(handle.curl);
+
+        std::vector<char> body;
+        ::curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+        const auto code(perform(curl, url, body));
+        if (code == 200) {
+            return std::make_shared<const std::vector<char>>
+                (std::move(body));
+        }
+        if (missing(code)) { return {}; }
+
+        LOGTHROW(err1, std::runtime_error)
+            << "Unable to fetch <" << url << ">: HTTP status "
+            << code << ".";
+        throw;
+    }
+
+    /** Probes given URL by HEAD request. Returns none if server does not
+     *  support HEAD.
+     */
+    boost::optional<bool> head(const std::string &url) {
+        trace::Span span("http.head", "remote");
+        Handle handle(*this);
+        auto *curl(handle.curl);
+
+        std::vector<char> body;
+        ::curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        const auto code(perform(curl, url, body));
+        if (code == 200) { return true; }
+        if (missing(code)) { return false; }
+        if ((code == 405) || (code == 501)) { return boost::none; }
+
+        LOGTHROW(err1, std::runtime_error)
+            << "Unable to probe <" << url << ">: HTTP status "
+            << code << ".";
+        throw;
+    }
+
+private:
+    struct Handle {
+        Handle(Http &http) : http(http), curl(http.acquire()) {}
+        ~Handle() { http.release(curl); }
+
+        Http &http;
+        CURL *curl;
+    };
+
+    static bool missing(long code) { return (code == 404) || (code == 410); }
+
+    /** Performs request prepared in handle. Transport errors, HTTP 429 and
+     *  5xx are retried with exponential backoff (randomized to keep
+     *  clients from retrying in lockstep). Returns final HTTP status.
+     */
+    long perform(CURL *curl, const std::string &url
+                 , std::vector<char> &body)
+    {
+        char error[CURL_ERROR_SIZE];
+        ::curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        ::curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+        ::curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error);
+
+        auto delay(options_.retryDelay);
+        for (unsigned int attempt(0); ; ++attempt) {
+            if (attempt) {
+                backoff(delay);
+                delay *= 2;
+            }
+
+            const bool retry(attempt < options_.retries);
+            body.clear();
+            error[0] = '\0';
+
+            const auto res(::curl_easy_perform(curl));
+            if (res != CURLE_OK) {
+                if (retry) {
+                    LOG(info2) << "Request to <" << url << "> failed ("
+                               << (*error ? error
+                                   : ::curl_easy_strerror(res))
+                               << "), retrying.";
+                    continue;
+                }
+                ::curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, nullptr);
+                LOGTHROW(err1, std::runtime_error)
+                    << "Unable to fetch <" << url << ">: "
+                    << (*error ? error : ::curl_easy_strerror(res)) << ".";
+            }
+
+            long code(0);
+            ::curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+            if (((code == 429) || (code >= 500)) && retry) {
+                LOG(info2) << "Request to <" << url << "> failed (HTTP "
+                           << code << "), retrying.";
+                continue;
+            }
+
+            ::curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, nullptr);
+            return code;
+        }
+    }
+
+    /** Sleeps for random time in [delay / 2, delay] milliseconds.
+     */
+    static void backoff(unsigned int delay) {
+        if (!delay) { return; }
+        thread_local std::minstd_rand engine(std::random_device{}());
+        std::uniform_int_distribution<unsigned int> dist(delay / 2, delay);
+        std::this_thread::sleep_for(std::chrono::milliseconds(dist(engine)));
+    }
+
+    CURL* acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]()
+        {
+            return !idle_.empty() || (open_ < options_.connections);
+        });
+
+        if (!idle_.empty()) {
+            auto *curl(idle_.back());
+            idle_.pop_back();
+            return curl;
+        }
+
+        auto *curl(::curl_easy_init());
+        if (!curl) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Unable to initialize HTTP client.";
+        }
+        ++open_;
+
+        ::curl_easy_setopt(curl, CURLOPT_SHARE, share_);
+        ::curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        ::curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        ::curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        ::curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+        ::curl_easy_setopt(curl, CURLOPT_TIMEOUT, options_.timeout);
+        ::curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &Http::write);
+        return curl;
+    }
+
+    void release(CURL *curl) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_.push_back(curl);
+        }
+        cond_.notify_one();
+    }
+
+    static std::size_t write(char *data, std::size_t size, std::size_t count
+                             , void *userdata)
+    {
+        auto &body(*static_cast<std::vector<char>*>(userdata));
+        body.insert(body.end(), data, data + size * count);
+        return size * count;
+    }
+
+    static void lock(CURL*, curl_lock_data data, curl_lock_access
+                     , void *userdata)
+    {
+        static_cast<Http*>(userdata)->locks_[data].lock();
+    }
+
+    static void unlock(CURL*, curl_lock_data data, void *userdata) {
+        static_cast<Http*>(userdata)->locks_[data].unlock();
+    }
+
+    const RemoteOptions options_;
+    CURLSH *share_;
+    std::mutex locks_[CURL_LOCK_DATA_LAST];
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<CURL*> idle_;
+    unsigned int open_;
+};
+
+#else // SLPK_HAS_CURL
+
+class Http {
+public:
+    Http(const RemoteOptions&) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Remote archives are not available: slpk was built without "
+            "libcurl.";
+    }
+
+    Data get(const std::string&) { return {}; }
+    boost::optional<bool> head(const std::string&) { return boost::none; }
+};
+
+#endif // SLPK_HAS_CURL
+
+/** Remote I3S layer. Metadata are synthesized (no resource compression,
+ *  node count unknown), the rest is fetched from the layer URL.
+ *
+ *  Listing is limited to the service documents since the REST API cannot
+ *  be enumerated.
+ */
+class RemoteSource : public Source {
+public:
+    RemoteSource(const RemoteOptions &options)
+        : url_(options.url), memory_(options.memoryCache)
+        , disk_(options.cacheDir), http_(options)
+    {
+        while (!url_.empty() && (url_.back() == '/')) { url_.pop_back(); }
+
+        const std::string metadata
+            ("{\"folderPattern\":\"BASIC\""
+             ",\"ArchiveCompressionType\":\"STORE\""
+             ",\"ResourceCompressionType\":\"NONE\""
+             ",\"I3SVersion\":\"1.6\",\"nodeCount\":0}");
+        metadata_ = std::make_shared<const std::vector<char>>
+            (metadata.begin(), metadata.end());
+
+        LOG(info1) << "Opened remote layer <" << url_ << ">.";
+    }
+
+    virtual roarchive::IStream::pointer
+    istream(const fs::path &path, const FilterInit &filterInit) const {
+        if (auto is = tryIstream(path, filterInit)) { return is; }
+        LOGTHROW(err1, roarchive::NoSuchFile)
+            << "File " << path << " not found in remote layer <"
+            << url_ << ">.";
+        throw;
+    }
+
+    virtual roarchive::IStream::pointer
+    tryIstream(const fs::path &path, const FilterInit &filterInit) const {
+        const auto data(get(path));
+        if (!data) { return {}; }
+        return memoryIStream(path, data->data(), data->size()
+                             , zip::method::store, data->size()
+                             , filterInit, data);
+    }
+
+    /** Answered from caches if possible, otherwise by HEAD request; only
+     *  servers without HEAD support make it download the resource.
+     */
+    virtual bool exists(const fs::path &path) const {
+        if (path == constants::MetadataName) { return true; }
+
+        const auto url(this->url(path));
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            Data data;
+            if (memory_.get(url, data)) { return bool(data); }
+
+            const auto finflight(inflight_.find(url));
+            if (finflight != inflight_.end()) {
+                auto future(finflight->second);
+                lock.unlock();
+                return bool(future.get());
+            }
+        }
+
+        if (disk_ && disk_.has(url)) { return true; }
+
+        const auto found(http_.head(url));
+        if (!found) { return bool(fetch(url)); }
+
+        if (!*found) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            memory_.put(url, {});
+        }
+        return *found;
+    }
+
+    virtual roarchive::Files list() const {
+        roarchive::Files files;
+        files.push_back(constants::MetadataName);
+        files.push_back(constants::SceneLayer);
+        return files;
+    }
+
+    virtual bool changed() const { return false; }
+
+private:
+    Data get(const fs::path &path) const {
+        if (path == constants::MetadataName) { return metadata_; }
+        return fetch(url(path));
+    }
+
+    std::string url(const fs::path &path) const {
+        const auto rp(remotePath(path));
+        return rp.empty() ? url_ : (url_ + "/" + rp);
+    }
+
+    /** Memory cache -> in-flight request -> disk cache -> HTTP. Missing
+     *  resources are cached in memory as well.
+     */
+    Data fetch(const std::string &url) const {
+        std::promise<Data> promise;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            Data data;
+            if (memory_.get(url, data)) { return data; }
+
+            const auto finflight(inflight_.find(url));
+            if (finflight != inflight_.end()) {
+                auto future(finflight->second);
+                lock.unlock();
+                return future.get();
+            }
+
+            inflight_.insert(std::make_pair
+                             (url, promise.get_future().share()));
+        }
+
+        Data data;
+        try {
+            if (disk_) { data = disk_.get(url); }
+            if (!data) {
+                data = http_.get(url);
+                if (data && disk_) { disk_.put(url, *data); }
+            }
+        } catch (...) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                inflight_.erase(url);
+            }
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            memory_.put(url, data);
+            inflight_.erase(url);
+        }
+        promise.set_value(data);
+        return data;
+    }
+
+    std::string url_;
+    Data metadata_;
+
+    mutable std::mutex mutex_;
+    mutable MemoryCache memory_;
+    mutable std::map<std::string, std::shared_future<Data>> inflight_;
+    const DiskCache disk_;
+    mutable Http http_;
+};
+
+} // namespace
+
+Source::pointer Source::remote(const RemoteOptions &options)
+{
+    return std::make_shared<RemoteSource>(options);
+}
+
+} } // namespace slpk::detail
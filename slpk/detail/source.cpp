@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <map>
+
+#include <boost/optional.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/array.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "files.hpp"
+#include "source.hpp"
+#include "zip.hpp"
+
+namespace fs = boost::filesystem;
+namespace bio = boost::iostreams;
+
+namespace slpk { namespace detail {
+
+namespace {
+
+class ArchiveSource : public Source {
+public:
+    ArchiveSource(const roarchive::RoArchive &archive)
+        : archive_(archive)
+    {}
+
+    virtual roarchive::IStream::pointer
+    istream(const fs::path &path, const FilterInit &filterInit) const {
+        if (filterInit) { return archive_.istream(path, filterInit); }
+        return archive_.istream(path);
+    }
+
+    virtual bool exists(const fs::path &path) const {
+        return archive_.exists(path);
+    }
+
+    virtual roarchive::Files list() const { return archive_.list(); }
+
+    virtual bool changed() const { return archive_.changed(); }
+
+private:
+    roarchive::RoArchive archive_;
+};
+
+/** Stream over (zip entry) data in memory. Stored data are read directly,
+ *  deflated ones through raw inflate.
+ */
+class MemoryIStream : public roarchive::IStream {
+public:
+    MemoryIStream(const fs::path &path, const char *data
+                  , std::size_t size, std::uint16_t method
+                  , std::size_t uncompressedSize
+                  , const Source::FilterInit &filterInit
+                  , const std::shared_ptr<const void> &owner)
+        : path_(path), owner_(owner)
+    {
+        if (filterInit) {
+            filterInit(fis_);
+        } else {
+            size_ = uncompressedSize;
+        }
+
+        switch (method) {
+        case zip::method::store: break;
+
+        case zip::method::deflate: {
+            bio::zlib_params p;
+            p.noheader = true;
+            fis_.push(bio::zlib_decompressor(p));
+        } break;
+
+        default:
+            LOGTHROW(err1, std::runtime_error)
+                << "Unsupported compression method " << method
+                << " of " << path << ".";
+        }
+
+        fis_.push(bio::array_source(data, size));
+    }
+
+    virtual std::istream& get() { return fis_; }
+    virtual fs::path path() const { return path_; }
+    virtual fs::path index() const { return path_; }
+    virtual boost::optional<std::size_t> size() const { return size_; }
+    virtual void close() {}
+
+private:
+    const fs::path path_;
+    const std::shared_ptr<const void> owner_;
+    boost::optional<std::size_t> size_;
+    bio::filtering_istream fis_;
+};
+
+class MemorySource : public Source {
+public:
+    MemorySource(const char *data, std::size_t size
+                 , const std::shared_ptr<const void> &owner)
+        : data_(data), size_(size), owner_(owner)
+    {
+        for (auto &entry
+                 : zip::stripRoot(zip::readCentralDirectory
+                                  (data_, size_, Name)
+                                  , constants::MetadataName))
+        {
+            // skip directories
+            if (!entry.path.empty() && (entry.path.back() == '/')) {
+                continue;
+            }
+            auto path(entry.path);
+            entries_.insert(std::make_pair(std::move(path)
+                                           , std::move(entry)));
+        }
+
+        LOG(info1) << "Opened in-memory zip archive with "
+                   << entries_.size() << " entries.";
+    }
+
+    virtual roarchive::IStream::pointer
+    istream(const fs::path &path, const FilterInit &filterInit) const {
+        return open(path, find(path), filterInit);
+    }
+
+    virtual roarchive::IStream::pointer
+    tryIstream(const fs::path &path, const FilterInit &filterInit) const {
+        const auto fentries(entries_.find(key(path)));
+        if (fentries == entries_.end()) { return {}; }
+        return open(path, fentries->second, filterInit);
+    }
+
+    virtual bool exists(const fs::path &path) const {
+        return entries_.count(key(path));
+    }
+
+    virtual roarchive::Files list() const {
+        roarchive::Files files;
+        for (const auto &item : entries_) { files.push_back(item.first); }
+        return files;
+    }
+
+    virtual bool changed() const { return false; }
+
+private:
+    static std::string key(const fs::path &path) {
+        auto key(path.generic_string());
+        if (!key.empty() && (key.front() == '/')) { key.erase(0, 1); }
+        return key;
+    }
+
+    roarchive::IStream::pointer open(const fs::path &path
+                                     , const zip::Entry &entry
+                                     , const FilterInit &filterInit) const
+    {
+        return memoryIStream(path, zip::entryData(data_, size_, entry, Name)
+                             , entry.compressedSize, entry.method
+                             , entry.uncompressedSize, filterInit, owner_);
+    }
+
+    const zip::Entry& find(const fs::path &path) const {
+        const auto fentries(entries_.find(key(path)));
+        if (fentries == entries_.end()) {
+            LOGTHROW(err1, roarchive::NoSuchFile)
+                << "File " << path << " not found in in-memory archive.";
+        }
+        return fentries->second;
+    }
+
+    static const fs::path Name;
+
+    const char *data_;
+    const std::size_t size_;
+    const std::shared_ptr<const void> owner_;
+    std::map<std::string, zip::Entry> entries_;
+};
+
+const fs::path MemorySource::Name("<memory>");
+
+} // namespace
+
+roarchive::IStream::pointer Source::tryIstream(const fs::path &path
+                                               , const FilterInit &filterInit)
+    const
+{
+    if (!exists(path)) { return {}; }
+    return istream(path, filterInit);
+}
+
+roarchive::IStream::pointer
+memoryIStream(const fs::path &path, const char *data, std::size_t size
+              , std::uint16_t method, std::size_t uncompressedSize
+              , const Source::FilterInit &filterInit
+              , const std::shared_ptr<const void> &owner)
+{
+    return std::make_shared<MemoryIStream>
+        (path, data, size, method, uncompressedSize, filterInit, owner);
+}
+
+Source::pointer Source::archive(const roarchive::RoArchive &archive)
+{
+    return std::make_shared<ArchiveSource>(archive);
+}
+
+Source::pointer Source::memory(const char *data, std::size_t size
+                               , const std::shared_ptr<const void> &owner)
+{
+    return std::make_shared<MemorySource>(data, size, owner);
+}
+
+} } // namespace slpk::detail
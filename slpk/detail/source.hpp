@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef slpk_detail_source_hpp_included_
+#define slpk_detail_source_hpp_included_
+
+#include <memory>
+#include <cstdint>
+#include <functional>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include "roarchive/roarchive.hpp"
+
+namespace slpk {
+
+struct RemoteOptions;
+
+namespace detail {
+
+/** Storage the archive is read from: roarchive or zip file in memory.
+ */
+class Source {
+public:
+    typedef std::shared_ptr<const Source> pointer;
+    typedef std::function<void(boost::iostreams::filtering_istream&)>
+        FilterInit;
+
+    virtual ~Source() {}
+
+    virtual roarchive::IStream::pointer
+    istream(const boost::filesystem::path &path
+            , const FilterInit &filterInit = FilterInit()) const = 0;
+
+    /** Like istream() but returns null if there is no such file. Default
+     *  implementation probes exists() first.
+     */
+    virtual roarchive::IStream::pointer
+    tryIstream(const boost::filesystem::path &path
+               , const FilterInit &filterInit = FilterInit()) const;
+
+    virtual bool exists(const boost::filesystem::path &path) const = 0;
+
+    virtual roarchive::Files list() const = 0;
+
+    virtual bool changed() const = 0;
+
+    /** Wraps generic read-only archive.
+     */
+    static pointer archive(const roarchive::RoArchive &archive);
+
+    /** Zip file in memory, entries are read in place. Data must be valid
+     *  while the source or any stream opened from it exists; owner (if any)
+     *  is held by both.
+     */
+    static pointer memory(const char *data, std::size_t size
+                          , const std::shared_ptr<const void> &owner
+                          = std::shared_ptr<const void>());
+
+    /** Remote I3S SceneServer layer accessed over HTTP.
+     */
+    static pointer remote(const RemoteOptions &options);
+};
+
+/** Stream over stored or raw deflated (zip method) data in memory. Owner (if
+ *  any) is held by the stream.
+ */
+roarchive::IStream::pointer
+memoryIStream(const boost::filesystem::path &path, const char *data
+              , std::size_t size, std::uint16_t method
+              , std::size_t uncompressedSize
+              , const Source::FilterInit &filterInit
+              , const std::shared_ptr<const void> &owner);
+
+} } // namespace slpk::detail
+
+#endif // slpk_detail_source_hpp_included_
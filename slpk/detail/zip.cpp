@@ -0,0 +1,389 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fstream>
+#include <algorithm>
+
+#include "dbglog/dbglog.hpp"
+
+#include "zip.hpp"
+
+namespace slpk { namespace detail { namespace zip {
+
+namespace {
+
+const std::uint32_t EocdSignature(0x06054b50);
+const std::uint32_t Zip64EocdSignature(0x06064b50);
+const std::uint32_t Zip64LocatorSignature(0x07064b50);
+const std::uint32_t EntrySignature(0x02014b50);
+const std::uint32_t LocalEntrySignature(0x04034b50);
+const std::uint16_t Zip64ExtraId(0x0001);
+
+const std::size_t EocdSize(22);
+const std::size_t Zip64LocatorSize(20);
+const std::size_t Zip64EocdSize(56);
+const std::size_t EntrySize(46);
+const std::size_t LocalEntrySize(30);
+const std::size_t MaxCommentSize(0xffff);
+
+typedef std::vector<unsigned char> Buffer;
+
+/** Little endian reader over a memory block.
+ */
+class Cursor {
+public:
+    Cursor(const boost::filesystem::path &path, const unsigned char *data
+           , std::size_t size)
+        : path_(path), data_(data), end_(data + size)
+    {}
+
+    template <typename T> T read() {
+        need(sizeof(T));
+        T value(0);
+        for (std::size_t i(0); i < sizeof(T); ++i) {
+            value |= T(data_[i]) << (8 * i);
+        }
+        data_ += sizeof(T);
+        return value;
+    }
+
+    std::string string(std::size_t size) {
+        need(size);
+        std::string value(reinterpret_cast<const char*>(data_), size);
+        data_ += size;
+        return value;
+    }
+
+    void skip(std::size_t size) { need(size); data_ += size; }
+
+    std::size_t left() const { return end_ - data_; }
+
+private:
+    void need(std::size_t size) const {
+        if (std::size_t(end_ - data_) < size) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Truncated zip central directory in " << path_ << ".";
+        }
+    }
+
+    const boost::filesystem::path &path_;
+    const unsigned char *data_;
+    const unsigned char *end_;
+};
+
+/** Zip file input, blocks are read into buffers.
+ */
+class FileInput {
+public:
+    FileInput(const boost::filesystem::path &path) {
+        f_.exceptions(std::ios::badbit | std::ios::failbit);
+        f_.open(path.string(), std::ios_base::in | std::ios_base::binary);
+        f_.seekg(0, std::ios_base::end);
+        size_ = f_.tellg();
+    }
+
+    std::uint64_t size() const { return size_; }
+
+    Buffer block(std::uint64_t offset, std::size_t size) {
+        Buffer buffer(size);
+        f_.seekg(offset);
+        f_.read(reinterpret_cast<char*>(buffer.data()), size);
+        return buffer;
+    }
+
+private:
+    std::ifstream f_;
+    std::uint64_t size_;
+};
+
+/** Block of zip data in memory.
+ */
+class View {
+public:
+    View(const unsigned char *data, std::size_t size)
+        : data_(data), size_(size) {}
+
+    const unsigned char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    const unsigned char *data_;
+    std::size_t size_;
+};
+
+/** Zip file input, blocks are served in place.
+ */
+class MemoryInput {
+public:
+    MemoryInput(const boost::filesystem::path &path, const char *data
+                , std::size_t size)
+        : path_(path), data_(reinterpret_cast<const unsigned char*>(data))
+        , size_(size)
+    {}
+
+    std::uint64_t size() const { return size_; }
+
+    View block(std::uint64_t offset, std::size_t size) const {
+        if ((offset > size_) || ((size_ - offset) < size)) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Zip block at " << offset << " is past the end of "
+                << path_ << ".";
+        }
+        return View(data_ + offset, size);
+    }
+
+private:
+    const boost::filesystem::path &path_;
+    const unsigned char *data_;
+    std::size_t size_;
+};
+
+struct Directory {
+    std::uint64_t entries;
+    std::uint64_t size;
+    std::uint64_t offset;
+
+    Directory() : entries(), size(), offset() {}
+};
+
+template <typename Input>
+void readZip64(const boost::filesystem::path &path, Input &input
+               , std::uint64_t eocdOffset, Directory &dir)
+{
+    if (eocdOffset < Zip64LocatorSize) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Missing zip64 end of central directory locator in "
+            << path << ".";
+    }
+
+    const auto locator(input.block(eocdOffset - Zip64LocatorSize
+                                   , Zip64LocatorSize));
+    Cursor lc(path, locator.data(), locator.size());
+    if (lc.read<std::uint32_t>() != Zip64LocatorSignature) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Invalid zip64 end of central directory locator in "
+            << path << ".";
+    }
+    lc.skip(4); // disk with zip64 EOCD
+    const auto zip64Offset(lc.read<std::uint64_t>());
+
+    const auto eocd(input.block(zip64Offset, Zip64EocdSize));
+    Cursor ec(path, eocd.data(), eocd.size());
+    if (ec.read<std::uint32_t>() != Zip64EocdSignature) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Invalid zip64 end of central directory record in "
+            << path << ".";
+    }
+    ec.skip(8 + 2 + 2 + 4 + 4 + 8); // size, versions, disks, disk entries
+    dir.entries = ec.read<std::uint64_t>();
+    dir.size = ec.read<std::uint64_t>();
+    dir.offset = ec.read<std::uint64_t>();
+}
+
+template <typename Input>
+Directory findDirectory(const boost::filesystem::path &path, Input &input)
+{
+    const std::uint64_t fileSize(input.size());
+    if (fileSize < EocdSize) {
+        LOGTHROW(err1, std::runtime_error)
+            << "File " << path << " is too small to be a zip archive.";
+    }
+
+    // EOCD is followed only by (up to 64KiB long) comment
+    const auto tailSize(std::min<std::uint64_t>
+                        (fileSize, EocdSize + MaxCommentSize));
+    const auto tailOffset(fileSize - tailSize);
+    const auto tail(input.block(tailOffset, tailSize));
+
+    for (auto i(tailSize - EocdSize + 1); i-- > 0; ) {
+        Cursor c(path, tail.data() + i, tailSize - i);
+        if (c.read<std::uint32_t>() != EocdSignature) { continue; }
+
+        c.skip(2 + 2 + 2); // disk numbers, entries on this disk
+        Directory dir;
+        dir.entries = c.read<std::uint16_t>();
+        dir.size = c.read<std::uint32_t>();
+        dir.offset = c.read<std::uint32_t>();
+
+        if ((dir.entries == 0xffff) || (dir.size == 0xffffffff)
+            || (dir.offset == 0xffffffff))
+        {
+            readZip64(path, input, tailOffset + i, dir);
+        }
+        return dir;
+    }
+
+    LOGTHROW(err1, std::runtime_error)
+        << "No end of central directory record found in " << path << ".";
+    throw;
+}
+
+void applyZip64Extra(const boost::filesystem::path &path, Entry &entry
+                     , const std::string &extra, bool usize, bool csize
+                     , bool offset)
+{
+    Cursor c(path, reinterpret_cast<const unsigned char*>(extra.data())
+             , extra.size());
+    while (c.left() >= 4) {
+        const auto id(c.read<std::uint16_t>());
+        const auto size(c.read<std::uint16_t>());
+        if (id != Zip64ExtraId) { c.skip(size); continue; }
+
+        // only fields saturated in the fixed part are present, in this order
+        if (usize) { entry.uncompressedSize = c.read<std::uint64_t>(); }
+        if (csize) { entry.compressedSize = c.read<std::uint64_t>(); }
+        if (offset) { entry.localHeaderOffset = c.read<std::uint64_t>(); }
+        return;
+    }
+}
+
+template <typename Input>
+Entry::list readDirectory(const boost::filesystem::path &path, Input &input)
+{
+    const auto dir(findDirectory(path, input));
+
+    // entry count is untrusted: every entry takes at least EntrySize bytes
+    if (dir.entries > (dir.size / EntrySize)) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Zip central directory in " << path << " claims "
+            << dir.entries << " entries but has only " << dir.size
+            << " bytes.";
+    }
+
+    const auto data(input.block(dir.offset, dir.size));
+
+    Entry::list entries;
+    entries.reserve(dir.entries);
+
+    Cursor c(path, data.data(), data.size());
+    for (std::uint64_t i(0); i < dir.entries; ++i) {
+        if (c.read<std::uint32_t>() != EntrySignature) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Invalid zip central directory entry #" << i
+                << " in " << path << ".";
+        }
+
+        entries.emplace_back();
+        auto &entry(entries.back());
+
+        c.skip(2 + 2 + 2); // versions, flags
+        entry.method = c.read<std::uint16_t>();
+        c.skip(2 + 2); // time, date
+        entry.crc32 = c.read<std::uint32_t>();
+        entry.compressedSize = c.read<std::uint32_t>();
+        entry.uncompressedSize = c.read<std::uint32_t>();
+        const auto nameSize(c.read<std::uint16_t>());
+        const auto extraSize(c.read<std::uint16_t>());
+        const auto commentSize(c.read<std::uint16_t>());
+        c.skip(2 + 2 + 4); // disk, attributes
+        entry.localHeaderOffset = c.read<std::uint32_t>();
+
+        entry.path = c.string(nameSize);
+        const auto extra(c.string(extraSize));
+        c.skip(commentSize);
+
+        const bool usize(entry.uncompressedSize == 0xffffffff);
+        const bool csize(entry.compressedSize == 0xffffffff);
+        const bool offset(entry.localHeaderOffset == 0xffffffff);
+        if (usize || csize || offset) {
+            applyZip64Extra(path, entry, extra, usize, csize, offset);
+        }
+    }
+
+    return entries;
+}
+
+} // namespace
+
+Entry::list readCentralDirectory(const boost::filesystem::path &path)
+{
+    FileInput input(path);
+    auto entries(readDirectory(path, input));
+
+    LOG(info1) << "Read " << entries.size() << " entries from zip central "
+        "directory of " << path << ".";
+
+    return entries;
+}
+
+Entry::list readCentralDirectory(const char *data, std::size_t size
+                                 , const boost::filesystem::path &name)
+{
+    MemoryInput input(name, data, size);
+    return readDirectory(name, input);
+}
+
+const char* entryData(const char *data, std::size_t size
+                      , const Entry &entry
+                      , const boost::filesystem::path &name)
+{
+    MemoryInput input(name, data, size);
+    const auto header(input.block(entry.localHeaderOffset, LocalEntrySize));
+
+    Cursor c(name, header.data(), header.size());
+    if (c.read<std::uint32_t>() != LocalEntrySignature) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Invalid zip local header of " << entry.path
+            << " in " << name << ".";
+    }
+    c.skip(2 + 2 + 2 + 2 + 2 + 4 + 4 + 4); // versions ... sizes
+    const auto nameSize(c.read<std::uint16_t>());
+    const auto extraSize(c.read<std::uint16_t>());
+
+    // validates that the whole entry is in the block
+    return reinterpret_cast<const char*>
+        (input.block(entry.localHeaderOffset + LocalEntrySize + nameSize
+                     + extraSize, entry.compressedSize).data());
+}
+
+Entry::list stripRoot(Entry::list entries, const std::string &hint)
+{
+    // shallowest hint wins
+    std::string prefix;
+    std::size_t depth(std::string::npos);
+    for (const auto &entry : entries) {
+        const boost::filesystem::path path(entry.path);
+        if (path.filename() != hint) { continue; }
+        const std::size_t d
+            (std::count(entry.path.begin(), entry.path.end(), '/'));
+        if (d < depth) {
+            depth = d;
+            prefix = entry.path.substr(0, entry.path.size() - hint.size());
+        }
+    }
+
+    if (prefix.empty()) { return entries; }
+
+    Entry::list out;
+    for (auto &entry : entries) {
+        if (entry.path.compare(0, prefix.size(), prefix)) { continue; }
+        entry.path.erase(0, prefix.size());
+        out.push_back(std::move(entry));
+    }
+    return out;
+}
+
+} } } // namespace slpk::detail::zip
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef slpk_detail_zip_hpp_included_
+#define slpk_detail_zip_hpp_included_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+namespace slpk { namespace detail { namespace zip {
+
+namespace method {
+    const std::uint16_t store(0);
+    const std::uint16_t deflate(8);
+} // namespace method
+
+/** Zip central directory entry.
+ */
+struct Entry {
+    std::string path;
+    std::uint64_t compressedSize;
+    std::uint64_t uncompressedSize;
+    std::uint64_t localHeaderOffset;
+    std::uint16_t method;
+    std::uint32_t crc32;
+
+    Entry()
+        : compressedSize(), uncompressedSize(), localHeaderOffset()
+        , method(), crc32()
+    {}
+
+    typedef std::vector<Entry> list;
+};
+
+/** Reads central directory of zip file at given path (zip64 aware). Only
+ *  the end of central directory records and the central directory itself
+ *  are read.
+ */
+Entry::list readCentralDirectory(const boost::filesystem::path &path);
+
+/** Reads central directory of zip file held in memory. Name is used in
+ *  error messages only.
+ */
+Entry::list readCentralDirectory(const char *data, std::size_t size
+                                 , const boost::filesystem::path &name);
+
+/** Returns pointer to (possibly compressed) data of given entry of zip file
+ *  held in memory. Local header is validated, nothing is copied.
+ */
+const char* entryData(const char *data, std::size_t size
+                      , const Entry &entry
+                      , const boost::filesystem::path &name);
+
+/** Makes entry paths relative to directory holding the shallowest file named
+ *  hint; entries outside of it are dropped. Entries are returned intact if
+ *  there is no such file or it lives in the zip root.
+ */
+Entry::list stripRoot(Entry::list entries, const std::string &hint);
+
+} } } // namespace slpk::detail::zip
+
+#endif // slpk_detail_zip_hpp_included_
@@ -0,0 +1,291 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <map>
+#include <set>
+#include <vector>
+#include <cstdint>
+#include <thread>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/openmp.hpp"
+
+#include "jsoncpp/json.hpp"
+#include "jsoncpp/io.hpp"
+
+#include "diff.hpp"
+#include "restapi.hpp"
+#include "detail/files.hpp"
+#include "detail/zip.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace slpk {
+
+namespace {
+
+/** Stored file identity: path as stored, size and CRC-32 of stored data.
+ */
+struct Fingerprint {
+    std::string path;
+    std::uint64_t size;
+    std::uint32_t crc;
+
+    Fingerprint(const std::string &path = "", std::uint64_t size = 0
+                , std::uint32_t crc = 0)
+        : path(path), size(size), crc(crc)
+    {}
+
+    bool operator==(const Fingerprint &o) const {
+        return (path == o.path) && (size == o.size) && (crc == o.crc);
+    }
+
+    bool operator!=(const Fingerprint &o) const { return !operator==(o); }
+
+    /** Keyed by path without .gz extension.
+     */
+    typedef std::map<std::string, Fingerprint> map;
+};
+
+std::string diffKey(fs::path path)
+{
+    if (path.extension() == detail::constants::ext::gz) {
+        path.replace_extension();
+    }
+    return path.generic_string();
+}
+
+/** Id of node given file belongs to, empty for files outside nodes/.
+ */
+std::string nodeOf(const std::string &path)
+{
+    const auto prefix(detail::constants::Nodes.string() + "/");
+    if (path.compare(0, prefix.size(), prefix)) { return {}; }
+    const auto end(path.find('/', prefix.size()));
+    if (end == std::string::npos) { return {}; }
+    return path.substr(prefix.size(), end - prefix.size());
+}
+
+bool isNodeIndexFile(const std::string &key)
+{
+    return fs::path(key).filename() == detail::constants::NodeIndex;
+}
+
+/** CRC-32 and size of a stored file.
+ */
+Fingerprint fingerprint(const Archive &archive, const fs::path &path)
+{
+    auto is(archive.rawistream(path));
+    auto &s(is->get());
+
+    Fingerprint fp(path.generic_string());
+    uLong crc(::crc32(0, Z_NULL, 0));
+
+    std::vector<char> buffer(1 << 16);
+    while (s) {
+        s.read(buffer.data(), buffer.size());
+        const auto count(s.gcount());
+        if (count <= 0) { break; }
+        crc = ::crc32(crc, reinterpret_cast<const Bytef*>(buffer.data())
+                      , uInt(count));
+        fp.size += count;
+    }
+    if (s.bad()) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Unable to read " << path << ".";
+    }
+
+    fp.crc = std::uint32_t(crc);
+    return fp;
+}
+
+/** Collects fingerprints of all files of an archive: from the central
+ *  directory of a zip archive opened from a path, otherwise by checksumming
+ *  all files in parallel.
+ */
+Fingerprint::map scan(const Archive &archive, int threads)
+{
+    Fingerprint::map fps;
+
+    const auto &root(archive.root());
+    if (!root.empty() && fs::is_regular_file(root)) {
+        for (const auto &entry
+                 : detail::zip::stripRoot
+                 (detail::zip::readCentralDirectory(root)
+                  , detail::constants::MetadataName))
+        {
+            // skip directories
+            if (entry.path.empty() || (entry.path.back() == '/')) {
+                continue;
+            }
+            fps.insert(Fingerprint::map::value_type
+                       (diffKey(entry.path)
+                        , Fingerprint(entry.path, entry.uncompressedSize
+                                      , entry.crc32)));
+        }
+        return fps;
+    }
+
+    const auto files(archive.fileList());
+    std::vector<Fingerprint> computed(files.size());
+    std::vector<std::string> errors(files.size());
+
+    UTILITY_OMP(parallel for num_threads(threads) schedule(dynamic)
+                shared(files, computed, errors, archive))
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        try {
+            computed[i] = fingerprint(archive, files[i]);
+        } catch (const std::exception &e) {
+            errors[i] = e.what();
+        }
+    }
+
+    for (std::size_t i(0); i < files.size(); ++i) {
+        if (!errors[i].empty()) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Unable to checksum " << files[i] << ": "
+                << errors[i];
+        }
+        fps.insert(Fingerprint::map::value_type
+                   (diffKey(files[i]), std::move(computed[i])));
+    }
+
+    return fps;
+}
+
+} // namespace
+
+DiffReport diff(const Archive &from, const Archive &to
+                , const DiffOptions &options)
+{
+    auto threads(options.threads);
+    if (threads <= 0) { threads = std::thread::hardware_concurrency(); }
+    if (threads <= 0) { threads = 1; }
+
+    LOG(info3) << "Scanning old archive.";
+    const auto old(scan(from, threads));
+    LOG(info3) << "Scanning new archive.";
+    const auto current(scan(to, threads));
+
+    DiffReport report;
+    std::set<std::string> oldNodes, newNodes, touchedNodes;
+
+    const auto add([&](ChangeType type, const Archive &archive
+                       , const Fingerprint &fp)
+    {
+        report.paths.emplace_back
+            (type, nodeOf(fp.path), fp.path
+             , RestApi::url(archive.sceneLayerInfo(), fp.path));
+        if (!report.paths.back().node.empty()) {
+            touchedNodes.insert(report.paths.back().node);
+        }
+    });
+
+    // merge both sorted maps
+    auto io(old.begin()), ic(current.begin());
+    while ((io != old.end()) || (ic != current.end())) {
+        if ((ic == current.end())
+            || ((io != old.end()) && (io->first < ic->first)))
+        {
+            if (isNodeIndexFile(io->first)) {
+                oldNodes.insert(nodeOf(io->first));
+            }
+            add(ChangeType::removed, from, io->second);
+            ++io;
+            continue;
+        }
+
+        if ((io == old.end()) || (ic->first < io->first)) {
+            if (isNodeIndexFile(ic->first)) {
+                newNodes.insert(nodeOf(ic->first));
+            }
+            add(ChangeType::added, to, ic->second);
+            ++ic;
+            continue;
+        }
+
+        if (isNodeIndexFile(io->first)) {
+            oldNodes.insert(nodeOf(io->first));
+            newNodes.insert(nodeOf(ic->first));
+        }
+        if (io->second != ic->second) {
+            add(ChangeType::modified, to, ic->second);
+        } else {
+            ++report.unchanged;
+        }
+        ++io;
+        ++ic;
+    }
+
+    for (const auto &id : touchedNodes) {
+        const bool inOld(oldNodes.count(id)), inNew(newNodes.count(id));
+        if (inOld && inNew) {
+            report.nodes.emplace_back(ChangeType::modified, id);
+        } else if (inNew) {
+            report.nodes.emplace_back(ChangeType::added, id);
+        } else if (inOld) {
+            report.nodes.emplace_back(ChangeType::removed, id);
+        }
+    }
+
+    return report;
+}
+
+void saveJson(std::ostream &os, const DiffReport &report)
+{
+    Json::Value value(Json::objectValue);
+    value["unchanged"] = Json::UInt64(report.unchanged);
+
+    auto &jpaths(value["paths"] = Json::arrayValue);
+    for (const auto &change : report.paths) {
+        auto &jchange(jpaths.append(Json::objectValue));
+        jchange["change"] = boost::lexical_cast<std::string>(change.type);
+        jchange["path"] = change.path;
+        if (!change.url.empty()) { jchange["url"] = change.url; }
+        if (!change.node.empty()) { jchange["node"] = change.node; }
+    }
+
+    auto &jnodes(value["nodes"] = Json::arrayValue);
+    for (const auto &change : report.nodes) {
+        auto &jchange(jnodes.append(Json::objectValue));
+        jchange["change"] = boost::lexical_cast<std::string>(change.type);
+        jchange["id"] = change.id;
+    }
+
+    Json::write(os, value, true);
+}
+
+} // namespace slpk
@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef slpk_diff_hpp_included_
+#define slpk_diff_hpp_included_
+
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+#include "utility/enum-io.hpp"
+
+#include "reader.hpp"
+
+/** Structural difference of two versions of an archive.
+ */
+
+namespace slpk {
+
+UTILITY_GENERATE_ENUM_CI(ChangeType,
+                         ((added))
+                         ((removed))
+                         ((modified))
+                         )
+
+struct PathChange {
+    ChangeType type;
+
+    /** Id of node the file belongs to, empty for layer-wide files.
+     */
+    std::string node;
+
+    /** Stored path (in the new archive, in the old one for removed files).
+     */
+    std::string path;
+
+    /** Path under which RestApi serves the file, empty if not served.
+     */
+    std::string url;
+
+    PathChange(ChangeType type = ChangeType::modified
+               , const std::string &node = "", const std::string &path = ""
+               , const std::string &url = "")
+        : type(type), node(node), path(path), url(url)
+    {}
+
+    typedef std::vector<PathChange> list;
+};
+
+struct NodeChange {
+    ChangeType type;
+    std::string id;
+
+    NodeChange(ChangeType type = ChangeType::modified
+               , const std::string &id = "")
+        : type(type), id(id)
+    {}
+
+    typedef std::vector<NodeChange> list;
+};
+
+struct DiffOptions {
+    /** Number of threads, 0 means number of CPUs.
+     */
+    int threads;
+
+    DiffOptions() : threads() {}
+};
+
+struct DiffReport {
+    /** Changed files, sorted by path.
+     */
+    PathChange::list paths;
+
+    /** Added, removed and modified nodes, sorted by id.
+     */
+    NodeChange::list nodes;
+
+    /** Number of files present and equal in both archives.
+     */
+    std::size_t unchanged;
+
+    DiffReport() : unchanged() {}
+
+    bool empty() const { return paths.empty(); }
+};
+
+/** Compares two versions of an archive.
+ *
+ *  Files are matched by stored path (regardless of .gz extension) and
+ *  compared by CRC-32 and size of their stored content. Zip archives opened
+ *  from a path are compared by their central directories only, nothing is
+ *  read or decompressed; files of other archives are checksummed as stored,
+ *  in parallel. Nodes are matched by id (their directory under nodes/); a
+ *  node is modified when any of its files is.
+ */
+DiffReport diff(const Archive &from, const Archive &to
+                , const DiffOptions &options = DiffOptions());
+
+/** Writes report as JSON.
+ */
+void saveJson(std::ostream &os, const DiffReport &report);
+
+} // namespace slpk
+
+#endif // slpk_diff_hpp_included_
@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef slpk_error_hpp_included_
+#define slpk_error_hpp_included_
+
+#include <string>
+#include <system_error>
+
+namespace slpk {
+
+/** Errors reported by non-throwing (std::error_code) archive access.
+ */
+enum class Errc {
+    /** No such file or resource in the archive.
+     */
+    noSuchFile = 1
+
+    /** Node has no texture of supported type at given index.
+     */
+    , noTexture
+};
+
+/** SLPK error category.
+ */
+class ErrorCategory : public std::error_category {
+public:
+    virtual const char* name() const noexcept { return "slpk"; }
+
+    virtual std::string message(int code) const {
+        switch (static_cast<Errc>(code)) {
+        case Errc::noSuchFile: return "no such file";
+        case Errc::noTexture: return "no texture available";
+        }
+        return "unknown slpk error";
+    }
+};
+
+inline const std::error_category& errorCategory()
+{
+    static const ErrorCategory category;
+    return category;
+}
+
+inline std::error_code make_error_code(Errc e)
+{
+    return std::error_code(static_cast<int>(e), errorCategory());
+}
+
+} // namespace slpk
+
+namespace std {
+
+template <> struct is_error_code_enum<slpk::Errc> : true_type {};
+
+} // namespace std
+
+#endif // slpk_error_hpp_included_
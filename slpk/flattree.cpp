@@ -0,0 +1,722 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <fstream>
+#include <algorithm>
+#include <type_traits>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/path.hpp"
+
+#include "flattree.hpp"
+#include "reader.hpp"
+#include "detail/files.hpp"
+
+namespace fs = boost::filesystem;
+namespace bi = boost::interprocess;
+
+namespace slpk {
+
+namespace detail { namespace flat {
+
+const char Magic[8] = { 'S', 'L', 'P', 'K', 'F', 'L', 'A', 'T' };
+const std::uint32_t Version(2);
+const std::uint32_t ByteOrderMark(0x01020304);
+const std::uint32_t None(0xffffffff);
+
+/** Header flags.
+ */
+const std::uint32_t Geographic(0x1);
+
+/** String in the string pool.
+ */
+struct String {
+    std::uint64_t offset;
+    std::uint32_t size;
+    std::uint32_t reserved;
+};
+
+/** Range of items in an array.
+ */
+struct Range {
+    std::uint32_t begin;
+    std::uint32_t count;
+};
+
+struct Lod {
+    std::uint32_t metricType;
+    std::uint32_t reserved;
+    double maxValue;
+    double avgValue;
+    double minValue;
+    double maxError;
+};
+
+/** Image header. All offsets are relative to the start of the image.
+ */
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t size;
+
+    std::uint32_t nodeCount;
+    std::uint32_t root;
+    std::uint64_t nodes;
+
+    std::uint32_t childCount;
+    std::uint32_t resourceCount;
+    std::uint64_t children;
+    std::uint64_t resources;
+
+    std::uint32_t lodCount;
+    std::uint32_t flags;
+    std::uint64_t lods;
+
+    std::uint64_t strings;
+    std::uint64_t stringsSize;
+};
+
+struct Node {
+    double center[3];
+    double radius;
+    std::int32_t level;
+    std::uint32_t parent;
+    Range children;
+    Range geometry;
+    Range texture;
+    Range feature;
+    Range lods;
+    String id;
+    String version;
+    String sharedResource;
+};
+
+static_assert(std::is_standard_layout<Header>::value
+              && std::is_standard_layout<Node>::value
+              && std::is_standard_layout<Lod>::value
+              , "Flat tree records must have standard layout.");
+
+} } // namespace detail::flat
+
+namespace flat = detail::flat;
+
+namespace {
+
+const std::size_t Alignment(8);
+
+const double MetersPerDegree(111320.0);
+
+std::uint64_t align(std::uint64_t offset)
+{
+    return (offset + Alignment - 1) & ~std::uint64_t(Alignment - 1);
+}
+
+template <typename T>
+const T* at(const char *data, std::uint64_t offset)
+{
+    return reinterpret_cast<const T*>(data + offset);
+}
+
+void invalid(const char *what)
+{
+    LOGTHROW(err1, std::runtime_error)
+        << "Invalid flat tree image: " << what << ".";
+}
+
+/** Checks that count items of size itemSize at offset fit in the image.
+ */
+void checkArray(std::uint64_t offset, std::uint64_t count
+                , std::uint64_t itemSize, std::uint64_t size
+                , const char *what)
+{
+    if ((offset > size) || (offset % Alignment)
+        || (count > ((size - offset) / itemSize)))
+    {
+        invalid(what);
+    }
+}
+
+void checkRange(const flat::Range &range, std::uint32_t count
+                , const char *what)
+{
+    if ((range.begin > count) || (range.count > (count - range.begin))) {
+        invalid(what);
+    }
+}
+
+void checkString(const flat::String &string, const flat::Header &header)
+{
+    if ((string.offset > header.stringsSize)
+        || (string.size > (header.stringsSize - string.offset)))
+    {
+        invalid("string out of bounds");
+    }
+}
+
+boost::string_ref string(const char *data, const flat::String &s)
+{
+    return boost::string_ref
+        (data + at<flat::Header>(data, 0)->strings + s.offset, s.size);
+}
+
+boost::string_ref resource(const char *data, const flat::Range &range
+                           , std::size_t i)
+{
+    if (i >= range.count) {
+        LOGTHROW(err1, std::out_of_range)
+            << "Resource index " << i << " out of range.";
+    }
+    const auto &h(*at<flat::Header>(data, 0));
+    return string(data, at<flat::String>(data, h.resources)[range.begin + i]);
+}
+
+/** Squared distance of two points in meters. Geographic points are in
+ *  degrees (equirectangular approximation at the first point's latitude).
+ */
+double distance2(const double *a, const double *b, bool geographic)
+{
+    double dx(b[0] - a[0]), dy(b[1] - a[1]);
+    const double dz(b[2] - a[2]);
+    if (geographic) {
+        dx *= MetersPerDegree * std::cos(a[1] * M_PI / 180.0);
+        dy *= MetersPerDegree;
+    }
+    return dx * dx + dy * dy + dz * dz;
+}
+
+bool intersects(const flat::Node &node, const MinimumBoundingSphere &sphere
+                , bool geographic)
+{
+    const double center[3] = { sphere.center(0), sphere.center(1)
+                               , sphere.center(2) };
+    const auto r(node.radius + sphere.r);
+    return distance2(node.center, center, geographic) <= r * r;
+}
+
+bool intersects(const flat::Node &node, const math::Extents3 &extents
+                , bool geographic)
+{
+    double nearest[3];
+    for (int i(0); i < 3; ++i) {
+        nearest[i] = std::min(std::max(node.center[i], extents.ll(i))
+                              , extents.ur(i));
+    }
+    return (distance2(node.center, nearest, geographic)
+            <= node.radius * node.radius);
+}
+
+struct MappedRegion {
+    bi::mapped_region region;
+
+    MappedRegion(bi::mapped_region &&region) : region(std::move(region)) {}
+};
+
+FlatTree mapRegion(bi::mapped_region &&region)
+{
+    auto holder(std::make_shared<MappedRegion>(std::move(region)));
+    return FlatTree(static_cast<const char*>(holder->region.get_address())
+                    , holder->region.get_size(), holder);
+}
+
+} // namespace
+
+FlatTree::FlatTree(const char *data, std::size_t size
+                   , const std::shared_ptr<const void> &holder)
+    : image_(holder, data), data_(data)
+    , header_(at<flat::Header>(data, 0))
+    , nodes_()
+{
+    if (reinterpret_cast<std::uintptr_t>(data) % Alignment) {
+        invalid("misaligned data");
+    }
+    if (size < sizeof(flat::Header)) { invalid("too small"); }
+
+    const auto &h(*header_);
+    if (std::memcmp(h.magic, flat::Magic, sizeof(flat::Magic))) {
+        invalid("bad magic");
+    }
+    if (h.byteOrder != flat::ByteOrderMark) { invalid("foreign byte order"); }
+    if (h.version != flat::Version) { invalid("unsupported version"); }
+    if (h.size > size) { invalid("truncated"); }
+
+    checkArray(h.nodes, h.nodeCount, sizeof(flat::Node), h.size, "nodes");
+    checkArray(h.children, h.childCount, sizeof(std::uint32_t), h.size
+               , "children");
+    checkArray(h.resources, h.resourceCount, sizeof(flat::String), h.size
+               , "resources");
+    checkArray(h.lods, h.lodCount, sizeof(flat::Lod), h.size, "lods");
+    checkArray(h.strings, h.stringsSize, 1, h.size, "strings");
+    if (h.nodeCount && (h.root >= h.nodeCount)) { invalid("root"); }
+
+    nodes_ = at<flat::Node>(data_, h.nodes);
+
+    // validate all references once, accessors do not check
+    const auto *children(at<std::uint32_t>(data_, h.children));
+    for (std::uint32_t i(0); i < h.childCount; ++i) {
+        if (children[i] >= h.nodeCount) { invalid("child index"); }
+    }
+    const auto *resources(at<flat::String>(data_, h.resources));
+    for (std::uint32_t i(0); i < h.resourceCount; ++i) {
+        checkString(resources[i], h);
+    }
+
+    for (std::uint32_t i(0); i < h.nodeCount; ++i) {
+        const auto &node(nodes_[i]);
+        if ((node.parent != flat::None) && (node.parent >= h.nodeCount)) {
+            invalid("parent index");
+        }
+        checkRange(node.children, h.childCount, "children range");
+        checkRange(node.geometry, h.resourceCount, "geometry range");
+        checkRange(node.texture, h.resourceCount, "texture range");
+        checkRange(node.feature, h.resourceCount, "feature range");
+        checkRange(node.lods, h.lodCount, "lod range");
+        checkString(node.id, h);
+        checkString(node.version, h);
+        checkString(node.sharedResource, h);
+    }
+}
+
+std::vector<char> FlatTree::build(const Tree &tree, bool geographic)
+{
+    std::vector<flat::Node> nodes;
+    std::vector<std::uint32_t> children;
+    std::vector<flat::String> resources;
+    std::vector<flat::Lod> lods;
+    std::string strings;
+
+    // nodes are stored in map (i.e. id) order
+    std::map<std::string, std::uint32_t> indices;
+    for (const auto &item : tree.nodes) {
+        indices.insert(std::make_pair(item.first, indices.size()));
+    }
+
+    const auto index([&](const std::string &id) -> std::uint32_t
+    {
+        const auto findices(indices.find(id));
+        return (findices == indices.end()) ? flat::None : findices->second;
+    });
+
+    const auto addString([&](const std::string &s) -> flat::String
+    {
+        flat::String string = { strings.size(), std::uint32_t(s.size()), 0 };
+        strings.append(s);
+        return string;
+    });
+
+    const auto addResources([&](const Resource::list &list) -> flat::Range
+    {
+        flat::Range range = { std::uint32_t(resources.size())
+                              , std::uint32_t(list.size()) };
+        for (const auto &resource : list) {
+            resources.push_back(addString(resource.href));
+        }
+        return range;
+    });
+
+    for (const auto &item : tree.nodes) {
+        const auto &src(item.second.node);
+
+        flat::Node node;
+        std::memset(&node, 0, sizeof(node));
+        for (int i(0); i < 3; ++i) { node.center[i] = src.mbs.center(i); }
+        node.radius = src.mbs.r;
+        node.level = src.level;
+        node.parent = (src.parentNode ? index(src.parentNode->id)
+                       : flat::None);
+
+        node.children.begin = children.size();
+        for (const auto &child : src.children) {
+            const auto ci(index(child.id));
+            if (ci != flat::None) { children.push_back(ci); }
+        }
+        node.children.count = children.size() - node.children.begin;
+
+        node.geometry = addResources(src.geometryData);
+        node.texture = addResources(src.textureData);
+        node.feature = addResources(src.featureData);
+
+        node.lods.begin = lods.size();
+        node.lods.count = src.lodSelection.size();
+        for (const auto &ls : src.lodSelection) {
+            flat::Lod lod;
+            std::memset(&lod, 0, sizeof(lod));
+            lod.metricType = static_cast<std::uint32_t>(ls.metricType);
+            lod.maxValue = ls.maxValue;
+            lod.avgValue = ls.avgValue;
+            lod.minValue = ls.minValue;
+            lod.maxError = ls.maxError;
+            lods.push_back(lod);
+        }
+
+        node.id = addString(src.id);
+        node.version = addString(src.version);
+        node.sharedResource = addString
+            (src.sharedResource ? src.sharedResource->href : std::string());
+
+        nodes.push_back(node);
+    }
+
+    if ((nodes.size() >= flat::None) || (children.size() >= flat::None)
+        || (resources.size() >= flat::None) || (lods.size() >= flat::None))
+    {
+        LOGTHROW(err1, std::runtime_error)
+            << "Tree is too large for flat tree image.";
+    }
+
+    flat::Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, flat::Magic, sizeof(flat::Magic));
+    header.version = flat::Version;
+    header.byteOrder = flat::ByteOrderMark;
+    header.nodeCount = nodes.size();
+    header.root = nodes.empty() ? 0 : index(tree.rootNodeId);
+    if (!nodes.empty() && (header.root == flat::None)) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Root node <" << tree.rootNodeId << "> not found in tree.";
+    }
+    header.childCount = children.size();
+    header.resourceCount = resources.size();
+    header.lodCount = lods.size();
+    header.flags = (geographic ? flat::Geographic : 0);
+    header.stringsSize = strings.size();
+
+    std::uint64_t offset(align(sizeof(header)));
+    header.nodes = offset;
+    offset = align(offset + nodes.size() * sizeof(flat::Node));
+    header.children = offset;
+    offset = align(offset + children.size() * sizeof(std::uint32_t));
+    header.resources = offset;
+    offset = align(offset + resources.size() * sizeof(flat::String));
+    header.lods = offset;
+    offset = align(offset + lods.size() * sizeof(flat::Lod));
+    header.strings = offset;
+    header.size = align(offset + strings.size());
+
+    std::vector<char> image(header.size, 0);
+    const auto copy([&](std::uint64_t offset, const void *data
+                        , std::size_t size)
+    {
+        if (size) { std::memcpy(image.data() + offset, data, size); }
+    });
+
+    copy(0, &header, sizeof(header));
+    copy(header.nodes, nodes.data(), nodes.size() * sizeof(flat::Node));
+    copy(header.children, children.data()
+         , children.size() * sizeof(std::uint32_t));
+    copy(header.resources, resources.data()
+         , resources.size() * sizeof(flat::String));
+    copy(header.lods, lods.data(), lods.size() * sizeof(flat::Lod));
+    copy(header.strings, strings.data(), strings.size());
+
+    return image;
+}
+
+void FlatTree::save(const Tree &tree, const fs::path &path
+                    , bool geographic)
+{
+    const auto image(build(tree, geographic));
+
+    const auto tmp(utility::addExtension(path, ".tmp"));
+    {
+        std::ofstream f;
+        f.exceptions(std::ios::badbit | std::ios::failbit);
+        f.open(tmp.string(), std::ios_base::out | std::ios_base::binary
+               | std::ios_base::trunc);
+        f.write(image.data(), image.size());
+    }
+    fs::rename(tmp, path);
+
+    LOG(info1) << "Saved flat tree (" << tree.nodes.size() << " nodes, "
+               << image.size() << " bytes) to " << path << ".";
+}
+
+FlatTree FlatTree::map(const fs::path &path)
+{
+    try {
+        bi::file_mapping file(path.string().c_str(), bi::read_only);
+        return mapRegion(bi::mapped_region(file, bi::read_only));
+    } catch (const bi::interprocess_exception &e) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Unable to map flat tree " << path << ": " << e.what() << ".";
+    }
+    throw;
+}
+
+boost::optional<FlatTree> FlatTree::load(const Archive &archive)
+{
+    std::error_code ec;
+    auto is(archive.rawistream(detail::constants::FlatTreeName, ec));
+    if (!is) { return boost::none; }
+
+    // vector storage is suitably aligned
+    const auto data(std::make_shared<std::vector<char>>(is->read()));
+    return FlatTree(data->data(), data->size(), data);
+}
+
+void FlatTree::createShared(const std::string &name, const Tree &tree
+                            , bool geographic)
+{
+    const auto image(build(tree, geographic));
+
+    try {
+        bi::shared_memory_object::remove(name.c_str());
+        bi::shared_memory_object shm(bi::create_only, name.c_str()
+                                     , bi::read_write);
+        shm.truncate(image.size());
+        bi::mapped_region region(shm, bi::read_write);
+        std::memcpy(region.get_address(), image.data(), image.size());
+    } catch (const bi::interprocess_exception &e) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Unable to create shared flat tree <" << name << ">: "
+            << e.what() << ".";
+    }
+
+    LOG(info1) << "Created shared flat tree <" << name << "> ("
+               << tree.nodes.size() << " nodes, " << image.size()
+               << " bytes).";
+}
+
+FlatTree FlatTree::openShared(const std::string &name)
+{
+    try {
+        bi::shared_memory_object shm(bi::open_only, name.c_str()
+                                     , bi::read_only);
+        return mapRegion(bi::mapped_region(shm, bi::read_only));
+    } catch (const bi::interprocess_exception &e) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Unable to open shared flat tree <" << name << ">: "
+            << e.what() << ".";
+    }
+    throw;
+}
+
+bool FlatTree::removeShared(const std::string &name)
+{
+    return bi::shared_memory_object::remove(name.c_str());
+}
+
+std::size_t FlatTree::size() const
+{
+    return header_->nodeCount;
+}
+
+bool FlatTree::geographic() const
+{
+    return header_->flags & flat::Geographic;
+}
+
+FlatNode FlatTree::root() const
+{
+    if (!header_->nodeCount) {
+        LOGTHROW(err1, std::runtime_error) << "Flat tree is empty.";
+    }
+    return FlatNode(image_, header_->root);
+}
+
+FlatNode FlatTree::node(std::size_t index) const
+{
+    if (index >= header_->nodeCount) {
+        LOGTHROW(err1, std::out_of_range)
+            << "Flat tree node index " << index << " out of range.";
+    }
+    return FlatNode(image_, index);
+}
+
+boost::optional<FlatNode> FlatTree::find(const std::string &id) const
+{
+    const auto *end(nodes_ + header_->nodeCount);
+    const auto *it(std::lower_bound
+                   (nodes_, end, id, [this](const flat::Node &node
+                                            , const std::string &id)
+    {
+        return string(data_, node.id) < id;
+    }));
+
+    if ((it == end) || (string(data_, it->id) != id)) {
+        return boost::none;
+    }
+    return FlatNode(image_, it - nodes_);
+}
+
+std::vector<FlatNode>
+FlatTree::intersecting(const MinimumBoundingSphere &sphere) const
+{
+    const auto geo(geographic());
+    std::vector<FlatNode> result;
+    for (std::uint32_t i(0); i < header_->nodeCount; ++i) {
+        if (intersects(nodes_[i], sphere, geo)) {
+            result.push_back(FlatNode(image_, i));
+        }
+    }
+    return result;
+}
+
+std::vector<FlatNode>
+FlatTree::intersecting(const math::Extents3 &extents) const
+{
+    const auto geo(geographic());
+    std::vector<FlatNode> result;
+    for (std::uint32_t i(0); i < header_->nodeCount; ++i) {
+        if (intersects(nodes_[i], extents, geo)) {
+            result.push_back(FlatNode(image_, i));
+        }
+    }
+    return result;
+}
+
+std::vector<FlatNode> FlatTree::level(int level) const
+{
+    std::vector<FlatNode> result;
+    for (std::uint32_t i(0); i < header_->nodeCount; ++i) {
+        if (nodes_[i].level == level) {
+            result.push_back(FlatNode(image_, i));
+        }
+    }
+    return result;
+}
+
+FlatNode::FlatNode(const std::shared_ptr<const char> &image
+                   , std::size_t index)
+    : image_(image)
+    , node_(at<flat::Node>(image.get()
+                           , at<flat::Header>(image.get(), 0)->nodes)
+            + index)
+    , index_(index)
+{}
+
+boost::string_ref FlatNode::id() const
+{
+    return string(image_.get(), node_->id);
+}
+
+boost::string_ref FlatNode::version() const
+{
+    return string(image_.get(), node_->version);
+}
+
+int FlatNode::level() const
+{
+    return node_->level;
+}
+
+MinimumBoundingSphere FlatNode::mbs() const
+{
+    MinimumBoundingSphere mbs;
+    mbs.center = math::Point3(node_->center[0], node_->center[1]
+                              , node_->center[2]);
+    mbs.r = node_->radius;
+    return mbs;
+}
+
+boost::optional<FlatNode> FlatNode::parent() const
+{
+    if (node_->parent == flat::None) { return boost::none; }
+    return FlatNode(image_, node_->parent);
+}
+
+std::size_t FlatNode::childCount() const
+{
+    return node_->children.count;
+}
+
+FlatNode FlatNode::child(std::size_t i) const
+{
+    if (i >= node_->children.count) {
+        LOGTHROW(err1, std::out_of_range)
+            << "Child index " << i << " out of range.";
+    }
+    const auto *data(image_.get());
+    const auto *children(at<std::uint32_t>
+                         (data, at<flat::Header>(data, 0)->children));
+    return FlatNode(image_, children[node_->children.begin + i]);
+}
+
+boost::string_ref FlatNode::sharedResource() const
+{
+    return string(image_.get(), node_->sharedResource);
+}
+
+std::size_t FlatNode::geometryCount() const
+{
+    return node_->geometry.count;
+}
+
+boost::string_ref FlatNode::geometry(std::size_t i) const
+{
+    return resource(image_.get(), node_->geometry, i);
+}
+
+std::size_t FlatNode::textureCount() const
+{
+    return node_->texture.count;
+}
+
+boost::string_ref FlatNode::texture(std::size_t i) const
+{
+    return resource(image_.get(), node_->texture, i);
+}
+
+std::size_t FlatNode::featureCount() const
+{
+    return node_->feature.count;
+}
+
+boost::string_ref FlatNode::feature(std::size_t i) const
+{
+    return resource(image_.get(), node_->feature, i);
+}
+
+LodSelection::list FlatNode::lodSelection() const
+{
+    const auto *data(image_.get());
+    const auto *lods(at<flat::Lod>(data, at<flat::Header>(data, 0)->lods)
+                     + node_->lods.begin);
+
+    LodSelection::list list;
+    for (std::uint32_t i(0); i < node_->lods.count; ++i) {
+        const auto &lod(lods[i]);
+        list.emplace_back();
+        auto &ls(list.back());
+        ls.metricType = static_cast<MetricType>(lod.metricType);
+        ls.maxValue = lod.maxValue;
+        ls.avgValue = lod.avgValue;
+        ls.minValue = lod.minValue;
+        ls.maxError = lod.maxError;
+    }
+    return list;
+}
+
+} // namespace slpk
@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef slpk_flattree_hpp_included_
+#define slpk_flattree_hpp_included_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+
+#include <boost/optional.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "math/geometry_core.hpp"
+
+#include "types.hpp"
+
+namespace slpk {
+
+namespace detail { namespace flat {
+    struct Header;
+    struct Node;
+    struct Range;
+} } // namespace detail::flat
+
+class FlatTree;
+class Archive;
+
+/** Node of a flat tree. Lightweight view into the tree image; shares
+ *  ownership of the image with the tree, so it stays valid after the tree
+ *  is moved or destroyed (unless the image is external data, see FlatTree).
+ *  Strings point into the image.
+ */
+class FlatNode {
+public:
+    std::size_t index() const { return index_; }
+
+    boost::string_ref id() const;
+    boost::string_ref version() const;
+    int level() const;
+    MinimumBoundingSphere mbs() const;
+
+    boost::optional<FlatNode> parent() const;
+    std::size_t childCount() const;
+    FlatNode child(std::size_t i) const;
+
+    /** Href of shared resource, empty if node has none.
+     */
+    boost::string_ref sharedResource() const;
+
+    std::size_t geometryCount() const;
+    boost::string_ref geometry(std::size_t i) const;
+    std::size_t textureCount() const;
+    boost::string_ref texture(std::size_t i) const;
+    std::size_t featureCount() const;
+    boost::string_ref feature(std::size_t i) const;
+
+    LodSelection::list lodSelection() const;
+
+    bool hasGeometry() const { return geometryCount(); }
+
+private:
+    friend class FlatTree;
+
+    FlatNode(const std::shared_ptr<const char> &image, std::size_t index);
+
+    std::shared_ptr<const char> image_;
+    const detail::flat::Node *node_;
+    std::size_t index_;
+};
+
+/** Read-only, position independent image of a node tree.
+ *
+ *  All references inside the image are offsets relative to its start, so
+ *  one process can build the image into a file or a shared memory segment
+ *  and any number of other processes can map it at whatever address. Nodes
+ *  are stored sorted by id; lookup is a binary search.
+ *
+ *  The image holds node structure, bounding spheres, LOD selection and
+ *  resource hrefs; full node documents and shared resources are not part
+ *  of it. It also records whether bounding sphere centers are geographic
+ *  (degrees, radius in meters); spatial queries take it into account.
+ */
+class FlatTree {
+public:
+    /** Wraps image held in memory. Data are not copied; holder (if any) is
+     *  kept alive by the tree and its nodes, without holder data must
+     *  outlive both. Data must be 8-byte aligned.
+     */
+    FlatTree(const char *data, std::size_t size
+             , const std::shared_ptr<const void> &holder
+             = std::shared_ptr<const void>());
+
+    /** Builds image of given tree.
+     *
+     * \param geographic bounding sphere centers are in degrees (geographic
+     *                   SRS, see Archive::srs())
+     */
+    static std::vector<char> build(const Tree &tree, bool geographic = false);
+
+    /** Builds image of given tree into a file (written atomically).
+     */
+    static void save(const Tree &tree, const boost::filesystem::path &path
+                     , bool geographic = false);
+
+    /** Maps image stored in a file.
+     */
+    static FlatTree map(const boost::filesystem::path &path);
+
+    /** Loads image stored inside an archive (by slpkrepack, under
+     *  detail::constants::FlatTreeName). Returns none if there is none.
+     */
+    static boost::optional<FlatTree> load(const Archive &archive);
+
+    /** Builds image of given tree into a named shared memory segment;
+     *  existing segment of the same name is replaced.
+     */
+    static void createShared(const std::string &name, const Tree &tree
+                             , bool geographic = false);
+
+    /** Maps image from a named shared memory segment.
+     */
+    static FlatTree openShared(const std::string &name);
+
+    /** Removes named shared memory segment. Already mapped trees stay valid.
+     */
+    static bool removeShared(const std::string &name);
+
+    std::size_t size() const;
+    bool geographic() const;
+    FlatNode root() const;
+    FlatNode node(std::size_t index) const;
+    boost::optional<FlatNode> find(const std::string &id) const;
+
+    /** Nodes whose bounding sphere intersects given sphere (in the same
+     *  SRS as the tree).
+     */
+    std::vector<FlatNode> intersecting(const MinimumBoundingSphere &sphere)
+        const;
+
+    /** Nodes whose bounding sphere intersects given extents.
+     */
+    std::vector<FlatNode> intersecting(const math::Extents3 &extents) const;
+
+    /** Nodes at given level.
+     */
+    std::vector<FlatNode> level(int level) const;
+
+private:
+    /** Image data; aliases holder.
+     */
+    std::shared_ptr<const char> image_;
+    const char *data_;
+    const detail::flat::Header *header_;
+    const detail::flat::Node *nodes_;
+};
+
+} // namespace slpk
+
+#endif // slpk_flattree_hpp_included_
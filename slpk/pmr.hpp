@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef slpk_pmr_hpp_included_
+#define slpk_pmr_hpp_included_
+
+#include <boost/container/pmr/memory_resource.hpp>
+#include <boost/container/pmr/polymorphic_allocator.hpp>
+#include <boost/container/pmr/monotonic_buffer_resource.hpp>
+#include <boost/container/pmr/global_resource.hpp>
+#include <boost/container/pmr/vector.hpp>
+#include <boost/container/pmr/map.hpp>
+#include <boost/container/pmr/string.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include "math/geometry_core.hpp"
+#include "geometry/mesh.hpp"
+
+#include "types.hpp"
+
+namespace slpk { namespace pmr {
+
+/** Polymorphic memory resources (boost.container implementation of
+ *  std::pmr, usable with C++11).
+ */
+using boost::container::pmr::memory_resource;
+using boost::container::pmr::monotonic_buffer_resource;
+using boost::container::pmr::new_delete_resource;
+using boost::container::pmr::get_default_resource;
+
+template <typename T>
+using polymorphic_allocator = boost::container::pmr::polymorphic_allocator<T>;
+
+template <typename T>
+using vector = boost::container::pmr::vector<T>;
+
+template <typename Key, typename T, typename Compare = std::less<Key>>
+using map = boost::container::pmr::map<Key, T, Compare>;
+
+typedef boost::container::pmr::string string;
+
+/** String ordering usable for lookup by any string type (std::string,
+ *  string literal via boost::string_ref) without building a temporary key.
+ */
+struct StringLess {
+    typedef void is_transparent;
+
+    template <typename A, typename B>
+    bool operator()(const A &a, const B &b) const {
+        return ref(a) < ref(b);
+    }
+
+private:
+    template <typename S>
+    static boost::string_ref ref(const S &s) {
+        return boost::string_ref(s.data(), s.size());
+    }
+};
+
+/** Sub mesh with all data allocated from a memory resource. Same content as
+ *  slpk::SubMesh.
+ */
+struct SubMesh {
+    typedef polymorphic_allocator<char> allocator_type;
+
+    vector<math::Point3d> vertices;
+    vector<math::Point2d> tCoords;
+    vector<geometry::Face> faces;
+    vector<math::Extents2> regions;
+
+    explicit SubMesh(const allocator_type &alloc = allocator_type())
+        : vertices(alloc), tCoords(alloc), faces(alloc), regions(alloc)
+    {}
+
+    SubMesh(SubMesh &&o, const allocator_type &alloc)
+        : vertices(std::move(o.vertices), alloc)
+        , tCoords(std::move(o.tCoords), alloc)
+        , faces(std::move(o.faces), alloc)
+        , regions(std::move(o.regions), alloc)
+    {}
+
+    SubMesh(SubMesh&&) = default;
+    SubMesh& operator=(SubMesh&&) = default;
+
+    /** Copies data to a regular (heap allocated) mesh.
+     */
+    geometry::Mesh mesh() const;
+};
+
+/** Mesh with all data allocated from a memory resource. Releasing the
+ *  resource (e.g. monotonic_buffer_resource::release()) frees the whole
+ *  mesh at once; the destructor is then not needed at all.
+ */
+struct Mesh {
+    typedef polymorphic_allocator<char> allocator_type;
+
+    vector<SubMesh> submeshes;
+
+    explicit Mesh(const allocator_type &alloc = allocator_type())
+        : submeshes(alloc)
+    {}
+
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
+
+    allocator_type get_allocator() const {
+        return submeshes.get_allocator();
+    }
+};
+
+} // namespace pmr
+
+/** Containers allocated from a memory resource. Maps take any string type
+ *  for lookup.
+ */
+template <> struct ContainerTraits<pmr::polymorphic_allocator<char>> {
+    typedef pmr::string string;
+
+    template <typename T> using vector = pmr::vector<T>;
+
+    template <typename T> using map = pmr::map<string, T, pmr::StringLess>;
+
+    typedef boost::string_ref key;
+};
+
+namespace pmr {
+
+/** Node tree types with all data allocated from a memory resource. Nodes
+ *  share the store like regular ones; releasing the resource (e.g.
+ *  monotonic_buffer_resource::release()) after the tree is destroyed frees
+ *  all of its memory at once.
+ */
+typedef polymorphic_allocator<char> allocator;
+
+typedef BasicNodeReference<allocator> NodeReference;
+typedef BasicResource<allocator> Resource;
+typedef BasicFeature<allocator> Feature;
+typedef BasicNode<allocator> Node;
+typedef BasicMaterial<allocator> Material;
+typedef BasicSharedResource<allocator> SharedResource;
+typedef BasicTreeNode<allocator> TreeNode;
+typedef BasicTree<allocator> Tree;
+
+// inlines
+
+inline geometry::Mesh SubMesh::mesh() const
+{
+    geometry::Mesh m;
+    m.vertices.assign(vertices.begin(), vertices.end());
+    m.tCoords.assign(tCoords.begin(), tCoords.end());
+    m.faces.assign(faces.begin(), faces.end());
+    return m;
+}
+
+} } // namespace slpk::pmr
+
+#endif // slpk_pmr_hpp_included_
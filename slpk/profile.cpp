@@ -0,0 +1,322 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <chrono>
+#include <thread>
+#include <iterator>
+#include <ostream>
+#include <algorithm>
+
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/openmp.hpp"
+
+#include "jsoncpp/json.hpp"
+#include "jsoncpp/io.hpp"
+
+#include "profile.hpp"
+#include "detail/files.hpp"
+#include "detail/geometry.hpp"
+
+namespace fs = boost::filesystem;
+namespace bio = boost::iostreams;
+
+namespace slpk {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+class CountingLoader
+    : public GeometryLoader
+    , public MeshLoader
+{
+public:
+    CountingLoader(NodeProfile &profile) : profile_(profile) {}
+
+    virtual MeshLoader& next() { return *this; }
+
+    virtual void addVertex(const math::Point3d&) {
+        ++profile_.decodedVertices;
+    }
+    virtual void addTexture(const math::Point2d&) {}
+    virtual void addNormal(const math::Point3d&) {}
+    virtual void addFace(const Face&, const FaceTc&, const Face&) {
+        ++profile_.decodedFaces;
+    }
+    virtual void addTxRegion(const Region&) {
+        ++profile_.regionCount;
+    }
+
+private:
+    NodeProfile &profile_;
+};
+
+std::vector<char> gunzip(const std::vector<char> &raw)
+{
+    bio::filtering_istream fis;
+    bio::zlib_params p;
+    p.window_bits |= 16;
+    fis.push(bio::zlib_decompressor(p));
+    fis.push(bio::array_source(raw.data(), raw.size()));
+
+    return std::vector<char>(std::istreambuf_iterator<char>(fis)
+                             , std::istreambuf_iterator<char>());
+}
+
+void profileGeometry(NodeProfile &profile, const Archive &archive
+                     , const TreeNode &treeNode)
+{
+    const auto &node(treeNode.node);
+    const auto &schema(node.store().defaultGeometrySchema);
+
+    for (const auto &resource : node.geometryData) {
+        const auto realPath(archive.realPath(resource.href + ".bin"));
+        const auto raw(archive.rawistream(realPath)->read());
+        profile.storedBytes += raw.size();
+
+        const auto data((realPath.extension() == detail::constants::ext::gz)
+                        ? gunzip(raw) : raw);
+        profile.uncompressedBytes += data.size();
+
+        if (!schema) { continue; }
+        bio::stream<bio::array_source> in(data.data(), data.size());
+        const auto header(detail::loadHeader(in, *schema));
+        profile.vertexCount += header.vertexCount;
+        profile.faceCount += header.faceCount;
+        profile.featureCount += header.featureCount;
+    }
+
+    CountingLoader loader(profile);
+    const auto start(Clock::now());
+    archive.loadGeometry(loader, node, treeNode.sharedResource);
+    profile.decodeTime = std::chrono::duration<double>
+        (Clock::now() - start).count();
+}
+
+void profileTextures(NodeProfile &profile, const Archive &archive
+                     , const Node &node)
+{
+    if (node.textureData.empty()) { return; }
+
+    for (std::size_t i(0); i < node.geometryData.size(); ++i) {
+        const auto size(archive.textureSize(node, i));
+        if (area(size) > area(profile.textureSize)) {
+            profile.textureSize = size;
+        }
+        profile.textureBytes += archive.texture(node, i)->read().size();
+    }
+}
+
+std::string csvEscape(const std::string &value)
+{
+    if (value.find_first_of(",\"\n") == std::string::npos) { return value; }
+
+    std::string out("\"");
+    for (auto c : value) {
+        if (c == '"') { out.push_back('"'); }
+        out.push_back(c);
+    }
+    out.push_back('"');
+    return out;
+}
+
+Json::Value asJson(const Histogram &h)
+{
+    Json::Value value(Json::objectValue);
+    value["min"] = Json::UInt64(h.min);
+    value["max"] = Json::UInt64(h.max);
+    value["mean"] = h.mean();
+    auto &bins(value["bins"] = Json::arrayValue);
+    for (auto bin : h.bins) { bins.append(Json::UInt64(bin)); }
+    return value;
+}
+
+} // namespace
+
+void Histogram::add(std::uint64_t value)
+{
+    std::size_t bin(0);
+    for (auto v(value >> 1); v; v >>= 1) { ++bin; }
+    if (bins.size() <= bin) { bins.resize(bin + 1); }
+    ++bins[bin];
+
+    if (!count || (value < min)) { min = value; }
+    if (!count || (value > max)) { max = value; }
+    sum += value;
+    ++count;
+}
+
+NodeProfile profileNode(const Archive &archive, const TreeNode &treeNode)
+{
+    const auto &node(treeNode.node);
+
+    NodeProfile profile;
+    profile.id = node.id;
+    profile.level = node.level;
+    profile.geometryCount = node.geometryData.size();
+
+    try {
+        profileGeometry(profile, archive, treeNode);
+        profileTextures(profile, archive, node);
+    } catch (const std::exception &e) {
+        LOG(warn2) << "Cannot profile node <" << node.id << ">: "
+                   << e.what();
+        profile.error = e.what();
+    }
+
+    return profile;
+}
+
+NodeProfile::list profileNodes(const Archive &archive, const Tree &tree
+                               , int threads)
+{
+    std::vector<const TreeNode*> treeNodes;
+    for (const auto &item : tree.nodes) { treeNodes.push_back(&item.second); }
+
+    NodeProfile::list nodes(treeNodes.size());
+
+    if (threads <= 0) { threads = std::thread::hardware_concurrency(); }
+    if (threads <= 0) { threads = 1; }
+
+    UTILITY_OMP(parallel for num_threads(threads) schedule(dynamic)
+                shared(treeNodes, nodes, archive))
+    for (std::size_t i = 0; i < treeNodes.size(); ++i) {
+        nodes[i] = profileNode(archive, *treeNodes[i]);
+    }
+
+    return nodes;
+}
+
+LevelProfile::map summarize(const NodeProfile::list &nodes)
+{
+    LevelProfile::map levels;
+
+    for (const auto &node : nodes) {
+        auto ilevels(levels.find(node.level));
+        if (ilevels == levels.end()) {
+            ilevels = levels.insert
+                (LevelProfile::map::value_type
+                 (node.level, LevelProfile(node.level))).first;
+        }
+        auto &level(ilevels->second);
+
+        ++level.nodeCount;
+        if (!node.error.empty()) {
+            ++level.errorCount;
+            continue;
+        }
+
+        level.vertexCount.add(node.vertexCount);
+        level.regionCount.add(node.regionCount);
+        level.storedBytes.add(node.storedBytes);
+        level.uncompressedBytes.add(node.uncompressedBytes);
+        level.decodeMicroseconds.add(std::uint64_t(node.decodeTime * 1e6));
+        level.texturePixels.add(area(node.textureSize));
+    }
+
+    return levels;
+}
+
+void saveCsv(std::ostream &os, const NodeProfile::list &nodes)
+{
+    os << "id,level,geometryCount,storedBytes,uncompressedBytes"
+        ",vertexCount,faceCount,featureCount,decodedVertices,decodedFaces"
+        ",regionCount,decodeTime,textureWidth,textureHeight,textureBytes"
+        ",error\n";
+
+    for (const auto &node : nodes) {
+        os << csvEscape(node.id)
+           << ',' << node.level
+           << ',' << node.geometryCount
+           << ',' << node.storedBytes
+           << ',' << node.uncompressedBytes
+           << ',' << node.vertexCount
+           << ',' << node.faceCount
+           << ',' << node.featureCount
+           << ',' << node.decodedVertices
+           << ',' << node.decodedFaces
+           << ',' << node.regionCount
+           << ',' << node.decodeTime
+           << ',' << node.textureSize.width
+           << ',' << node.textureSize.height
+           << ',' << node.textureBytes
+           << ',' << csvEscape(node.error)
+           << '\n';
+    }
+}
+
+void saveJson(std::ostream &os, const NodeProfile::list &nodes
+              , const LevelProfile::map &levels)
+{
+    Json::Value report(Json::objectValue);
+
+    auto &jnodes(report["nodes"] = Json::arrayValue);
+    for (const auto &node : nodes) {
+        auto &jnode(jnodes.append(Json::objectValue));
+        jnode["id"] = node.id;
+        jnode["level"] = node.level;
+        jnode["geometryCount"] = Json::UInt64(node.geometryCount);
+        jnode["storedBytes"] = Json::UInt64(node.storedBytes);
+        jnode["uncompressedBytes"] = Json::UInt64(node.uncompressedBytes);
+        jnode["vertexCount"] = Json::UInt64(node.vertexCount);
+        jnode["faceCount"] = Json::UInt64(node.faceCount);
+        jnode["featureCount"] = Json::UInt64(node.featureCount);
+        jnode["decodedVertices"] = Json::UInt64(node.decodedVertices);
+        jnode["decodedFaces"] = Json::UInt64(node.decodedFaces);
+        jnode["regionCount"] = Json::UInt64(node.regionCount);
+        jnode["decodeTime"] = node.decodeTime;
+        auto &ts(jnode["textureSize"] = Json::arrayValue);
+        ts.append(node.textureSize.width);
+        ts.append(node.textureSize.height);
+        jnode["textureBytes"] = Json::UInt64(node.textureBytes);
+        if (!node.error.empty()) { jnode["error"] = node.error; }
+    }
+
+    auto &jlevels(report["levels"] = Json::arrayValue);
+    for (const auto &item : levels) {
+        const auto &level(item.second);
+        auto &jlevel(jlevels.append(Json::objectValue));
+        jlevel["level"] = level.level;
+        jlevel["nodeCount"] = Json::UInt64(level.nodeCount);
+        jlevel["errorCount"] = Json::UInt64(level.errorCount);
+        jlevel["vertexCount"] = asJson(level.vertexCount);
+        jlevel["regionCount"] = asJson(level.regionCount);
+        jlevel["storedBytes"] = asJson(level.storedBytes);
+        jlevel["uncompressedBytes"] = asJson(level.uncompressedBytes);
+        jlevel["decodeMicroseconds"] = asJson(level.decodeMicroseconds);
+        jlevel["texturePixels"] = asJson(level.texturePixels);
+    }
+
+    Json::write(os, report, true);
+}
+
+} // namespace slpk
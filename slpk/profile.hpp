@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef slpk_profile_hpp_included_
+#define slpk_profile_hpp_included_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+#include "math/geometry_core.hpp"
+
+#include "reader.hpp"
+
+/** Per-node decode cost profile of an archive.
+ */
+
+namespace slpk {
+
+struct NodeProfile {
+    std::string id;
+    int level;
+
+    /** Number of geometry resources (submeshes).
+     */
+    std::size_t geometryCount;
+
+    /** Geometry bytes as stored in the archive (i.e. gzipped if resources
+     *  are gzipped).
+     */
+    std::size_t storedBytes;
+
+    /** Geometry bytes after resource decompression.
+     */
+    std::size_t uncompressedBytes;
+
+    /** Counts from geometry headers (summed over all submeshes).
+     */
+    std::size_t vertexCount;
+    std::size_t faceCount;
+    std::size_t featureCount;
+
+    /** Counts reported by the decoder (after vertex deduplication).
+     */
+    std::size_t decodedVertices;
+    std::size_t decodedFaces;
+    std::size_t regionCount;
+
+    /** Wall time of loadGeometry in seconds (including I/O and inflate).
+     */
+    double decodeTime;
+
+    /** Size of largest texture and total stored texture bytes.
+     */
+    math::Size2 textureSize;
+    std::size_t textureBytes;
+
+    /** Error message when node cannot be profiled, empty otherwise.
+     */
+    std::string error;
+
+    NodeProfile()
+        : level(), geometryCount(), storedBytes(), uncompressedBytes()
+        , vertexCount(), faceCount(), featureCount()
+        , decodedVertices(), decodedFaces(), regionCount()
+        , decodeTime(), textureBytes()
+    {}
+
+    typedef std::vector<NodeProfile> list;
+};
+
+/** Histogram with power of two bins: bin 0 holds values 0 and 1, bin i
+ *  holds values in [2^i, 2^(i + 1)).
+ */
+struct Histogram {
+    std::vector<std::size_t> bins;
+    std::uint64_t min;
+    std::uint64_t max;
+    double sum;
+    std::size_t count;
+
+    Histogram() : min(), max(), sum(), count() {}
+
+    void add(std::uint64_t value);
+
+    double mean() const { return count ? (sum / count) : 0.0; }
+};
+
+/** Summary of one LOD level.
+ */
+struct LevelProfile {
+    int level;
+    std::size_t nodeCount;
+    std::size_t errorCount;
+
+    Histogram vertexCount;
+    Histogram regionCount;
+    Histogram storedBytes;
+    Histogram uncompressedBytes;
+    Histogram decodeMicroseconds;
+    Histogram texturePixels;
+
+    LevelProfile(int level = 0) : level(level), nodeCount(), errorCount() {}
+
+    typedef std::map<int, LevelProfile> map;
+};
+
+/** Profiles single node. Errors are reported in NodeProfile::error.
+ */
+NodeProfile profileNode(const Archive &archive, const TreeNode &treeNode);
+
+/** Profiles all nodes of given tree in parallel. Output is in tree (node
+ *  id) order.
+ *
+ * \param threads number of threads, 0 means number of CPUs
+ */
+NodeProfile::list profileNodes(const Archive &archive, const Tree &tree
+                               , int threads = 0);
+
+/** Builds per-level summaries.
+ */
+LevelProfile::map summarize(const NodeProfile::list &nodes);
+
+/** Writes one CSV line per node (with header line).
+ */
+void saveCsv(std::ostream &os, const NodeProfile::list &nodes);
+
+/** Writes nodes and level summaries as JSON.
+ */
+void saveJson(std::ostream &os, const NodeProfile::list &nodes
+              , const LevelProfile::map &levels);
+
+} // namespace slpk
+
+#endif // slpk_profile_hpp_included_
@@ -28,10 +28,16 @@
 
 #include <map>
 #include <queue>
+#include <deque>
 #include <string>
 #include <tuple>
 #include <fstream>
 #include <algorithm>
+#include <thread>
+#include <exception>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include <boost/utility/in_place_factory.hpp>
 #include <boost/filesystem.hpp>
@@ -39,6 +45,8 @@
 #include <boost/iostreams/filter/zlib.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/array.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
 
@@ -49,6 +57,7 @@
 #include "utility/path.hpp"
 #include "utility/uri.hpp"
 #include "utility/binaryio.hpp"
+#include "utility/openmp.hpp"
 
 #include "imgproc/readimage.hpp"
 
@@ -59,6 +68,16 @@
 #include "reader.hpp"
 #include "restapi.hpp"
 #include "detail/files.hpp"
+#include "detail/geometry.hpp"
+#include "detail/zip.hpp"
+#include "detail/entryreader.hpp"
+#include "detail/source.hpp"
+#include "detail/decode.hpp"
+#include "detail/paa.hpp"
+#include "detail/document.hpp"
+#include "stats.hpp"
+#include "srs.hpp"
+#include "trace.hpp"
 
 namespace fs = boost::filesystem;
 namespace ba = boost::algorithm;
@@ -148,12 +167,19 @@ void makeDirInplace(std::string &path)
     }
 }
 
+Json::Value parseJson(std::istream &in, const fs::path &path
+                      , const char *what)
+{
+    trace::Span span("json.parse", "reader");
+    return Json::read(in, path, what);
+}
+
 Metadata loadMetadata(std::istream &in, const fs::path &path)
 {
     LOG(info1) << "Loading SLPK metadata from " << path  << ".";
 
     // load json
-    const auto value(Json::read(in, path, "SLPK metadata"));
+    const auto value(parseJson(in, path, "SLPK metadata"));
 
     Metadata metadata;
     try {
@@ -443,7 +469,7 @@ loadSceneLayerInfo(std::istream &in, const fs::path &path)
     LOG(info1) << "Loading SLPK 3d scene layer info from " << path  << ".";
 
 
-    const auto value(Json::read(in, path, "SLPK 3d scene layer info"));
+    const auto value(parseJson(in, path, "SLPK 3d scene layer info"));
 
     std::pair<SceneLayerInfo, boost::any> out;
     out.second = value;
@@ -498,27 +524,64 @@ void parse(MinimumBoundingSphere &mbs, const Json::Value &value
     Json::get(mbs.r, value, 3, name);
 }
 
-void parse(NodeReference &nr, const Json::Value &value, const std::string &dir)
+/** Json::get/getOpt counterparts for all string types of the node tree
+ *  types (see ContainerTraits).
+ */
+void getString(std::string &s, const Json::Value &value, const char *name)
+{
+    Json::get(s, value, name);
+}
+
+void getString(pmr::string &s, const Json::Value &value, const char *name)
+{
+    s = Json::check(value[name], Json::stringValue, name).asCString();
+}
+
+void getStringOpt(std::string &s, const Json::Value &value, const char *name)
+{
+    Json::getOpt(s, value, name);
+}
+
+void getStringOpt(pmr::string &s, const Json::Value &value
+                  , const char *name)
+{
+    if (value.isMember(name)) { getString(s, value, name); }
+}
+
+void assign(std::string &s, std::string &&value) { s = std::move(value); }
+
+void assign(pmr::string &s, const std::string &value)
+{
+    s.assign(value.data(), value.size());
+}
+
+template <typename Allocator>
+void parse(BasicNodeReference<Allocator> &nr, const Json::Value &value
+           , const std::string &dir)
 {
-    Json::get(nr.id, value, "id");
+    getString(nr.id, value, "id");
     parse(nr.mbs, value["mbs"], "mbs");
-    Json::get(nr.href, value, "href");
-    nr.href = joinPaths(dir, makeDir(nr.href));
+    std::string href;
+    Json::get(href, value, "href");
+    assign(nr.href, joinPaths(dir, makeDir(href)));
     // version
     // featureCount
 }
 
-void parse(boost::optional<NodeReference> &nr, const Json::Value &value
-           , const std::string &dir)
+template <typename Allocator>
+void parse(boost::optional<BasicNodeReference<Allocator>> &nr
+           , const Json::Value &value, const std::string &dir
+           , const Allocator &alloc)
 {
     if (value.isNull()) { return; }
 
-    nr = boost::in_place();
+    nr = boost::in_place(alloc);
     parse(*nr, value, dir);
 }
 
-void parse(NodeReference::list &nrl, const Json::Value &value
-           , const std::string &dir)
+template <typename List>
+void parseReferences(List &nrl, const Json::Value &value
+                     , const std::string &dir)
 {
     if (value.isNull()) { return; }
 
@@ -528,14 +591,18 @@ void parse(NodeReference::list &nrl, const Json::Value &value
     }
 }
 
-void parse(Resource &r, const Json::Value &value, const std::string &dir
+template <typename Allocator>
+void parse(BasicResource<Allocator> &r, const Json::Value &value
+           , const std::string &dir
            , const Encoding *encoding = nullptr
            , bool isDir = false)
 {
-    Json::get(r.href, value, "href");
+    std::string href;
+    Json::get(href, value, "href");
 
-    r.href = joinPaths(dir, r.href);
-    if (isDir) { makeDirInplace(r.href); }
+    href = joinPaths(dir, href);
+    if (isDir) { makeDirInplace(href); }
+    assign(r.href, std::move(href));
 
     if (encoding) { r.encoding = encoding; }
 
@@ -546,20 +613,23 @@ void parse(Resource &r, const Json::Value &value, const std::string &dir
     Json::getOpt(r.faceElements, value, "faceElements");
 }
 
-void parse(boost::optional<Resource> &r, const Json::Value &value
-           , const std::string &dir, const Encoding *encoding = nullptr
+template <typename Allocator>
+void parse(boost::optional<BasicResource<Allocator>> &r
+           , const Json::Value &value, const std::string &dir
+           , const Allocator &alloc, const Encoding *encoding = nullptr
            , bool isDir = false)
 {
     if (value.isNull()) { return; }
 
-    r = boost::in_place();
+    r = boost::in_place(alloc);
     parse(*r, value, dir, encoding, isDir);
 }
 
-void parse(Resource::list &rl, const Json::Value &value
-           , const std::string &dir
-           , const Encoding::list &encodings
-           , bool isDir = false)
+template <typename List>
+void parseResources(List &rl, const Json::Value &value
+                    , const std::string &dir
+                    , const Encoding::list &encodings
+                    , bool isDir = false)
 {
     if (value.isNull()) { return; }
 
@@ -584,9 +654,10 @@ void parse(Resource::list &rl, const Json::Value &value
     }
 }
 
-void parse(Resource::list &rl, const Json::Value &value
-           , const std::string &dir
-           , const Encoding &encoding, bool isDir = false)
+template <typename List>
+void parseResources(List &rl, const Json::Value &value
+                    , const std::string &dir
+                    , const Encoding &encoding, bool isDir = false)
 {
     for (const auto &item : value) {
         rl.emplace_back();
@@ -594,57 +665,68 @@ void parse(Resource::list &rl, const Json::Value &value
     }
 }
 
-Node loadNodeIndex(std::istream &in, const fs::path &path
-                   , const std::string &dir, const Store::pointer &store)
+/** Parses node index document straight into node allocated by given
+ *  allocator.
+ */
+template <typename Allocator>
+BasicNode<Allocator>
+loadNodeIndex(std::istream &in, const fs::path &path, const std::string &dir
+              , const Store::pointer &store, const Allocator &alloc)
 {
     LOG(info1) << "Loading SLPK 3d node index document from " << path  << ".";
-    const auto value(Json::read(in, path, "SLPK 3d Node Index Document"));
+    const auto value(parseJson(in, path, "SLPK 3d Node Index Document"));
 
-    Node ni(store);
-    Json::get(ni.id, value, "id");
+    BasicNode<Allocator> ni(store, alloc);
+    getString(ni.id, value, "id");
     Json::get(ni.level, value, "level");
-    Json::getOpt(ni.version, value, "version");
+    getStringOpt(ni.version, value, "version");
 
     parse(ni.mbs, value["mbs"], "mbs");
 
     parse(ni.parentNode, Json::check(Json::Null
                                      , value["parentNode"], Json::objectValue
                                      , "parentNode")
-          , dir);
+          , dir, alloc);
 
-    parse(ni.children
-          , Json::check(Json::Null, value["children"]
-                        , Json::arrayValue, "children")
-          , dir);
+    parseReferences(ni.children
+                    , Json::check(Json::Null, value["children"]
+                                  , Json::arrayValue, "children")
+                    , dir);
 
-    parse(ni.neighbors
-          , Json::check(Json::Null, value["neighbors"]
-                        , Json::arrayValue, "neighbors")
-          , dir);
+    parseReferences(ni.neighbors
+                    , Json::check(Json::Null, value["neighbors"]
+                                  , Json::arrayValue, "neighbors")
+                    , dir);
 
     parse(ni.sharedResource
           , Json::check(Json::Null, value["sharedResource"]
                         , Json::objectValue, "sharedResource")
-          , dir, nullptr, true);
+          , dir, alloc, nullptr, true);
 
-    parse(ni.featureData
-          , Json::check(Json::Null, value["featureData"]
-                        , Json::arrayValue, "featureData")
-          , dir, store->featureEncoding);
+    parseResources(ni.featureData
+                   , Json::check(Json::Null, value["featureData"]
+                                 , Json::arrayValue, "featureData")
+                   , dir, store->featureEncoding);
 
-    parse(ni.geometryData
-          , Json::check(Json::Null, value["geometryData"]
-                        , Json::arrayValue, "geometryData")
-          , dir, store->geometryEncoding);
+    parseResources(ni.geometryData
+                   , Json::check(Json::Null, value["geometryData"]
+                                 , Json::arrayValue, "geometryData")
+                   , dir, store->geometryEncoding);
 
-    parse(ni.textureData
-          , Json::check(Json::Null, value["textureData"]
-                        , Json::arrayValue, "textureData")
-          , dir, store->textureEncoding);
+    parseResources(ni.textureData
+                   , Json::check(Json::Null, value["textureData"]
+                                 , Json::arrayValue, "textureData")
+                   , dir, store->textureEncoding);
 
     return ni;
 }
 
+Node loadNodeIndex(std::istream &in, const fs::path &path
+                   , const std::string &dir, const Store::pointer &store)
+{
+    return loadNodeIndex(in, path, dir, store, Node::allocator_type());
+}
+
 Node loadNodeIndex(const roarchive::IStream::pointer &istream
                    , const std::string &dir, const Store::pointer &store)
 {
@@ -658,9 +740,10 @@ void parse(Material::Params &params, const Json::Value &value)
     Json::getOpt(params.vertexColors, value, "vertexColors");
 }
 
-void parse(Material &material, const Json::Value &value)
+template <typename Allocator>
+void parse(BasicMaterial<Allocator> &material, const Json::Value &value)
 {
-    Json::get(material.name, value, "name");
+    getString(material.name, value, "name");
     Json::getOpt(material.type, value, "type");
 
     if (value.isMember("params")) {
@@ -668,7 +751,8 @@ void parse(Material &material, const Json::Value &value)
     }
 }
 
-void parse(Material::list &materials, const Json::Value &value)
+template <typename List>
+void parseMaterials(List &materials, const Json::Value &value)
 {
     for (const auto &name : value.getMemberNames()) {
         materials.emplace_back(name);
@@ -676,82 +760,62 @@ void parse(Material::list &materials, const Json::Value &value)
     }
 }
 
-SharedResource loadSharedResource(std::istream &in, const fs::path &path)
+/** Parses shared resource document straight into shared resource
+ *  allocated by given allocator.
+ */
+template <typename Allocator>
+BasicSharedResource<Allocator>
+loadSharedResource(std::istream &in, const fs::path &path
+                   , const Allocator &alloc)
 {
     LOG(info1) << "Loading SLPK Shared Rsource from " << path  << ".";
-    const auto value(Json::read(in, path, "SLPK Shared Resource"));
+    const auto value(parseJson(in, path, "SLPK Shared Resource"));
 
-    SharedResource sr;
+    BasicSharedResource<Allocator> sr(alloc);
 
-    parse(sr.materialDefinitions
-          , Json::check(Json::Null, value["materialDefinitions"]
-                        , Json::objectValue, "materialDefinitions"));
+    parseMaterials(sr.materialDefinitions
+                   , Json::check(Json::Null, value["materialDefinitions"]
+                                 , Json::objectValue
+                                 , "materialDefinitions"));
 
     return sr;
 }
 
+SharedResource loadSharedResource(std::istream &in, const fs::path &path)
+{
+    return loadSharedResource(in, path, SharedResource::allocator_type());
+}
+
 SharedResource loadSharedResource(const roarchive::IStream::pointer &istream)
 {
     return loadSharedResource(istream->get(), istream->path());
 }
 
-template <bool normalize> struct Normalize {};
-
-template <>
-struct Normalize<true> {
-    template <typename DstT, typename SrcT>
-    static DstT apply(SrcT value) {
-        return DstT(value) / std::numeric_limits<SrcT>::max();
-    }
-};
+using detail::read;
+using detail::byteCount;
 
-template <>
-struct Normalize<false> {
-    template <typename DstT, typename SrcT>
-    static DstT apply(SrcT value) {
-        return DstT(value);
-    }
-};
+} // namespace
 
-template <typename T, bool normalize = false>
-void read(std::istream &in, DataType type, T &out)
+Node detail::loadNodeIndex(std::istream &in, const fs::path &path
+                           , const std::string &dir
+                           , const Store::pointer &store)
 {
-#define READ_DATATYPE(ENUM, TYPE)                                           \
-    case DataType::ENUM:                                                    \
-        out = Normalize<normalize>::template apply<T>(bin::read<TYPE>(in)); \
-        return
-
-    switch (type) {
-        READ_DATATYPE(uint8, std::uint8_t);
-        READ_DATATYPE(uint16, std::uint16_t);
-        READ_DATATYPE(uint32, std::uint32_t);
-        READ_DATATYPE(uint64, std::uint64_t);
-
-        READ_DATATYPE(int8, std::int8_t);
-        READ_DATATYPE(int16, std::int16_t);
-        READ_DATATYPE(int32, std::int32_t);
-        READ_DATATYPE(int64, std::int64_t);
-
-        READ_DATATYPE(float32, float);
-        READ_DATATYPE(float64, double);
-    }
-#undef READ_DATATYPE
+    return slpk::loadNodeIndex(in, path, dir, store);
+}
 
-    LOGTHROW(err1, std::logic_error)
-        << "Invalid datatype (int code="
-        << static_cast<int>(type) << ").";
-    throw;
+SharedResource detail::loadSharedResource(std::istream &in
+                                          , const fs::path &path)
+{
+    return slpk::loadSharedResource(in, path);
 }
 
-template <typename T, bool normalize = false>
-T read(std::istream &in, DataType type)
+std::pair<SceneLayerInfo, boost::any>
+detail::loadSceneLayerInfo(std::istream &in, const fs::path &path)
 {
-    T out;
-    read<T, normalize>(in, type, out);
-    return out;
+    return slpk::loadSceneLayerInfo(in, path);
 }
 
-std::size_t byteCount(const DataType &type)
+std::size_t detail::byteCount(DataType type)
 {
 #define MEASURE_DATATYPE(ENUM, TYPE)            \
     case DataType::ENUM: return sizeof(TYPE)
@@ -776,20 +840,8 @@ std::size_t byteCount(const DataType &type)
     throw;
 }
 
-std::size_t byteCount(const GeometryAttribute &ga)
-{
-    return ga.valuesPerElement * byteCount(ga.valueType);
-}
-
-struct Header {
-    std::size_t vertexCount;
-    std::size_t faceCount;
-    std::size_t featureCount;
-
-    Header() : vertexCount(), faceCount(), featureCount() {}
-};
-
-Header loadHeader(std::istream &in, const HeaderAttribute::list &has)
+detail::Header detail::loadHeader(std::istream &in
+                                  , const HeaderAttribute::list &has)
 {
     Header h;
 
@@ -808,366 +860,38 @@ Header loadHeader(std::istream &in, const HeaderAttribute::list &has)
     return h;
 }
 
-struct MeshFeatures {
-    bool hasRegions = false;
-    bool hasColor = false;
-};
-
-namespace paa {
-
-struct CompareRegion {
-    bool operator()(const Region &r1, const Region &r2) {
-        if (r1.ll < r2.ll) { return true; }
-        if (r2.ll < r1.ll) { return false; }
-        return r1.ur < r2.ur;
-    }
-};
-
-template <typename AddValueType, typename T>
-void callAddValue(MeshLoader &loader, const AddValueType &addValue
-                  , const T &value)
-{
-    (loader.*addValue)(value);
-}
-
-template <typename AddValueType, typename T1, typename T2>
-void callAddValue(MeshLoader &loader, const AddValueType &addValue
-                  , const std::tuple<T1, T2> &value)
+detail::Header detail::loadHeader(std::istream &in
+                                  , const GeometrySchema &schema)
 {
-    (loader.*addValue)(std::get<0>(value));
-}
-
-class Fuser {
-public:
-    Fuser(std::istream &in, MeshLoader &loader, const Node &node
-          , const Header &header, const MeshFeatures &features)
-        : in_(in), loader_(loader), node_(node)
-        , header_(header), features_(features)
-        , verticesLoaded_(false)
-        , faces_(header.vertexCount / 3)
-        , facesNormal_(header.vertexCount / 3)
-        , facesTc_(header.vertexCount / 3)
-    {
-        if (header.vertexCount % 3) {
-            LOGTHROW(err1, std::runtime_error)
-                << "Invalid number of vertices in PerAttributeArray layout: "
-                "number of vertices (" << header.vertexCount
-                << ") not divisible by 3.";
-        }
-    }
-
-    virtual ~Fuser() {}
-
-    void operator()(const GeometrySchema &schema) {
-        for (const auto &ga : schema.vertexAttributes) {
-            if (ga.key == "position") {
-                loadFaces(ga);
-                verticesLoaded_ = true;
-            } else if (ga.key == "uv0") {
-                loadTcFaces(ga);
-            } else if (ga.key == "normal") {
-                loadNormals(ga);
-                //ignore(ga);
-            } else if (ga.key == "region") {
-                loadTxRegions(ga);
-            } else {
-                ignore(ga);
-            }
-        }
-
-        if (!verticesLoaded_) {
-            LOGTHROW(err1, std::runtime_error)
-                << "No vertex coordinates defined.";
-        }
-
-#if 0
-        // do we need features?
-        for (const auto &fa : schema.featureAttributes) {
-            if (fa.key == "id") {
-                for (std::size_t i(0); i < header_.featureCount; ++i) {
-                    LOG(info4)
-                        << "id: " << read<std::size_t>(in_, fa.valueType);
-                }
-            } else if (fa.key == "faceRange") {
-                for (std::size_t i(0); i < header_.featureCount; ++i) {
-                    auto rmin(read<std::size_t>(in_, fa.valueType));
-                    auto rmax(read<std::size_t>(in_, fa.valueType));
-                    LOG(info4)
-                        << "range: " << rmin << ", " << rmax;
-                }
-            } else {
-                ignore(fa);
-            }
-        }
-#endif
-
-        // finalize lod
-        finalize();
-
-        // feed loader with faces
-        auto ifacesTc(facesTc_.begin());
-        auto ifacesNormal(facesNormal_.begin());
-        for (const auto &face : faces_) {
-            loader_.addFace(face, *ifacesTc++, *ifacesNormal++);
-        }
-    }
+    auto h(loadHeader(in, schema.header));
 
-protected:
-    /** Adds new value to an index. Returns position of exiting entry if value
-     *  was already added. Otherwise inserts new entery and returns its
-     *  position in the index.
-     *
-     *  Position is computed from size of index or via provided counter.
-     */
-    template <typename Index, typename AddValueType, typename T>
-    int add(Index &index, const AddValueType &addValue
-            , const T &value, std::size_t *counter = nullptr)
+    // I3S 1.x headers usually lack faceCount; every 3 vertices of
+    // a non-indexed triangle mesh make a face
+    if (!h.faceCount && (schema.geometryType == GeometryType::triangles)
+        && (schema.topology != Topology::indexed))
     {
-        auto findex(index.find(value));
-        if (findex != index.end()) { return findex->second; }
-        const auto i(counter ? (*counter)++ : index.size());
-        index.insert(typename Index::value_type(value, i));
-        callAddValue(loader_, addValue, value);
-        return i;
-    }
-
-    int vertex(const GeometryAttribute &ga) {
-        math::Point3d point;
-        read(in_, ga.valueType, point(0)); point(0) += node_.mbs.center(0);
-        read(in_, ga.valueType, point(1)); point(1) += node_.mbs.center(1);
-        read(in_, ga.valueType, point(2)); point(2) += node_.mbs.center(2);
-        return add(vertices_, &MeshLoader::addVertex, point);
-    }
-
-    int normal(const GeometryAttribute &ga) {
-        math::Point3d point;
-        read(in_, ga.valueType, point(0));
-        read(in_, ga.valueType, point(1));
-        read(in_, ga.valueType, point(2));
-        return add(normals_, &MeshLoader::addNormal, point);
-    }
-
-    void loadFaces(const GeometryAttribute &ga) {
-        if (ga.valuesPerElement != 3) {
-            LOGTHROW(err1, std::runtime_error)
-                << "Number of vertex elements must be 3, not "
-                << ga.valuesPerElement << ".";
-        }
-
-        LOG(debug) << "Loading data for vertices.";
-        for (auto &face : faces_) {
-            face(0) = vertex(ga);
-            face(1) = vertex(ga);
-            face(2) = vertex(ga);
-        }
-    }
-
-    void loadNormals(const GeometryAttribute &ga) {
-        if (ga.valuesPerElement != 3) {
-            LOGTHROW(err1, std::runtime_error)
-                << "Number of normal elements must be 3, not "
-                << ga.valuesPerElement << ".";
-        }
-
-        LOG(debug) << "Loading data for normals.";
-        for (auto &face : facesNormal_) {
-            face(0) = normal(ga);
-            face(1) = normal(ga);
-            face(2) = normal(ga);
-        }
-    }
-
-    virtual void loadTcFaces(const GeometryAttribute &ga) = 0;
-    virtual void loadTxRegions(const GeometryAttribute &ga) { ignore(ga); }
-    virtual void finalize() = 0;
-
-    void ignore(const GeometryAttribute &ga) {
-        LOG(debug)
-            << "Ignoring data for unsupported vertex attribute <"
-            << ga.key << "> (" << (header_.vertexCount * byteCount(ga))
-            << " bytes).";
-        in_.ignore(header_.vertexCount * byteCount(ga));
-    }
-
-    std::istream &in_;
-    MeshLoader &loader_;
-    const Node &node_;
-    const Header &header_;
-    const MeshFeatures &features_;
-    bool verticesLoaded_;
-
-    typedef std::map<math::Point3d, int> VertexMap;
-    typedef std::map<math::Point2d, int> TextureMap;
-    typedef std::vector<TextureMap> TextureMaps;
-    typedef std::map<Region, int, CompareRegion> RegionMap;
-
-    Faces faces_;
-    Faces facesNormal_;
-    FacesTc facesTc_;
-    VertexMap vertices_;
-    VertexMap normals_;
-};
-
-class SimpleFuser : public Fuser {
-public:
-    SimpleFuser(std::istream &in, MeshLoader &loader, const Node &node
-                , const Header &header, const MeshFeatures &features)
-        : Fuser(in, loader, node, header, features)
-    {}
-
-private:
-    void loadTcFaces(const GeometryAttribute &ga) {
-        if (ga.valuesPerElement != 2) {
-            LOGTHROW(err1, std::runtime_error)
-                << "Number of UV elements must be 2, not "
-                << ga.valuesPerElement << ".";
-        }
-
-        LOG(debug) << "Loading data for texture coordinates.";
-        for (auto &face : facesTc_) {
-            face(0) = tc(ga);
-            face(1) = tc(ga);
-            face(2) = tc(ga);
-        }
+        h.faceCount = h.vertexCount / 3;
     }
 
-    void finalize() {}
-
-    int tc(const GeometryAttribute &ga)  {
-        math::Point2d point;
-        read(in_, ga.valueType, point(0));
-        read(in_, ga.valueType, point(1));
-
-        // flip Y coord
-        point(1) = 1.0 - point(1);
-        return add(tc_, &MeshLoader::addTexture, point);
-    }
-
-    TextureMap tc_;
-};
-
-class RegionFuser : public Fuser {
-public:
-    RegionFuser(std::istream &in, MeshLoader &loader, const Node &node
-                , const Header &header, const MeshFeatures &features)
-        : Fuser(in, loader, node, header, features)
-        , regions_(header.vertexCount)
-    {}
-
-private:
-    void loadTcFaces(const GeometryAttribute &ga) {
-        if (ga.valuesPerElement != 2) {
-            LOGTHROW(err1, std::runtime_error)
-                << "Number of UV elements must be 2, not "
-                << ga.valuesPerElement << ".";
-        }
-
-        LOG(debug) << "Loading data for texture coordinates.";
-        for (auto &face : facesTc_) {
-            face(0) = tc(ga);
-            face(1) = tc(ga);
-            face(2) = tc(ga);
-        }
-    }
-
-    int tc(const GeometryAttribute &ga)  {
-        const auto index(tc_.size());
-        tc_.emplace_back();
-        auto &point(tc_.back());
-
-        read(in_, ga.valueType, point(0));
-        read(in_, ga.valueType, point(1));
-        // flip Y coord
-        point(1) = 1.0 - point(1);
-
-        return index;
-    }
-
-    void loadTxRegions(const GeometryAttribute &ga) {
-        if (ga.valuesPerElement != 4) {
-            LOGTHROW(err1, std::runtime_error)
-                << "Number of region elements must be 4, not "
-                << ga.valuesPerElement << ".";
-        }
-
-        LOG(debug) << "Loading data for texture regions.";
-        for (auto &regionIndex : regions_) {
-            Region region;
-            region.ll(0) = read<double, true>(in_, ga.valueType);
-            region.ll(1) = read<double, true>(in_, ga.valueType);
-            region.ur(0) = read<double, true>(in_, ga.valueType);
-            region.ur(1) = read<double, true>(in_, ga.valueType);
-
-            regionIndex = add(regionMap_, &MeshLoader::addTxRegion, region);
-        }
-#if 0
-        for (const auto &item : regionMap_) {
-            LOG(info4) << item.first << " -> " << item.second;
-        }
-#endif
-    }
-
-    void finalize() {
-        // generate texture coordinates
-
-        // multiple texturing maps, one per region
-        TextureMaps tcMaps(regionMap_.size());
-
-        auto itc(tc_.begin());
-        auto iregions(regions_.begin());
-        std::size_t counter(0);
-        for (auto &face : facesTc_) {
-            const auto &region(*iregions++);
-            const auto &region2(*iregions++);
-            const auto &region3(*iregions++);
-
-            auto &tcMap(tcMaps[region]);
-            face.region = region;
-            face(0) = add(tcMap, &MeshLoader::addTexture, *itc++, &counter);
-            face(1) = add(tcMap, &MeshLoader::addTexture, *itc++, &counter);
-            face(2) = add(tcMap, &MeshLoader::addTexture, *itc++, &counter);
-
-            if ((region != region2) || (region2 != region3)
-                || (region3 != region))
-            {
-                LOG(warn1)
-                    << "Face (" << face(0) << ", " << face(1)
-                    << ", " << face(2) << ") references texture coordinates "
-                    << "inside different texture subregions ("
-                    << region << ", " << region2 << ", " << region3 << ").";
-            }
-        }
-    }
-
-    math::Points2d tc_;
-    RegionMap regionMap_;
-    std::vector<int> regions_;
-};
+    return h;
+}
 
-void load(MeshLoader &loader, std::istream &in
-          , const Node &node, const Header &header
-          , const MeshFeatures &features
-          , const GeometrySchema &schema)
-{
-    // empty mesh?
-    if (!header.vertexCount) { return; }
+namespace {
 
-    if (features.hasRegions && has(schema.vertexAttributes, "reions")) {
-        // we need to take UV (sub) regions into account
-        RegionFuser(in, loader, node, header, features)(schema);
-    } else {
-        // good old textured mesh
-        SimpleFuser(in, loader, node, header, features)(schema);
-    }
-}
+using detail::Header;
+using detail::loadHeader;
 
-} // namespace paa
+using detail::MeshFeatures;
+namespace paa = detail::paa;
 
-void loadMesh(MeshLoader &loader, const Node &node
+template <typename Allocator>
+void loadMesh(MeshLoader &loader, const BasicNode<Allocator> &node
               , const MeshFeatures &features
-              , const Resource &
-              , std::istream &in, const fs::path &path)
+              , const BasicResource<Allocator> &
+              , std::istream &in, const fs::path &path
+              , detail::decode::Scratch &scratch)
 {
+    trace::Span span("geometry.decode", "reader");
     LOG(info1) << "Loading geometry from " << path  << ".";
 
     const auto &store(node.store());
@@ -1190,7 +914,8 @@ void loadMesh(MeshLoader &loader, const Node &node
 
     switch (schema.topology) {
     case Topology::perAttributeArray:
-        paa::load(loader, in, node, header, features, schema);
+        paa::load(loader, in, node.mbs.center, header, features, schema
+                  , scratch);
         break;
 
     case Topology::interleavedArray:
@@ -1207,13 +932,33 @@ void loadMesh(MeshLoader &loader, const Node &node
     }
 }
 
-void loadMesh(MeshLoader &loader, const Node &node
+template <typename Allocator>
+void loadMesh(MeshLoader &loader, const BasicNode<Allocator> &node
               , const MeshFeatures &features
-              , const Resource &resource
-              , const roarchive::IStream::pointer &istream)
+              , const BasicResource<Allocator> &resource
+              , const roarchive::IStream::pointer &istream
+              , detail::decode::Scratch &scratch)
 {
     loadMesh(loader, node, features, resource
-             , istream->get(), istream->path());
+             , istream->get(), istream->path(), scratch);
+}
+
+template <typename Allocator>
+MeshFeatures
+meshFeatures(const boost::optional<BasicSharedResource<Allocator>>
+             &sharedResource)
+{
+    // TODO: features should come from features but... let's wait for v1.7
+    MeshFeatures features;
+    if (sharedResource) {
+        if (!sharedResource->materialDefinitions.empty()) {
+            // use first material
+            const auto &material
+                (*sharedResource->materialDefinitions.begin());
+            features.hasRegions = material.params.vertexRegions;
+        }
+    }
+    return features;
 }
 
 } // namespace
@@ -1247,23 +992,78 @@ void SceneLayerInfo::finish(const std::string &cwd)
     store->finish(cwd);
 }
 
+namespace {
+
+/** zlib decompressor recording inflate spans.
+ */
+class TracedZlibDecompressor : public bio::zlib_decompressor {
+public:
+    TracedZlibDecompressor(const bio::zlib_params &params)
+        : bio::zlib_decompressor(params)
+    {}
+
+    template<typename Source>
+    std::streamsize read(Source &src, char_type *s, std::streamsize n) {
+        trace::Span span("inflate", "reader");
+        return bio::zlib_decompressor::read(src, s, n);
+    }
+};
+
+void pushGunzip(bio::filtering_istream &fis)
+{
+    // use raw zlib decompressor, tell zlib to autodetect gzip header
+    bio::zlib_params p;
+    p.window_bits |= 16;
+    fis.push(TracedZlibDecompressor(p));
+}
+
+} // namespace
+
 Archive::Archive(const fs::path &root, const std::string &mime)
-    : archive_
-      (root, roarchive::OpenOptions().setHint(detail::constants::MetadataName)
-       .setMime(mime))
-    , metadata_(loadMetadata(archive_.istream
-                             (detail::constants::MetadataName)))
+    : Archive([&]()
+    {
+        return detail::Source::archive
+            (roarchive::RoArchive
+             (root, roarchive::OpenOptions()
+              .setHint(detail::constants::MetadataName)
+              .setMime(mime)));
+    })
 {
-    std::tie(sli_, rawSli_)
-        = loadSceneLayerInfo(istream(detail::constants::SceneLayer));
-    sli_.finish();
+    root_ = root;
 }
 
 Archive::Archive(roarchive::RoArchive &archive)
-    : archive_(archive.applyHint(detail::constants::MetadataName))
-    , metadata_(loadMetadata(archive_.istream
-                             (detail::constants::MetadataName)))
+    : Archive([&]()
+    {
+        return detail::Source::archive
+            (archive.applyHint(detail::constants::MetadataName));
+    })
+{}
+
+Archive::Archive(const char *data, std::size_t size)
+    : Archive([&]() { return detail::Source::memory(data, size); })
+{}
+
+Archive::Archive(const std::shared_ptr<const std::vector<char>> &data)
+    : Archive([&]()
+    {
+        return detail::Source::memory(data->data(), data->size(), data);
+    })
+{}
+
+Archive::Archive(const RemoteOptions &options)
+    : Archive([&]() { return detail::Source::remote(options); })
+{}
+
+Archive::Archive(const SourceFactory &openSource)
 {
+    SLPK_STATS_SCOPE(open);
+    trace::Span span("archive.open", "reader");
+
+    source_ = openSource();
+    metadata_ = loadMetadata(source_->istream
+                             (detail::constants::MetadataName));
+
     std::tie(sli_, rawSli_)
         = loadSceneLayerInfo(istream(detail::constants::SceneLayer));
     sli_.finish();
@@ -1271,25 +1071,36 @@ Archive::Archive(roarchive::RoArchive &archive)
 
 roarchive::IStream::pointer Archive::istream(const fs::path &path) const
 {
+    std::error_code ec;
+    if (auto is = istream(path, ec)) { return is; }
+
+    LOGTHROW(err1, roarchive::NoSuchFile)
+        << "File " << path << " not found in the SLPK archive.";
+    throw;
+}
+
+roarchive::IStream::pointer Archive::istream(const fs::path &path
+                                             , std::error_code &ec) const
+{
+    trace::Span span("stream.open", "reader");
+    ec.clear();
+
     switch (metadata_.resourceCompressionType) {
     case ResourceCompressionType::none:
-        return archive_.istream(path);
-
-    case ResourceCompressionType::gzip: {
-        const auto gzPath
-            (utility::addExtension(path, detail::constants::ext::gz));
-        if (archive_.exists(gzPath)) {
-            return archive_.istream
-                (gzPath, [](bio::filtering_istream &fis) {
-                    // use raw zlib decompressor, tell zlib to autodetect gzip
-                    // header
-                    bio::zlib_params p;
-                    p.window_bits |= 16;
-                    fis.push(bio::zlib_decompressor(p));
-                });
+        if (auto is = source_->tryIstream(path)) { return is; }
+        ec = Errc::noSuchFile;
+        return {};
+
+    case ResourceCompressionType::gzip:
+        if (auto is = source_->tryIstream
+            (utility::addExtension(path, detail::constants::ext::gz)
+             , pushGunzip))
+        {
+            return is;
         }
-        return archive_.istream(path);
-    } break;
+        if (auto is = source_->tryIstream(path)) { return is; }
+        ec = Errc::noSuchFile;
+        return {};
     }
 
     LOGTHROW(err1, std::runtime_error)
@@ -1301,47 +1112,52 @@ roarchive::IStream::pointer
 Archive::istream(const fs::path &path
                  , const std::initializer_list<const char*> &extensions) const
 {
-    std::size_t left(extensions.size());
-    if (!left) { return istream(path); }
+    std::error_code ec;
+    if (auto is = istream(path, extensions, ec)) { return is; }
+
+    LOGTHROW(err1, roarchive::NoSuchFile)
+        << "File " << path << " not found in the SLPK archive.";
+    throw;
+}
+
+roarchive::IStream::pointer
+Archive::istream(const fs::path &path
+                 , const std::initializer_list<const char*> &extensions
+                 , std::error_code &ec) const
+{
+    if (!extensions.size()) { return istream(path, ec); }
+
+    trace::Span span("stream.open", "reader");
+    ec.clear();
 
     for (const auto &extension : extensions) {
-        --left;
         const auto ePath(utility::addExtension(path, extension));
 
         switch (metadata_.resourceCompressionType) {
         case ResourceCompressionType::none:
-            if (left && !archive_.exists(ePath)) { continue; }
-            return archive_.istream(path);
-
-        case ResourceCompressionType::gzip: {
-            const auto gzPath
-                (utility::addExtension(ePath, detail::constants::ext::gz));
-            if (archive_.exists(ePath)) {
-                return archive_.istream(ePath);
-            } else if (left && !archive_.exists(gzPath)) { continue; }
-
-            return archive_.istream
-                (gzPath, [](bio::filtering_istream &fis) {
-                    // use raw zlib decompressor, tell zlib to autodetect gzip
-                    // header
-                    bio::zlib_params p;
-                    p.window_bits |= 16;
-                    fis.push(bio::zlib_decompressor(p));
-                });
-        } break;
+            if (auto is = source_->tryIstream(ePath)) { return is; }
+            continue;
+
+        case ResourceCompressionType::gzip:
+            if (auto is = source_->tryIstream(ePath)) { return is; }
+            if (auto is = source_->tryIstream
+                (utility::addExtension(ePath, detail::constants::ext::gz)
+                 , pushGunzip))
+            {
+                return is;
+            }
+            continue;
         }
 
         LOGTHROW(err1, std::runtime_error)
             << "Invalid ResourceCompressionType in metadata.";
-        throw;
     }
 
-    LOGTHROW(err1, std::logic_error)
-        << "Error obtaining stream.";
-    throw;
+    ec = Errc::noSuchFile;
+    return {};
 }
 
-fs::path Archive::realPath(const boost::filesystem::path &path)
+fs::path Archive::realPath(const boost::filesystem::path &path) const
 {
     switch (metadata_.resourceCompressionType) {
     case ResourceCompressionType::none:
@@ -1350,7 +1166,7 @@ fs::path Archive::realPath(const boost::filesystem::path &path)
     case ResourceCompressionType::gzip: {
         const auto gzPath
             (utility::addExtension(path, detail::constants::ext::gz));
-        if (archive_.exists(gzPath)) { return gzPath; }
+        if (source_->exists(gzPath)) { return gzPath; }
         return path;
     } break;
     }
@@ -1362,12 +1178,22 @@ fs::path Archive::realPath(const boost::filesystem::path &path)
 
 roarchive::IStream::pointer Archive::rawistream(const fs::path &path) const
 {
-    return archive_.istream(path);
+    return source_->istream(path);
+}
+
+roarchive::IStream::pointer Archive::rawistream(const fs::path &path
+                                                , std::error_code &ec) const
+{
+    ec.clear();
+    auto is(source_->tryIstream(path));
+    if (!is) { ec = Errc::noSuchFile; }
+    return is;
 }
 
 Node Archive::loadNodeIndex(const fs::path &dir
                             , boost::filesystem::path *path) const
 {
+    SLPK_STATS_SCOPE(loadNodeIndex);
     auto is(istream(joinPaths(dir.string(), detail::constants::NodeIndex)));
     if (path) { *path = is->index(); }
     return slpk::loadNodeIndex(is, dir.string(), sli_.store);
@@ -1388,6 +1214,7 @@ Node Archive::loadRootNodeIndex(boost::filesystem::path *path) const
 
 Tree Archive::loadTree() const
 {
+    SLPK_STATS_SCOPE(loadTree);
     Tree tree;
 
     std::queue<const NodeReference*> queue;
@@ -1427,19 +1254,73 @@ Tree Archive::loadTree() const
     return tree;
 }
 
-NodeInfo::list Archive::loadNodes() const
+pmr::Tree Archive::loadTree(pmr::memory_resource *memory) const
 {
-    NodeInfo::list nodes;
+    SLPK_STATS_SCOPE(loadTree);
+    pmr::Tree tree(memory);
+    const auto alloc(tree.get_allocator());
 
-    std::queue<std::string> queue;
-    queue.push(sli_.store->rootNode);
+    // documents are parsed straight into the memory resource
+    const auto load([&](const std::string &dir) -> pmr::Node
+    {
+        SLPK_STATS_SCOPE(loadNodeIndex);
+        auto is(istream(joinPaths(dir, detail::constants::NodeIndex)));
+        return slpk::loadNodeIndex(is->get(), is->path(), dir, sli_.store
+                                   , alloc);
+    });
 
-    boost::filesystem::path path;
-    while (!queue.empty()) {
-        const auto &href(queue.front());
-        auto node(loadNodeIndex(href, &path));
-        nodes.emplace_back(href, path.string(), std::move(node));
-        for (const auto &child : nodes.back().node.children) {
+    std::queue<const pmr::NodeReference*> queue;
+    auto add([&](pmr::Node &&node)
+    {
+        pmr::SharedResource::optional sharedResource;
+        if (node.hasSharedResource()) {
+            const auto &href(node.sharedResource->href);
+            auto is(istream(joinPaths
+                            (std::string(href.data(), href.size())
+                             , detail::constants::SharedResource)));
+            sharedResource = slpk::loadSharedResource
+                (is->get(), is->path(), alloc);
+        }
+
+        pmr::string id(node.id, alloc);
+        auto res(tree.nodes.emplace
+                 (std::move(id), pmr::TreeNode
+                  (std::move(node), std::move(sharedResource))));
+        for (const auto &child : res.first->second.node.children) {
+            queue.push(&child);
+        }
+    });
+
+    // load root and remember id
+    {
+        auto root(load(sli_.store->rootNode));
+        tree.rootNodeId = root.id;
+        add(std::move(root));
+    }
+
+    while (!queue.empty()) {
+        const auto &href(queue.front()->href);
+        add(load(std::string(href.data(), href.size())));
+        queue.pop();
+    }
+
+    return tree;
+}
+
+NodeInfo::list Archive::loadNodes() const
+{
+    SLPK_STATS_SCOPE(loadNodes);
+    NodeInfo::list nodes;
+
+    std::queue<std::string> queue;
+    queue.push(sli_.store->rootNode);
+
+    boost::filesystem::path path;
+    while (!queue.empty()) {
+        const auto &href(queue.front());
+        auto node(loadNodeIndex(href, &path));
+        nodes.emplace_back(href, path.string(), std::move(node));
+        for (const auto &child : nodes.back().node.children) {
             queue.push(child.href);
         }
         queue.pop();
@@ -1448,27 +1329,589 @@ NodeInfo::list Archive::loadNodes() const
     return nodes;
 }
 
+namespace {
+
+TreeNode loadTreeNode(const Archive &archive, const std::string &href
+                      , bool sharedResource)
+{
+    auto node(archive.loadNodeIndex(href));
+    SharedResource::optional sr;
+    if (sharedResource && node.hasSharedResource()) {
+        sr = archive.loadSharedResource(node.sharedResource->href);
+    }
+    return TreeNode(std::move(node), std::move(sr));
+}
+
+/** Queues children of given node so that the first child is taken first:
+ *  BFS takes from the front, DFS from the back.
+ */
+template <typename Pending>
+void enqueueChildren(std::deque<Pending> &pending, const Node &node
+                     , bool dfs)
+{
+    const auto &children(node.children);
+    if (dfs) {
+        for (auto ichildren(children.rbegin()); ichildren != children.rend();
+             ++ichildren)
+        {
+            pending.emplace_back(ichildren->href);
+        }
+    } else {
+        for (const auto &child : children) { pending.emplace_back(child.href); }
+    }
+}
+
+template <typename Pending>
+Pending takeNext(std::deque<Pending> &pending, bool dfs)
+{
+    if (dfs) {
+        auto next(std::move(pending.back()));
+        pending.pop_back();
+        return next;
+    }
+    auto next(std::move(pending.front()));
+    pending.pop_front();
+    return next;
+}
+
+/** Node loaded ahead by a pool task. Whoever claims it first loads it: the
+ *  task, or the visiting thread if the task has not started yet, so the
+ *  visitor never waits for tasks queued behind others (e.g. when it is a
+ *  pool task itself).
+ */
+struct AheadLoad {
+    std::atomic<bool> claimed;
+    std::promise<TreeNode> node;
+
+    AheadLoad() : claimed(false) {}
+
+    bool claim() { return !claimed.exchange(true); }
+};
+
+struct PendingNode {
+    std::string href;
+    std::shared_ptr<AheadLoad> ahead;
+    std::future<TreeNode> node;
+
+    PendingNode(const std::string &href) : href(href) {}
+};
+
+/** Pool tasks helping a calling thread that blocks until they are done.
+ *  Helpers that have not started by the time the caller closes are skipped,
+ *  so the caller never waits for tasks queued behind blocked workers (e.g.
+ *  when it is a pool task itself). Shared by the caller and its tasks.
+ */
+class Helpers {
+public:
+    Helpers() : closed_(false), running_() {}
+
+    /** Runs work unless already closed.
+     */
+    template <typename Work>
+    void run(const Work &work) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (closed_) { return; }
+            ++running_;
+        }
+
+        std::exception_ptr error;
+        try { work(); } catch (...) { error = std::current_exception(); }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (error && !error_) { error_ = error; }
+        --running_;
+        cond_.notify_all();
+    }
+
+    /** Skips helpers not started yet, waits for the running ones. Returns
+     *  first error of a helper.
+     */
+    std::exception_ptr close() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        closed_ = true;
+        cond_.wait(lock, [this]() { return !running_; });
+        return error_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool closed_;
+    std::size_t running_;
+    std::exception_ptr error_;
+};
+
+
+void visitInOrder(const Archive &archive, const std::string &root
+                  , const NodeVisitor &visitor, bool dfs
+                  , bool sharedResource, std::size_t window)
+{
+    auto &pool(ThreadPool::instance());
+
+    std::deque<PendingNode> pending;
+    pending.emplace_back(root);
+    std::size_t ahead(0);
+
+    try {
+        while (!pending.empty()) {
+            auto next(takeNext(pending, dfs));
+            if (next.ahead) { --ahead; }
+            const auto tn((next.ahead && !next.ahead->claim())
+                          ? next.node.get()
+                          : loadTreeNode(archive, next.href, sharedResource));
+            enqueueChildren(pending, tn.node, dfs);
+
+            // load following nodes ahead; window includes the visited one
+            const auto size(pending.size());
+            for (std::size_t i(0), e(std::min(size, window));
+                 (i < e) && (ahead + 1 < window); ++i)
+            {
+                auto &p(pending[dfs ? (size - 1 - i) : i]);
+                if (p.ahead) { continue; }
+                const auto href(p.href);
+                const auto load(std::make_shared<AheadLoad>());
+                p.ahead = load;
+                p.node = load->node.get_future();
+                pool.post([&archive, href, sharedResource, load]()
+                {
+                    if (!load->claim()) { return; }
+                    try {
+                        load->node.set_value
+                            (loadTreeNode(archive, href, sharedResource));
+                    } catch (...) {
+                        load->node.set_exception(std::current_exception());
+                    }
+                });
+                ++ahead;
+            }
+
+            visitor(tn);
+        }
+    } catch (...) {
+        // started loads ahead reference the archive, unstarted are dropped
+        for (auto &p : pending) {
+            if (p.ahead && !p.ahead->claim()) { p.node.wait(); }
+        }
+        throw;
+    }
+}
+
+void visitParallel(const Archive &archive, const std::string &root
+                   , const NodeVisitor &visitor, bool dfs
+                   , bool sharedResource, std::size_t window, int threads)
+{
+    std::deque<std::string> pending;
+    pending.emplace_back(root);
+    std::size_t inFlight(0);
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    const auto worker([&]()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            cv.wait(lock, [&]()
+            {
+                return error || (pending.empty()
+                                 ? !inFlight : (inFlight < window));
+            });
+            if (error || pending.empty()) { return; }
+
+            const auto href(takeNext(pending, dfs));
+            ++inFlight;
+            lock.unlock();
+
+            std::exception_ptr e;
+            try {
+                const auto tn(loadTreeNode(archive, href, sharedResource));
+                {
+                    std::unique_lock<std::mutex> l(mutex);
+                    enqueueChildren(pending, tn.node, dfs);
+                }
+                cv.notify_all();
+                visitor(tn);
+            } catch (...) {
+                e = std::current_exception();
+            }
+
+            lock.lock();
+            --inFlight;
+            if (e && !error) { error = e; }
+            cv.notify_all();
+        }
+    });
+
+    auto &pool(ThreadPool::instance());
+    const std::size_t helpers
+        (std::min(window - 1
+                  , (threads > 0) ? std::size_t(threads - 1) : pool.size()));
+
+    // worker catches everything itself, helpers only need to be waited for
+    const auto helping(std::make_shared<Helpers>());
+    for (std::size_t i(0); i < helpers; ++i) {
+        pool.post([helping, &worker]() { helping->run(worker); });
+    }
+    worker();
+    helping->close();
+    if (error) { std::rethrow_exception(error); }
+}
+
+} // namespace
+
+void Archive::forEachNode(const NodeVisitor &visitor
+                          , const VisitOptions &options) const
+{
+    trace::Span span("tree.visit", "reader");
+    const bool dfs(options.traversal == Traversal::dfs);
+    const std::size_t window(std::max(options.window, std::size_t(1)));
+
+    if (options.threads == 1) {
+        visitInOrder(*this, sli_.store->rootNode, visitor, dfs
+                     , options.sharedResource, window);
+    } else {
+        visitParallel(*this, sli_.store->rootNode, visitor, dfs
+                      , options.sharedResource, window, options.threads);
+    }
+}
+
+namespace {
+
+/** Marks decode context as used by current decode.
+ */
+class ContextLock {
+public:
+    ContextLock(DecodeContext &context)
+        : detail_(context.detail())
+    {
+        if (detail_.busy.exchange(true, std::memory_order_acquire)) {
+            LOGTHROW(err1, std::logic_error)
+                << "Decode context is already in use.";
+        }
+    }
+
+    ~ContextLock() { detail_.busy.store(false, std::memory_order_release); }
+
+private:
+    DecodeContext::Detail &detail_;
+};
+
+/** Runs function with thread's default decode context or, when it is
+ *  already in use (i.e. nested decode from a loader), with a temporary one.
+ */
+template <typename F>
+auto withLocalContext(const F &f) -> decltype(f(DecodeContext::local()))
+{
+    auto &context(DecodeContext::local());
+    if (!context.detail().busy) { return f(context); }
+
+    DecodeContext tmp;
+    return f(tmp);
+}
+
+} // namespace
+
 void Archive::loadGeometry(GeometryLoader &loader, const Node &node
                            , const SharedResource::optional &sharedResource)
     const
 {
-    // TODO: features should come from features but... let's wait for v1.7
-    MeshFeatures features;
-    if (sharedResource) {
-        if (!sharedResource->materialDefinitions.empty()) {
-            // use first material
-            const auto &material
-                (*sharedResource->materialDefinitions.begin());
-            features.hasRegions = material.params.vertexRegions;
+    withLocalContext([&](DecodeContext &context)
+    {
+        loadGeometry(loader, node, sharedResource, context);
+    });
+}
+
+void Archive::loadGeometry(GeometryLoader &loader, const Node &node
+                           , const SharedResource::optional &sharedResource
+                           , DecodeContext &context) const
+{
+    SLPK_STATS_SCOPE(loadGeometry);
+    ContextLock lock(context);
+    auto &ctx(context.detail());
+
+    const auto features(meshFeatures(sharedResource));
+    for (const auto &resource : node.geometryData) {
+        const auto path(realPath(resource.href + ".bin"));
+        {
+            auto is(source_->istream(path));
+            ctx.read(is->get(), is->size() ? *is->size() : 0);
         }
+
+        auto &in(ctx.stream(ctx.raw.data(), ctx.rawSize
+                            , (path.extension()
+                               == detail::constants::ext::gz)
+                            , "geometry"));
+        loadMesh(loader.next(), node, features, resource, in, path
+                 , ctx.scratch);
     }
+}
+
+namespace {
+
+template <typename Allocator>
+void loadGeometry(const Archive &archive, GeometryLoader &loader
+                  , const BasicNode<Allocator> &node
+                  , const boost::optional<BasicSharedResource<Allocator>>
+                  &sharedResource
+                  , pmr::memory_resource *memory)
+{
+    SLPK_STATS_SCOPE(loadGeometry);
+    detail::decode::Scratch scratch(memory);
 
+    const auto features(meshFeatures(sharedResource));
     for (const auto &resource : node.geometryData) {
+        std::string path(resource.href.data(), resource.href.size());
+        path.append(".bin");
         loadMesh(loader.next(), node, features, resource
-                 , istream(resource.href + ".bin"));
+                 , archive.istream(path), scratch);
+    }
+}
+
+} // namespace
+
+void Archive::loadGeometry(GeometryLoader &loader, const Node &node
+                           , const SharedResource::optional &sharedResource
+                           , pmr::memory_resource *memory) const
+{
+    slpk::loadGeometry(*this, loader, node, sharedResource, memory);
+}
+
+void Archive::loadGeometry(GeometryLoader &loader, const pmr::Node &node
+                           , const pmr::SharedResource::optional
+                           &sharedResource
+                           , pmr::memory_resource *memory) const
+{
+    slpk::loadGeometry(*this, loader, node, sharedResource, memory);
+}
+
+namespace {
+
+/** Accounts resource at given archive path to its node. Paths outside of
+ *  node directories are ignored.
+ */
+void addResource(NodeResources::map &index, const std::string &path
+                 , const ResourceSize &size)
+{
+    const auto nodes(detail::constants::Nodes.string());
+    if ((path.size() <= nodes.size() + 1)
+        || path.compare(0, nodes.size(), nodes)
+        || (path[nodes.size()] != '/'))
+    {
+        return;
+    }
+
+    // nodes/ID/rest
+    const auto idStart(nodes.size() + 1);
+    const auto slash(path.find('/', idStart));
+    if (slash == std::string::npos) { return; }
+
+    auto &node(index[path.substr(idStart, slash - idStart)]);
+    const auto rest(path.substr(slash + 1));
+
+    const auto startsWith([&](const std::string &prefix)
+    {
+        return !rest.compare(0, prefix.size(), prefix);
+    });
+
+    if (startsWith(detail::constants::NodeIndex)) {
+        node.index += size;
+    } else if (startsWith("geometries/")) {
+        node.geometry += size;
+    } else if (startsWith("textures/")) {
+        node.texture += size;
+    } else if (startsWith("features/")) {
+        node.features += size;
+    } else {
+        node.other += size;
     }
 }
 
+/** Reads zip central directory and makes entry paths relative to archive
+ *  root (i.e. directory holding the metadata). Entries outside of the
+ *  archive root are dropped.
+ */
+detail::zip::Entry::list archiveEntries(const fs::path &zipPath)
+{
+    return detail::zip::stripRoot(detail::zip::readCentralDirectory(zipPath)
+                                  , detail::constants::MetadataName);
+}
+
+} // namespace
+
+namespace {
+
+/** Nodes read together in batch geometry loading.
+ */
+const std::size_t BatchWindow(16);
+const unsigned int BatchReadQueueDepth(32);
+
+} // namespace
+
+void Archive::loadGeometry(GeometryLoader &loader, const Node &node
+                           , const SharedResource::optional &sharedResource
+                           , const std::vector<char> *data) const
+{
+    SLPK_STATS_SCOPE(loadGeometry);
+
+    withLocalContext([&](DecodeContext &context)
+    {
+        ContextLock lock(context);
+        auto &ctx(context.detail());
+
+        const auto features(meshFeatures(sharedResource));
+        for (const auto &resource : node.geometryData) {
+            const auto &raw(*data++);
+            const auto path(realPath(resource.href + ".bin"));
+
+            auto &in(ctx.stream(raw.data(), raw.size()
+                                , (path.extension()
+                                   == detail::constants::ext::gz)
+                                , "geometry"));
+            loadMesh(loader.next(), node, features, resource, in, path
+                     , ctx.scratch);
+        }
+    });
+}
+
+void Archive::loadGeometry(const std::vector<const TreeNode*> &nodes
+                           , const GeometryLoaderFactory &factory
+                           , const GeometrySink &sink, int threads) const
+{
+    trace::Span span("geometry.batch", "reader");
+
+    // order nodes by position of their first geometry in the archive; nodes
+    // without geometry go first
+    typedef std::tuple<std::uint64_t, std::string, const TreeNode*> Item;
+    std::vector<Item> items;
+    items.reserve(nodes.size());
+
+    std::map<std::string, detail::zip::Entry> entries;
+    if (!root_.empty() && fs::is_regular_file(root_)) {
+        for (auto &entry : archiveEntries(root_)) {
+            auto path(entry.path);
+            entries.insert(std::make_pair(std::move(path), std::move(entry)));
+        }
+    }
+
+    for (const auto *tn : nodes) {
+        const auto &node(tn->node);
+        if (node.geometryData.empty()) {
+            items.emplace_back(0, std::string(), tn);
+            continue;
+        }
+        const auto path(realPath(node.geometryData.front().href + ".bin")
+                        .generic_string());
+        const auto fentries(entries.find(path));
+        items.emplace_back((fentries == entries.end())
+                           ? 0 : fentries->second.localHeaderOffset
+                           , path, tn);
+    }
+    std::stable_sort(items.begin(), items.end()
+                     , [](const Item &l, const Item &r)
+    {
+        return std::tie(std::get<0>(l), std::get<1>(l))
+            < std::tie(std::get<0>(r), std::get<1>(r));
+    });
+
+    // geometry entries of given node, empty if not available
+    const auto nodeEntries([&](const Node &node)
+    {
+        std::vector<const detail::zip::Entry*> out;
+        for (const auto &resource : node.geometryData) {
+            const auto fentries
+                (entries.find(realPath(resource.href + ".bin")
+                              .generic_string()));
+            if (fentries == entries.end()) { return decltype(out)(); }
+            out.push_back(&fentries->second);
+        }
+        return out;
+    });
+
+    // workers pull windows of nodes in archive order; with zip file at
+    // hand, geometry of whole window is read at once bypassing roarchive
+    std::atomic<std::size_t> next(0);
+    std::mutex sinkMutex;
+    const auto worker([&]()
+    {
+        std::unique_ptr<detail::EntryReader> reader;
+        if (!entries.empty()) {
+            reader.reset(new detail::EntryReader
+                         (root_, BatchReadQueueDepth));
+        }
+
+        for (;;) {
+            const auto begin(next.fetch_add(BatchWindow));
+            if (begin >= items.size()) { return; }
+            const auto end(std::min(begin + BatchWindow, items.size()));
+
+            // node -> index of its first entry in data, -1 if not read
+            std::vector<int> firsts(end - begin, -1);
+            std::vector<detail::EntryReader::Data> data;
+            if (reader) {
+                trace::Span span("geometry.batchRead", "reader");
+                std::vector<const detail::zip::Entry*> request;
+                for (auto i(begin); i < end; ++i) {
+                    const auto ne(nodeEntries(std::get<2>(items[i])->node));
+                    if (ne.empty()) { continue; }
+                    firsts[i - begin] = request.size();
+                    request.insert(request.end(), ne.begin(), ne.end());
+                }
+
+                try {
+                    data = reader->read(request);
+                } catch (const std::exception &e) {
+                    LOG(warn2) << "Batch read failed, falling back to "
+                        "stream access: " << e.what();
+                    std::fill(firsts.begin(), firsts.end(), -1);
+                }
+            }
+
+            for (auto i(begin); i < end; ++i) {
+                const auto &tn(*std::get<2>(items[i]));
+                const auto first(firsts[i - begin]);
+
+                std::unique_ptr<GeometryLoader> loader;
+                std::exception_ptr error;
+                try {
+                    loader = factory(tn);
+                    if (first < 0) {
+                        loadGeometry(*loader, tn.node, tn.sharedResource);
+                    } else {
+                        loadGeometry(*loader, tn.node, tn.sharedResource
+                                     , &data[first]);
+                    }
+                } catch (...) {
+                    loader.reset();
+                    error = std::current_exception();
+                }
+
+                std::unique_lock<std::mutex> lock(sinkMutex);
+                sink(tn, std::move(loader), error);
+            }
+        }
+    });
+
+    auto &pool(ThreadPool::instance());
+    const std::size_t helpers
+        (std::min(items.size()
+                  , (threads > 0) ? std::size_t(threads - 1) : pool.size()));
+
+    // helpers touch this frame only while the call waits for them
+    const auto helping(std::make_shared<Helpers>());
+    for (std::size_t i(0); i < helpers; ++i) {
+        pool.submit([helping, &worker]() { helping->run(worker); });
+    }
+
+    // calling thread works as well; exceptions (from sink) are rethrown
+    // after all running helpers are done
+    std::exception_ptr error;
+    try { worker(); } catch (...) { error = std::current_exception(); }
+    const auto helperError(helping->close());
+    if (!error) { error = helperError; }
+    if (error) { std::rethrow_exception(error); }
+}
+
 namespace {
 
 class SimpleMeshLoader
@@ -1521,19 +1964,160 @@ private:
     SubMesh* current_;
 };
 
+/** Simple geometry loader building mesh in a memory resource.
+ */
+class PmrMeshLoader
+    : public GeometryLoader
+    , public MeshLoader
+{
+public:
+    PmrMeshLoader(std::size_t count, pmr::memory_resource *memory)
+        : mesh_(memory), current_(nullptr)
+    {
+        mesh_.submeshes.resize(count);
+    }
+
+    virtual MeshLoader& next() {
+        if (!current_) {
+            current_ = mesh_.submeshes.data();
+        } else {
+            ++current_;
+        }
+        return *this;
+    }
+
+    pmr::Mesh&& moveout() {
+        return std::move(mesh_);
+    }
+
+    virtual void addVertex(const math::Point3d &v) {
+        current_->vertices.push_back(v);
+    }
+
+    virtual void addTexture(const math::Point2d &t) {
+        current_->tCoords.push_back(t);
+    }
+
+    virtual void addFace(const Face &mesh, const FaceTc &tc, const Face&)
+    {
+        current_->faces.emplace_back(mesh(0), mesh(1), mesh(2)
+                                     , tc(0), tc(1), tc(2)
+                                     , tc.region);
+    }
+
+    virtual void addTxRegion(const Region &r) {
+        current_->regions.push_back(r);
+    }
+
+private:
+    virtual void addNormal(const math::Point3d&) {}
+
+    pmr::Mesh mesh_;
+    pmr::SubMesh* current_;
+};
+
 } // namespace
 
 Mesh Archive::loadGeometry(const Node &node
                            , const SharedResource::optional &sharedResource)
     const
 {
+    SLPK_STATS_SCOPE(loadGeometry);
     SimpleMeshLoader loader(node.geometryData.size());
     loadGeometry(loader, node, sharedResource);
     return loader.moveout();
 }
 
+Mesh Archive::loadGeometry(const Node &node
+                           , const SharedResource::optional &sharedResource
+                           , DecodeContext &context) const
+{
+    SimpleMeshLoader loader(node.geometryData.size());
+    loadGeometry(loader, node, sharedResource, context);
+    return loader.moveout();
+}
+
+pmr::Mesh Archive::loadGeometry(const Node &node
+                                , const SharedResource::optional
+                                &sharedResource
+                                , pmr::memory_resource *memory) const
+{
+    PmrMeshLoader loader(node.geometryData.size(), memory);
+    loadGeometry(loader, node, sharedResource, memory);
+    return loader.moveout();
+}
+
+pmr::Mesh Archive::loadGeometry(const pmr::Node &node
+                                , const pmr::SharedResource::optional
+                                &sharedResource
+                                , pmr::memory_resource *memory) const
+{
+    PmrMeshLoader loader(node.geometryData.size(), memory);
+    loadGeometry(loader, node, sharedResource, memory);
+    return loader.moveout();
+}
+
+GeometryHeader Archive::geometryHeader(const Node &node, int index) const
+{
+    trace::Span span("geometry.header", "reader");
+
+    const auto &store(node.store());
+    if (!store.defaultGeometrySchema) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Cannot read geometry header since there is no default "
+            "geometry schema present in the store.";
+    }
+
+    if ((index < 0) || (std::size_t(index) >= node.geometryData.size())) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Node <" << node.id << "> has no geometry #" << index << ".";
+    }
+
+    // stream is inflated lazily, only header bytes are processed
+    auto is(istream(node.geometryData[index].href + ".bin"));
+    return loadHeader(is->get(), *store.defaultGeometrySchema);
+}
+
+GeometryHeader::map Archive::geometryHeaders(const Tree &tree, int threads)
+    const
+{
+    std::vector<const Node*> nodes;
+    for (const auto &item : tree.nodes) { nodes.push_back(&item.second.node); }
+
+    std::vector<GeometryHeader::list> headers(nodes.size());
+
+    if (threads <= 0) { threads = std::thread::hardware_concurrency(); }
+    if (threads <= 0) { threads = 1; }
+
+    std::exception_ptr error;
+
+    UTILITY_OMP(parallel for num_threads(threads) schedule(dynamic)
+                shared(nodes, headers, error))
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        const auto &node(*nodes[i]);
+        try {
+            auto &nh(headers[i]);
+            for (std::size_t g(0); g < node.geometryData.size(); ++g) {
+                nh.push_back(geometryHeader(node, g));
+            }
+        } catch (...) {
+            UTILITY_OMP(critical(slpk_geometryHeaders))
+            if (!error) { error = std::current_exception(); }
+        }
+    }
+
+    if (error) { std::rethrow_exception(error); }
+
+    GeometryHeader::map out;
+    for (std::size_t i(0); i < nodes.size(); ++i) {
+        out[nodes[i]->id] = std::move(headers[i]);
+    }
+    return out;
+}
+
 roarchive::IStream::pointer Archive::texture(const Node &node, int index) const
 {
+    SLPK_STATS_SCOPE(texture);
     const auto& pe(node.store().preferredTextureEncoding());
 
     if (!pe.encoding) {
@@ -1555,8 +2139,28 @@ roarchive::IStream::pointer Archive::texture(const Node &node, int index) const
         (node.textureData[i].href, { ".bin", pe.encoding->ext.c_str() });
 }
 
+roarchive::IStream::pointer Archive::texture(const Node &node, int index
+                                             , std::error_code &ec) const
+{
+    SLPK_STATS_SCOPE(texture);
+    ec.clear();
+
+    const auto& pe(node.store().preferredTextureEncoding());
+    const auto i(index * node.store().textureEncoding.size() + pe.index);
+    if (!pe.encoding || (i >= node.textureData.size())) {
+        ec = Errc::noTexture;
+        return {};
+    }
+
+    return istream
+        (node.textureData[i].href, { ".bin", pe.encoding->ext.c_str() }
+         , ec);
+}
+
 math::Size2 Archive::textureSize(const Node &node, int index) const
 {
+    SLPK_STATS_SCOPE(texture);
+    trace::Span span("texture.measure", "reader");
     const auto& pe(node.store().preferredTextureEncoding());
 
     if (!pe.encoding) {
@@ -1581,19 +2185,93 @@ math::Size2 Archive::textureSize(const Node &node, int index) const
     return imgproc::imageSize(*is, is->path());
 }
 
+std::future<Node>
+Archive::loadNodeIndexAsync(const boost::filesystem::path &dir
+                            , Priority priority) const
+{
+    return ThreadPool::instance().submit([this, dir]()
+    {
+        return loadNodeIndex(dir);
+    }, priority);
+}
+
+std::future<Mesh>
+Archive::loadGeometryAsync(const Node &node
+                           , const SharedResource::optional &sharedResource
+                           , Priority priority) const
+{
+    // task outlives the caller's arguments if the future is dropped
+    return ThreadPool::instance().submit([this, node, sharedResource]()
+    {
+        return loadGeometry(node, sharedResource);
+    }, priority);
+}
+
+std::future<roarchive::IStream::pointer>
+Archive::textureAsync(const Node &node, int index, Priority priority) const
+{
+    return ThreadPool::instance().submit([this, node, index]()
+    {
+        return texture(node, index);
+    }, priority);
+}
+
 geo::SrsDefinition Archive::srs() const
 {
-    return sli_.spatialReference.srs();
+    return cachedSrs(sli_.spatialReference);
 }
 
 roarchive::Files Archive::fileList() const
 {
-    return archive_.list();
+    return source_->list();
+}
+
+NodeResources::map Archive::resourceIndex() const
+{
+    if (root_.empty()) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Resource index is available only for archives opened "
+            "from a path.";
+    }
+
+    NodeResources::map index;
+
+    if (fs::is_directory(root_)) {
+        for (const auto &path : source_->list()) {
+            ResourceSize size;
+            size.stored = size.uncompressed = fs::file_size(root_ / path);
+            size.count = 1;
+            addResource(index, path.generic_string(), size);
+        }
+        return index;
+    }
+
+    for (const auto &entry : archiveEntries(root_)) {
+        ResourceSize size;
+        size.stored = entry.compressedSize;
+        size.uncompressed = entry.uncompressedSize;
+        size.count = 1;
+        addResource(index, entry.path, size);
+    }
+
+    return index;
+}
+
+namespace {
+
+fs::path restApiLayerPrefix(const SceneLayerInfo &sli)
+{
+    return utility::Uri::joinAndRemoveDotSegments
+        ("/" + constants::SceneServer + "/", sli.href)
+        .substr(1);
 }
 
+} // namespace
+
 RestApi::RestApi(Archive &&archive)
     : archive_(std::move(archive))
 {
+    SLPK_STATS_SCOPE(restApi);
     const auto add([&](const std::string &path, const ApiFile &af)
     {
         files_.insert(ApiFile::map::value_type(path, af));
@@ -1633,13 +2311,7 @@ RestApi::RestApi(Archive &&archive)
         addSlashed(constants::SceneServer, af);
     }
 
-    const auto &sli(archive_.sceneLayerInfo());
-
-    // build layer prefix
-    const fs::path layerPrefix
-        = utility::Uri::joinAndRemoveDotSegments
-        ("/" + constants::SceneServer + "/", sli.href)
-        .substr(1);
+    const auto layerPrefix(restApiLayerPrefix(archive_.sceneLayerInfo()));
 
     const auto buildApiFile([&](ApiFile af) -> ApiFile
     {
@@ -1718,25 +2390,39 @@ RestApi::RestApi(Archive &&archive)
 std::pair<roarchive::IStream::pointer, const ApiFile*>
 RestApi::file(const boost::filesystem::path &path) const
 {
+    std::error_code ec;
+    auto result(file(path, ec));
+    if (ec) {
+        LOGTHROW(err1, roarchive::NoSuchFile)
+            << "File " << path << " not found in the SLPK archive.";
+    }
+    return result;
+}
+
+std::pair<roarchive::IStream::pointer, const ApiFile*>
+RestApi::file(const boost::filesystem::path &path, std::error_code &ec) const
+{
+    ec.clear();
+
     // try to find file
     auto ffiles(files_.find(path.string()));
-
     if (ffiles == files_.end()) {
-        LOGTHROW(err1, roarchive::NoSuchFile)
-            << "File " << path << " not found in the SLPK archive.";
+        ec = Errc::noSuchFile;
+        return {};
     }
 
     std::pair<roarchive::IStream::pointer, const ApiFile*>
         result(roarchive::IStream::pointer(), &ffiles->second);
     if (result.second->content.empty()) {
-        result.first = std::move(archive_.rawistream(result.second->path));
+        result.first = archive_.rawistream(result.second->path, ec);
+        if (ec) { return {}; }
     }
     return result;
 }
 
 bool Archive::changed() const
 {
-    return archive_.changed();
+    return source_->changed();
 }
 
 bool RestApi::changed() const
@@ -1744,6 +2430,40 @@ bool RestApi::changed() const
     return archive_.changed();
 }
 
+std::string RestApi::url(const SceneLayerInfo &sli
+                         , const boost::filesystem::path &path)
+{
+    const auto layerPrefix(restApiLayerPrefix(sli));
+
+    auto stripped(path);
+    if (stripped.extension() == detail::constants::ext::gz) {
+        stripped.replace_extension();
+    }
+    const auto fname(stripped.filename().string());
+
+    if (stripped == detail::constants::SceneLayer) {
+        return layerPrefix.string();
+    }
+
+    // node index and shared resource are served as their directories
+    if ((fname == detail::constants::NodeIndex)
+        || (fname == detail::constants::SharedResource))
+    {
+        return (layerPrefix / stripped.parent_path()).string();
+    }
+
+    // resources live under nodes and are served without extensions
+    if (stripped.begin() == stripped.end()
+        || (*stripped.begin() != detail::constants::Nodes))
+    {
+        return {};
+    }
+
+    const auto dot(fname.find('.'));
+    return (layerPrefix / stripped.parent_path()
+            / fname.substr(0, dot)).string();
+}
+
 HeightModelInfo::HeightModelInfo(const geo::SrsDefinition &srs)
     : heightModel(HeightModel::ellipsoidal)
     , ellipsoid("unnamed"), heightUnit("meter")
@@ -30,6 +30,12 @@
 #include <initializer_list>
 #include <vector>
 #include <map>
+#include <cstdint>
+
+#include <future>
+#include <memory>
+#include <exception>
+#include <functional>
 
 #include <boost/any.hpp>
 
@@ -40,9 +46,16 @@
 #include "roarchive/roarchive.hpp"
 
 #include "types.hpp"
+#include "threadpool.hpp"
+#include "remote.hpp"
+#include "pmr.hpp"
+#include "decodecontext.hpp"
+#include "error.hpp"
 
 namespace slpk {
 
+namespace detail { class Source; }
+
 typedef math::Point3_<unsigned int> Face;
 typedef std::vector<Face> Faces;
 typedef math::Extents2 Region;
@@ -92,6 +105,58 @@ public:
     virtual MeshLoader& next() = 0;
 };
 
+/** Creates geometry loader for given node in batch geometry loading.
+ */
+typedef std::function<std::unique_ptr<GeometryLoader>(const TreeNode&)>
+    GeometryLoaderFactory;
+
+/** Receives loaded node in batch geometry loading. Loader is null and error
+ *  is set if loading failed.
+ */
+typedef std::function<void(const TreeNode &node
+                           , std::unique_ptr<GeometryLoader> &&loader
+                           , const std::exception_ptr &error)>
+    GeometrySink;
+
+/** Node traversal order.
+ */
+UTILITY_GENERATE_ENUM_CI(Traversal,
+                         ((bfs))
+                         ((dfs))
+                         )
+
+/** Receives node visited by Archive::forEachNode. The node is valid only
+ *  during the call.
+ */
+typedef std::function<void(const TreeNode &node)> NodeVisitor;
+
+/** Archive::forEachNode options.
+ */
+struct VisitOptions {
+    /** Visiting order; DFS is pre-order.
+     */
+    Traversal traversal;
+
+    /** Number of visiting threads. 1 visits in the calling thread, 0 means
+     *  pool size + 1.
+     */
+    int threads;
+
+    /** Maximum number of nodes held at once (being loaded, loaded ahead or
+     *  being visited).
+     */
+    std::size_t window;
+
+    /** Load shared resources of visited nodes.
+     */
+    bool sharedResource;
+
+    VisitOptions()
+        : traversal(Traversal::bfs), threads(1), window(16)
+        , sharedResource(true)
+    {}
+};
+
 /** Sub mesh for provided simple geometry loader.
  */
 struct SubMesh {
@@ -107,6 +172,56 @@ struct Mesh {
     SubMesh::list submeshes;
 };
 
+/** Size of a group of archive resources.
+ */
+struct ResourceSize {
+    /** Bytes occupied in the archive.
+     */
+    std::uint64_t stored;
+
+    /** Bytes after archive (zip) decompression. Gzipped resources are still
+     *  gzipped.
+     */
+    std::uint64_t uncompressed;
+
+    /** Number of resources.
+     */
+    std::size_t count;
+
+    ResourceSize() : stored(), uncompressed(), count() {}
+
+    ResourceSize& operator+=(const ResourceSize &o) {
+        stored += o.stored;
+        uncompressed += o.uncompressed;
+        count += o.count;
+        return *this;
+    }
+};
+
+/** Sizes of node resources by resource type.
+ */
+struct NodeResources {
+    ResourceSize index;
+    ResourceSize geometry;
+    ResourceSize texture;
+    ResourceSize features;
+    ResourceSize other;
+
+    ResourceSize total() const {
+        ResourceSize t;
+        t += index;
+        t += geometry;
+        t += texture;
+        t += features;
+        t += other;
+        return t;
+    }
+
+    /** Mapping from node directory name (i.e. node ID) to its resources.
+     */
+    typedef std::map<std::string, NodeResources> map;
+};
+
 /** Scene scervice file mapping.
  */
 
@@ -123,26 +238,68 @@ public:
     Archive(const boost::filesystem::path &root, const std::string &mime = "");
     Archive(roarchive::RoArchive &archive);
 
-    /** Generic I/O.
+    /** Open SLPK (zip) archive held in memory, e.g. an upload buffer. Zip
+     *  entries are read in place, nothing is copied. Data must stay valid
+     *  while the archive or any stream opened from it exists.
+     */
+    Archive(const char *data, std::size_t size);
+
+    /** Open SLPK (zip) archive held in shared memory buffer. The buffer is
+     *  kept alive by the archive and by all streams opened from it.
+     */
+    Archive(const std::shared_ptr<const std::vector<char>> &data);
+
+    /** Open remote I3S SceneServer layer. Reads go over HTTP; the archive
+     *  is safe to use from multiple threads (async and batch APIs issue
+     *  parallel requests). File listing contains service documents only.
+     */
+    Archive(const RemoteOptions &options);
+
+    /** Generic I/O. Throws roarchive::NoSuchFile if there is no such file.
      */
     roarchive::IStream::pointer
     istream(const boost::filesystem::path &path) const;
 
+    /** Generic I/O. Returns null and sets ec to Errc::noSuchFile if there is
+     *  no such file; nothing is thrown on this path.
+     */
+    roarchive::IStream::pointer
+    istream(const boost::filesystem::path &path, std::error_code &ec) const;
+
     /** Generic I/O. Tries all extensions.
      */
     roarchive::IStream::pointer
     istream(const boost::filesystem::path &path
             , const std::initializer_list<const char*> &extensions) const;
 
+    /** Generic I/O. Tries all extensions. Non-throwing variant, see above.
+     */
+    roarchive::IStream::pointer
+    istream(const boost::filesystem::path &path
+            , const std::initializer_list<const char*> &extensions
+            , std::error_code &ec) const;
+
     /** Generic I/O. Does not ungzip gzipped files. Usable only for HTTP
      *  adapters.
      */
     roarchive::IStream::pointer
     rawistream(const boost::filesystem::path &path) const;
 
+    /** Generic I/O. Does not ungzip gzipped files. Non-throwing variant,
+     *  see istream().
+     */
+    roarchive::IStream::pointer
+    rawistream(const boost::filesystem::path &path, std::error_code &ec)
+        const;
+
     /** Returns real path to resource.
      */
-    boost::filesystem::path realPath(const boost::filesystem::path &path);
+    boost::filesystem::path realPath(const boost::filesystem::path &path)
+        const;
+
+    /** Returns loaded archive metadata.
+     */
+    const Metadata& metadata() const { return metadata_; }
 
     /** Returns loaded scene layer info.
      */
@@ -175,30 +332,159 @@ public:
      */
     Tree loadTree() const;
 
+    /** Loads whole node tree with all nodes and shared resources allocated
+     *  from given memory resource: documents are parsed straight into the
+     *  resource.
+     */
+    pmr::Tree loadTree(pmr::memory_resource *memory) const;
+
     /** Loads whole node tree as a list of extended node info.
      */
     NodeInfo::list loadNodes() const;
 
+    /** Visits every node of the tree without materializing it: at most
+     *  options.window nodes are held in memory, pending nodes are queued
+     *  as hrefs only.
+     *
+     *  Single thread visits nodes in exact traversal order in the calling
+     *  thread while following nodes are loaded ahead in
+     *  ThreadPool::instance(). More threads (the calling thread and pool
+     *  workers) call the visitor concurrently in approximate order.
+     *
+     *  The first exception (load or visitor) stops the traversal and is
+     *  rethrown.
+     *
+     *  Safe to call from a pool task: the calling thread never waits for
+     *  pool tasks that have not started, it does their work itself.
+     */
+    void forEachNode(const NodeVisitor &visitor
+                     , const VisitOptions &options = VisitOptions()) const;
+
     /** Loads node geometry. Possibly more meshes than just one.
+     *  Uses DecodeContext::local().
      */
     Mesh loadGeometry(const Node &node
                       , const SharedResource::optional &sharedResource) const;
 
-    /** Generic mesh load interface.
+    /** Loads node geometry using given decode context.
+     */
+    Mesh loadGeometry(const Node &node
+                      , const SharedResource::optional &sharedResource
+                      , DecodeContext &context) const;
+
+    /** Generic mesh load interface. Uses DecodeContext::local().
      */
     void loadGeometry(GeometryLoader &loader, const Node &node
                       , const SharedResource::optional &sharedResource) const;
 
+    /** Generic mesh load interface using given decode context. Context must
+     *  not be used by another decode at the same time (std::logic_error is
+     *  thrown).
+     */
+    void loadGeometry(GeometryLoader &loader, const Node &node
+                      , const SharedResource::optional &sharedResource
+                      , DecodeContext &context) const;
+
+    /** Generic mesh load interface with decoding temporaries (vertex and
+     *  texture coordinate indices, face lists) allocated from given memory
+     *  resource.
+     */
+    void loadGeometry(GeometryLoader &loader, const Node &node
+                      , const SharedResource::optional &sharedResource
+                      , pmr::memory_resource *memory) const;
+
+    /** Generic mesh load interface for node from pmr::Tree, see above.
+     */
+    void loadGeometry(GeometryLoader &loader, const pmr::Node &node
+                      , const pmr::SharedResource::optional &sharedResource
+                      , pmr::memory_resource *memory) const;
+
+    /** Loads node geometry into mesh allocated from given memory resource;
+     *  decoding temporaries come from the resource as well. With a
+     *  monotonic_buffer_resource per request the whole decode is released
+     *  at once by releasing the resource.
+     */
+    pmr::Mesh loadGeometry(const Node &node
+                           , const SharedResource::optional &sharedResource
+                           , pmr::memory_resource *memory) const;
+
+    /** Loads geometry of node from pmr::Tree into mesh allocated from given
+     *  memory resource, see above.
+     */
+    pmr::Mesh loadGeometry(const pmr::Node &node
+                           , const pmr::SharedResource::optional
+                           &sharedResource
+                           , pmr::memory_resource *memory) const;
+
+    /** Batch mesh load interface. Nodes are loaded in order of their
+     *  geometry in the archive (for sequential I/O) by the calling thread
+     *  and ThreadPool::instance() workers. Every node is delivered to the
+     *  sink as soon as it is loaded; sink calls are serialized. Each thread
+     *  decodes with its DecodeContext::local().
+     *
+     *  Safe to call from a pool task: the calling thread loads everything
+     *  itself if no worker is free, workers that did not get to help are
+     *  not waited for.
+     *
+     * \param nodes nodes to load, must outlive the call
+     * \param factory creates loader for each node
+     * \param sink receives loaded nodes
+     * \param threads number of threads, 0 means pool size + 1
+     */
+    void loadGeometry(const std::vector<const TreeNode*> &nodes
+                      , const GeometryLoaderFactory &factory
+                      , const GeometrySink &sink, int threads = 0) const;
+
+    /** Reads header of given geometry resource of a node without decoding
+     *  the geometry. Only the header bytes are read (and inflated).
+     */
+    GeometryHeader geometryHeader(const Node &node, int index = 0) const;
+
+    /** Reads headers of all geometry resources of all nodes in the tree in
+     *  parallel. Nodes without geometry map to an empty list.
+     *
+     * \param threads number of threads, 0 means number of CPUs
+     */
+    GeometryHeader::map geometryHeaders(const Tree &tree, int threads = 0)
+        const;
+
     /** Opens texture file for given geometry mesh. If there are more version of
      *  the same texture the returns PNG or JPEG. DDS is ignored.
      */
     roarchive::IStream::pointer texture(const Node &node, int index = 0)
         const;
 
+    /** Non-throwing variant of texture(). Returns null and sets ec to
+     *  Errc::noTexture (no such texture in the node) or Errc::noSuchFile
+     *  (texture file missing in the archive).
+     */
+    roarchive::IStream::pointer texture(const Node &node, int index
+                                        , std::error_code &ec) const;
+
     /** Measures texture image size.
      */
     math::Size2 textureSize(const Node &node, int index = 0) const;
 
+    /** Asynchronous variants of loadNodeIndex, loadGeometry and texture
+     *  running in ThreadPool::instance().
+     *
+     *  Node and shared resource are copied into the task. Archive must
+     *  outlive the task itself: a task keeps running even if its future is
+     *  dropped.
+     */
+    std::future<Node>
+    loadNodeIndexAsync(const boost::filesystem::path &dir
+                       , Priority priority = Priority::normal) const;
+
+    std::future<Mesh>
+    loadGeometryAsync(const Node &node
+                      , const SharedResource::optional &sharedResource
+                      , Priority priority = Priority::normal) const;
+
+    std::future<roarchive::IStream::pointer>
+    textureAsync(const Node &node, int index = 0
+                 , Priority priority = Priority::normal) const;
+
     /** Get raw scene layer info as decoded from file.
      */
     const boost::any& rawSceneLayerInfo() const { return rawSli_; }
@@ -207,15 +493,46 @@ public:
      */
     roarchive::Files fileList() const;
 
+    /** Returns sizes of resources of all nodes. Zip archives are indexed by
+     *  single read of the zip central directory, plain directories by
+     *  file sizes. Nothing is cached, keep the result.
+     *
+     *  Available only for archives opened from a path.
+     */
+    NodeResources::map resourceIndex() const;
+
+    /** Path the archive was opened from, empty if not opened from a path.
+     */
+    const boost::filesystem::path& root() const { return root_; }
+
     /** Has the underlying archive been changed.
      */
     bool changed() const;
 
 private:
-    roarchive::RoArchive archive_;
+    /** Loads node geometry from already read resources (one per geometry
+     *  data).
+     */
+    void loadGeometry(GeometryLoader &loader, const Node &node
+                      , const SharedResource::optional &sharedResource
+                      , const std::vector<char> *data) const;
+
+    typedef std::function<std::shared_ptr<const detail::Source>()>
+        SourceFactory;
+
+    /** Opens source, metadata and scene layer info. Everything, including
+     *  opening the source, is accounted as the open operation.
+     */
+    Archive(const SourceFactory &openSource);
+
+    std::shared_ptr<const detail::Source> source_;
     Metadata metadata_;
     boost::any rawSli_;
     SceneLayerInfo sli_;
+
+    /** Path to archive, empty if not opened from a path.
+     */
+    boost::filesystem::path root_;
 };
 
 } // namespace slpk
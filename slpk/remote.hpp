@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef slpk_remote_hpp_included_
+#define slpk_remote_hpp_included_
+
+#include <string>
+#include <cstddef>
+
+#include <boost/filesystem/path.hpp>
+
+namespace slpk {
+
+/** Access to a remote I3S SceneServer layer, see Archive(RemoteOptions).
+ *
+ *  Resources are fetched over HTTP(S) with connection reuse; concurrent
+ *  requests for the same resource are coalesced into one. Fetched resources
+ *  are kept in a bounded in-memory cache and optionally in a persistent
+ *  on-disk cache; missing resources (HTTP 404, 410) are remembered in
+ *  memory too.
+ */
+struct RemoteOptions {
+    /** Layer URL, e.g. http://host/SceneServer/layers/0
+     */
+    std::string url;
+
+    /** Persistent cache directory. No on-disk cache if empty.
+     */
+    boost::filesystem::path cacheDir;
+
+    /** Maximum number of parallel connections.
+     */
+    unsigned int connections;
+
+    /** In-memory cache size limit in bytes.
+     */
+    std::size_t memoryCache;
+
+    /** Request timeout in seconds, 0 means no timeout.
+     */
+    long timeout;
+
+    /** Number of retries of failed requests (transport errors, HTTP 429
+     *  and 5xx).
+     */
+    unsigned int retries;
+
+    /** Delay before first retry in milliseconds, doubled with every
+     *  following one (randomized down to half to spread retries).
+     */
+    unsigned int retryDelay;
+
+    explicit RemoteOptions(const std::string &url = "")
+        : url(url), connections(8), memoryCache(std::size_t(64) << 20)
+        , timeout(30), retries(2), retryDelay(200)
+    {}
+};
+
+} // namespace slpk
+
+#endif // slpk_remote_hpp_included_
@@ -76,10 +76,23 @@ public:
     std::pair<roarchive::IStream::pointer, const ApiFile*>
     file(const boost::filesystem::path &path) const;
 
+    /** Non-throwing variant of file(). Unknown path sets ec to
+     *  Errc::noSuchFile and returns null pair.
+     */
+    std::pair<roarchive::IStream::pointer, const ApiFile*>
+    file(const boost::filesystem::path &path, std::error_code &ec) const;
+
     /** Reports whether the underlying archive has been changed.
      */
     bool changed() const;
 
+    /** Path (relative to service root) under which given stored file of an
+     *  archive with given scene layer info is served. Returns empty string
+     *  for files the API does not serve.
+     */
+    static std::string url(const SceneLayerInfo &sli
+                           , const boost::filesystem::path &path);
+
 private:
     Archive archive_;
     ApiFile::map files_;
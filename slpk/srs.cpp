@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "dbglog/dbglog.hpp"
+
+#include "srs.hpp"
+
+namespace slpk {
+
+namespace {
+
+std::string key(const geo::SrsDefinition &srs)
+{
+    return std::to_string(static_cast<int>(srs.type)) + ":" + srs.srs;
+}
+
+std::string key(const SpatialReference &sr)
+{
+    if (!sr.wkt.empty()) { return "wkt:" + sr.wkt; }
+    return std::to_string(sr.wkid) + "+" + std::to_string(sr.vcsWkid);
+}
+
+/** Insert-only map guarded by mutex; values are built outside the lock.
+ */
+template <typename T>
+class Cache {
+public:
+    template <typename Factory>
+    const T& get(const std::string &key, const Factory &factory) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto fmap(map_.find(key));
+            if (fmap != map_.end()) { return fmap->second; }
+        }
+
+        T value(factory());
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        return map_.insert(std::make_pair(key, std::move(value)))
+            .first->second;
+    }
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, T> map_;
+};
+
+} // namespace
+
+const geo::SrsDefinition& cachedSrs(const SpatialReference &sr)
+{
+    static Cache<geo::SrsDefinition> cache;
+    return cache.get(key(sr), [&]() { return sr.srs(); });
+}
+
+const HeightModelInfo& cachedHeightModelInfo(const geo::SrsDefinition &srs)
+{
+    static Cache<HeightModelInfo> cache;
+    return cache.get(key(srs), [&]() { return HeightModelInfo(srs); });
+}
+
+CsConvertorPool::Lease::~Lease()
+{
+    if (conv_) { pool_->release(key_, std::move(conv_)); }
+}
+
+CsConvertorPool::Lease
+CsConvertorPool::get(const geo::SrsDefinition &src
+                     , const geo::SrsDefinition &dst)
+{
+    const auto k(key(src) + "\n" + key(dst));
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto fidle(idle_.find(k));
+        if ((fidle != idle_.end()) && !fidle->second.empty()) {
+            std::unique_ptr<geo::CsConvertor> conv
+                (std::move(fidle->second.back()));
+            fidle->second.pop_back();
+            return Lease(*this, k, std::move(conv));
+        }
+    }
+
+    LOG(info1) << "Creating convertor " << src << " -> " << dst << ".";
+    return Lease(*this, k, std::unique_ptr<geo::CsConvertor>
+                 (new geo::CsConvertor(src, dst)));
+}
+
+void CsConvertorPool::release(const std::string &key
+                              , std::unique_ptr<geo::CsConvertor> &&conv)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_[key].push_back(std::move(conv));
+}
+
+void CsConvertorPool::clear()
+{
+    decltype(idle_) idle;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::swap(idle, idle_);
+    }
+}
+
+CsConvertorPool& CsConvertorPool::instance()
+{
+    static CsConvertorPool pool;
+    return pool;
+}
+
+} // namespace slpk
@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef slpk_srs_hpp_included_
+#define slpk_srs_hpp_included_
+
+#include <memory>
+#include <mutex>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "geo/srsdef.hpp"
+#include "geo/csconvertor.hpp"
+
+#include "types.hpp"
+
+namespace slpk {
+
+/** Process-wide cache of SRS definitions built from spatial references.
+ *  Thread safe; returned references are valid for the process lifetime.
+ */
+const geo::SrsDefinition& cachedSrs(const SpatialReference &sr);
+
+/** Process-wide cache of height model info parsed from SRS definitions.
+ *  Thread safe; returned references are valid for the process lifetime.
+ */
+const HeightModelInfo& cachedHeightModelInfo(const geo::SrsDefinition &srs);
+
+/** Thread safe pool of coordinate system convertors keyed by (src, dst)
+ *  SRS. Convertor is not thread safe itself: it is leased to a single user
+ *  and returned to the pool when the lease is destroyed, so every pair is
+ *  set up at most once per concurrently used instance.
+ */
+class CsConvertorPool {
+public:
+    class Lease {
+    public:
+        Lease(Lease &&o)
+            : pool_(o.pool_), key_(std::move(o.key_))
+            , conv_(std::move(o.conv_))
+        {}
+
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        const geo::CsConvertor& operator*() const { return *conv_; }
+        operator const geo::CsConvertor&() const { return *conv_; }
+
+        template <typename T> T operator()(const T &p) const {
+            return (*conv_)(p);
+        }
+
+    private:
+        friend class CsConvertorPool;
+
+        Lease(CsConvertorPool &pool, const std::string &key
+              , std::unique_ptr<geo::CsConvertor> &&conv)
+            : pool_(&pool), key_(key), conv_(std::move(conv))
+        {}
+
+        CsConvertorPool *pool_;
+        std::string key_;
+        std::unique_ptr<geo::CsConvertor> conv_;
+    };
+
+    /** Leases convertor from src to dst. Creates new one if there is no idle
+     *  convertor for this pair.
+     */
+    Lease get(const geo::SrsDefinition &src, const geo::SrsDefinition &dst);
+
+    /** Drops all idle convertors.
+     */
+    void clear();
+
+    /** Process-wide pool.
+     */
+    static CsConvertorPool& instance();
+
+private:
+    void release(const std::string &key
+                 , std::unique_ptr<geo::CsConvertor> &&conv);
+
+    std::mutex mutex_;
+    std::map<std::string, std::vector<std::unique_ptr<geo::CsConvertor>>>
+        idle_;
+};
+
+} // namespace slpk
+
+#endif // slpk_srs_hpp_included_
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** Replacement of global operator new/delete feeding slpk::stats.
+ *
+ *  Compiled in only with SLPK_STATS. Every block is prefixed with its size
+ *  so deallocations can be accounted for.
+ */
+
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+
+#include "stats.hpp"
+
+namespace {
+
+// keeps returned memory aligned as malloc does
+constexpr std::size_t HeaderSize(alignof(std::max_align_t));
+
+void* allocate(std::size_t size) noexcept
+{
+    auto *p(static_cast<char*>(std::malloc(size + HeaderSize)));
+    if (!p) { return nullptr; }
+    *reinterpret_cast<std::size_t*>(p) = size;
+    slpk::stats::allocated(size);
+    return p + HeaderSize;
+}
+
+void release(void *ptr) noexcept
+{
+    if (!ptr) { return; }
+    auto *p(static_cast<char*>(ptr) - HeaderSize);
+    slpk::stats::deallocated(*reinterpret_cast<std::size_t*>(p));
+    std::free(p);
+}
+
+void* allocateOrThrow(std::size_t size)
+{
+    for (;;) {
+        if (auto *p = allocate(size)) { return p; }
+        auto handler(std::get_new_handler());
+        if (!handler) { throw std::bad_alloc(); }
+        handler();
+    }
+}
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    return allocateOrThrow(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocateOrThrow(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void *p) noexcept { release(p); }
+void operator delete[](void *p) noexcept { release(p); }
+void operator delete(void *p, std::size_t) noexcept { release(p); }
+void operator delete[](void *p, std::size_t) noexcept { release(p); }
+
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{
+    release(p);
+}
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atomic>
+
+#include "stats.hpp"
+
+namespace slpk { namespace stats {
+
+namespace {
+
+constexpr std::size_t OperationCount
+    (sizeof(operations) / sizeof(operations[0]));
+
+struct AtomicCounters {
+    std::atomic<std::size_t> calls;
+    std::atomic<std::size_t> allocations;
+    std::atomic<std::size_t> bytes;
+};
+
+// zero-initialized (static storage), no dynamic initialization so it is
+// safe to be used from operator new before main
+AtomicCounters counters[OperationCount];
+std::atomic<std::size_t> allocations;
+std::atomic<std::size_t> liveBytes;
+std::atomic<std::size_t> peakLiveBytes;
+
+// bit mask of operations active in this thread
+thread_local std::uint32_t active(0);
+
+} // namespace
+
+bool enabled()
+{
+#ifdef SLPK_HAS_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+Stats snapshot()
+{
+    Stats stats;
+    stats.enabled = enabled();
+    if (!stats.enabled) { return stats; }
+
+    for (std::size_t i(0); i < OperationCount; ++i) {
+        auto &c(stats.operations[operations[i]]);
+        c.calls = counters[i].calls;
+        c.allocations = counters[i].allocations;
+        c.bytes = counters[i].bytes;
+    }
+    stats.allocations = allocations;
+    stats.liveBytes = liveBytes;
+    stats.peakLiveBytes = peakLiveBytes;
+    return stats;
+}
+
+void reset()
+{
+    for (auto &c : counters) {
+        c.calls = 0;
+        c.allocations = 0;
+        c.bytes = 0;
+    }
+    peakLiveBytes.store(liveBytes);
+}
+
+Scope::Scope(Operation operation)
+    : previous_(active)
+{
+    const auto bit(std::uint32_t(1) << static_cast<int>(operation));
+
+    // count only outermost scope of given operation
+    if (!(active & bit)) {
+        ++counters[static_cast<int>(operation)].calls;
+        active |= bit;
+    }
+}
+
+Scope::~Scope()
+{
+    active = previous_;
+}
+
+void allocated(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    const auto live(liveBytes += size);
+    auto peak(peakLiveBytes.load(std::memory_order_relaxed));
+    while ((live > peak)
+           && !peakLiveBytes.compare_exchange_weak
+           (peak, live, std::memory_order_relaxed))
+    {}
+
+    for (auto mask(active); mask; mask &= (mask - 1)) {
+        auto &c(counters[__builtin_ctz(mask)]);
+        c.allocations.fetch_add(1, std::memory_order_relaxed);
+        c.bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+void deallocated(std::size_t size)
+{
+    liveBytes -= size;
+}
+
+} } // namespace slpk::stats
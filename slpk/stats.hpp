@@ -0,0 +1,147 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef slpk_stats_hpp_included_
+#define slpk_stats_hpp_included_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+#include "utility/enum-io.hpp"
+
+/** Memory instrumentation of archive operations.
+ *
+ *  Counting is compiled in only when the library is built with SLPK_STATS
+ *  CMake option (which defines SLPK_HAS_STATS). In such build the library
+ *  replaces global operator new/delete to see every allocation; otherwise
+ *  scopes compile to nothing and snapshot() returns empty statistics.
+ */
+
+namespace slpk { namespace stats {
+
+UTILITY_GENERATE_ENUM_CI(Operation,
+                         ((open))
+                         ((loadNodeIndex))
+                         ((loadTree))
+                         ((loadNodes))
+                         ((loadGeometry))
+                         ((texture))
+                         ((restApi))
+                         )
+
+/** All operations, in enum order.
+ */
+const Operation operations[] = {
+    Operation::open, Operation::loadNodeIndex, Operation::loadTree
+    , Operation::loadNodes, Operation::loadGeometry, Operation::texture
+    , Operation::restApi
+};
+
+struct Counters {
+    /** Number of entered (outermost) scopes of this operation.
+     */
+    std::size_t calls;
+
+    /** Number of allocations made inside this operation (including nested
+     *  operations).
+     */
+    std::size_t allocations;
+
+    /** Number of bytes allocated inside this operation (including nested
+     *  operations).
+     */
+    std::size_t bytes;
+
+    Counters() : calls(), allocations(), bytes() {}
+};
+
+struct Stats {
+    /** False if the library has been built without instrumentation.
+     */
+    bool enabled;
+
+    std::map<Operation, Counters> operations;
+
+    /** Number of allocations (whole process).
+     */
+    std::size_t allocations;
+
+    /** Bytes allocated and not yet freed (whole process).
+     */
+    std::size_t liveBytes;
+
+    /** Maximum of liveBytes since start or last reset.
+     */
+    std::size_t peakLiveBytes;
+
+    Stats() : enabled(), allocations(), liveBytes(), peakLiveBytes() {}
+};
+
+/** Returns true if instrumentation is compiled in.
+ */
+bool enabled();
+
+/** Returns current statistics.
+ */
+Stats snapshot();
+
+/** Resets operation counters; peak live bytes is reset to current live
+ *  bytes.
+ */
+void reset();
+
+/** Marks current thread as running given operation until destroyed. Scopes
+ *  can be nested.
+ */
+class Scope {
+public:
+    Scope(Operation operation);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    std::uint32_t previous_;
+};
+
+/** Allocation hooks. Called by the replacement operator new/delete.
+ */
+void allocated(std::size_t size);
+void deallocated(std::size_t size);
+
+} } // namespace slpk::stats
+
+#ifdef SLPK_HAS_STATS
+#  define SLPK_STATS_SCOPE(OPERATION)                                   \
+    ::slpk::stats::Scope slpk_stats_scope_                              \
+        (::slpk::stats::Operation::OPERATION)
+#else
+#  define SLPK_STATS_SCOPE(OPERATION)
+#endif
+
+#endif // slpk_stats_hpp_included_
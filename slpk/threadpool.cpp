@@ -0,0 +1,179 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+
+#include "dbglog/dbglog.hpp"
+
+#include "threadpool.hpp"
+
+namespace slpk {
+
+namespace {
+
+const std::size_t PriorityCount(3);
+
+/** Pool and worker index of current thread.
+ */
+thread_local const ThreadPool *currentPool(nullptr);
+thread_local std::size_t currentWorker(0);
+
+std::mutex instanceMutex;
+std::unique_ptr<ThreadPool> instancePool;
+std::size_t instanceSize(0);
+
+} // namespace
+
+struct ThreadPool::Worker {
+    std::mutex mutex;
+    std::deque<Task> queues[PriorityCount];
+};
+
+ThreadPool::ThreadPool(std::size_t threads)
+    : pending_(0), next_(0), stop_(false)
+{
+    if (!threads) { threads = std::thread::hardware_concurrency(); }
+    if (!threads) { threads = 1; }
+
+    for (std::size_t i(0); i < threads; ++i) {
+        workers_.emplace_back(new Worker());
+    }
+
+    for (std::size_t i(0); i < threads; ++i) {
+        threads_.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+
+    for (auto &thread : threads_) { thread.join(); }
+}
+
+void ThreadPool::post(Task task, Priority priority)
+{
+    const auto index((currentPool == this)
+                     ? currentWorker
+                     : (next_++ % workers_.size()));
+
+    {
+        auto &worker(*workers_[index]);
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        worker.queues[static_cast<int>(priority)]
+            .push_back(std::move(task));
+    }
+
+    {
+        // under lock to not lose wakeup of a worker going to sleep
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++pending_;
+    }
+    cv_.notify_one();
+}
+
+bool ThreadPool::take(std::size_t index, Task &task)
+{
+    const auto count(workers_.size());
+
+    for (std::size_t p(0); p < PriorityCount; ++p) {
+        // own queue first, newest task
+        {
+            auto &worker(*workers_[index]);
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            auto &queue(worker.queues[p]);
+            if (!queue.empty()) {
+                task = std::move(queue.back());
+                queue.pop_back();
+                return true;
+            }
+        }
+
+        // steal oldest task from others
+        for (std::size_t i(1); i < count; ++i) {
+            auto &worker(*workers_[(index + i) % count]);
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            auto &queue(worker.queues[p]);
+            if (!queue.empty()) {
+                task = std::move(queue.front());
+                queue.pop_front();
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::run(std::size_t index)
+{
+    currentPool = this;
+    currentWorker = index;
+
+    for (;;) {
+        Task task;
+        if (take(index, task)) {
+            --pending_;
+            try {
+                task();
+            } catch (const std::exception &e) {
+                LOG(err2) << "Thread pool task failed: " << e.what();
+            } catch (...) {
+                LOG(err2) << "Thread pool task failed with unknown error.";
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&]() { return stop_ || pending_; });
+        if (stop_ && !pending_) { return; }
+    }
+}
+
+ThreadPool& ThreadPool::instance()
+{
+    std::unique_lock<std::mutex> lock(instanceMutex);
+    if (!instancePool) { instancePool.reset(new ThreadPool(instanceSize)); }
+    return *instancePool;
+}
+
+void ThreadPool::configure(std::size_t threads)
+{
+    std::unique_lock<std::mutex> lock(instanceMutex);
+    if (instancePool) {
+        LOGTHROW(err1, std::logic_error)
+            << "Library thread pool is already running.";
+    }
+    instanceSize = threads;
+}
+
+} // namespace slpk
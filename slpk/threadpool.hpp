@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef slpk_threadpool_hpp_included_
+#define slpk_threadpool_hpp_included_
+
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+namespace slpk {
+
+/** Task priority. Higher priority tasks are always taken first.
+ */
+enum class Priority { high = 0, normal = 1, low = 2 };
+
+/** Work-stealing thread pool.
+ *
+ *  Every worker has its own task queues (one per priority). Tasks posted
+ *  from a worker go to its own queues (processed LIFO), tasks posted from
+ *  other threads are distributed round-robin. Idle workers steal (FIFO)
+ *  from the others.
+ *
+ *  Never block on a future of a pool task inside another pool task: the
+ *  pool does not grow.
+ */
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    /** Creates pool with given number of workers, 0 means number of CPUs.
+     */
+    explicit ThreadPool(std::size_t threads = 0);
+
+    /** Runs all queued tasks and joins workers.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** Queues task. Exceptions thrown by the task are logged and dropped.
+     */
+    void post(Task task, Priority priority = Priority::normal);
+
+    /** Queues function, returns future of its result.
+     */
+    template <typename Function>
+    std::future<typename std::result_of<Function()>::type>
+    submit(Function &&function, Priority priority = Priority::normal);
+
+    std::size_t size() const { return workers_.size(); }
+
+    /** Library-wide pool used by Archive's asynchronous API. Created on
+     *  first use.
+     */
+    static ThreadPool& instance();
+
+    /** Sets number of workers of library-wide pool. Must be called before
+     *  first use of instance(), otherwise throws.
+     */
+    static void configure(std::size_t threads);
+
+private:
+    struct Worker;
+
+    void run(std::size_t index);
+    bool take(std::size_t index, Task &task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::atomic<std::size_t> pending_;
+    std::atomic<std::size_t> next_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+};
+
+// inlines
+
+template <typename Function>
+std::future<typename std::result_of<Function()>::type>
+ThreadPool::submit(Function &&function, Priority priority)
+{
+    typedef typename std::result_of<Function()>::type Result;
+
+    // std::function needs copyable target
+    auto task(std::make_shared<std::packaged_task<Result()>>
+              (std::forward<Function>(function)));
+    auto future(task->get_future());
+    post([task]() { (*task)(); }, priority);
+    return future;
+}
+
+} // namespace slpk
+
+#endif // slpk_threadpool_hpp_included_
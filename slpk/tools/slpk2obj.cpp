@@ -25,6 +25,11 @@
  */
 
 #include <set>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
 
 #include <boost/optional.hpp>
 #include <boost/utility/in_place_factory.hpp>
@@ -47,6 +52,8 @@
 #include "geo/csconvertor.hpp"
 
 #include "slpk/reader.hpp"
+#include "slpk/srs.hpp"
+#include "slpk/trace.hpp"
 
 namespace po = boost::program_options;
 namespace bio = boost::iostreams;
@@ -72,6 +79,7 @@ public:
     Slpk2Obj()
         : service::Cmdline("slpk2obj", BUILD_TARGET_VERSION)
         , overwrite_(false), srs_(3857)
+        , weldTolerance_(1e-3), atlasSize_(8192)
     {}
 
 private:
@@ -94,6 +102,12 @@ private:
     geo::SrsDefinition srs_;
 
     boost::optional<NodeIdSet> nodes_;
+
+    boost::optional<int> level_;
+    double weldTolerance_;
+    int atlasSize_;
+
+    boost::optional<fs::path> trace_;
 };
 
 void Slpk2Obj::configuration(po::options_description &cmdline
@@ -110,6 +124,20 @@ void Slpk2Obj::configuration(po::options_description &cmdline
          , "Destination SRS of converted meshes.")
         ("nodes", po::value<NodeIdList>()
          , "Limit output to listed nodes.")
+        ("level", po::value<int>()
+         , "Export only nodes at given LOD level as a single merged mesh "
+         "with welded vertices and textures combined into atlases.")
+        ("weldTolerance", po::value(&weldTolerance_)
+         ->default_value(weldTolerance_)->required()
+         , "Maximum distance (in destination SRS units) of two vertices "
+         "to be welded together when merging level.")
+        ("atlasSize", po::value(&atlasSize_)
+         ->default_value(atlasSize_)->required()
+         , "Maximum width/height of generated texture atlas when merging "
+         "level.")
+        ("trace", po::value<fs::path>()
+         , "Record timeline of conversion and save it to given file "
+         "in Chrome trace-event JSON format.")
         ;
 
     pd
@@ -128,6 +156,24 @@ void Slpk2Obj::configure(const po::variables_map &vars)
         const auto &raw(vars["nodes"].as<NodeIdList>());
         nodes_ = boost::in_place(raw.begin(), raw.end());
     }
+
+    if (vars.count("level")) {
+        level_ = vars["level"].as<int>();
+    }
+
+    if (vars.count("trace")) {
+        trace_ = vars["trace"].as<fs::path>();
+    }
+
+    if (weldTolerance_ < 0.0) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "weldTolerance");
+    }
+
+    if (atlasSize_ <= 0) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "atlasSize");
+    }
 }
 
 bool Slpk2Obj::help(std::ostream &out, const std::string &what) const
@@ -137,6 +183,15 @@ bool Slpk2Obj::help(std::ostream &out, const std::string &what) const
 
     Converts SLPK archive into textured meshes in OBJ format.
 
+    With --level, only nodes at given LOD level are converted and merged
+    into single mesh (OUTPUT/level-N.obj). Vertices closer than
+    --weldTolerance are welded together and textures are packed into one
+    or more texture atlases not larger than --atlasSize.
+
+    With --trace, spans of archive access, decoding and conversion are
+    recorded per thread and saved as Chrome trace-event JSON viewable in
+    chrome://tracing or Perfetto UI.
+
 usage
     slpk2obj INPUT OUTPUT [OPTIONS]
 )RAW";
@@ -154,33 +209,18 @@ void writeMtl(const fs::path &path, const std::string &name)
       << "\n";
 }
 
-class DeepCopyCsCovertor {
-public:
-    DeepCopyCsCovertor(geo::SrsDefinition src, geo::SrsDefinition dst)
-        : src_(src), dst_(dst), conv_(src_, dst_)
-    {}
-
-    DeepCopyCsCovertor(const DeepCopyCsCovertor &c)
-        : src_(c.src_), dst_(c.dst_), conv_(src_, dst_)
-    {}
+void writeMtl(const fs::path &path, const std::vector<std::string> &names)
+{
+    LOG(info1) << "Writing " << path;
+    std::ofstream f(path.string());
 
-    DeepCopyCsCovertor& operator=(const DeepCopyCsCovertor &c) {
-        src_ = c.src_;
-        dst_ = c.dst_;
-        conv_ = geo::CsConvertor(src_, dst_);
-        return *this;
+    int index(0);
+    for (const auto &name : names) {
+        f << "newmtl " << index++ << "\n"
+          << "map_Kd " << name
+          << "\n";
     }
-
-    operator const geo::CsConvertor&() const { return conv_; }
-
-    template <typename T> T operator()(const T &p) const { return conv_(p); }
-
-private:
-    geo::SrsDefinition src_;
-    geo::SrsDefinition dst_;
-
-    geo::CsConvertor conv_;
-};
+}
 
 /** Loads SLPK geometry as a list of submeshes.
  */
@@ -211,7 +251,7 @@ private:
 
 math::Extents2 measureMesh(const slpk::Tree &tree
                            , const slpk::Archive &input
-                           , DeepCopyCsCovertor conv
+                           , const geo::SrsDefinition &srs
                            , const boost::optional<NodeIdSet> &pickedNodes)
 {
     // find topLevel
@@ -236,14 +276,18 @@ math::Extents2 measureMesh(const slpk::Tree &tree
 
     math::Extents2 extents(math::InvalidExtents{});
 
-    UTILITY_OMP(parallel for firstprivate(conv), shared(extents, treeNodes))
+    auto &pool(slpk::CsConvertorPool::instance());
+    const auto srcSrs(input.srs());
+
+    UTILITY_OMP(parallel for shared(extents, treeNodes))
     for (std::size_t i = 0; i < treeNodes.size(); ++i) {
         const auto &treeNode(*treeNodes[i]);
         const auto &node(treeNode.node);
+        const auto conv(pool.get(srcSrs, srs));
 
         // load geometry
         math::Extents2 e(math::InvalidExtents{});
-        MeasureMesh loader(conv, e);
+        MeasureMesh loader(*conv, e);
         input.loadGeometry(loader, node, treeNode.sharedResource);
 
         UTILITY_OMP(critical(slpk2obj_measureMesh))
@@ -258,6 +302,7 @@ math::Extents2 measureMesh(const slpk::Tree &tree
 
 cv::Mat stream2mat(const roarchive::IStream::pointer &txStream)
 {
+    slpk::trace::Span span("texture.decode", "slpk2obj");
     const auto buf(txStream->read());
     const auto image(cv::imdecode(buf, CV_LOAD_IMAGE_COLOR));
 
@@ -284,9 +329,11 @@ inline math::Point2d& denormalize(const math::Size2f &rsize, math::Point2d &tc)
     return tc;
 }
 
-void rebuild(slpk::SubMesh &submesh
-             , const roarchive::IStream::pointer &txStream
-             , const fs::path &texPath)
+/** Unpacks texture regions of given submesh into single texture. Texture
+ *  coordinates are remapped to new texture.
+ */
+cv::Mat rebuild(slpk::SubMesh &submesh
+                , const roarchive::IStream::pointer &txStream)
 {
     const auto tx(stream2mat(txStream));
 
@@ -400,7 +447,14 @@ void rebuild(slpk::SubMesh &submesh
         }
     }
 
-    cv::imwrite(texPath.string(), otx
+    return otx;
+}
+
+void writeTexture(const fs::path &path, const cv::Mat &tx)
+{
+    slpk::trace::Span span("texture.encode", "slpk2obj");
+    LOG(info1) << "Writing " << path;
+    cv::imwrite(path.string(), tx
                 , { cv::IMWRITE_JPEG_QUALITY, 85
                     , cv::IMWRITE_PNG_COMPRESSION, 9 });
 }
@@ -409,13 +463,13 @@ void write(const slpk::Archive &input, fs::path &output
            , const geo::SrsDefinition &srs
            , const boost::optional<NodeIdSet> &pickedNodes)
 {
-    DeepCopyCsCovertor conv
-        (input.sceneLayerInfo().spatialReference.srs(), srs);
+    auto &pool(slpk::CsConvertorPool::instance());
+    const auto srcSrs(input.srs());
 
     const auto tree(input.loadTree());
 
     // find extents in destination SRS to localize mesh
-    const auto extents(measureMesh(tree, input, conv, pickedNodes));
+    const auto extents(measureMesh(tree, input, srs, pickedNodes));
     const auto center(math::center(extents));
 
     // collect nodes for OpenMP
@@ -425,11 +479,13 @@ void write(const slpk::Archive &input, fs::path &output
         treeNodes.push_back(&item.second);
     }
 
-    UTILITY_OMP(parallel for firstprivate(conv), shared(treeNodes, center))
+    UTILITY_OMP(parallel for shared(treeNodes, center))
     for (std::size_t i = 0; i < treeNodes.size(); ++i) {
         const auto &treeNode(*treeNodes[i]);
         const auto &node(treeNode.node);
+        const auto conv(pool.get(srcSrs, srs));
 
+        slpk::trace::Span span("node.convert", "slpk2obj");
         LOG(info3) << "Converting <" << node.id << ">.";
 
         auto geometry(input.loadGeometry(node, treeNode.sharedResource));
@@ -464,7 +520,7 @@ void write(const slpk::Archive &input, fs::path &output
             } else {
                 // texture atlas, need to repack/unpack texture
                 texPath = utility::addExtension(path, ".jpg");
-                rebuild(submesh, texture, texPath);
+                writeTexture(texPath, rebuild(submesh, texture));
             }
 
             {
@@ -481,12 +537,459 @@ void write(const slpk::Archive &input, fs::path &output
     }
 }
 
+/** Single submesh prepared for merging. Vertices are in destination SRS and
+ *  texture regions (if any) are already unpacked.
+ */
+struct Part {
+    geometry::Mesh mesh;
+    cv::Mat texture;
+
+    /** Atlas index and texture position inside the atlas.
+     */
+    int atlas;
+    math::Point2i origin;
+
+    typedef std::vector<Part> list;
+
+    Part() : atlas() {}
+};
+
+/** Vertex welder. Vertices are stored in a spatial hash with cells of
+ *  tolerance size, so only neighbouring cells need to be searched.
+ */
+class Welder {
+public:
+    Welder(math::Points3d &vertices, double tolerance)
+        : vertices_(vertices), tolerance_(tolerance)
+        , tolerance2_(tolerance * tolerance)
+    {}
+
+    /** Returns index of given vertex in the output vertex list. Reuses
+     *  existing vertex if it is closer than tolerance.
+     */
+    int vertex(const math::Point3d &v);
+
+private:
+    struct Cell {
+        long i, j, k;
+
+        Cell(long i = 0, long j = 0, long k = 0) : i(i), j(j), k(k) {}
+
+        bool operator==(const Cell &o) const {
+            return (i == o.i) && (j == o.j) && (k == o.k);
+        }
+    };
+
+    struct CellHash {
+        std::size_t operator()(const Cell &c) const {
+            std::size_t seed(std::hash<long>()(c.i));
+            seed ^= std::hash<long>()(c.j) + 0x9e3779b9 + (seed << 6)
+                + (seed >> 2);
+            seed ^= std::hash<long>()(c.k) + 0x9e3779b9 + (seed << 6)
+                + (seed >> 2);
+            return seed;
+        }
+    };
+
+    typedef std::unordered_map<Cell, std::vector<int>, CellHash> Cells;
+
+    /** Grid cell of given vertex. With zero tolerance the cell is the
+     *  vertex itself (bit pattern of its coordinates), i.e. an exact key.
+     */
+    Cell cell(const math::Point3d &v) const {
+        if (!tolerance_) {
+            return Cell(bits(v(0)), bits(v(1)), bits(v(2)));
+        }
+        return Cell(long(std::floor(v(0) / tolerance_))
+                    , long(std::floor(v(1) / tolerance_))
+                    , long(std::floor(v(2) / tolerance_)));
+    }
+
+    static long bits(double value) {
+        static_assert(sizeof(long) == sizeof(double)
+                      , "Exact vertex key needs 64-bit long.");
+        // make -0.0 and 0.0 the same key
+        value += 0.0;
+        long key;
+        std::memcpy(&key, &value, sizeof(key));
+        return key;
+    }
+
+    math::Points3d &vertices_;
+    double tolerance_;
+    double tolerance2_;
+    Cells cells_;
+};
+
+int Welder::vertex(const math::Point3d &v)
+{
+    const auto c(cell(v));
+
+    // zero tolerance: only exact matches, no need to look around
+    const long span(tolerance_ ? 1 : 0);
+
+    for (long k(c.k - span); k <= c.k + span; ++k) {
+        for (long j(c.j - span); j <= c.j + span; ++j) {
+            for (long i(c.i - span); i <= c.i + span; ++i) {
+                auto fcells(cells_.find(Cell(i, j, k)));
+                if (fcells == cells_.end()) { continue; }
+
+                for (const auto index : fcells->second) {
+                    const auto &o(vertices_[index]);
+                    const auto dx(o(0) - v(0));
+                    const auto dy(o(1) - v(1));
+                    const auto dz(o(2) - v(2));
+                    if ((dx * dx + dy * dy + dz * dz) <= tolerance2_) {
+                        return index;
+                    }
+                }
+            }
+        }
+    }
+
+    const int index(vertices_.size());
+    vertices_.push_back(v);
+    cells_[c].push_back(index);
+    return index;
+}
+
+/** Accumulates meshes into one, welding vertices on the way.
+ */
+class Merger {
+public:
+    Merger(double tolerance)
+        : welder_(mesh_.vertices, tolerance), degenerated_()
+    {}
+
+    Merger(const Merger&) = delete;
+    Merger& operator=(const Merger&) = delete;
+
+    void add(const geometry::Mesh &mesh);
+
+    void add(const Merger &merger) {
+        add(merger.mesh_);
+        degenerated_ += merger.degenerated_;
+    }
+
+    geometry::Mesh& mesh() { return mesh_; }
+
+    std::size_t degenerated() const { return degenerated_; }
+
+private:
+    geometry::Mesh mesh_;
+    Welder welder_;
+    std::size_t degenerated_;
+};
+
+void Merger::add(const geometry::Mesh &mesh)
+{
+    std::vector<int> vmap;
+    vmap.reserve(mesh.vertices.size());
+    for (const auto &v : mesh.vertices) {
+        vmap.push_back(welder_.vertex(v));
+    }
+
+    // texture coordinates are not welded, just append them
+    const int tcOffset(mesh_.tCoords.size());
+    mesh_.tCoords.insert(mesh_.tCoords.end()
+                         , mesh.tCoords.begin(), mesh.tCoords.end());
+
+    for (const auto &face : mesh.faces) {
+        const auto a(vmap[face.a]);
+        const auto b(vmap[face.b]);
+        const auto c(vmap[face.c]);
+
+        // face collapsed by welding
+        if ((a == b) || (b == c) || (c == a)) {
+            ++degenerated_;
+            continue;
+        }
+
+        mesh_.faces.emplace_back(a, b, c
+                                 , face.ta + tcOffset
+                                 , face.tb + tcOffset
+                                 , face.tc + tcOffset
+                                 , face.imageId);
+    }
+}
+
+/** Packs part textures into atlases (simple shelf packing of textures sorted
+ *  by height). Texture larger than atlas size gets its own atlas.
+ *
+ *  Returns list of atlas sizes.
+ */
+std::vector<math::Size2> packAtlases(Part::list &parts, int atlasSize)
+{
+    std::vector<Part*> sorted;
+    for (auto &part : parts) { sorted.push_back(&part); }
+
+    std::sort(sorted.begin(), sorted.end()
+              , [](const Part *l, const Part *r) -> bool
+    {
+        if (l->texture.rows != r->texture.rows) {
+            return l->texture.rows > r->texture.rows;
+        }
+        return l->texture.cols > r->texture.cols;
+    });
+
+    std::vector<math::Size2> atlases;
+    int x(0), y(0), shelfHeight(0);
+
+    // atlas being packed, none if negative
+    int current(-1);
+
+    for (auto *part : sorted) {
+        const math::Size2 size(part->texture.cols, part->texture.rows);
+
+        if ((size.width > atlasSize) || (size.height > atlasSize)) {
+            // oversized texture gets its own atlas
+            atlases.push_back(size);
+            part->atlas = atlases.size() - 1;
+            part->origin = math::Point2i(0, 0);
+            continue;
+        }
+
+        if (current >= 0) {
+            if (x && ((x + size.width) > atlasSize)) {
+                // next shelf
+                y += shelfHeight;
+                x = shelfHeight = 0;
+            }
+
+            // atlas full
+            if (y && ((y + size.height) > atlasSize)) { current = -1; }
+        }
+
+        if (current < 0) {
+            current = atlases.size();
+            atlases.emplace_back(0, 0);
+            x = y = shelfHeight = 0;
+        }
+
+        part->atlas = current;
+        part->origin = math::Point2i(x, y);
+
+        x += size.width;
+        shelfHeight = std::max(shelfHeight, size.height);
+
+        auto &atlas(atlases[current]);
+        atlas.width = std::max(atlas.width, x);
+        atlas.height = std::max(atlas.height, y + size.height);
+    }
+
+    return atlases;
+}
+
+/** Maps part's texture coordinates into its atlas.
+ */
+void remap(Part &part, const math::Size2 &atlasSize)
+{
+    const math::Size2 size(part.texture.cols, part.texture.rows);
+
+    for (auto &tc : part.mesh.tCoords) {
+        tc(0) = (part.origin(0) + tc(0) * size.width) / atlasSize.width;
+        tc(1) = 1.0 - ((part.origin(1) + (1.0 - tc(1)) * size.height)
+                       / atlasSize.height);
+    }
+
+    for (auto &face : part.mesh.faces) { face.imageId = part.atlas; }
+}
+
+/** Number of consecutive parts merged into one partial mesh.
+ */
+const std::size_t MergeRunSize(16);
+
+struct MergeOptions {
+    double weldTolerance;
+    int atlasSize;
+};
+
+void writeLevel(const slpk::Archive &input, fs::path &output
+                , const geo::SrsDefinition &srs, int level
+                , const MergeOptions &options
+                , const boost::optional<NodeIdSet> &pickedNodes)
+{
+    auto &pool(slpk::CsConvertorPool::instance());
+    const auto srcSrs(input.srs());
+
+    const auto tree(input.loadTree());
+
+    // collect nodes for OpenMP
+    std::vector<const slpk::TreeNode*> treeNodes;
+    for (const auto &item : tree.nodes) {
+        if (notPicked(item.first, pickedNodes)) { continue; }
+        const auto &node(item.second.node);
+        if ((node.level == level) && node.hasGeometry()) {
+            treeNodes.push_back(&item.second);
+        }
+    }
+
+    if (treeNodes.empty()) {
+        LOGTHROW(err2, std::runtime_error)
+            << "No node with geometry at level " << level << ".";
+    }
+
+    LOG(info3) << "Loading " << treeNodes.size() << " nodes at level "
+               << level << ".";
+
+    // load all submeshes, keep node order for deterministic output
+    std::vector<Part::list> nodeParts(treeNodes.size());
+
+    UTILITY_OMP(parallel for shared(treeNodes, nodeParts)
+                schedule(dynamic))
+    for (std::size_t i = 0; i < treeNodes.size(); ++i) {
+        const auto &treeNode(*treeNodes[i]);
+        const auto &node(treeNode.node);
+        const auto conv(pool.get(srcSrs, srs));
+
+        slpk::trace::Span span("node.load", "slpk2obj");
+        LOG(info2) << "Loading <" << node.id << ">.";
+
+        auto geometry(input.loadGeometry(node, treeNode.sharedResource));
+
+        auto &parts(nodeParts[i]);
+        int meshIndex(0);
+        for (auto &submesh : geometry.submeshes) {
+            for (auto &v : submesh.mesh.vertices) { v = conv(v); }
+
+            parts.emplace_back();
+            auto &part(parts.back());
+
+            auto texture(input.texture(node, meshIndex++));
+            part.texture = (submesh.regions.empty()
+                            ? stream2mat(texture)
+                            : rebuild(submesh, texture));
+            part.mesh = std::move(submesh.mesh);
+        }
+    }
+
+    Part::list parts;
+    for (auto &np : nodeParts) {
+        for (auto &part : np) { parts.push_back(std::move(part)); }
+    }
+    nodeParts.clear();
+
+    // pack textures into atlases and map texture coordinates
+    const auto atlases(packAtlases(parts, options.atlasSize));
+    LOG(info3) << "Packed " << parts.size() << " textures into "
+               << atlases.size() << " atlas(es).";
+
+    create_directories(output);
+    const auto base(output / ("level-" + std::to_string(level)));
+
+    std::vector<std::string> atlasNames;
+    for (std::size_t a(0); a < atlases.size(); ++a) {
+        atlasNames.push_back
+            (base.filename().string() + "-" + std::to_string(a) + ".jpg");
+    }
+
+    UTILITY_OMP(parallel for shared(parts, atlases))
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        remap(parts[i], atlases[parts[i].atlas]);
+    }
+
+    UTILITY_OMP(parallel for shared(parts, atlases, atlasNames)
+                schedule(dynamic))
+    for (std::size_t a = 0; a < atlases.size(); ++a) {
+        const auto &size(atlases[a]);
+        cv::Mat atlas(size.height, size.width, CV_8UC3, cv::Scalar());
+
+        for (const auto &part : parts) {
+            if (part.atlas != int(a)) { continue; }
+            part.texture.copyTo
+                (atlas(cv::Rect(part.origin(0), part.origin(1)
+                                , part.texture.cols, part.texture.rows)));
+        }
+
+        writeTexture(output / atlasNames[a], atlas);
+    }
+
+    // textures are no longer needed
+    for (auto &part : parts) { part.texture.release(); }
+
+    // parallel reduction: consecutive runs of parts are merged into partial
+    // meshes, partial meshes are then merged together in run order; runs do
+    // not depend on thread count, so neither does the (order dependent)
+    // welded result
+    const std::size_t runCount
+        ((parts.size() + MergeRunSize - 1) / MergeRunSize);
+    std::vector<std::unique_ptr<Merger>> partials(runCount);
+
+    UTILITY_OMP(parallel for shared(parts, partials, options)
+                schedule(static))
+    for (std::size_t r = 0; r < runCount; ++r) {
+        partials[r].reset(new Merger(options.weldTolerance));
+        auto &partial(*partials[r]);
+
+        const auto end(std::min(parts.size(), (r + 1) * MergeRunSize));
+        for (std::size_t i(r * MergeRunSize); i < end; ++i) {
+            slpk::trace::Span span("mesh.weld", "slpk2obj");
+            partial.add(parts[i].mesh);
+            parts[i].mesh = geometry::Mesh();
+        }
+    }
+
+    Merger merger(options.weldTolerance);
+    for (auto &partial : partials) {
+        slpk::trace::Span span("mesh.merge", "slpk2obj");
+        merger.add(*partial);
+        partial.reset();
+    }
+
+    auto &mesh(merger.mesh());
+
+    LOG(info3) << "Merged mesh: " << mesh.vertices.size() << " vertices, "
+               << mesh.faces.size() << " faces ("
+               << merger.degenerated() << " faces collapsed by welding).";
+
+    // localize mesh
+    {
+        math::Extents2 extents(math::InvalidExtents{});
+        for (const auto &v : mesh.vertices) {
+            math::update(extents, math::Point2d(v(0), v(1)));
+        }
+        const auto center(math::center(extents));
+        for (auto &v : mesh.vertices) {
+            v(0) -= center(0);
+            v(1) -= center(1);
+        }
+    }
+
+    const auto meshPath(utility::addExtension(base, ".obj"));
+    const auto mtlPath(utility::addExtension(base, ".mtl"));
+
+    {
+        // save mesh
+        LOG(info1) << "Writing " << meshPath;
+        utility::ofstreambuf os(meshPath.string());
+        os.precision(12);
+        saveAsObj(mesh, os, mtlPath.filename().string());
+        os.flush();
+    }
+
+    writeMtl(mtlPath, atlasNames);
+}
+
 int Slpk2Obj::run()
 {
+    if (trace_) { slpk::trace::start(); }
+
     LOG(info4) << "Opening SLPK archive at " << input_ << ".";
     slpk::Archive archive(input_);
-    LOG(info4) << "Generating textured meshes at " << output_ << ".";
-    write(archive, output_, srs_, nodes_);
+    if (level_) {
+        LOG(info4) << "Generating merged mesh of level " << *level_
+                   << " at " << output_ << ".";
+        writeLevel(archive, output_, srs_, *level_
+                   , { weldTolerance_, atlasSize_ }, nodes_);
+    } else {
+        LOG(info4) << "Generating textured meshes at " << output_ << ".";
+        write(archive, output_, srs_, nodes_);
+    }
+
+    if (trace_) {
+        slpk::trace::stop();
+        slpk::trace::save(*trace_);
+    }
     return EXIT_SUCCESS;
 }
 
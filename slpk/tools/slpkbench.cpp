@@ -0,0 +1,563 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdlib>
+#include <chrono>
+#include <map>
+#include <vector>
+#include <future>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include <boost/optional.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/buildsys.hpp"
+#include "utility/gccversion.hpp"
+#include "utility/limits.hpp"
+#include "utility/openmp.hpp"
+
+#include "service/cmdline.hpp"
+
+#include "jsoncpp/json.hpp"
+#include "jsoncpp/io.hpp"
+
+#include "slpk/reader.hpp"
+#include "slpk/detail/zip.hpp"
+#include "slpk/detail/entryreader.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+namespace ba = boost::algorithm;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double since(const Clock::time_point &start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/** Work done by single measured operation.
+ */
+struct Work {
+    std::size_t bytes;
+    std::size_t vertices;
+
+    Work(std::size_t bytes = 0, std::size_t vertices = 0)
+        : bytes(bytes), vertices(vertices)
+    {}
+};
+
+/** Measured stage: latency of every operation and total wall time.
+ */
+struct Stage {
+    std::vector<double> latencies;
+    double wall;
+    std::size_t bytes;
+    std::size_t vertices;
+    std::size_t errors;
+
+    Stage() : wall(), bytes(), vertices(), errors() {}
+};
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty()) { return 0.0; }
+    const auto index(std::size_t(p * (sorted.size() - 1) + 0.5));
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+Json::Value asJson(const Stage &stage, int threads = 0)
+{
+    auto sorted(stage.latencies);
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum(0.0);
+    for (auto l : sorted) { sum += l; }
+
+    Json::Value value(Json::objectValue);
+    if (threads) { value["threads"] = threads; }
+    value["operations"] = Json::UInt64(sorted.size());
+    value["errors"] = Json::UInt64(stage.errors);
+    value["wall"] = stage.wall;
+
+    auto &throughput(value["throughput"] = Json::objectValue);
+    if (stage.wall > 0.0) {
+        throughput["operationsPerSecond"] = sorted.size() / stage.wall;
+        if (stage.bytes) {
+            throughput["MBPerSecond"] = (stage.bytes / stage.wall) / 1e6;
+        }
+        if (stage.vertices) {
+            throughput["verticesPerSecond"] = stage.vertices / stage.wall;
+        }
+    }
+    if (stage.bytes) { value["bytes"] = Json::UInt64(stage.bytes); }
+    if (stage.vertices) { value["vertices"] = Json::UInt64(stage.vertices); }
+
+    // latencies in milliseconds
+    auto &latency(value["latency"] = Json::objectValue);
+    if (!sorted.empty()) {
+        latency["min"] = sorted.front() * 1e3;
+        latency["mean"] = (sum / sorted.size()) * 1e3;
+        latency["p50"] = percentile(sorted, 0.50) * 1e3;
+        latency["p90"] = percentile(sorted, 0.90) * 1e3;
+        latency["p99"] = percentile(sorted, 0.99) * 1e3;
+        latency["max"] = sorted.back() * 1e3;
+    }
+
+    return value;
+}
+
+/** Runs given function serially `repeat` times.
+ */
+template <typename Function>
+Stage serial(int repeat, const Function &function)
+{
+    Stage stage;
+    const auto start(Clock::now());
+    for (int i(0); i < repeat; ++i) {
+        const auto opStart(Clock::now());
+        const Work work(function());
+        stage.latencies.push_back(since(opStart));
+        stage.bytes += work.bytes;
+        stage.vertices += work.vertices;
+    }
+    stage.wall = since(start);
+    return stage;
+}
+
+/** Runs given function for every item in [0, count) using given number of
+ *  threads.
+ */
+template <typename Function>
+Stage parallel(int threads, std::size_t count, const Function &function)
+{
+    Stage stage;
+    stage.latencies.resize(count);
+
+    std::size_t bytes(0);
+    std::size_t vertices(0);
+    std::size_t errors(0);
+
+    const auto start(Clock::now());
+
+    UTILITY_OMP(parallel for num_threads(threads) schedule(dynamic)
+                reduction(+:bytes, vertices, errors))
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto opStart(Clock::now());
+        try {
+            const Work work(function(i));
+            bytes += work.bytes;
+            vertices += work.vertices;
+        } catch (const std::exception &e) {
+            LOG(warn2) << "Operation failed: <" << e.what() << ">.";
+            ++errors;
+        }
+        stage.latencies[i] = since(opStart);
+    }
+
+    stage.wall = since(start);
+    stage.bytes = bytes;
+    stage.vertices = vertices;
+    stage.errors = errors;
+    return stage;
+}
+
+/** Waits for all futures. Latency of an operation is time from start of
+ *  the stage (all operations are submitted at once) to its completion.
+ */
+template <typename Function>
+Stage asyncGeometry(std::size_t count, const Function &function)
+{
+    Stage stage;
+    const auto start(Clock::now());
+
+    std::vector<std::future<slpk::Mesh>> futures;
+    for (std::size_t i(0); i < count; ++i) {
+        futures.push_back(function(i));
+    }
+
+    for (auto &future : futures) {
+        try {
+            const auto result(future.get());
+            for (const auto &submesh : result.submeshes) {
+                stage.vertices += submesh.mesh.vertices.size();
+            }
+        } catch (const std::exception &e) {
+            LOG(warn2) << "Operation failed: <" << e.what() << ">.";
+            ++stage.errors;
+        }
+        stage.latencies.push_back(since(start));
+    }
+
+    stage.wall = since(start);
+    return stage;
+}
+
+class SlpkBench : public service::Cmdline
+{
+public:
+    SlpkBench()
+        : service::Cmdline("slpkbench", BUILD_TARGET_VERSION)
+        , repeat_(5), threads_({ 1 })
+        , queueDepths_({ 1, 2, 4, 8, 16, 32, 64 })
+        , connections_(8)
+    {}
+
+private:
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+        UTILITY_OVERRIDE;
+
+    virtual void configure(const po::variables_map &vars)
+        UTILITY_OVERRIDE;
+
+    virtual bool help(std::ostream &out, const std::string &what) const
+        UTILITY_OVERRIDE;
+
+    virtual int run() UTILITY_OVERRIDE;
+
+    slpk::Archive open() const;
+
+    fs::path input_;
+    fs::path output_;
+    int repeat_;
+    std::vector<int> threads_;
+    std::vector<int> queueDepths_;
+    boost::optional<std::size_t> limit_;
+    fs::path cache_;
+    unsigned int connections_;
+};
+
+void SlpkBench::configuration(po::options_description &cmdline
+                              , po::options_description &config
+                              , po::positional_options_description &pd)
+{
+    cmdline.add_options()
+        ("input", po::value(&input_)->required()
+         , "Path to input SLPK archive or URL of remote I3S layer.")
+        ("output", po::value(&output_)
+         , "Path to output JSON report. Written to stdout if not set.")
+        ("repeat", po::value(&repeat_)->default_value(repeat_)->required()
+         , "Number of repetitions of whole-archive stages (open, loadTree, "
+         "loadNodes).")
+        ("threads", po::value<std::vector<int>>()->multitoken()
+         , "List of thread counts to run per-node stages with. "
+         "Defaults to 1.")
+        ("limit", po::value<std::size_t>()
+         , "Limit per-node stages to first N nodes (in BFS order).")
+        ("queueDepth", po::value<std::vector<int>>()->multitoken()
+         , "List of queue depths to run batch entry read stage with "
+         "(zip archives only). Defaults to 1 2 4 8 16 32 64.")
+        ("cache", po::value(&cache_)
+         , "Persistent cache directory for remote input.")
+        ("connections", po::value(&connections_)
+         ->default_value(connections_)->required()
+         , "Maximum number of parallel connections for remote input.")
+        ;
+
+    pd
+        .add("input", 1);
+
+    (void) config;
+}
+
+void SlpkBench::configure(const po::variables_map &vars)
+{
+    if (vars.count("threads")) {
+        threads_ = vars["threads"].as<std::vector<int>>();
+        for (auto threads : threads_) {
+            if (threads <= 0) {
+                throw po::validation_error
+                    (po::validation_error::invalid_option_value, "threads");
+            }
+        }
+    }
+
+    if (vars.count("limit")) {
+        limit_ = vars["limit"].as<std::size_t>();
+    }
+
+    if (vars.count("queueDepth")) {
+        queueDepths_ = vars["queueDepth"].as<std::vector<int>>();
+        for (auto depth : queueDepths_) {
+            if (depth <= 0) {
+                throw po::validation_error
+                    (po::validation_error::invalid_option_value
+                     , "queueDepth");
+            }
+        }
+    }
+
+    if (!connections_) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "connections");
+    }
+
+    if (repeat_ <= 0) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "repeat");
+    }
+}
+
+bool SlpkBench::help(std::ostream &out, const std::string &what) const
+{
+    if (what.empty()) {
+        out << R"RAW(slpkbench
+
+    Measures SLPK reader performance stage by stage: archive open,
+    loadTree, loadNodes, streaming traversal (forEachNode), node index
+    parse, geometry decode, texture read and texture size measurement.
+
+    Geometry decode is also measured through the asynchronous API running
+    on the library thread pool (all nodes submitted at once).
+
+    For zip archives, raw batch reads of all geometry entries (io_uring or
+    pread backend) are measured for every queue depth given by
+    --queueDepth; one operation is one batch of 64 entries.
+
+    Input can be URL of remote I3S layer (e.g. served by slpkserve) to
+    measure remote access. With --cache, resources fetched once are
+    served from the persistent cache in repeated stages.
+
+    Per-node stages are run for every thread count given by --threads.
+    Report (throughput and latency percentiles in milliseconds) is written
+    as JSON.
+
+usage
+    slpkbench INPUT [OPTIONS]
+)RAW";
+    }
+    return false;
+}
+
+slpk::Archive SlpkBench::open() const
+{
+    const auto &input(input_.string());
+    if (ba::istarts_with(input, "http://")
+        || ba::istarts_with(input, "https://"))
+    {
+        slpk::RemoteOptions options(input);
+        options.cacheDir = cache_;
+        options.connections = connections_;
+        return slpk::Archive(options);
+    }
+    return slpk::Archive(input_);
+}
+
+int SlpkBench::run()
+{
+    Json::Value report(Json::objectValue);
+    report["tool"] = "slpkbench";
+    report["version"] = BUILD_TARGET_VERSION;
+    report["input"] = input_.string();
+    auto &stages(report["stages"] = Json::objectValue);
+
+    LOG(info4) << "Measuring archive open.";
+    stages["open"] = asJson(serial(repeat_, [&]() -> Work
+    {
+        auto archive(open());
+        return {};
+    }));
+
+    auto archive(open());
+
+    LOG(info4) << "Measuring loadTree.";
+    slpk::Tree tree;
+    stages["loadTree"] = asJson(serial(repeat_, [&]() -> Work
+    {
+        tree = archive.loadTree();
+        return {};
+    }));
+
+    LOG(info4) << "Measuring loadNodes.";
+    slpk::NodeInfo::list nodes;
+    stages["loadNodes"] = asJson(serial(repeat_, [&]() -> Work
+    {
+        nodes = archive.loadNodes();
+        return {};
+    }));
+
+    LOG(info4) << "Measuring forEachNode.";
+    stages["forEachNode"] = asJson(serial(repeat_, [&]() -> Work
+    {
+        archive.forEachNode([](const slpk::TreeNode&) {});
+        return {};
+    }));
+
+    if (limit_ && (nodes.size() > *limit_)) { nodes.resize(*limit_); }
+    report["nodeCount"] = Json::UInt64(nodes.size());
+
+    // nodes with geometry, paired with their shared resources
+    std::vector<const slpk::TreeNode*> geometryNodes;
+    for (const auto &ni : nodes) {
+        if (!ni.node.hasGeometry()) { continue; }
+        if (const auto *tn = tree.find(ni.node.id)) {
+            geometryNodes.push_back(tn);
+        }
+    }
+
+    auto &nodeIndex(stages["nodeIndex"] = Json::arrayValue);
+    auto &geometry(stages["loadGeometry"] = Json::arrayValue);
+    auto &texture(stages["texture"] = Json::arrayValue);
+    auto &textureSize(stages["textureSize"] = Json::arrayValue);
+
+    for (const auto threads : threads_) {
+        LOG(info4) << "Measuring node index parse (" << threads
+                   << " threads).";
+        nodeIndex.append(asJson(parallel(threads, nodes.size()
+                                         , [&](std::size_t i) -> Work
+        {
+            archive.loadNodeIndex(nodes[i].href);
+            return {};
+        }), threads));
+
+        LOG(info4) << "Measuring geometry decode (" << threads
+                   << " threads).";
+        geometry.append(asJson(parallel(threads, geometryNodes.size()
+                                        , [&](std::size_t i) -> Work
+        {
+            const auto &tn(*geometryNodes[i]);
+            const auto mesh(archive.loadGeometry(tn.node, tn.sharedResource));
+            Work work;
+            for (const auto &submesh : mesh.submeshes) {
+                work.vertices += submesh.mesh.vertices.size();
+            }
+            return work;
+        }), threads));
+
+        LOG(info4) << "Measuring texture read (" << threads << " threads).";
+        texture.append(asJson(parallel(threads, geometryNodes.size()
+                                       , [&](std::size_t i) -> Work
+        {
+            const auto &node(geometryNodes[i]->node);
+            Work work;
+            for (std::size_t t(0); t < node.geometryData.size(); ++t) {
+                work.bytes += archive.texture(node, t)->read().size();
+            }
+            return work;
+        }), threads));
+
+        LOG(info4) << "Measuring texture size (" << threads << " threads).";
+        textureSize.append(asJson(parallel(threads, geometryNodes.size()
+                                           , [&](std::size_t i) -> Work
+        {
+            const auto &node(geometryNodes[i]->node);
+            for (std::size_t t(0); t < node.geometryData.size(); ++t) {
+                archive.textureSize(node, t);
+            }
+            return {};
+        }), threads));
+    }
+
+    LOG(info4) << "Measuring asynchronous geometry decode ("
+               << slpk::ThreadPool::instance().size()
+               << " pool threads).";
+    stages["loadGeometryAsync"] = asJson
+        (asyncGeometry(geometryNodes.size(), [&](std::size_t i)
+    {
+        const auto &tn(*geometryNodes[i]);
+        return archive.loadGeometryAsync(tn.node, tn.sharedResource);
+    }), int(slpk::ThreadPool::instance().size()));
+
+    if (fs::is_regular_file(input_)) {
+        std::map<std::string, slpk::detail::zip::Entry> entries;
+        for (auto &entry
+                 : slpk::detail::zip::readCentralDirectory(input_))
+        {
+            auto path(entry.path);
+            entries.insert(std::make_pair(std::move(path)
+                                          , std::move(entry)));
+        }
+
+        std::vector<const slpk::detail::zip::Entry*> geometryEntries;
+        for (const auto *tn : geometryNodes) {
+            for (const auto &resource : tn->node.geometryData) {
+                const auto fentries
+                    (entries.find(archive.realPath(resource.href + ".bin")
+                                  .generic_string()));
+                if (fentries != entries.end()) {
+                    geometryEntries.push_back(&fentries->second);
+                }
+            }
+        }
+
+        auto &batchRead(stages["batchRead"] = Json::arrayValue);
+        for (const auto depth : queueDepths_) {
+            slpk::detail::EntryReader reader(input_, depth);
+            LOG(info4) << "Measuring batch entry read (" << reader.backend()
+                       << ", queue depth " << depth << ").";
+
+            const std::size_t batch(64);
+            Stage stage;
+            const auto start(Clock::now());
+            for (std::size_t b(0); b < geometryEntries.size(); b += batch) {
+                const auto opStart(Clock::now());
+                std::vector<const slpk::detail::zip::Entry*> request
+                    (geometryEntries.begin() + b
+                     , geometryEntries.begin()
+                     + std::min(b + batch, geometryEntries.size()));
+                for (const auto &data : reader.read(request)) {
+                    stage.bytes += data.size();
+                }
+                stage.latencies.push_back(since(opStart));
+            }
+            stage.wall = since(start);
+
+            auto jstage(asJson(stage));
+            jstage["queueDepth"] = depth;
+            jstage["backend"] = reader.backend();
+            batchRead.append(jstage);
+        }
+    }
+
+    if (output_.empty()) {
+        Json::write(std::cout, report, true);
+        std::cout << std::endl;
+    } else {
+        std::ofstream f(output_.string());
+        f.exceptions(std::ios::badbit | std::ios::failbit);
+        Json::write(f, report, true);
+        f.close();
+    }
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    utility::unlimitedCoredump();
+    return SlpkBench()(argc, argv);
+}
@@ -0,0 +1,183 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cstdlib>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/buildsys.hpp"
+#include "utility/gccversion.hpp"
+#include "utility/limits.hpp"
+
+#include "service/cmdline.hpp"
+
+#include "slpk/reader.hpp"
+#include "slpk/diff.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+namespace {
+
+class SlpkDiff : public service::Cmdline
+{
+public:
+    SlpkDiff()
+        : service::Cmdline("slpkdiff", BUILD_TARGET_VERSION)
+    {}
+
+private:
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+        UTILITY_OVERRIDE;
+
+    virtual void configure(const po::variables_map &vars)
+        UTILITY_OVERRIDE;
+
+    virtual bool help(std::ostream &out, const std::string &what) const
+        UTILITY_OVERRIDE;
+
+    virtual int run() UTILITY_OVERRIDE;
+
+    fs::path from_;
+    fs::path to_;
+    fs::path output_;
+    slpk::DiffOptions options_;
+};
+
+void SlpkDiff::configuration(po::options_description &cmdline
+                             , po::options_description &config
+                             , po::positional_options_description &pd)
+{
+    cmdline.add_options()
+        ("from", po::value(&from_)->required()
+         , "Path to old SLPK archive.")
+        ("to", po::value(&to_)->required()
+         , "Path to new SLPK archive.")
+        ("output", po::value(&output_)
+         , "Path to output JSON report. Changes are printed to stdout if "
+         "not specified.")
+        ("threads", po::value(&options_.threads)
+         ->default_value(options_.threads)->required()
+         , "Number of threads, 0 means number of CPUs.")
+        ;
+
+    pd
+        .add("from", 1)
+        .add("to", 1)
+        .add("output", 1);
+
+    (void) config;
+}
+
+void SlpkDiff::configure(const po::variables_map &vars)
+{
+    if (options_.threads < 0) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "threads");
+    }
+
+    (void) vars;
+}
+
+bool SlpkDiff::help(std::ostream &out, const std::string &what) const
+{
+    if (what.empty()) {
+        out << R"RAW(slpkdiff
+
+    Lists files added, removed and modified between two versions of SLPK
+    archive, together with the REST API paths they are served under (as
+    by slpkserve), e.g. to invalidate or upload only changed resources.
+
+    Files are compared by CRC-32 and size of stored data; zip archives
+    are compared by their central directories without reading any data.
+    Nodes are matched by id.
+
+    Prints one change per line ("+", "-" or "M", stored path, API path)
+    or writes JSON report. Exits with non-zero status when archives
+    differ.
+
+usage
+    slpkdiff FROM TO [OUTPUT] [OPTIONS]
+)RAW";
+    }
+    return false;
+}
+
+int SlpkDiff::run()
+{
+    LOG(info4) << "Opening SLPK archives at " << from_ << " and "
+               << to_ << ".";
+    slpk::Archive from(from_);
+    slpk::Archive to(to_);
+
+    const auto report(slpk::diff(from, to, options_));
+
+    std::size_t counts[3] = { 0, 0, 0 };
+    for (const auto &change : report.paths) {
+        ++counts[int(change.type)];
+    }
+
+    LOG(info4)
+        << "Archives differ in " << report.paths.size() << " files ("
+        << counts[int(slpk::ChangeType::added)] << " added, "
+        << counts[int(slpk::ChangeType::removed)] << " removed, "
+        << counts[int(slpk::ChangeType::modified)] << " modified) and "
+        << report.nodes.size() << " nodes; " << report.unchanged
+        << " files unchanged.";
+
+    if (!output_.empty()) {
+        std::ofstream f(output_.string());
+        f.exceptions(std::ios::badbit | std::ios::failbit);
+        slpk::saveJson(f, report);
+        f.close();
+    } else {
+        for (const auto &change : report.paths) {
+            switch (change.type) {
+            case slpk::ChangeType::added: std::cout << '+'; break;
+            case slpk::ChangeType::removed: std::cout << '-'; break;
+            case slpk::ChangeType::modified: std::cout << 'M'; break;
+            }
+            std::cout << '\t' << change.path << '\t' << change.url << '\n';
+        }
+        std::cout.flush();
+    }
+
+    return report.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    utility::unlimitedCoredump();
+    return SlpkDiff()(argc, argv);
+}
@@ -0,0 +1,419 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cstdlib>
+#include <cmath>
+#include <set>
+#include <deque>
+#include <vector>
+#include <string>
+#include <limits>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <ogr_spatialref.h>
+
+#include <boost/optional.hpp>
+#include <boost/filesystem.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/buildsys.hpp"
+#include "utility/gccversion.hpp"
+#include "utility/limits.hpp"
+
+#include "jsoncpp/json.hpp"
+
+#include "service/cmdline.hpp"
+
+#include "slpk/reader.hpp"
+#include "slpk/writer.hpp"
+#include "slpk/copier.hpp"
+#include "slpk/detail/files.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+namespace constants = slpk::detail::constants;
+
+namespace {
+
+/** Meters per degree of latitude (mean).
+ */
+const double MetersPerDegree(111320.0);
+
+math::Point2d parsePoint(const std::string &value, const char *option)
+{
+    std::istringstream is(value);
+    math::Point2d p;
+    char comma(0);
+    if (!(is >> p(0) >> comma >> p(1)) || (comma != ',')) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, option);
+    }
+    return p;
+}
+
+/** Selection area: bounding box and/or polygon in the index SRS.
+ */
+class Selection {
+public:
+    Selection() : geographic_(false) {}
+
+    void bbox(const math::Extents2 &bbox) { bbox_ = bbox; }
+    void polygon(const std::vector<math::Point2d> &polygon) {
+        polygon_ = polygon;
+    }
+    void geographic(bool value) { geographic_ = value; }
+
+    bool empty() const { return !bbox_ && polygon_.empty(); }
+
+    /** Bounding box of selection.
+     */
+    math::Extents2 extents() const;
+
+    /** Does bounding sphere (projected to XY) intersect the selection?
+     */
+    bool intersects(const slpk::MinimumBoundingSphere &mbs) const;
+
+private:
+    bool inside(const math::Point2d &p) const;
+    double distance(const math::Point2d &p) const;
+
+    boost::optional<math::Extents2> bbox_;
+    std::vector<math::Point2d> polygon_;
+
+    /** MBS radius is in meters while center is in degrees.
+     */
+    bool geographic_;
+};
+
+math::Extents2 Selection::extents() const
+{
+    math::Extents2 e(math::InvalidExtents{});
+    if (bbox_) { e = *bbox_; }
+    for (const auto &p : polygon_) {
+        e.ll(0) = std::min(e.ll(0), p(0)); e.ll(1) = std::min(e.ll(1), p(1));
+        e.ur(0) = std::max(e.ur(0), p(0)); e.ur(1) = std::max(e.ur(1), p(1));
+    }
+    return e;
+}
+
+bool Selection::inside(const math::Point2d &p) const
+{
+    bool in(false);
+    for (std::size_t i(0), j(polygon_.size() - 1); i < polygon_.size()
+             ; j = i++)
+    {
+        const auto &a(polygon_[i]);
+        const auto &b(polygon_[j]);
+        if (((a(1) > p(1)) != (b(1) > p(1)))
+            && (p(0) < ((b(0) - a(0)) * (p(1) - a(1)) / (b(1) - a(1))
+                        + a(0))))
+        {
+            in = !in;
+        }
+    }
+    return in;
+}
+
+double Selection::distance(const math::Point2d &p) const
+{
+    double best(std::numeric_limits<double>::max());
+    for (std::size_t i(0), j(polygon_.size() - 1); i < polygon_.size()
+             ; j = i++)
+    {
+        const auto &a(polygon_[j]);
+        const auto &b(polygon_[i]);
+        const double dx(b(0) - a(0)), dy(b(1) - a(1));
+        const double len2(dx * dx + dy * dy);
+        double t(len2 ? (((p(0) - a(0)) * dx + (p(1) - a(1)) * dy) / len2)
+                 : 0.0);
+        t = std::max(0.0, std::min(1.0, t));
+        const double ex(a(0) + t * dx - p(0)), ey(a(1) + t * dy - p(1));
+        best = std::min(best, std::sqrt(ex * ex + ey * ey));
+    }
+    return best;
+}
+
+bool Selection::intersects(const slpk::MinimumBoundingSphere &mbs) const
+{
+    const math::Point2d c(mbs.center(0), mbs.center(1));
+
+    // convert radius to degrees, longitude degrees are shorter (err on the
+    // bigger side)
+    double r(mbs.r);
+    if (geographic_) {
+        const double lat(c(1) * M_PI / 180.0);
+        r /= MetersPerDegree * std::max(std::cos(lat), 1e-3);
+    }
+
+    if (bbox_) {
+        const auto &b(*bbox_);
+        const double dx(std::max({ b.ll(0) - c(0), 0.0, c(0) - b.ur(0) }));
+        const double dy(std::max({ b.ll(1) - c(1), 0.0, c(1) - b.ur(1) }));
+        if ((dx * dx + dy * dy) > (r * r)) { return false; }
+    }
+
+    if (polygon_.size() >= 3) {
+        if (!inside(c) && (distance(c) > r)) { return false; }
+    }
+
+    return true;
+}
+
+/** Keeps node references (children, neighbors) to selected nodes only.
+ *  Returns true if anything was removed.
+ */
+bool prune(Json::Value &value, const char *member
+           , const std::set<std::string> &keep)
+{
+    if (!value.isMember(member)) { return false; }
+    const auto &refs(value[member]);
+
+    Json::Value out(Json::arrayValue);
+    for (const auto &ref : refs) {
+        if (keep.count(ref["id"].asString())) { out.append(ref); }
+    }
+
+    if (out.size() == refs.size()) { return false; }
+
+    if (out.size()) {
+        value[member] = out;
+    } else {
+        value.removeMember(member);
+    }
+    return true;
+}
+
+class SlpkExtract : public service::Cmdline
+{
+public:
+    SlpkExtract()
+        : service::Cmdline("slpkextract", BUILD_TARGET_VERSION)
+        , overwrite_(false)
+    {}
+
+private:
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+        UTILITY_OVERRIDE;
+
+    virtual void configure(const po::variables_map &vars)
+        UTILITY_OVERRIDE;
+
+    virtual bool help(std::ostream &out, const std::string &what) const
+        UTILITY_OVERRIDE;
+
+    virtual int run() UTILITY_OVERRIDE;
+
+    fs::path input_;
+    fs::path output_;
+    bool overwrite_;
+    Selection selection_;
+};
+
+void SlpkExtract::configuration(po::options_description &cmdline
+                                , po::options_description &config
+                                , po::positional_options_description &pd)
+{
+    cmdline.add_options()
+        ("input", po::value(&input_)->required()
+         , "Path to input SLPK archive.")
+        ("output", po::value(&output_)->required()
+         , "Path to output SLPK archive.")
+        ("overwrite", "Overwrite existing output archive.")
+        ("bbox", po::value<std::vector<std::string>>()->multitoken()
+         , "Selection bounding box as two corners: XMIN,YMIN XMAX,YMAX "
+         "(in layer's index SRS).")
+        ("polygon", po::value<std::vector<std::string>>()->multitoken()
+         , "Selection polygon as list of vertices: X,Y X,Y X,Y ... "
+         "(in layer's index SRS).")
+        ;
+
+    pd
+        .add("input", 1)
+        .add("output", 1);
+
+    (void) config;
+}
+
+void SlpkExtract::configure(const po::variables_map &vars)
+{
+    overwrite_ = vars.count("overwrite");
+
+    if (vars.count("bbox")) {
+        const auto &corners(vars["bbox"].as<std::vector<std::string>>());
+        if (corners.size() != 2) {
+            throw po::validation_error
+                (po::validation_error::invalid_option_value, "bbox");
+        }
+        const auto ll(parsePoint(corners[0], "bbox"));
+        const auto ur(parsePoint(corners[1], "bbox"));
+        if ((ll(0) > ur(0)) || (ll(1) > ur(1))) {
+            throw po::validation_error
+                (po::validation_error::invalid_option_value, "bbox");
+        }
+        selection_.bbox(math::Extents2(ll(0), ll(1), ur(0), ur(1)));
+    }
+
+    if (vars.count("polygon")) {
+        std::vector<math::Point2d> polygon;
+        for (const auto &vertex
+                 : vars["polygon"].as<std::vector<std::string>>())
+        {
+            polygon.push_back(parsePoint(vertex, "polygon"));
+        }
+        if (polygon.size() < 3) {
+            throw po::validation_error
+                (po::validation_error::invalid_option_value, "polygon");
+        }
+        selection_.polygon(polygon);
+    }
+
+    if (selection_.empty()) {
+        throw po::required_option("bbox");
+    }
+}
+
+bool SlpkExtract::help(std::ostream &out, const std::string &what) const
+{
+    if (what.empty()) {
+        out << R"RAW(slpkextract
+
+    Extracts spatial subset of SLPK archive. Nodes are selected by their
+    bounding spheres against bounding box and/or polygon; subtrees outside
+    of the selection are pruned without even loading them.
+
+    Only node index documents of nodes that lost children or neighbors
+    are rewritten. Everything else (node documents, geometries, textures,
+    features, shared resources) is copied byte for byte.
+
+usage
+    slpkextract INPUT OUTPUT (--bbox XMIN,YMIN XMAX,YMAX
+                              | --polygon X,Y X,Y X,Y ...) [OPTIONS]
+)RAW";
+    }
+    return false;
+}
+
+int SlpkExtract::run()
+{
+    LOG(info4) << "Opening SLPK archive at " << input_ << ".";
+    slpk::Archive archive(input_);
+
+    selection_.geographic(archive.srs().reference().IsGeographic());
+
+    // clip layer extents to the selection
+    auto sli(archive.sceneLayerInfo());
+    sli.store = std::make_shared<slpk::Store>(*sli.store);
+    {
+        auto &e(sli.store->extents);
+        const auto s(selection_.extents());
+        if ((e.ll(0) <= e.ur(0)) && (e.ll(1) <= e.ur(1))) {
+            e.ll(0) = std::max(e.ll(0), s.ll(0));
+            e.ll(1) = std::max(e.ll(1), s.ll(1));
+            e.ur(0) = std::min(e.ur(0), s.ur(0));
+            e.ur(1) = std::min(e.ur(1), s.ur(1));
+        }
+    }
+
+    const auto &rootDir(sli.store->rootNode);
+    auto root(archive.loadNodeIndex(rootDir));
+    if (!selection_.intersects(root.mbs)) {
+        LOG(fatal) << "Selection does not intersect the layer.";
+        return EXIT_FAILURE;
+    }
+
+    slpk::Writer writer(output_, archive.metadata(), sli, overwrite_);
+    slpk::Copier copier(archive, writer);
+
+    std::size_t rewritten(0);
+    std::deque<std::string> queue{ rootDir };
+
+    const auto selected([&](const slpk::NodeReference::list &refs)
+                        -> std::set<std::string>
+    {
+        std::set<std::string> ids;
+        for (const auto &ref : refs) {
+            if (selection_.intersects(ref.mbs)) { ids.insert(ref.id); }
+        }
+        return ids;
+    });
+
+    for (bool first(true); !queue.empty(); first = false) {
+        const auto dir(queue.front());
+        queue.pop_front();
+
+        const auto node(first ? std::move(root)
+                        : archive.loadNodeIndex(dir));
+
+        const auto children(selected(node.children));
+        const auto neighbors(selected(node.neighbors));
+
+        const auto path(dir + constants::NodeIndex);
+        if ((children.size() != node.children.size())
+            || (neighbors.size() != node.neighbors.size()))
+        {
+            auto value(copier.nodeIndex(node, dir));
+            prune(value, "children", children);
+            prune(value, "neighbors", neighbors);
+            copier.store(path, value);
+            ++rewritten;
+        } else {
+            copier.copy(copier.find(path));
+        }
+
+        copier.copyResources(node);
+
+        for (const auto &child : node.children) {
+            if (children.count(child.id)) { queue.push_back(child.href); }
+        }
+    }
+
+    LOG(info4) << "Flushing output archive.";
+    writer.flush();
+
+    const auto stats(copier.stats());
+    LOG(info4)
+        << "Extracted " << writer.metadata().nodeCount << " nodes ("
+        << rewritten << " node documents rewritten): " << stats.passthrough
+        << " files copied as stored, " << stats.recoded
+        << " files recompressed, " << stats.missing << " missing files.";
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    utility::unlimitedCoredump();
+    return SlpkExtract()(argc, argv);
+}
@@ -0,0 +1,659 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+
+#include <boost/optional.hpp>
+#include <boost/format.hpp>
+#include <boost/utility/in_place_factory.hpp>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/buildsys.hpp"
+#include "utility/gccversion.hpp"
+#include "utility/limits.hpp"
+
+#include "service/cmdline.hpp"
+
+#include "slpk/writer.hpp"
+#include "slpk/trace.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+namespace {
+
+/** SplitMix64 step; used to derive independent per-node seeds from the
+ *  master seed.
+ */
+std::uint64_t mix(std::uint64_t value)
+{
+    value += 0x9e3779b97f4a7c15ull;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+/** Largest integer value exactly representable by given data type.
+ */
+double maxInteger(slpk::DataType type)
+{
+#define MAX_DATATYPE(ENUM, TYPE)                \
+    case slpk::DataType::ENUM:                  \
+        return double(std::numeric_limits<TYPE>::max())
+
+    switch (type) {
+        MAX_DATATYPE(uint8, std::uint8_t);
+        MAX_DATATYPE(uint16, std::uint16_t);
+        MAX_DATATYPE(uint32, std::uint32_t);
+        MAX_DATATYPE(uint64, std::uint64_t);
+
+        MAX_DATATYPE(int8, std::int8_t);
+        MAX_DATATYPE(int16, std::int16_t);
+        MAX_DATATYPE(int32, std::int32_t);
+        MAX_DATATYPE(int64, std::int64_t);
+
+    case slpk::DataType::float32:
+        return std::ldexp(1.0, std::numeric_limits<float>::digits);
+    case slpk::DataType::float64:
+        return std::ldexp(1.0, std::numeric_limits<double>::digits);
+    }
+#undef MAX_DATATYPE
+
+    return 0.0;
+}
+
+bool isSigned(slpk::DataType type)
+{
+    switch (type) {
+    case slpk::DataType::uint8: case slpk::DataType::uint16:
+    case slpk::DataType::uint32: case slpk::DataType::uint64:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/** Smooth synthetic terrain: sum of few randomly oriented sine waves. Height
+ *  is a function of position only so neighbouring nodes and LODs match.
+ */
+class Terrain {
+public:
+    Terrain(std::uint64_t seed, double size, double amplitude)
+    {
+        std::mt19937_64 rng(mix(seed));
+        std::uniform_real_distribution<double> angle(0.0, 2.0 * M_PI);
+
+        double wavelength(size / 2.0);
+        double a(amplitude);
+        for (int i(0); i < 4; ++i) {
+            const auto alpha(angle(rng));
+            waves_.push_back({ std::cos(alpha) * 2.0 * M_PI / wavelength
+                               , std::sin(alpha) * 2.0 * M_PI / wavelength
+                               , angle(rng), a });
+            wavelength /= 3.0;
+            a /= 3.0;
+        }
+    }
+
+    double operator()(double x, double y) const {
+        double z(0.0);
+        for (const auto &w : waves_) {
+            z += w.amplitude * std::sin(w.kx * x + w.ky * y + w.phase);
+        }
+        return z;
+    }
+
+private:
+    struct Wave {
+        double kx, ky, phase, amplitude;
+    };
+
+    std::vector<Wave> waves_;
+};
+
+/** Generated node layout.
+ */
+struct GenNode {
+    std::string id;
+    int level;
+    math::Extents2 extents;
+    int parent;
+    std::vector<int> children;
+    slpk::MinimumBoundingSphere mbs;
+
+    typedef std::vector<GenNode> list;
+
+    GenNode(int level, const math::Extents2 &extents, int parent)
+        : level(level), extents(extents), parent(parent)
+    {}
+
+    slpk::NodeReference reference() const {
+        slpk::NodeReference nr;
+        nr.id = id;
+        nr.mbs = mbs;
+        nr.href = "../" + id;
+        return nr;
+    }
+};
+
+/** Regular grid mesh sampled from terrain, exactly faceCount faces.
+ */
+class GridMesh : public slpk::MeshSaver {
+public:
+    GridMesh(const math::Extents2 &extents, const Terrain &terrain
+             , std::size_t faceCount)
+        : extents_(extents), terrain_(terrain), faceCount_(faceCount)
+        , n_(std::max(1, int(std::ceil(std::sqrt(faceCount / 2.0)))))
+        , size_(math::size(extents))
+    {}
+
+    virtual Properties properties() const {
+        Properties p;
+        p.faceCount = faceCount_;
+        return p;
+    }
+
+    virtual math::Triangle3d face(std::size_t index) const {
+        const auto uv(faceTc(index));
+        return {{ point(uv[0]), point(uv[1]), point(uv[2]) }};
+    }
+
+    virtual math::Triangle2d faceTc(std::size_t index) const {
+        const auto cell(index / 2);
+        const double i(cell % n_);
+        const double j(cell / n_);
+
+        // grid points in normalized coordinates
+        const math::Point2d p00(i / n_, j / n_);
+        const math::Point2d p10((i + 1) / n_, j / n_);
+        const math::Point2d p01(i / n_, (j + 1) / n_);
+        const math::Point2d p11((i + 1) / n_, (j + 1) / n_);
+
+        if (index % 2) { return {{ tc(p10), tc(p11), tc(p01) }}; }
+        return {{ tc(p00), tc(p10), tc(p01) }};
+    }
+
+private:
+    /** Normalized grid coordinates to texture coordinates (origin at top).
+     */
+    static math::Point2d tc(const math::Point2d &p) {
+        return math::Point2d(p(0), 1.0 - p(1));
+    }
+
+    math::Point3d point(const math::Point2d &uv) const {
+        const auto x(extents_.ll(0) + uv(0) * size_.width);
+        const auto y(extents_.ll(1) + (1.0 - uv(1)) * size_.height);
+        return math::Point3d(x, y, terrain_(x, y));
+    }
+
+    const math::Extents2 extents_;
+    const Terrain &terrain_;
+    const std::size_t faceCount_;
+    const int n_;
+    const math::Size2f size_;
+};
+
+/** Deterministic texture: level-colored checkerboard with noise.
+ */
+class SyntheticTexture : public slpk::TextureSaver {
+public:
+    SyntheticTexture(int size, std::uint64_t seed, int level)
+        : image_(size, size, CV_8UC3)
+    {
+        std::mt19937_64 rng(seed);
+        std::uniform_int_distribution<int> noise(-24, 24);
+
+        const cv::Vec3b base(std::uint8_t(64 + (level * 53) % 160)
+                             , std::uint8_t(64 + (level * 97) % 160)
+                             , std::uint8_t(64 + (level * 31) % 160));
+        const int cell(std::max(1, size / 8));
+
+        for (int j(0); j < size; ++j) {
+            for (int i(0); i < size; ++i) {
+                const bool dark(((i / cell) + (j / cell)) % 2);
+                auto &px(image_.at<cv::Vec3b>(j, i));
+                for (int c(0); c < 3; ++c) {
+                    const auto v(base[c] + (dark ? -48 : 48) + noise(rng));
+                    px[c] = std::uint8_t(std::min(255, std::max(0, v)));
+                }
+            }
+        }
+    }
+
+    virtual math::Size2 imageSize() const {
+        return math::Size2(image_.cols, image_.rows);
+    }
+
+    virtual void save(std::ostream &os, const std::string &mimeType) const {
+        std::vector<unsigned char> buf;
+        if (mimeType == "image/jpeg") {
+            cv::imencode(".jpg", image_, buf
+                         , { cv::IMWRITE_JPEG_QUALITY, 85 });
+        } else if (mimeType == "image/png") {
+            cv::imencode(".png", image_, buf
+                         , { cv::IMWRITE_PNG_COMPRESSION, 9 });
+        } else {
+            LOGTHROW(err2, std::runtime_error)
+                << "Unsupported texture encoding <" << mimeType << ">.";
+        }
+        os.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+    }
+
+private:
+    cv::Mat image_;
+};
+
+class SlpkGen : public service::Cmdline
+{
+public:
+    SlpkGen()
+        : service::Cmdline("slpkgen", BUILD_TARGET_VERSION)
+        , overwrite_(false), seed_(1), nodeCount_(85), depth_(4)
+        , vertices_(3 * 2048), textureSizes_({ 256 })
+        , textureEncodings_({ "image/jpeg" })
+        , extent_(10000.0), origin_(1600000.0, 6300000.0), wkid_(3857)
+        , positionType_(slpk::DataType::float32)
+        , uvType_(slpk::DataType::float32)
+        , headerType_(slpk::DataType::uint32)
+    {
+        metadata_.archiveCompressionType = slpk::ArchiveCompressionType::store;
+        metadata_.resourceCompressionType
+            = slpk::ResourceCompressionType::gzip;
+    }
+
+private:
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+        UTILITY_OVERRIDE;
+
+    virtual void configure(const po::variables_map &vars)
+        UTILITY_OVERRIDE;
+
+    virtual bool help(std::ostream &out, const std::string &what) const
+        UTILITY_OVERRIDE;
+
+    virtual int run() UTILITY_OVERRIDE;
+
+    GenNode::list layout() const;
+
+    fs::path output_;
+    bool overwrite_;
+    std::uint64_t seed_;
+    std::size_t nodeCount_;
+    int depth_;
+    std::size_t vertices_;
+    std::vector<int> textureSizes_;
+    std::vector<std::string> textureEncodings_;
+    double extent_;
+    math::Point2d origin_;
+    int wkid_;
+
+    slpk::DataType positionType_;
+    slpk::DataType uvType_;
+    slpk::DataType headerType_;
+
+    slpk::Metadata metadata_;
+
+    boost::optional<fs::path> trace_;
+};
+
+void SlpkGen::configuration(po::options_description &cmdline
+                            , po::options_description &config
+                            , po::positional_options_description &pd)
+{
+    cmdline.add_options()
+        ("output", po::value(&output_)->required()
+         , "Path to output SLPK archive.")
+        ("overwrite", "Overwrite existing output archive.")
+        ("seed", po::value(&seed_)->default_value(seed_)->required()
+         , "Random seed. Same seed and options produce the same content.")
+        ("nodeCount", po::value(&nodeCount_)->default_value(nodeCount_)
+         ->required()
+         , "Number of generated nodes.")
+        ("depth", po::value(&depth_)->default_value(depth_)->required()
+         , "Depth of the node tree; fanout is derived from nodeCount.")
+        ("vertices", po::value(&vertices_)->default_value(vertices_)
+         ->required()
+         , "Number of vertices per node (rounded down to whole faces).")
+        ("textureSize", po::value<std::vector<int>>()->multitoken()
+         , "Texture size(s) in pixels; with more values each node picks "
+         "one at random. Defaults to 256.")
+        ("textureEncoding", po::value<std::vector<std::string>>()
+         ->multitoken()
+         , "Texture encodings (image/jpeg, image/png). "
+         "Defaults to image/jpeg.")
+        ("archiveCompression", po::value
+         (&metadata_.archiveCompressionType)
+         ->default_value(metadata_.archiveCompressionType)->required()
+         , "Archive (zip) compression type (STORE, DEFLATE).")
+        ("resourceCompression", po::value
+         (&metadata_.resourceCompressionType)
+         ->default_value(metadata_.resourceCompressionType)->required()
+         , "Resource compression type (NONE, GZIP).")
+        ("positionType", po::value(&positionType_)
+         ->default_value(positionType_)->required()
+         , "Value type of vertex positions; positions are stored relative "
+         "to node center, the type must be signed and hold +-extent/2.")
+        ("uvType", po::value(&uvType_)
+         ->default_value(uvType_)->required()
+         , "Value type of texture coordinates.")
+        ("headerType", po::value(&headerType_)
+         ->default_value(headerType_)->required()
+         , "Value type of geometry header fields; must hold vertices.")
+        ("extent", po::value(&extent_)->default_value(extent_)->required()
+         , "Width/height of generated area in SRS units.")
+        ("originX", po::value(&origin_(0))->default_value(origin_(0))
+         ->required()
+         , "Easting of lower left corner of generated area.")
+        ("originY", po::value(&origin_(1))->default_value(origin_(1))
+         ->required()
+         , "Northing of lower left corner of generated area.")
+        ("wkid", po::value(&wkid_)->default_value(wkid_)->required()
+         , "EPSG code of layer's (projected) SRS.")
+        ("trace", po::value<fs::path>()
+         , "Record timeline of writer internals and save it to given file "
+         "in Chrome trace-event JSON format.")
+        ;
+
+    pd
+        .add("output", 1);
+
+    (void) config;
+}
+
+void SlpkGen::configure(const po::variables_map &vars)
+{
+    overwrite_ = vars.count("overwrite");
+
+    if (vars.count("textureSize")) {
+        textureSizes_ = vars["textureSize"].as<std::vector<int>>();
+    }
+    for (auto size : textureSizes_) {
+        if (size <= 0) {
+            throw po::validation_error
+                (po::validation_error::invalid_option_value, "textureSize");
+        }
+    }
+
+    if (vars.count("trace")) {
+        trace_ = vars["trace"].as<fs::path>();
+    }
+
+    if (vars.count("textureEncoding")) {
+        textureEncodings_
+            = vars["textureEncoding"].as<std::vector<std::string>>();
+    }
+
+    if (!nodeCount_) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "nodeCount");
+    }
+
+    if ((depth_ <= 0) || ((depth_ > 1) == (nodeCount_ == 1))) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "depth");
+    }
+
+    if (vertices_ < 3) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "vertices");
+    }
+
+    // header holds vertex count
+    if (double(vertices_) > maxInteger(headerType_)) {
+        LOG(err3) << "Header type " << headerType_ << " cannot hold "
+                  << vertices_ << " vertices.";
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "headerType");
+    }
+
+    // positions are stored relative to node center: root node spans
+    // +-extent/2 horizontally, terrain height varies much less
+    if (!(extent_ > 0.0)) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "extent");
+    }
+    if (!isSigned(positionType_)
+        || ((extent_ / 2.0) > maxInteger(positionType_)))
+    {
+        LOG(err3) << "Position type " << positionType_
+                  << " cannot hold vertex offsets up to +-"
+                  << (extent_ / 2.0) << ".";
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "positionType");
+    }
+}
+
+bool SlpkGen::help(std::ostream &out, const std::string &what) const
+{
+    if (what.empty()) {
+        out << R"RAW(slpkgen
+
+    Generates synthetic SLPK archive (textured terrain mesh pyramid) for
+    performance testing. Node count, tree depth, mesh and texture sizes,
+    compression and attribute types are configurable.
+
+    Output content is fully determined by --seed and the other options.
+
+usage
+    slpkgen OUTPUT [OPTIONS]
+)RAW";
+    }
+    return false;
+}
+
+GenNode::list SlpkGen::layout() const
+{
+    // find minimal fanout able to hold all nodes in given depth
+    int fanout(1);
+    if (depth_ > 1) {
+        for (fanout = 2; ; ++fanout) {
+            std::size_t capacity(0), levelSize(1);
+            for (int l(0); l < depth_; ++l) {
+                capacity += levelSize;
+                levelSize *= fanout;
+            }
+            if (capacity >= nodeCount_) { break; }
+        }
+    }
+    const int grid(std::ceil(std::sqrt(double(fanout))));
+
+    GenNode::list nodes;
+    nodes.emplace_back(0, math::Extents2(origin_(0), origin_(1)
+                                         , origin_(0) + extent_
+                                         , origin_(1) + extent_)
+                       , -1);
+
+    // breadth first, stop when node count is reached
+    for (std::size_t index(0); index < nodes.size(); ++index) {
+        if ((nodes[index].level + 1) >= depth_) { continue; }
+
+        for (int c(0); (c < fanout) && (nodes.size() < nodeCount_); ++c) {
+            const auto parent(nodes[index]);
+            const auto size(math::size(parent.extents));
+            const double w(size.width / grid), h(size.height / grid);
+            const double x(parent.extents.ll(0) + (c % grid) * w);
+            const double y(parent.extents.ll(1) + (c / grid) * h);
+
+            nodes.emplace_back(parent.level + 1
+                               , math::Extents2(x, y, x + w, y + h)
+                               , int(index));
+            nodes[index].children.push_back(nodes.size() - 1);
+        }
+    }
+
+    const Terrain terrain(seed_, extent_, extent_ / 20.0);
+    int counter(0);
+    for (auto &node : nodes) {
+        node.id = (node.parent < 0) ? "root" : std::to_string(++counter);
+
+        const auto center(math::center(node.extents));
+        const auto size(math::size(node.extents));
+        node.mbs.center = math::Point3(center(0), center(1)
+                                       , terrain(center(0), center(1)));
+        node.mbs.r = std::sqrt(size.width * size.width
+                               + size.height * size.height
+                               + 4 * (extent_ / 20.0) * (extent_ / 20.0))
+            / 2.0;
+    }
+
+    return nodes;
+}
+
+int SlpkGen::run()
+{
+    if (trace_) { slpk::trace::start(); }
+
+    const auto nodes(layout());
+
+    slpk::SceneLayerInfo sli;
+    sli.id = 0;
+    sli.href = "./layers/0";
+    sli.layerType = slpk::LayerType::integratedMesh;
+    sli.name = "synthetic-" + std::to_string(seed_);
+    sli.capabilities = { slpk::Capability::view, slpk::Capability::query };
+    sli.spatialReference.wkid = wkid_;
+    sli.spatialReference.vcsWkid = 0;
+    sli.heightModelInfo.heightModel = slpk::HeightModel::ellipsoidal;
+
+    auto &store(*sli.store);
+    store.id = str(boost::format("%016x") % mix(seed_));
+    store.version = store.id;
+    store.profile = slpk::Profile::meshpyramids;
+    store.resourcePattern = {
+        slpk::ResourcePattern::nodeIndexDocument
+        , slpk::ResourcePattern::sharedResource
+        , slpk::ResourcePattern::geometry
+        , slpk::ResourcePattern::texture
+        , slpk::ResourcePattern::featureData
+    };
+    store.rootNode = "./nodes/root";
+    store.extents = nodes.front().extents;
+    store.lodType = slpk::LodType::meshPyramid;
+    store.lodModel = slpk::LodModel::nodeSwitching;
+    store.indexingScheme.name = slpk::IndexSchemeName::esriRTree;
+    store.indexingScheme.inclusive = true;
+    store.indexingScheme.dimensionality = 3;
+    store.indexingScheme.childrenCardinality
+        = slpk::Cardinality(0, int(nodes.front().children.size()));
+    for (const auto &mime : textureEncodings_) {
+        store.textureEncoding.emplace_back(mime);
+    }
+
+    {
+        store.defaultGeometrySchema = boost::in_place();
+        auto &gs(*store.defaultGeometrySchema);
+        gs.geometryType = slpk::GeometryType::triangles;
+        gs.topology = slpk::Topology::perAttributeArray;
+        gs.header.emplace_back("vertexCount", headerType_);
+        gs.header.emplace_back("featureCount", headerType_);
+
+        gs.vertexAttributes.emplace_back("position");
+        gs.vertexAttributes.back().valueType = positionType_;
+        gs.vertexAttributes.back().valuesPerElement = 3;
+        gs.vertexAttributes.emplace_back("uv0");
+        gs.vertexAttributes.back().valueType = uvType_;
+        gs.vertexAttributes.back().valuesPerElement = 2;
+
+        gs.featureAttributes.emplace_back("id");
+        gs.featureAttributes.back().valueType = slpk::DataType::uint64;
+        gs.featureAttributes.back().valuesPerElement = 1;
+        gs.featureAttributes.emplace_back("faceRange");
+        gs.featureAttributes.back().valueType = slpk::DataType::uint32;
+        gs.featureAttributes.back().valuesPerElement = 2;
+    }
+
+    LOG(info4) << "Generating " << nodes.size() << " nodes into "
+               << output_ << ".";
+
+    slpk::Writer writer(output_, metadata_, sli, overwrite_);
+
+    const Terrain terrain(seed_, extent_, extent_ / 20.0);
+    const auto faceCount(vertices_ / 3);
+
+    // serial on purpose: keeps archive entry order stable
+    std::uint64_t nodeIndex(0);
+    for (const auto &gn : nodes) {
+        const auto nodeSeed(mix(seed_ ^ mix(nodeIndex++)));
+        std::mt19937_64 rng(nodeSeed);
+
+        slpk::Node node(sli.store);
+        node.id = gn.id;
+        node.level = gn.level;
+        node.mbs = gn.mbs;
+        if (gn.parent >= 0) {
+            node.parentNode = nodes[gn.parent].reference();
+        }
+        for (auto child : gn.children) {
+            node.children.push_back(nodes[child].reference());
+        }
+
+        node.lodSelection.emplace_back();
+        node.lodSelection.back().metricType
+            = slpk::MetricType::maxScreenThreshold;
+        node.lodSelection.back().maxValue = 1000.0 / gn.mbs.r;
+
+        slpk::SharedResource sr;
+        sr.materialDefinitions.emplace_back("Mat0");
+        sr.materialDefinitions.back().name = "standard";
+
+        const auto textureSize
+            (textureSizes_[std::uniform_int_distribution<std::size_t>
+                           (0, textureSizes_.size() - 1)(rng)]);
+
+        LOG(info2) << "Generating node <" << node.id << ">.";
+        writer.write(node, sr, GridMesh(gn.extents, terrain, faceCount)
+                     , SyntheticTexture(textureSize, rng(), gn.level));
+        writer.write(node, &sr);
+    }
+
+    writer.flush();
+
+    if (trace_) {
+        slpk::trace::stop();
+        slpk::trace::save(*trace_);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    utility::unlimitedCoredump();
+    return SlpkGen()(argc, argv);
+}
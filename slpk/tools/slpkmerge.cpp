@@ -0,0 +1,567 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <deque>
+#include <vector>
+#include <string>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+
+#include <ogr_spatialref.h>
+
+#include <boost/optional.hpp>
+#include <boost/filesystem.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/buildsys.hpp"
+#include "utility/gccversion.hpp"
+#include "utility/limits.hpp"
+
+#include "jsoncpp/json.hpp"
+
+#include "service/cmdline.hpp"
+
+#include "slpk/reader.hpp"
+#include "slpk/writer.hpp"
+#include "slpk/copier.hpp"
+#include "slpk/detail/files.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+namespace constants = slpk::detail::constants;
+
+namespace {
+
+/** Meters per degree of latitude (mean).
+ */
+const double MetersPerDegree(111320.0);
+
+const std::string RootId("root");
+
+/** Input archive summary; only this is kept for all inputs.
+ */
+struct Input {
+    fs::path path;
+    std::string prefix;
+    std::string rootId;
+    slpk::MinimumBoundingSphere mbs;
+    int rootLevel;
+
+    /** Synthesized parent node.
+     */
+    std::size_t parent;
+
+    Input(const fs::path &path = fs::path(), std::size_t index = 0)
+        : path(path), prefix(std::to_string(index) + "-"), rootLevel()
+        , parent()
+    {}
+
+    typedef std::vector<Input> list;
+};
+
+/** Synthesized node above input roots.
+ */
+struct Synthesized {
+    std::string id;
+    int level;
+    slpk::MinimumBoundingSphere mbs;
+    boost::optional<std::size_t> parent;
+
+    /** Indices of synthesized children or, at the lowest level, of inputs.
+     */
+    std::vector<std::size_t> children;
+    bool leaf;
+
+    Synthesized() : level(), leaf() {}
+
+    typedef std::vector<Synthesized> list;
+};
+
+/** Distance of two bounding sphere centers; geographic centers are in
+ *  degrees, distance is in meters (equirectangular approximation).
+ */
+double distance(const math::Point3 &a, const math::Point3 &b
+                , bool geographic)
+{
+    double dx(b(0) - a(0)), dy(b(1) - a(1));
+    const double dz(b(2) - a(2));
+    if (geographic) {
+        const double lat((a(1) + b(1)) / 2.0 * M_PI / 180.0);
+        dx *= MetersPerDegree * std::cos(lat);
+        dy *= MetersPerDegree;
+    }
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+/** Sphere enclosing given spheres (centered at centroid, not minimal).
+ */
+slpk::MinimumBoundingSphere
+enclose(const std::vector<slpk::MinimumBoundingSphere> &spheres
+        , bool geographic)
+{
+    slpk::MinimumBoundingSphere mbs;
+    mbs.center = math::Point3(0.0, 0.0, 0.0);
+    if (spheres.empty()) { return mbs; }
+
+    for (const auto &s : spheres) {
+        for (int i(0); i < 3; ++i) { mbs.center(i) += s.center(i); }
+    }
+    for (int i(0); i < 3; ++i) { mbs.center(i) /= spheres.size(); }
+
+    for (const auto &s : spheres) {
+        mbs.r = std::max(mbs.r, distance(mbs.center, s.center, geographic)
+                         + s.r);
+    }
+    return mbs;
+}
+
+/** Spreads lower 32 bits of value to even bits.
+ */
+std::uint64_t spread(std::uint64_t v)
+{
+    v &= 0xffffffffull;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+    v = (v | (v << 2)) & 0x3333333333333333ull;
+    v = (v | (v << 1)) & 0x5555555555555555ull;
+    return v;
+}
+
+/** Sorts sphere indices along Morton (Z-order) curve of their centers.
+ */
+std::vector<std::size_t>
+mortonOrder(const std::vector<slpk::MinimumBoundingSphere> &spheres)
+{
+    double llx(std::numeric_limits<double>::max()), lly(llx);
+    double urx(std::numeric_limits<double>::lowest()), ury(urx);
+    for (const auto &s : spheres) {
+        llx = std::min(llx, s.center(0)); lly = std::min(lly, s.center(1));
+        urx = std::max(urx, s.center(0)); ury = std::max(ury, s.center(1));
+    }
+
+    const double scale(double(0xffffffffu));
+    const double sx((urx > llx) ? (scale / (urx - llx)) : 0.0);
+    const double sy((ury > lly) ? (scale / (ury - lly)) : 0.0);
+
+    std::vector<std::uint64_t> keys;
+    std::vector<std::size_t> order;
+    for (const auto &s : spheres) {
+        const auto x(std::uint64_t((s.center(0) - llx) * sx));
+        const auto y(std::uint64_t((s.center(1) - lly) * sy));
+        keys.push_back(spread(x) | (spread(y) << 1));
+        order.push_back(order.size());
+    }
+
+    std::stable_sort(order.begin(), order.end()
+                     , [&](std::size_t l, std::size_t r)
+    {
+        return keys[l] < keys[r];
+    });
+    return order;
+}
+
+/** Builds synthesized levels bottom up: spheres of one level are packed
+ *  along Morton curve into groups of fanout, until single root remains.
+ *  Fanout 0 means flat root. Returns synthesized nodes, root first;
+ *  inputs get their parents assigned.
+ */
+Synthesized::list synthesize(Input::list &inputs, std::size_t fanout
+                             , bool geographic)
+{
+    std::vector<Synthesized::list> levels;
+
+    // current level: spheres and what they stand for
+    std::vector<slpk::MinimumBoundingSphere> spheres;
+    for (const auto &input : inputs) { spheres.push_back(input.mbs); }
+    bool leaf(true);
+
+    for (;;) {
+        const auto groupSize(fanout ? fanout : spheres.size());
+        const auto order(mortonOrder(spheres));
+
+        Synthesized::list level;
+        for (std::size_t i(0); i < order.size(); i += groupSize) {
+            level.emplace_back();
+            auto &node(level.back());
+            node.leaf = leaf;
+
+            std::vector<slpk::MinimumBoundingSphere> members;
+            for (std::size_t j(i); j < std::min(i + groupSize, order.size())
+                     ; ++j)
+            {
+                node.children.push_back(order[j]);
+                members.push_back(spheres[order[j]]);
+            }
+            node.mbs = enclose(members, geographic);
+        }
+
+        levels.push_back(level);
+        if (level.size() == 1) { break; }
+
+        spheres.clear();
+        for (const auto &node : level) { spheres.push_back(node.mbs); }
+        leaf = false;
+    }
+
+    // flatten top down, root first
+    Synthesized::list nodes;
+    std::vector<std::size_t> offsets(levels.size());
+    {
+        std::size_t offset(0);
+        for (std::size_t l(levels.size()); l--; ) {
+            offsets[l] = offset;
+            offset += levels[l].size();
+        }
+    }
+
+    int depth(0);
+    for (std::size_t l(levels.size()); l--; ++depth) {
+        for (std::size_t i(0); i < levels[l].size(); ++i) {
+            auto node(levels[l][i]);
+            node.level = depth;
+            node.id = depth ? ("m" + std::to_string(depth) + "-"
+                               + std::to_string(i))
+                : RootId;
+            nodes.push_back(node);
+        }
+    }
+
+    for (std::size_t l(levels.size()); l--; ) {
+        for (std::size_t i(0); i < levels[l].size(); ++i) {
+            const auto index(offsets[l] + i);
+            for (auto &child : nodes[index].children) {
+                if (nodes[index].leaf) {
+                    inputs[child].parent = index;
+                } else {
+                    // make child index global
+                    child += offsets[l - 1];
+                    nodes[child].parent = index;
+                }
+            }
+        }
+    }
+
+    return nodes;
+}
+
+slpk::NodeReference reference(const std::string &id
+                              , const slpk::MinimumBoundingSphere &mbs)
+{
+    slpk::NodeReference nr;
+    nr.id = id;
+    nr.mbs = mbs;
+    nr.href = "../" + id;
+    return nr;
+}
+
+Json::Value asJson(const slpk::NodeReference &nr)
+{
+    Json::Value value(Json::objectValue);
+    value["id"] = nr.id;
+    value["href"] = nr.href;
+    auto &mbs(value["mbs"] = Json::arrayValue);
+    mbs.append(nr.mbs.center(0));
+    mbs.append(nr.mbs.center(1));
+    mbs.append(nr.mbs.center(2));
+    mbs.append(nr.mbs.r);
+    return value;
+}
+
+/** Prefixes node id in a node reference; href follows the id.
+ */
+void rename(Json::Value &ref, const std::string &prefix)
+{
+    const auto id(prefix + ref["id"].asString());
+    ref["id"] = id;
+    ref["href"] = "../" + id;
+}
+
+std::string nodeDir(const std::string &id)
+{
+    return (constants::Nodes / id).generic_string() + "/";
+}
+
+class SlpkMerge : public service::Cmdline
+{
+public:
+    SlpkMerge()
+        : service::Cmdline("slpkmerge", BUILD_TARGET_VERSION)
+        , overwrite_(false), fanout_(16), flat_(false)
+    {}
+
+private:
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+        UTILITY_OVERRIDE;
+
+    virtual void configure(const po::variables_map &vars)
+        UTILITY_OVERRIDE;
+
+    virtual bool help(std::ostream &out, const std::string &what) const
+        UTILITY_OVERRIDE;
+
+    virtual int run() UTILITY_OVERRIDE;
+
+    /** Streams all nodes of single input into the writer.
+     */
+    std::size_t copy(slpk::Writer &writer, const Input &input
+                     , const Synthesized &parent, int levelOffset);
+
+    fs::path output_;
+    std::vector<fs::path> inputs_;
+    bool overwrite_;
+    std::size_t fanout_;
+    bool flat_;
+};
+
+void SlpkMerge::configuration(po::options_description &cmdline
+                              , po::options_description &config
+                              , po::positional_options_description &pd)
+{
+    cmdline.add_options()
+        ("output", po::value(&output_)->required()
+         , "Path to output SLPK archive.")
+        ("input", po::value(&inputs_)->required()->multitoken()
+         , "Paths to input SLPK archives.")
+        ("overwrite", "Overwrite existing output archive.")
+        ("fanout", po::value(&fanout_)->default_value(fanout_)->required()
+         , "Maximum number of children of synthesized nodes.")
+        ("flat", "Put all input roots directly under single synthesized "
+         "root.")
+        ;
+
+    pd
+        .add("output", 1)
+        .add("input", -1);
+
+    (void) config;
+}
+
+void SlpkMerge::configure(const po::variables_map &vars)
+{
+    overwrite_ = vars.count("overwrite");
+    flat_ = vars.count("flat");
+
+    if (fanout_ < 2) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "fanout");
+    }
+}
+
+bool SlpkMerge::help(std::ostream &out, const std::string &what) const
+{
+    if (what.empty()) {
+        out << R"RAW(slpkmerge
+
+    Merges SLPK archives (of the same SRS and texture encodings) into one
+    layer. Input root nodes are indexed by synthesized upper levels
+    (packed along Morton curve by --fanout) or by a single flat root
+    (--flat). Synthesized nodes carry no geometry, clients descend
+    through them.
+
+    Node ids of input archives are prefixed by input index to avoid
+    collisions; node index documents are rewritten accordingly, all other
+    files are copied as stored. Inputs are processed one at a time, memory
+    use does not grow with their number.
+
+usage
+    slpkmerge OUTPUT INPUT... [OPTIONS]
+)RAW";
+    }
+    return false;
+}
+
+std::size_t SlpkMerge::copy(slpk::Writer &writer, const Input &input
+                            , const Synthesized &parent, int levelOffset)
+{
+    LOG(info3) << "Merging " << input.path << ".";
+    slpk::Archive archive(input.path);
+    slpk::Copier copier(archive, writer);
+
+    std::size_t count(0);
+    std::deque<std::string> queue{ archive.sceneLayerInfo().store->rootNode };
+
+    for (bool root(true); !queue.empty(); root = false) {
+        const auto dir(queue.front());
+        queue.pop_front();
+
+        const auto node(archive.loadNodeIndex(dir));
+        const auto id(input.prefix + node.id);
+        const auto newDir(nodeDir(id));
+
+        auto value(copier.nodeIndex(node, dir));
+        value["id"] = id;
+        value["level"] = node.level + levelOffset;
+
+        if (root) {
+            value["parentNode"] = asJson(reference(parent.id, parent.mbs));
+        } else if (value.isMember("parentNode")) {
+            rename(value["parentNode"], input.prefix);
+        }
+        for (const char *member : { "children", "neighbors" }) {
+            if (!value.isMember(member)) { continue; }
+            for (auto &ref : value[member]) { rename(ref, input.prefix); }
+        }
+
+        copier.store(newDir + constants::NodeIndex, value);
+        copier.copyResources(node, dir, newDir);
+        ++count;
+
+        for (const auto &child : node.children) {
+            queue.push_back(child.href);
+        }
+    }
+
+    const auto stats(copier.stats());
+    LOG(info3)
+        << "Merged " << count << " nodes from " << input.path << ": "
+        << stats.passthrough << " files copied as stored, "
+        << stats.recoded << " files recompressed, " << stats.missing
+        << " missing files.";
+
+    return count;
+}
+
+int SlpkMerge::run()
+{
+    // first pass: summaries only
+    Input::list inputs;
+    boost::optional<slpk::Metadata> metadata;
+    boost::optional<slpk::SceneLayerInfo> sli;
+    bool geographic(false);
+
+    for (const auto &path : inputs_) {
+        LOG(info4) << "Scanning " << path << ".";
+        slpk::Archive archive(path);
+        const auto &asli(archive.sceneLayerInfo());
+
+        if (!sli) {
+            metadata = archive.metadata();
+            sli = asli;
+            sli->store = std::make_shared<slpk::Store>(*asli.store);
+            geographic = archive.srs().reference().IsGeographic();
+        } else {
+            if ((asli.spatialReference.wkid != sli->spatialReference.wkid)
+                || (asli.spatialReference.vcsWkid
+                    != sli->spatialReference.vcsWkid))
+            {
+                LOGTHROW(err2, std::runtime_error)
+                    << "Spatial reference of " << path
+                    << " differs from " << inputs_.front() << ".";
+            }
+
+            const auto &te(asli.store->textureEncoding);
+            const auto &ote(sli->store->textureEncoding);
+            if ((te.size() != ote.size())
+                || !std::equal(te.begin(), te.end(), ote.begin()
+                               , [](const slpk::Encoding &l
+                                    , const slpk::Encoding &r)
+                {
+                    return l.mime == r.mime;
+                }))
+            {
+                LOGTHROW(err2, std::runtime_error)
+                    << "Texture encodings of " << path
+                    << " differ from " << inputs_.front() << ".";
+            }
+
+            // layer extents cover all inputs
+            auto &e(sli->store->extents);
+            const auto &ae(asli.store->extents);
+            e.ll(0) = std::min(e.ll(0), ae.ll(0));
+            e.ll(1) = std::min(e.ll(1), ae.ll(1));
+            e.ur(0) = std::max(e.ur(0), ae.ur(0));
+            e.ur(1) = std::max(e.ur(1), ae.ur(1));
+        }
+
+        const auto root(archive.loadRootNodeIndex());
+        inputs.emplace_back(path, inputs.size());
+        inputs.back().rootId = root.id;
+        inputs.back().mbs = root.mbs;
+        inputs.back().rootLevel = root.level;
+    }
+
+    auto nodes(synthesize(inputs, flat_ ? 0 : fanout_, geographic));
+    const int depth(nodes.back().level + 1);
+    LOG(info4) << "Synthesized " << nodes.size() << " nodes in " << depth
+               << " levels above " << inputs.size() << " input roots.";
+
+    sli->store->rootNode = "./" + nodeDir(RootId);
+    slpk::Writer writer(output_, *metadata, *sli, overwrite_);
+
+    for (const auto &sn : nodes) {
+        slpk::Node node(sli->store);
+        node.id = sn.id;
+        node.level = sn.level;
+        node.mbs = sn.mbs;
+        if (sn.parent) {
+            const auto &parent(nodes[*sn.parent]);
+            node.parentNode = reference(parent.id, parent.mbs);
+        }
+        for (auto child : sn.children) {
+            if (sn.leaf) {
+                const auto &input(inputs[child]);
+                node.children.push_back
+                    (reference(input.prefix + input.rootId, input.mbs));
+            } else {
+                node.children.push_back
+                    (reference(nodes[child].id, nodes[child].mbs));
+            }
+        }
+        writer.write(node);
+    }
+
+    std::size_t count(0);
+    for (const auto &input : inputs) {
+        count += copy(writer, input, nodes[input.parent]
+                      , depth - input.rootLevel);
+    }
+
+    LOG(info4) << "Flushing output archive.";
+    writer.flush();
+
+    LOG(info4) << "Merged " << count << " nodes from " << inputs.size()
+               << " archives.";
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    utility::unlimitedCoredump();
+    return SlpkMerge()(argc, argv);
+}
@@ -0,0 +1,722 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** Microbenchmarks of reader/writer hot loops.
+ *
+ * Benchmarked internals are exposed by slpk/detail headers.
+ */
+
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+
+#include <boost/format.hpp>
+#include <boost/utility/in_place_factory.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/device/array.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/buildsys.hpp"
+#include "utility/gccversion.hpp"
+#include "utility/limits.hpp"
+#include "utility/binaryio.hpp"
+
+#include "jsoncpp/json.hpp"
+#include "jsoncpp/io.hpp"
+
+#include "service/cmdline.hpp"
+
+#include "slpk/reader.hpp"
+#include "slpk/writer.hpp"
+#include "slpk/pmr.hpp"
+#include "slpk/stats.hpp"
+#include "slpk/detail/geometry.hpp"
+#include "slpk/detail/decode.hpp"
+#include "slpk/detail/paa.hpp"
+#include "slpk/detail/document.hpp"
+
+#ifdef SLPK_HAS_STATS
+
+// instrumented library replaces operator new/delete itself, count through it
+namespace {
+
+std::size_t allocationCount()
+{
+    return slpk::stats::snapshot().allocations;
+}
+
+} // namespace
+
+#else // SLPK_HAS_STATS
+
+namespace {
+
+std::atomic<std::size_t> allocationTotal(0);
+
+std::size_t allocationCount()
+{
+    return allocationTotal.load();
+}
+
+} // namespace
+
+// count every allocation made by this program
+void* operator new(std::size_t size)
+{
+    ++allocationTotal;
+    if (void *p = std::malloc(size ? size : 1)) { return p; }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+#endif // SLPK_HAS_STATS
+
+namespace po = boost::program_options;
+
+namespace bin = utility::binaryio;
+
+namespace slpk { namespace microbench {
+
+using detail::read;
+using detail::byteCount;
+using detail::Header;
+using detail::loadHeader;
+using detail::MeshFeatures;
+using detail::build;
+using detail::loadNodeIndex;
+using detail::loadSharedResource;
+using detail::loadSceneLayerInfo;
+namespace paa = detail::paa;
+
+typedef std::chrono::steady_clock Clock;
+
+double since(const Clock::time_point &start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/** Prevents compiler from optimizing out benchmarked code.
+ */
+volatile double sink;
+
+struct Result {
+    std::string name;
+    std::size_t elements;
+    std::size_t calls;
+    double nsPerElement;
+    double nsPerCall;
+    double allocationsPerCall;
+
+    typedef std::vector<Result> list;
+};
+
+class Runner {
+public:
+    Runner(double minTime) : minTime_(minTime) {}
+
+    /** Runs function repeatedly for at least minTime seconds. Every call
+     *  processes given number of elements.
+     */
+    template <typename Function>
+    void operator()(const std::string &name, std::size_t elements
+                    , const Function &function);
+
+    const Result::list& results() const { return results_; }
+
+private:
+    double minTime_;
+    Result::list results_;
+};
+
+template <typename Function>
+void Runner::operator()(const std::string &name, std::size_t elements
+                        , const Function &function)
+{
+    // warm-up
+    function();
+
+    Result r;
+    r.name = name;
+    r.elements = elements;
+    r.calls = 0;
+
+    const auto allocations(allocationCount());
+    const auto start(Clock::now());
+    double elapsed(0.0);
+    do {
+        function();
+        ++r.calls;
+        elapsed = since(start);
+    } while ((elapsed < minTime_) || (r.calls < 3));
+
+    r.nsPerCall = (elapsed * 1e9) / r.calls;
+    r.nsPerElement = r.nsPerCall / std::max(elements, std::size_t(1));
+    r.allocationsPerCall
+        = double(allocationCount() - allocations) / r.calls;
+
+    LOG(info3) << name << ": " << r.nsPerElement << " ns/element, "
+               << r.allocationsPerCall << " allocations/call.";
+    results_.push_back(r);
+}
+
+typedef boost::iostreams::stream<boost::iostreams::array_source> ArrayIStream;
+typedef boost::iostreams::stream<boost::iostreams::array_sink> ArrayOStream;
+
+/** Mesh loader that just counts what it gets.
+ */
+class CountingLoader : public MeshLoader {
+public:
+    CountingLoader() : count() {}
+
+    virtual void addVertex(const math::Point3d&) { ++count; }
+    virtual void addTexture(const math::Point2d&) { ++count; }
+    virtual void addNormal(const math::Point3d&) { ++count; }
+    virtual void addFace(const Face&, const FaceTc&, const Face&) { ++count; }
+    virtual void addTxRegion(const Region&) { ++count; }
+
+    std::size_t count;
+};
+
+/** Regular n x n grid mesh, every inner vertex shared by 6 faces.
+ */
+class GridSaver : public MeshSaver {
+public:
+    GridSaver(int n) : n_(n) {}
+
+    virtual Properties properties() const {
+        Properties p;
+        p.faceCount = 2 * n_ * n_;
+        return p;
+    }
+
+    virtual math::Triangle3d face(std::size_t index) const {
+        const auto t(faceTc(index));
+        return {{ point(t[0]), point(t[1]), point(t[2]) }};
+    }
+
+    virtual math::Triangle2d faceTc(std::size_t index) const {
+        const double i((index / 2) % n_);
+        const double j((index / 2) / n_);
+        const math::Point2d p00(i / n_, j / n_);
+        const math::Point2d p10((i + 1) / n_, j / n_);
+        const math::Point2d p01(i / n_, (j + 1) / n_);
+        const math::Point2d p11((i + 1) / n_, (j + 1) / n_);
+        if (index % 2) { return {{ p10, p11, p01 }}; }
+        return {{ p00, p10, p01 }};
+    }
+
+private:
+    static math::Point3d point(const math::Point2d &p) {
+        return math::Point3d(p(0) * 100.0, p(1) * 100.0, p(0) * p(1));
+    }
+
+    int n_;
+};
+
+GeometrySchema makeSchema(bool regions)
+{
+    GeometrySchema gs;
+    gs.header.emplace_back("vertexCount", DataType::uint32);
+    gs.header.emplace_back("featureCount", DataType::uint32);
+
+    gs.vertexAttributes.emplace_back("position");
+    gs.vertexAttributes.back().valueType = DataType::float32;
+    gs.vertexAttributes.back().valuesPerElement = 3;
+    gs.vertexAttributes.emplace_back("uv0");
+    gs.vertexAttributes.back().valueType = DataType::float32;
+    gs.vertexAttributes.back().valuesPerElement = 2;
+    if (regions) {
+        gs.vertexAttributes.emplace_back("region");
+        gs.vertexAttributes.back().valueType = DataType::uint16;
+        gs.vertexAttributes.back().valuesPerElement = 4;
+    }
+
+    gs.featureAttributes.emplace_back("id");
+    gs.featureAttributes.back().valueType = DataType::uint64;
+    gs.featureAttributes.back().valuesPerElement = 1;
+    gs.featureAttributes.emplace_back("faceRange");
+    gs.featureAttributes.back().valueType = DataType::uint32;
+    gs.featureAttributes.back().valuesPerElement = 2;
+    return gs;
+}
+
+/** Serializes grid mesh in PerAttributeArray layout (without header).
+ */
+std::string makeGeometry(int n, bool regions)
+{
+    const GridSaver saver(n);
+    const auto faceCount(saver.properties().faceCount);
+
+    std::ostringstream os;
+    for (std::size_t i(0); i < faceCount; ++i) {
+        for (const auto &p : saver.face(i)) {
+            bin::write(os, float(p(0)));
+            bin::write(os, float(p(1)));
+            bin::write(os, float(p(2)));
+        }
+    }
+    for (std::size_t i(0); i < faceCount; ++i) {
+        for (const auto &p : saver.faceTc(i)) {
+            bin::write(os, float(p(0)));
+            bin::write(os, float(p(1)));
+        }
+    }
+    if (regions) {
+        // four regions, each quarter of the grid
+        for (std::size_t i(0); i < faceCount; ++i) {
+            const std::uint16_t r((i * 4 / faceCount) * 16384);
+            for (int v(0); v < 3; ++v) {
+                bin::write(os, r);
+                bin::write(os, std::uint16_t(0));
+                bin::write(os, std::uint16_t(r + 16383));
+                bin::write(os, std::uint16_t(65535));
+            }
+        }
+    }
+    return os.str();
+}
+
+Store::pointer makeStore()
+{
+    auto store(std::make_shared<Store>());
+    store->rootNode = "./nodes/root";
+    store->geometryEncoding = Encoding("application/octet-stream");
+    store->textureEncoding.emplace_back("image/jpeg");
+    store->textureEncoding.emplace_back("image/vnd-ms.dds");
+    store->defaultGeometrySchema = makeSchema(false);
+    store->finish();
+    return store;
+}
+
+Node makeNode(const Store::pointer &store)
+{
+    Node node(store);
+    node.id = "12-3-4";
+    node.level = 3;
+    node.version = "8c5a2b1e-7d7a-4e0c-9f0e-3a2b1c0d9e8f";
+    node.mbs.center = math::Point3(14.42, 50.08, 250.0);
+    node.mbs.r = 125.0;
+
+    node.parentNode = boost::in_place();
+    node.parentNode->id = "12-3";
+    node.parentNode->href = "../12-3";
+    node.parentNode->mbs = node.mbs;
+
+    for (int i(0); i < 4; ++i) {
+        NodeReference nr;
+        nr.id = node.id + "-" + std::to_string(i);
+        nr.href = "../" + nr.id;
+        nr.mbs = node.mbs;
+        node.children.push_back(nr);
+        node.neighbors.push_back(nr);
+    }
+
+    node.geometryData.emplace_back("./geometries/0");
+    node.featureData.emplace_back("./features/0");
+    node.textureData.emplace_back("./textures/0_0");
+    node.textureData.emplace_back("./textures/0_0_1");
+    node.lodSelection.emplace_back();
+    node.lodSelection.back().maxValue = 1000.0;
+    return node;
+}
+
+SharedResource makeSharedResource()
+{
+    SharedResource sr;
+    sr.materialDefinitions.emplace_back("Mat0");
+    sr.materialDefinitions.back().name = "standard";
+
+    sr.textureDefinitions.emplace_back("tex0");
+    auto &texture(sr.textureDefinitions.back());
+    texture.encoding.emplace_back("image/jpeg");
+    texture.images.emplace_back();
+    texture.images.back().id = "1152921504606846976";
+    texture.images.back().versions.emplace_back("../textures/0_0");
+    return sr;
+}
+
+void readValues(Runner &runner, std::size_t count)
+{
+    for (const auto type : {
+            DataType::uint8, DataType::uint16, DataType::uint32
+            , DataType::uint64, DataType::int8, DataType::int16
+            , DataType::int32, DataType::int64
+            , DataType::float32, DataType::float64 })
+    {
+        const std::string buf(count * byteCount(type), '\x01');
+
+        runner(str(boost::format("read<double>(%s)") % type), count
+               , [&]()
+        {
+            ArrayIStream in(buf.data(), buf.size());
+            double sum(0.0);
+            for (std::size_t i(0); i < count; ++i) {
+                sum += read<double>(in, type);
+            }
+            sink = sum;
+        });
+    }
+}
+
+void decode(Runner &runner, int n)
+{
+    const auto store(makeStore());
+    const auto node(makeNode(store));
+
+    Header header;
+    header.vertexCount = 3 * 2 * n * n;
+    header.featureCount = 1;
+
+    {
+        const auto schema(makeSchema(false));
+        const auto buf(makeGeometry(n, false));
+        const MeshFeatures features;
+
+        runner("Fuser (SimpleFuser, dedup)", header.vertexCount, [&]()
+        {
+            ArrayIStream in(buf.data(), buf.size());
+            CountingLoader loader;
+            detail::decode::Scratch scratch;
+            paa::SimpleFuser(in, loader, node.mbs.center, header, features
+                             , scratch)(schema);
+            sink = loader.count;
+        });
+
+        // same with temporaries in a reused arena
+        std::vector<char> arena(buf.size() * 8);
+        runner("Fuser (SimpleFuser, dedup, arena)", header.vertexCount, [&]()
+        {
+            pmr::monotonic_buffer_resource memory
+                (arena.data(), arena.size());
+            ArrayIStream in(buf.data(), buf.size());
+            CountingLoader loader;
+            detail::decode::Scratch scratch(&memory);
+            paa::SimpleFuser(in, loader, node.mbs.center, header, features
+                             , scratch)(schema);
+            sink = loader.count;
+        });
+
+        // same with retained scratch space (DecodeContext)
+        detail::decode::Scratch retained;
+        runner("Fuser (SimpleFuser, dedup, retained)", header.vertexCount
+               , [&]()
+        {
+            ArrayIStream in(buf.data(), buf.size());
+            CountingLoader loader;
+            retained.clear();
+            paa::SimpleFuser(in, loader, node.mbs.center, header, features
+                             , retained)(schema);
+            sink = loader.count;
+        });
+    }
+
+    {
+        const auto schema(makeSchema(true));
+        const auto buf(makeGeometry(n, true));
+        MeshFeatures features;
+        features.hasRegions = true;
+
+        runner("RegionFuser (incl. finalize)", header.vertexCount, [&]()
+        {
+            ArrayIStream in(buf.data(), buf.size());
+            CountingLoader loader;
+            detail::decode::Scratch scratch;
+            paa::RegionFuser(in, loader, node.mbs.center, header, features
+                             , scratch)(schema);
+            sink = loader.count;
+        });
+    }
+}
+
+void headers(Runner &runner, std::size_t count)
+{
+    const auto schema(makeSchema(false));
+
+    std::ostringstream os;
+    for (std::size_t i(0); i < count; ++i) {
+        bin::write(os, std::uint32_t(i * 3));
+        bin::write(os, std::uint32_t(1));
+    }
+    const auto buf(os.str());
+
+    runner("loadHeader", count, [&]()
+    {
+        ArrayIStream in(buf.data(), buf.size());
+        std::size_t sum(0);
+        for (std::size_t i(0); i < count; ++i) {
+            sum += loadHeader(in, schema.header).vertexCount;
+        }
+        sink = sum;
+    });
+}
+
+void json(Runner &runner)
+{
+    const auto store(makeStore());
+    const auto node(makeNode(store));
+    const auto sr(makeSharedResource());
+
+    SceneLayerInfo sli;
+    sli.name = "microbench";
+    sli.store = store;
+    sli.capabilities = { Capability::view };
+    Metadata metadata;
+
+    const auto serialize([](const Json::Value &value) -> std::string
+    {
+        std::ostringstream os;
+        Json::write(os, value, false);
+        return os.str();
+    });
+
+    Json::Value jNode;
+    build(jNode, node, true);
+    const auto sNode(serialize(jNode));
+
+    Json::Value jSr;
+    build(jSr, sr);
+    const auto sSr(serialize(jSr));
+
+    Json::Value jSli;
+    build(jSli, sli, metadata);
+    const auto sSli(serialize(jSli));
+
+    // parsers
+
+    runner("parse(Node)", 1, [&]()
+    {
+        std::istringstream is(sNode);
+        sink = loadNodeIndex(is, "nodes/12-3-4/3dNodeIndexDocument.json"
+                             , "nodes/12-3-4/", store).level;
+    });
+
+    runner("parse(SharedResource)", 1, [&]()
+    {
+        std::istringstream is(sSr);
+        sink = loadSharedResource
+            (is, "nodes/12-3-4/shared/sharedResource.json")
+            .materialDefinitions.size();
+    });
+
+    runner("parse(SceneLayerInfo)", 1, [&]()
+    {
+        std::istringstream is(sSli);
+        sink = loadSceneLayerInfo(is, "3dSceneLayer.json").first.id;
+    });
+
+    // builders
+
+    runner("build(Node)", 1, [&]()
+    {
+        Json::Value value;
+        build(value, node, true);
+        sink = value.size();
+    });
+
+    runner("build(Node)+write", 1, [&]()
+    {
+        Json::Value value;
+        build(value, node, true);
+        sink = serialize(value).size();
+    });
+
+    runner("build(SharedResource)", 1, [&]()
+    {
+        Json::Value value;
+        build(value, sr);
+        sink = value.size();
+    });
+
+    runner("build(SceneLayerInfo)", 1, [&]()
+    {
+        Json::Value value;
+        build(value, sli, metadata);
+        sink = value.size();
+    });
+}
+
+void save(Runner &runner, int n)
+{
+    const auto store(makeStore());
+    const auto node(makeNode(store));
+    const auto gs(makeSchema(false));
+    const GridSaver saver(n);
+    const auto faceCount(saver.properties().faceCount);
+
+    // header + positions + uv0 + feature
+    std::vector<char> buf(64 + faceCount * 3 * (3 + 2) * sizeof(float));
+
+    runner("SavePerAttributeArray", 3 * faceCount, [&]()
+    {
+        ArrayOStream os(buf.data(), buf.size());
+        FeatureData::Feature feature;
+        ArrayBufferView abv;
+        detail::saveMesh(os, node, saver, gs, feature, abv);
+        sink = abv.vertexAttributes.size();
+    });
+}
+
+} } // namespace slpk::microbench
+
+namespace {
+
+class SlpkMicroBench : public service::Cmdline
+{
+public:
+    SlpkMicroBench()
+        : service::Cmdline("slpkmicrobench", BUILD_TARGET_VERSION)
+        , minTime_(0.5), grid_(64), count_(1 << 16)
+    {}
+
+private:
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+        UTILITY_OVERRIDE;
+
+    virtual void configure(const po::variables_map &vars)
+        UTILITY_OVERRIDE;
+
+    virtual bool help(std::ostream &out, const std::string &what) const
+        UTILITY_OVERRIDE;
+
+    virtual int run() UTILITY_OVERRIDE;
+
+    boost::filesystem::path output_;
+    double minTime_;
+    int grid_;
+    std::size_t count_;
+};
+
+void SlpkMicroBench::configuration(po::options_description &cmdline
+                                   , po::options_description &config
+                                   , po::positional_options_description &pd)
+{
+    cmdline.add_options()
+        ("output", po::value(&output_)
+         , "Path to output JSON report. Only table on stdout if not set.")
+        ("minTime", po::value(&minTime_)->default_value(minTime_)
+         ->required()
+         , "Minimum time (in seconds) spent in each benchmark.")
+        ("grid", po::value(&grid_)->default_value(grid_)->required()
+         , "Size of synthetic grid mesh (grid x grid quads).")
+        ("count", po::value(&count_)->default_value(count_)->required()
+         , "Number of values/headers read by read<T> and loadHeader "
+         "benchmarks.")
+        ;
+
+    (void) config;
+    (void) pd;
+}
+
+void SlpkMicroBench::configure(const po::variables_map &vars)
+{
+    (void) vars;
+    if (grid_ <= 0) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "grid");
+    }
+}
+
+bool SlpkMicroBench::help(std::ostream &out, const std::string &what) const
+{
+    if (what.empty()) {
+        out << R"RAW(slpkmicrobench
+
+    Runs microbenchmarks of SLPK reader and writer hot loops on synthetic
+    buffers and reports time per element and heap allocations per call.
+
+usage
+    slpkmicrobench [OPTIONS]
+)RAW";
+    }
+    return false;
+}
+
+int SlpkMicroBench::run()
+{
+    slpk::microbench::Runner runner(minTime_);
+
+    slpk::microbench::readValues(runner, count_);
+    slpk::microbench::decode(runner, grid_);
+    slpk::microbench::headers(runner, count_);
+    slpk::microbench::json(runner);
+    slpk::microbench::save(runner, grid_);
+
+    std::cout << boost::format("%-32s %12s %14s %14s\n")
+        % "benchmark" % "ns/element" % "ns/call" % "allocs/call";
+    for (const auto &r : runner.results()) {
+        std::cout << boost::format("%-32s %12.2f %14.1f %14.1f\n")
+            % r.name % r.nsPerElement % r.nsPerCall % r.allocationsPerCall;
+    }
+
+    if (!output_.empty()) {
+        Json::Value report(Json::objectValue);
+        report["tool"] = "slpkmicrobench";
+        report["version"] = BUILD_TARGET_VERSION;
+        auto &results(report["results"] = Json::arrayValue);
+        for (const auto &r : runner.results()) {
+            auto &value(results.append(Json::objectValue));
+            value["name"] = r.name;
+            value["elements"] = Json::UInt64(r.elements);
+            value["calls"] = Json::UInt64(r.calls);
+            value["nsPerElement"] = r.nsPerElement;
+            value["nsPerCall"] = r.nsPerCall;
+            value["allocationsPerCall"] = r.allocationsPerCall;
+        }
+
+        std::ofstream f(output_.string());
+        f.exceptions(std::ios::badbit | std::ios::failbit);
+        Json::write(f, report, true);
+        f.close();
+    }
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    utility::unlimitedCoredump();
+    return SlpkMicroBench()(argc, argv);
+}
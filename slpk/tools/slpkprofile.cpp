@@ -0,0 +1,249 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include <boost/optional.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/buildsys.hpp"
+#include "utility/gccversion.hpp"
+#include "utility/limits.hpp"
+#include "utility/enum-io.hpp"
+
+#include "service/cmdline.hpp"
+
+#include "slpk/reader.hpp"
+#include "slpk/profile.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+namespace {
+
+UTILITY_GENERATE_ENUM_CI(Format,
+                         ((csv))
+                         ((json))
+                         )
+
+UTILITY_GENERATE_ENUM_CI(SortKey,
+                         ((none))
+                         ((vertexCount))
+                         ((faceCount))
+                         ((regionCount))
+                         ((storedBytes))
+                         ((uncompressedBytes))
+                         ((decodeTime))
+                         ((texturePixels))
+                         ((textureBytes))
+                         )
+
+double sortValue(const slpk::NodeProfile &node, SortKey key)
+{
+    switch (key) {
+    case SortKey::none: break;
+    case SortKey::vertexCount: return node.vertexCount;
+    case SortKey::faceCount: return node.faceCount;
+    case SortKey::regionCount: return node.regionCount;
+    case SortKey::storedBytes: return node.storedBytes;
+    case SortKey::uncompressedBytes: return node.uncompressedBytes;
+    case SortKey::decodeTime: return node.decodeTime;
+    case SortKey::texturePixels: return area(node.textureSize);
+    case SortKey::textureBytes: return node.textureBytes;
+    }
+    return 0.0;
+}
+
+class SlpkProfile : public service::Cmdline
+{
+public:
+    SlpkProfile()
+        : service::Cmdline("slpkprofile", BUILD_TARGET_VERSION)
+        , threads_(0), sort_(SortKey::none)
+    {}
+
+private:
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+        UTILITY_OVERRIDE;
+
+    virtual void configure(const po::variables_map &vars)
+        UTILITY_OVERRIDE;
+
+    virtual bool help(std::ostream &out, const std::string &what) const
+        UTILITY_OVERRIDE;
+
+    virtual int run() UTILITY_OVERRIDE;
+
+    fs::path input_;
+    fs::path output_;
+    boost::optional<Format> format_;
+    int threads_;
+    SortKey sort_;
+    boost::optional<std::size_t> top_;
+};
+
+void SlpkProfile::configuration(po::options_description &cmdline
+                                , po::options_description &config
+                                , po::positional_options_description &pd)
+{
+    cmdline.add_options()
+        ("input", po::value(&input_)->required()
+         , "Path to input SLPK archive.")
+        ("output", po::value(&output_)
+         , "Path to output report. Report is written to stdout if not "
+         "specified.")
+        ("format", po::value<Format>()
+         , "Report format (csv, json). Derived from output extension, "
+         "defaults to json.")
+        ("threads", po::value(&threads_)->default_value(threads_)
+         ->required()
+         , "Number of threads, 0 means number of CPUs.")
+        ("sort", po::value(&sort_)->default_value(sort_)->required()
+         , "Sort nodes by given key in descending order (none, vertexCount, "
+         "faceCount, regionCount, storedBytes, uncompressedBytes, "
+         "decodeTime, texturePixels, textureBytes).")
+        ("top", po::value<std::size_t>()
+         , "Report only first N nodes (after sorting). Level summaries "
+         "always cover all nodes.")
+        ;
+
+    pd
+        .add("input", 1)
+        .add("output", 1);
+
+    (void) config;
+}
+
+void SlpkProfile::configure(const po::variables_map &vars)
+{
+    if (vars.count("format")) {
+        format_ = vars["format"].as<Format>();
+    } else if (output_.extension() == ".csv") {
+        format_ = Format::csv;
+    }
+
+    if (vars.count("top")) {
+        top_ = vars["top"].as<std::size_t>();
+    }
+
+    if (threads_ < 0) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "threads");
+    }
+}
+
+bool SlpkProfile::help(std::ostream &out, const std::string &what) const
+{
+    if (what.empty()) {
+        out << R"RAW(slpkprofile
+
+    Profiles decode cost of every node of SLPK archive: stored and
+    uncompressed geometry sizes, header vertex/face/feature counts,
+    decoded vertex/face/region counts, decode time and texture size.
+
+    Nodes are profiled in parallel. Report (one line per node in CSV or
+    nodes plus per-level power-of-two histograms in JSON) is sortable by
+    --sort and can be limited to worst nodes by --top. Level summaries
+    are logged as well.
+
+usage
+    slpkprofile INPUT [OUTPUT] [OPTIONS]
+)RAW";
+    }
+    return false;
+}
+
+int SlpkProfile::run()
+{
+    LOG(info4) << "Opening SLPK archive at " << input_ << ".";
+    slpk::Archive archive(input_);
+
+    LOG(info4) << "Loading tree.";
+    const auto tree(archive.loadTree());
+
+    LOG(info4) << "Profiling " << tree.nodes.size() << " nodes.";
+    auto nodes(slpk::profileNodes(archive, tree, threads_));
+    const auto levels(slpk::summarize(nodes));
+
+    for (const auto &item : levels) {
+        const auto &level(item.second);
+        LOG(info4)
+            << "Level " << level.level << ": " << level.nodeCount
+            << " nodes (" << level.errorCount << " failed), vertices "
+            << level.vertexCount.min << "/" << level.vertexCount.mean()
+            << "/" << level.vertexCount.max << ", decode [us] "
+            << level.decodeMicroseconds.min << "/"
+            << level.decodeMicroseconds.mean() << "/"
+            << level.decodeMicroseconds.max << " (min/mean/max).";
+    }
+
+    if (sort_ != SortKey::none) {
+        std::stable_sort(nodes.begin(), nodes.end()
+                         , [&](const slpk::NodeProfile &l
+                               , const slpk::NodeProfile &r)
+        {
+            return sortValue(l, sort_) > sortValue(r, sort_);
+        });
+    }
+
+    if (top_ && (nodes.size() > *top_)) { nodes.resize(*top_); }
+
+    const auto save([&](std::ostream &os)
+    {
+        switch (format_ ? *format_ : Format::json) {
+        case Format::csv: slpk::saveCsv(os, nodes); break;
+        case Format::json: slpk::saveJson(os, nodes, levels); break;
+        }
+    });
+
+    if (output_.empty()) {
+        save(std::cout);
+        std::cout.flush();
+    } else {
+        std::ofstream f(output_.string());
+        f.exceptions(std::ios::badbit | std::ios::failbit);
+        save(f);
+        f.close();
+    }
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    utility::unlimitedCoredump();
+    return SlpkProfile()(argc, argv);
+}
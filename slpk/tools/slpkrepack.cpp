@@ -0,0 +1,379 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cstdlib>
+#include <cstdint>
+#include <set>
+#include <map>
+#include <vector>
+#include <string>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+
+#include <ogr_spatialref.h>
+
+#include <boost/optional.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/device/array.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/buildsys.hpp"
+#include "utility/gccversion.hpp"
+#include "utility/limits.hpp"
+#include "utility/enum-io.hpp"
+
+#include "service/cmdline.hpp"
+
+#include "slpk/reader.hpp"
+#include "slpk/writer.hpp"
+#include "slpk/copier.hpp"
+#include "slpk/flattree.hpp"
+#include "slpk/detail/files.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+namespace bio = boost::iostreams;
+
+namespace constants = slpk::detail::constants;
+
+namespace {
+
+UTILITY_GENERATE_ENUM_CI(EntryOrder,
+                         ((tree))
+                         ((morton))
+                         )
+
+/** Node with its directory and position in output order.
+ */
+struct Item {
+    const slpk::TreeNode *treeNode;
+    std::string dir;
+    std::uint64_t key;
+
+    Item(const slpk::TreeNode *treeNode = nullptr
+         , const std::string &dir = "")
+        : treeNode(treeNode), dir(dir), key()
+    {}
+
+    typedef std::vector<Item> list;
+};
+
+/** Spreads lower 32 bits of value to even bits.
+ */
+std::uint64_t spread(std::uint64_t v)
+{
+    v &= 0xffffffffull;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+    v = (v | (v << 2)) & 0x3333333333333333ull;
+    v = (v | (v << 1)) & 0x5555555555555555ull;
+    return v;
+}
+
+/** Collects nodes in breadth first order together with their directories.
+ */
+Item::list collect(const slpk::Archive &archive, const slpk::Tree &tree)
+{
+    Item::list items;
+
+    const auto &rootDir(archive.sceneLayerInfo().store->rootNode);
+    const auto froot(tree.nodes.find(tree.rootNodeId));
+    if (froot == tree.nodes.end()) { return items; }
+    items.emplace_back(&froot->second, rootDir);
+
+    for (std::size_t i(0); i < items.size(); ++i) {
+        for (const auto &child : items[i].treeNode->node.children) {
+            const auto fchild(tree.nodes.find(child.id));
+            if (fchild == tree.nodes.end()) { continue; }
+            items.emplace_back(&fchild->second, child.href);
+        }
+    }
+
+    return items;
+}
+
+/** Orders nodes level by level, inside a level along Morton (Z-order)
+ *  curve of bounding sphere centers.
+ */
+void mortonOrder(Item::list &items)
+{
+    if (items.empty()) { return; }
+
+    double llx(std::numeric_limits<double>::max()), lly(llx);
+    double urx(std::numeric_limits<double>::lowest()), ury(urx);
+    for (const auto &item : items) {
+        const auto &c(item.treeNode->node.mbs.center);
+        llx = std::min(llx, c(0)); lly = std::min(lly, c(1));
+        urx = std::max(urx, c(0)); ury = std::max(ury, c(1));
+    }
+
+    const double scale(double(0xffffffffu));
+    const double sx((urx > llx) ? (scale / (urx - llx)) : 0.0);
+    const double sy((ury > lly) ? (scale / (ury - lly)) : 0.0);
+
+    for (auto &item : items) {
+        const auto &c(item.treeNode->node.mbs.center);
+        const auto x(std::uint64_t((c(0) - llx) * sx));
+        const auto y(std::uint64_t((c(1) - lly) * sy));
+        item.key = spread(x) | (spread(y) << 1);
+    }
+
+    std::stable_sort(items.begin(), items.end()
+                     , [](const Item &l, const Item &r)
+    {
+        const auto ll(l.treeNode->node.level), rl(r.treeNode->node.level);
+        if (ll != rl) { return ll < rl; }
+        return l.key < r.key;
+    });
+}
+
+class SlpkRepack : public service::Cmdline
+{
+public:
+    SlpkRepack()
+        : service::Cmdline("slpkrepack", BUILD_TARGET_VERSION)
+        , overwrite_(false), order_(EntryOrder::morton), flatTree_(false)
+        , pruneUnreferenced_(false)
+    {}
+
+private:
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+        UTILITY_OVERRIDE;
+
+    virtual void configure(const po::variables_map &vars)
+        UTILITY_OVERRIDE;
+
+    virtual bool help(std::ostream &out, const std::string &what) const
+        UTILITY_OVERRIDE;
+
+    virtual int run() UTILITY_OVERRIDE;
+
+    fs::path input_;
+    fs::path output_;
+    bool overwrite_;
+    boost::optional<slpk::ArchiveCompressionType> archiveCompression_;
+    boost::optional<slpk::ResourceCompressionType> resourceCompression_;
+    EntryOrder order_;
+    std::set<std::string> strip_;
+    bool flatTree_;
+    bool pruneUnreferenced_;
+};
+
+void SlpkRepack::configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+{
+    cmdline.add_options()
+        ("input", po::value(&input_)->required()
+         , "Path to input SLPK archive.")
+        ("output", po::value(&output_)->required()
+         , "Path to output SLPK archive.")
+        ("overwrite", "Overwrite existing output archive.")
+        ("archiveCompression", po::value<slpk::ArchiveCompressionType>()
+         , "Archive (zip) compression type (STORE, DEFLATE). Defaults to "
+         "input's. Gzipped resources are never deflated again.")
+        ("resourceCompression", po::value<slpk::ResourceCompressionType>()
+         , "Resource compression type (NONE, GZIP). Defaults to input's.")
+        ("order", po::value(&order_)->default_value(order_)->required()
+         , "Order of output entries: tree (breadth first) or morton "
+         "(level by level, Z-order of node centers inside a level).")
+        ("strip", po::value<std::vector<std::string>>()->multitoken()
+         , "Texture encodings (MIME types) to strip, e.g. "
+         "image/vnd-ms.dds.")
+        ("flatTree", "Store flat tree index (see FlatTree::load) in the "
+         "output archive.")
+        ("pruneUnreferenced", "Do not copy files not referenced from the "
+         "node tree.")
+        ;
+
+    pd
+        .add("input", 1)
+        .add("output", 1);
+
+    (void) config;
+}
+
+void SlpkRepack::configure(const po::variables_map &vars)
+{
+    overwrite_ = vars.count("overwrite");
+    flatTree_ = vars.count("flatTree");
+    pruneUnreferenced_ = vars.count("pruneUnreferenced");
+
+    if (vars.count("archiveCompression")) {
+        archiveCompression_
+            = vars["archiveCompression"].as<slpk::ArchiveCompressionType>();
+    }
+    if (vars.count("resourceCompression")) {
+        resourceCompression_
+            = vars["resourceCompression"]
+            .as<slpk::ResourceCompressionType>();
+    }
+
+    if (vars.count("strip")) {
+        for (const auto &mime : vars["strip"].as<std::vector<std::string>>())
+        {
+            strip_.insert(mime);
+        }
+    }
+
+    if (fs::exists(output_) && fs::exists(input_)
+        && fs::equivalent(input_, output_))
+    {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "output");
+    }
+}
+
+bool SlpkRepack::help(std::ostream &out, const std::string &what) const
+{
+    if (what.empty()) {
+        out << R"RAW(slpkrepack
+
+    Rewrites SLPK archive with chosen archive and resource compression,
+    spatially ordered entries, optionally stripped texture encodings and
+    generated flat tree index.
+
+    Payloads are copied as stored (no decompression and recompression)
+    whenever resource compression does not change; only node index
+    documents and shared resources touched by stripping are rewritten.
+
+usage
+    slpkrepack INPUT OUTPUT [OPTIONS]
+)RAW";
+    }
+    return false;
+}
+
+int SlpkRepack::run()
+{
+    LOG(info4) << "Opening SLPK archive at " << input_ << ".";
+    slpk::Archive archive(input_);
+
+    auto metadata(archive.metadata());
+    if (archiveCompression_) {
+        metadata.archiveCompressionType = *archiveCompression_;
+    }
+    if (resourceCompression_) {
+        metadata.resourceCompressionType = *resourceCompression_;
+    }
+
+    // stripped encodings disappear from the store as well
+    auto sli(archive.sceneLayerInfo());
+    if (!strip_.empty()) {
+        sli.store = std::make_shared<slpk::Store>(*sli.store);
+        auto &encodings(sli.store->textureEncoding);
+        encodings.erase(std::remove_if(encodings.begin(), encodings.end()
+                                       , [&](const slpk::Encoding &e)
+        {
+            return strip_.count(e.mime);
+        }), encodings.end());
+    }
+
+    LOG(info4) << "Loading tree.";
+    const auto tree(archive.loadTree());
+    auto items(collect(archive, tree));
+    if (order_ == EntryOrder::morton) { mortonOrder(items); }
+
+    slpk::Writer writer(output_, metadata, sli, overwrite_);
+    slpk::Copier copier(archive, writer);
+    copier.stripEncodings(strip_);
+
+    LOG(info4) << "Copying " << items.size() << " nodes.";
+    for (const auto &item : items) {
+        const auto &node(item.treeNode->node);
+
+        const bool touched
+            (std::any_of(node.textureData.begin(), node.textureData.end()
+                         , [&](const slpk::Resource &r)
+        {
+            return r.encoding && strip_.count(r.encoding->mime);
+        }));
+
+        const auto path(item.dir + constants::NodeIndex);
+        if (touched) {
+            copier.store(path, copier.nodeIndex(node, item.dir));
+            copier.claim(copier.find(path));
+        } else {
+            copier.copy(copier.find(path));
+        }
+
+        copier.copyResources(node);
+    }
+
+    if (flatTree_) {
+        LOG(info4) << "Storing flat tree index.";
+        const auto image(slpk::FlatTree::build
+                         (tree, archive.srs().reference().IsGeographic()));
+        bio::stream<bio::array_source> is(image.data(), image.size());
+        writer.copy(constants::FlatTreeName, is);
+    }
+
+    // anything else not written by the writer itself
+    std::size_t unreferenced(0);
+    for (const auto &file : archive.fileList()) {
+        if (copier.copied(file)) { continue; }
+
+        auto name(file.filename());
+        if (name.extension() == constants::ext::gz) { name = name.stem(); }
+        if ((name == constants::MetadataName)
+            || (name == constants::SceneLayer)
+            || (flatTree_ && (name == constants::FlatTreeName)))
+        {
+            continue;
+        }
+
+        ++unreferenced;
+        if (!pruneUnreferenced_) { copier.copy(file); }
+    }
+
+    LOG(info4) << "Flushing output archive.";
+    writer.flush();
+
+    const auto stats(copier.stats());
+    LOG(info4)
+        << "Repacked " << writer.metadata().nodeCount << " nodes: "
+        << stats.passthrough << " files copied as stored, "
+        << stats.recoded << " files recompressed, " << stats.missing
+        << " missing files, " << unreferenced << " unreferenced files "
+        << (pruneUnreferenced_ ? "pruned." : "kept.");
+
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    utility::unlimitedCoredump();
+    return SlpkRepack()(argc, argv);
+}
@@ -0,0 +1,300 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <sstream>
+#include <iostream>
+
+#include <boost/asio.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/buildsys.hpp"
+#include "utility/gccversion.hpp"
+#include "utility/limits.hpp"
+
+#include "service/cmdline.hpp"
+
+#include "slpk/reader.hpp"
+#include "slpk/restapi.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+namespace ba = boost::algorithm;
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+namespace {
+
+struct Response {
+    int status;
+    std::string reason;
+    std::string contentType;
+    std::string contentEncoding;
+    std::vector<char> body;
+
+    Response(int status = 200, const std::string &reason = "OK")
+        : status(status), reason(reason)
+    {}
+};
+
+/** Minimal HTTP/1.1 server (GET only, keep-alive) over slpk::RestApi.
+ */
+class Server {
+public:
+    Server(const slpk::RestApi &api, int latency)
+        : api_(api), latency_(latency)
+    {}
+
+    void serve(tcp::acceptor &acceptor);
+
+private:
+    void connection(tcp::socket socket);
+    Response get(const std::string &path);
+
+    /** Read-only after construction, shared by all connections without
+     *  locking.
+     */
+    const slpk::RestApi &api_;
+    std::chrono::milliseconds latency_;
+};
+
+void Server::serve(tcp::acceptor &acceptor)
+{
+    for (;;) {
+        tcp::socket socket(acceptor.get_executor());
+        acceptor.accept(socket);
+        std::thread([this](tcp::socket socket)
+        {
+            try {
+                connection(std::move(socket));
+            } catch (const std::exception &e) {
+                LOG(warn2) << "Connection failed: " << e.what();
+            }
+        }, std::move(socket)).detach();
+    }
+}
+
+void Server::connection(tcp::socket socket)
+{
+    asio::streambuf buf;
+    for (;;) {
+        boost::system::error_code ec;
+        asio::read_until(socket, buf, "\r\n\r\n", ec);
+        if (ec) { return; }
+
+        std::istream is(&buf);
+        std::string method, target, version, line;
+        is >> method >> target >> version;
+        std::getline(is, line);
+
+        bool keepAlive(version == "HTTP/1.1");
+        while (std::getline(is, line) && (line != "\r")) {
+            ba::trim(line);
+            if (ba::istarts_with(line, "connection:")) {
+                auto value(line.substr(11));
+                ba::trim(value);
+                keepAlive = ba::iequals(value, "keep-alive");
+            }
+        }
+
+        Response response(405, "Method Not Allowed");
+        if (method == "GET") {
+            const auto query(target.find('?'));
+            if (query != std::string::npos) { target.resize(query); }
+            while (!target.empty() && (target.front() == '/')) {
+                target.erase(0, 1);
+            }
+            response = get(target);
+        }
+
+        if (latency_.count()) { std::this_thread::sleep_for(latency_); }
+
+        std::ostringstream os;
+        os << "HTTP/1.1 " << response.status << ' ' << response.reason
+           << "\r\nContent-Length: " << response.body.size() << "\r\n";
+        if (!response.contentType.empty()) {
+            os << "Content-Type: " << response.contentType << "\r\n";
+        }
+        if (!response.contentEncoding.empty()) {
+            os << "Content-Encoding: " << response.contentEncoding << "\r\n";
+        }
+        os << "Connection: " << (keepAlive ? "keep-alive" : "close")
+           << "\r\n\r\n";
+        const auto header(os.str());
+
+        std::vector<asio::const_buffer> buffers;
+        buffers.push_back(asio::buffer(header));
+        buffers.push_back(asio::buffer(response.body));
+        asio::write(socket, buffers);
+
+        LOG(info1) << method << " /" << target << " -> " << response.status
+                   << " (" << response.body.size() << " bytes).";
+
+        if (!keepAlive) { return; }
+    }
+}
+
+Response Server::get(const std::string &path)
+{
+    try {
+        std::error_code ec;
+        const auto file(api_.file(path, ec));
+        if (ec == slpk::Errc::noSuchFile) {
+            return Response(404, "Not Found");
+        }
+
+        Response response;
+        response.contentType = file.second->contentType;
+        response.contentEncoding = file.second->transferEncoding;
+        if (file.first) {
+            response.body = file.first->read();
+        } else {
+            response.body.assign(file.second->content.begin()
+                                 , file.second->content.end());
+        }
+        return response;
+    } catch (const std::exception &e) {
+        LOG(err2) << "Failed to serve /" << path << ": " << e.what();
+        return Response(500, "Internal Server Error");
+    }
+}
+
+class SlpkServe : public service::Cmdline
+{
+public:
+    SlpkServe()
+        : service::Cmdline("slpkserve", BUILD_TARGET_VERSION)
+        , listen_("127.0.0.1:8080"), latency_(0)
+    {}
+
+private:
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+        UTILITY_OVERRIDE;
+
+    virtual void configure(const po::variables_map &vars)
+        UTILITY_OVERRIDE;
+
+    virtual bool help(std::ostream &out, const std::string &what) const
+        UTILITY_OVERRIDE;
+
+    virtual int run() UTILITY_OVERRIDE;
+
+    fs::path input_;
+    std::string listen_;
+    int latency_;
+};
+
+void SlpkServe::configuration(po::options_description &cmdline
+                              , po::options_description &config
+                              , po::positional_options_description &pd)
+{
+    cmdline.add_options()
+        ("input", po::value(&input_)->required()
+         , "Path to input SLPK archive.")
+        ("listen", po::value(&listen_)->default_value(listen_)->required()
+         , "Listen address (host:port).")
+        ("latency", po::value(&latency_)->default_value(latency_)
+         ->required()
+         , "Artificial latency added to every response, in milliseconds.")
+        ;
+
+    pd
+        .add("input", 1);
+
+    (void) config;
+}
+
+void SlpkServe::configure(const po::variables_map &vars)
+{
+    (void) vars;
+
+    if (listen_.rfind(':') == std::string::npos) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "listen");
+    }
+
+    if (latency_ < 0) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "latency");
+    }
+}
+
+bool SlpkServe::help(std::ostream &out, const std::string &what) const
+{
+    if (what.empty()) {
+        out << R"RAW(slpkserve
+
+    Serves SLPK archive as an I3S SceneServer over plain HTTP/1.1
+    (GET only, keep-alive, one thread per connection). Layer URL is
+    http://LISTEN/SceneServer/layers/0 (layer id as found in the archive).
+
+    Stand-in for a remote service: use it to exercise and benchmark remote
+    archive access (slpk::RemoteOptions, slpkbench with URL input) offline.
+    --latency simulates network round trip time.
+
+usage
+    slpkserve INPUT [OPTIONS]
+)RAW";
+    }
+    return false;
+}
+
+int SlpkServe::run()
+{
+    LOG(info4) << "Opening SLPK archive at " << input_ << ".";
+    slpk::RestApi api(slpk::Archive{input_});
+
+    const auto colon(listen_.rfind(':'));
+    asio::io_service ios;
+    tcp::resolver resolver(ios);
+    const auto endpoint
+        (*resolver.resolve(tcp::resolver::query
+                           (listen_.substr(0, colon)
+                            , listen_.substr(colon + 1))));
+
+    tcp::acceptor acceptor(ios, endpoint);
+    LOG(info4) << "Serving " << input_ << " at http://" << listen_ << "/"
+               << slpk::constants::SceneServer << ".";
+
+    Server(api, latency_).serve(acceptor);
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    utility::unlimitedCoredump();
+    return SlpkServe()(argc, argv);
+}
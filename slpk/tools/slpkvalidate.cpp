@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cstdlib>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/buildsys.hpp"
+#include "utility/gccversion.hpp"
+#include "utility/limits.hpp"
+
+#include "service/cmdline.hpp"
+
+#include "slpk/reader.hpp"
+#include "slpk/validate.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+namespace {
+
+class SlpkValidate : public service::Cmdline
+{
+public:
+    SlpkValidate()
+        : service::Cmdline("slpkvalidate", BUILD_TARGET_VERSION)
+    {}
+
+private:
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description &config
+                               , po::positional_options_description &pd)
+        UTILITY_OVERRIDE;
+
+    virtual void configure(const po::variables_map &vars)
+        UTILITY_OVERRIDE;
+
+    virtual bool help(std::ostream &out, const std::string &what) const
+        UTILITY_OVERRIDE;
+
+    virtual int run() UTILITY_OVERRIDE;
+
+    fs::path input_;
+    fs::path output_;
+    slpk::ValidationOptions options_;
+};
+
+void SlpkValidate::configuration(po::options_description &cmdline
+                                 , po::options_description &config
+                                 , po::positional_options_description &pd)
+{
+    cmdline.add_options()
+        ("input", po::value(&input_)->required()
+         , "Path to input SLPK archive.")
+        ("output", po::value(&output_)
+         , "Path to output JSON report. Issues are only logged if not "
+         "specified.")
+        ("threads", po::value(&options_.threads)
+         ->default_value(options_.threads)->required()
+         , "Number of threads, 0 means number of CPUs.")
+        ("checkEntries", po::value(&options_.checkEntries)
+         ->default_value(options_.checkEntries)->required()
+         , "Check zip entry CRCs and sizes and all gzip streams.")
+        ("checkGeometry", po::value(&options_.checkGeometry)
+         ->default_value(options_.checkGeometry)->required()
+         , "Check geometry buffers against the geometry schema.")
+        ("checkTextures", po::value(&options_.checkTextures)
+         ->default_value(options_.checkTextures)->required()
+         , "Check that textures resolve and are readable.")
+        ("checkFeatures", po::value(&options_.checkFeatures)
+         ->default_value(options_.checkFeatures)->required()
+         , "Check that feature data resolve and are readable.")
+        ;
+
+    pd
+        .add("input", 1)
+        .add("output", 1);
+
+    (void) config;
+}
+
+void SlpkValidate::configure(const po::variables_map &vars)
+{
+    if (options_.threads < 0) {
+        throw po::validation_error
+            (po::validation_error::invalid_option_value, "threads");
+    }
+
+    (void) vars;
+}
+
+bool SlpkValidate::help(std::ostream &out, const std::string &what) const
+{
+    if (what.empty()) {
+        out << R"RAW(slpkvalidate
+
+    Validates integrity of SLPK archive: walks the node tree and checks
+    that node references, shared resources, geometries, textures and
+    feature data resolve, that geometry buffers match the geometry schema,
+    and that zip entries (CRC, size) and gzip streams are intact.
+
+    Work is done in parallel. Validation never stops at the first problem,
+    all issues are logged and optionally written to JSON report. Exits
+    with non-zero status when any error is found.
+
+usage
+    slpkvalidate INPUT [OUTPUT] [OPTIONS]
+)RAW";
+    }
+    return false;
+}
+
+int SlpkValidate::run()
+{
+    LOG(info4) << "Opening SLPK archive at " << input_ << ".";
+    slpk::Archive archive(input_);
+
+    const auto report(slpk::validate(archive, options_));
+
+    for (const auto &issue : report.issues) {
+        const auto &node(issue.node.empty() ? std::string("-") : issue.node);
+        if (issue.severity == slpk::IssueSeverity::error) {
+            LOG(err3) << "<" << node << "> " << issue.path << ": "
+                      << issue.message;
+        } else {
+            LOG(warn3) << "<" << node << "> " << issue.path << ": "
+                       << issue.message;
+        }
+    }
+
+    LOG(info4)
+        << "Validated " << report.nodeCount << " nodes, "
+        << report.resourceCount << " resources and " << report.entryCount
+        << " entries: " << report.count(slpk::IssueSeverity::error)
+        << " errors, " << report.count(slpk::IssueSeverity::warning)
+        << " warnings.";
+
+    if (!output_.empty()) {
+        std::ofstream f(output_.string());
+        f.exceptions(std::ios::badbit | std::ios::failbit);
+        slpk::saveJson(f, report);
+        f.close();
+    }
+
+    return report.ok() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    utility::unlimitedCoredump();
+    return SlpkValidate()(argc, argv);
+}
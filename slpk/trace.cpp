@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fstream>
+
+#include "dbglog/dbglog.hpp"
+
+#include "trace.hpp"
+
+namespace slpk { namespace trace {
+
+namespace detail {
+
+std::atomic<bool> recording(false);
+
+} // namespace detail
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Event {
+    const char *name;
+    const char *category;
+    std::uint64_t start;
+    std::uint64_t end;
+    unsigned int thread;
+
+    /** Held while written; writers whose indices wrap around to the same
+     *  slot take turns.
+     */
+    std::atomic<bool> busy;
+
+    Event()
+        : name(), category(), start(), end(), thread(), busy(false)
+    {}
+};
+
+/** Ring buffer, fully allocated before it is published to writers.
+ */
+struct Buffer {
+    std::unique_ptr<Event[]> events;
+    std::size_t capacity;
+    std::atomic<std::size_t> next;
+
+    Buffer(std::size_t capacity)
+        : events(new Event[capacity]), capacity(capacity), next(0)
+    {}
+};
+
+/** Buffer being recorded into, null when not recording.
+ */
+std::atomic<Buffer*> current(nullptr);
+
+/** Number of record() calls currently running. Buffer taken out of current
+ *  is not touched by any writer once this drops to zero.
+ */
+std::atomic<std::size_t> writers(0);
+
+/** Last recorded (stopped and drained) buffer, owned here; serialized by
+ *  control mutex together with start/stop/save.
+ */
+std::unique_ptr<Buffer> recorded;
+std::mutex control;
+
+/** Start of recording in clock ticks.
+ */
+std::atomic<Clock::rep> origin(0);
+
+std::atomic<unsigned int> threadCounter(0);
+
+unsigned int threadId()
+{
+    // small sequential thread ids, assigned on first recorded span
+    thread_local unsigned int id(++threadCounter);
+    return id;
+}
+
+/** Takes buffer out of writers' reach and waits for running writers.
+ *  Called under control mutex.
+ */
+void stopAndDrain()
+{
+    detail::recording = false;
+
+    std::unique_ptr<Buffer> buffer(current.exchange(nullptr));
+    if (!buffer) { return; }
+
+    while (writers.load()) { std::this_thread::yield(); }
+    recorded = std::move(buffer);
+}
+
+} // namespace
+
+namespace detail {
+
+std::uint64_t now()
+{
+    // nanoseconds since start(), offset by one to keep zero as "not
+    // recording" marker in Span
+    const auto elapsed(Clock::now().time_since_epoch()
+                       - Clock::duration(origin.load
+                                         (std::memory_order_relaxed)));
+    return 1 + std::chrono::duration_cast<std::chrono::nanoseconds>
+        (elapsed).count();
+}
+
+void record(const char *name, const char *category
+            , std::uint64_t start, std::uint64_t end)
+{
+    if (!active()) { return; }
+
+    // announce writer before looking at the buffer: stopAndDrain() waits for
+    // every writer that could have seen it
+    ++writers;
+    if (auto *buffer = current.load()) {
+        const auto index(buffer->next.fetch_add
+                         (1, std::memory_order_relaxed));
+        auto &e(buffer->events[index % buffer->capacity]);
+        while (e.busy.exchange(true, std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        e.name = name;
+        e.category = category;
+        e.start = start;
+        e.end = end;
+        e.thread = threadId();
+        e.busy.store(false, std::memory_order_release);
+    }
+    --writers;
+}
+
+} // namespace detail
+
+void start(std::size_t capacity)
+{
+    std::unique_ptr<Buffer> buffer(new Buffer(capacity ? capacity : 1));
+
+    std::lock_guard<std::mutex> lock(control);
+    stopAndDrain();
+    recorded.reset();
+
+    origin = Clock::now().time_since_epoch().count();
+    current = buffer.release();
+    detail::recording = true;
+}
+
+void stop()
+{
+    std::lock_guard<std::mutex> lock(control);
+    stopAndDrain();
+}
+
+void save(std::ostream &os)
+{
+    std::lock_guard<std::mutex> lock(control);
+    stopAndDrain();
+
+    if (!recorded) {
+        os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[]}\n";
+        return;
+    }
+
+    const auto &buffer(*recorded);
+    const auto capacity(buffer.capacity);
+    const std::size_t next(buffer.next);
+
+    // oldest event first
+    const auto count(std::min(next, capacity));
+    const auto first((next > capacity) ? (next % capacity) : 0);
+
+    if (next > capacity) {
+        LOG(info2) << "Trace ring buffer wrapped around, "
+                   << (next - capacity) << " oldest events lost.";
+    }
+
+    // timestamps and durations are in microseconds
+    const auto precision(os.precision(15));
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (std::size_t i(0); i < count; ++i) {
+        const auto &e(buffer.events[(first + i) % capacity]);
+        if (i) { os << ','; }
+        os << "\n{\"name\":\"" << e.name
+           << "\",\"cat\":\"" << e.category
+           << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+           << ",\"ts\":" << ((e.start - 1) / 1000.0)
+           << ",\"dur\":" << ((e.end - e.start) / 1000.0)
+           << '}';
+    }
+    os << "\n]}\n";
+    os.precision(precision);
+}
+
+void save(const boost::filesystem::path &path)
+{
+    std::ofstream f;
+    f.exceptions(std::ios::badbit | std::ios::failbit);
+    f.open(path.string(), std::ios_base::out | std::ios_base::trunc);
+    save(f);
+    f.close();
+
+    LOG(info3) << "Trace saved to " << path << ".";
+}
+
+} } // namespace slpk::trace
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef slpk_trace_hpp_included_
+#define slpk_trace_hpp_included_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+#include <boost/filesystem/path.hpp>
+
+/** Timeline tracing of reader and writer internals.
+ *
+ *  Spans are recorded into a fixed size ring buffer (oldest events are
+ *  overwritten) only between start() and stop(); otherwise a span costs one
+ *  relaxed atomic load. Recorded events are saved in Chrome trace-event JSON
+ *  format loadable by chrome://tracing or Perfetto UI.
+ */
+
+namespace slpk { namespace trace {
+
+/** Starts recording into ring buffer of given number of events. Discards any
+ *  previously recorded events. The buffer is allocated before it is made
+ *  visible to recording threads.
+ */
+void start(std::size_t capacity = 1 << 20);
+
+/** Stops recording and waits for spans being recorded right now. Recorded
+ *  events are kept until next start().
+ */
+void stop();
+
+/** Saves recorded events as Chrome trace-event JSON. Stops recording first,
+ *  so it is safe to call while other threads are recording spans.
+ */
+void save(std::ostream &os);
+void save(const boost::filesystem::path &path);
+
+namespace detail {
+
+extern std::atomic<bool> recording;
+
+std::uint64_t now();
+
+void record(const char *name, const char *category
+            , std::uint64_t start, std::uint64_t end);
+
+} // namespace detail
+
+/** Returns true if recording is active.
+ */
+inline bool active() {
+    return detail::recording.load(std::memory_order_relaxed);
+}
+
+/** Records one span from construction to destruction. Name and category must
+ *  be string literals (only the pointers are stored).
+ */
+class Span {
+public:
+    Span(const char *name, const char *category = "slpk")
+        : name_(name), category_(category)
+        , start_(active() ? detail::now() : 0)
+    {}
+
+    ~Span() {
+        if (start_) { detail::record(name_, category_, start_, detail::now()); }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char *name_;
+    const char *category_;
+    std::uint64_t start_;
+};
+
+} } // namespace slpk::trace
+
+#endif // slpk_trace_hpp_included_
@@ -120,6 +120,8 @@ struct SpatialReference {
         : wkid(4326), latestWkid(), vcsWkid(5773), latestVcsWkid()
     {}
 
+    /** Builds SRS definition. See cachedSrs() in srs.hpp.
+     */
     geo::SrsDefinition srs() const;
 };
 
@@ -136,6 +138,9 @@ struct HeightModelInfo {
 
     HeightModelInfo() : heightModel(HeightModel::orthometric) {}
 
+    /** Parses height model from SRS WKT. See cachedHeightModelInfo() in
+     *  srs.hpp.
+     */
     HeightModelInfo(const geo::SrsDefinition &srs);
 };
 
@@ -292,6 +297,21 @@ struct GeometrySchema {
     typedef std::vector<GeometrySchema> list;
 };
 
+/** Counts stored in geometry buffer header (as described by
+ *  GeometrySchema::header). Missing counts are zero, except for faceCount of
+ *  non-indexed triangle meshes which is derived from vertexCount.
+ */
+struct GeometryHeader {
+    std::size_t vertexCount;
+    std::size_t faceCount;
+    std::size_t featureCount;
+
+    GeometryHeader() : vertexCount(), faceCount(), featureCount() {}
+
+    typedef std::vector<GeometryHeader> list;
+    typedef std::map<std::string, list> map;
+};
+
 namespace v17 {
 
 struct GeometryDefinition {
@@ -445,18 +465,68 @@ struct MinimumBoundingSphere {
     MinimumBoundingSphere() : r() {}
 };
 
-struct NodeReference {
-    std::string id;
+/** Containers used by the allocator-aware node tree types (BasicNode etc.)
+ *  for given allocator. std::allocator gives regular std containers (see
+ *  Node), pmr.hpp adds containers allocated from a memory resource (see
+ *  pmr::Node).
+ */
+template <typename Allocator> struct ContainerTraits;
+
+template <> struct ContainerTraits<std::allocator<char>> {
+    typedef std::string string;
+
+    template <typename T> using vector = std::vector<T>;
+
+    /** Map with string key.
+     */
+    template <typename T> using map = std::map<std::string, T>;
+
+    /** Type used for lookup in map.
+     */
+    typedef std::string key;
+};
+
+namespace detail {
+
+template <typename T>
+boost::optional<T> moveOptional(boost::optional<T> &value
+                                , const typename T::allocator_type &alloc)
+{
+    if (!value) { return boost::none; }
+    return T(std::move(*value), alloc);
+}
+
+} // namespace detail
+
+template <typename Allocator>
+struct BasicNodeReference {
+    typedef Allocator allocator_type;
+    typedef ContainerTraits<Allocator> Containers;
+
+    typename Containers::string id;
     MinimumBoundingSphere mbs;
-    std::string href;
-    std::string version;
+    typename Containers::string href;
+    typename Containers::string version;
     int featureCount;
 
-    typedef std::vector<NodeReference> list;
+    typedef typename Containers::template vector<BasicNodeReference> list;
+
+    BasicNodeReference() : featureCount() {}
 
-    NodeReference() : featureCount() {}
+    explicit BasicNodeReference(const allocator_type &alloc)
+        : id(alloc), href(alloc), version(alloc), featureCount()
+    {}
+
+    BasicNodeReference(BasicNodeReference &&o, const allocator_type &alloc)
+        : id(std::move(o.id), alloc), mbs(o.mbs)
+        , href(std::move(o.href), alloc)
+        , version(std::move(o.version), alloc)
+        , featureCount(o.featureCount)
+    {}
 };
 
+typedef BasicNodeReference<std::allocator<char>> NodeReference;
+
 struct FeatureRange {
     int min;
     int max;
@@ -466,23 +536,44 @@ struct FeatureRange {
     bool valid() const { return max >= min; }
 };
 
-struct Resource {
-    std::string href;
+template <typename Allocator>
+struct BasicResource {
+    typedef Allocator allocator_type;
+    typedef ContainerTraits<Allocator> Containers;
+
+    typename Containers::string href;
     const Encoding *encoding;
-    std::vector<std::string> layerContent;
+    typename Containers::template vector<typename Containers::string>
+        layerContent;
     FeatureRange featureRange;
     bool multiTextureBundle;
     int vertexElements;
     int faceElements;
 
-    Resource(const std::string &href = "")
-        : href(href), encoding(), featureRange(0, -1)
+    BasicResource(const std::string &href = ""
+                  , const allocator_type &alloc = allocator_type())
+        : href(href.data(), href.size(), alloc), encoding()
+        , layerContent(alloc), featureRange(0, -1)
         , multiTextureBundle(), vertexElements(), faceElements()
     {}
 
-    typedef std::vector<Resource> list;
+    explicit BasicResource(const allocator_type &alloc)
+        : BasicResource(std::string(), alloc)
+    {}
+
+    BasicResource(BasicResource &&o, const allocator_type &alloc)
+        : href(std::move(o.href), alloc), encoding(o.encoding)
+        , layerContent(std::move(o.layerContent), alloc)
+        , featureRange(o.featureRange)
+        , multiTextureBundle(o.multiTextureBundle)
+        , vertexElements(o.vertexElements), faceElements(o.faceElements)
+    {}
+
+    typedef typename Containers::template vector<BasicResource> list;
 };
 
+typedef BasicResource<std::allocator<char>> Resource;
+
 UTILITY_GENERATE_ENUM_CI(MetricType,
                          ((maxScreenThreshold))
                          ((screenSpaceRelative))
@@ -504,46 +595,103 @@ struct LodSelection {
     typedef std::vector<LodSelection> list;
 };
 
-struct Feature {
+template <typename Allocator>
+struct BasicFeature {
+    typedef Allocator allocator_type;
+    typedef ContainerTraits<Allocator> Containers;
+
     int id;
     MinimumBoundingSphere mbs;
     int lodChildFeatures;
-    std::vector<std::string> lodChildNodes;
+    typename Containers::template vector<typename Containers::string>
+        lodChildNodes;
     int rank;
-    std::string rootFeature;
+    typename Containers::string rootFeature;
+
+    typedef typename Containers::template vector<BasicFeature> list;
 
-    typedef std::vector<Feature> list;
+    BasicFeature() : id(), lodChildFeatures(), rank() {}
 
-    Feature() : id(), lodChildFeatures(), rank() {}
+    explicit BasicFeature(const allocator_type &alloc)
+        : id(), lodChildFeatures(), lodChildNodes(alloc), rank()
+        , rootFeature(alloc)
+    {}
+
+    BasicFeature(BasicFeature &&o, const allocator_type &alloc)
+        : id(o.id), mbs(o.mbs), lodChildFeatures(o.lodChildFeatures)
+        , lodChildNodes(std::move(o.lodChildNodes), alloc), rank(o.rank)
+        , rootFeature(std::move(o.rootFeature), alloc)
+    {}
 };
 
-struct Node {
-    std::string id;
+typedef BasicFeature<std::allocator<char>> Feature;
+
+/** Node index document. All strings and lists come from the allocator
+ *  (only the rarely used I3S 1.7 geometry definition is always heap
+ *  allocated), see ContainerTraits.
+ */
+template <typename Allocator>
+struct BasicNode {
+    typedef Allocator allocator_type;
+    typedef ContainerTraits<Allocator> Containers;
+    typedef BasicNodeReference<Allocator> NodeReference;
+    typedef BasicResource<Allocator> Resource;
+    typedef BasicFeature<Allocator> Feature;
+
+    typename Containers::string id;
     int level;
-    std::string version;
+    typename Containers::string version;
     MinimumBoundingSphere mbs;
     boost::optional<std::time_t> created;
     boost::optional<std::time_t> expires;
     boost::optional<math::Matrix4> transform;
     boost::optional<NodeReference> parentNode;
-    NodeReference::list children;
-    NodeReference::list neighbors;
+    typename NodeReference::list children;
+    typename NodeReference::list neighbors;
 
     boost::optional<Resource> sharedResource;
-    Resource::list featureData;
-    Resource::list geometryData;
-    Resource::list textureData;
-    LodSelection::list lodSelection;
-    Feature::list features;
+    typename Resource::list featureData;
+    typename Resource::list geometryData;
+    typename Resource::list textureData;
+    typename Containers::template vector<LodSelection> lodSelection;
+    typename Feature::list features;
     v17::GeometryDefinition geometryDefinition;
 
-    Node(const Store::pointer &store = Store::pointer()) : store_(store) {}
+    BasicNode(const Store::pointer &store = Store::pointer())
+        : store_(store)
+    {}
+
+    BasicNode(const Store::pointer &store, const allocator_type &alloc)
+        : id(alloc), version(alloc), children(alloc), neighbors(alloc)
+        , featureData(alloc), geometryData(alloc), textureData(alloc)
+        , lodSelection(alloc), features(alloc), store_(store)
+    {}
+
+    BasicNode(BasicNode &&o, const allocator_type &alloc)
+        : id(std::move(o.id), alloc), level(o.level)
+        , version(std::move(o.version), alloc), mbs(o.mbs)
+        , created(o.created), expires(o.expires), transform(o.transform)
+        , parentNode(detail::moveOptional(o.parentNode, alloc))
+        , children(std::move(o.children), alloc)
+        , neighbors(std::move(o.neighbors), alloc)
+        , sharedResource(detail::moveOptional(o.sharedResource, alloc))
+        , featureData(std::move(o.featureData), alloc)
+        , geometryData(std::move(o.geometryData), alloc)
+        , textureData(std::move(o.textureData), alloc)
+        , lodSelection(std::move(o.lodSelection), alloc)
+        , features(std::move(o.features), alloc)
+        , geometryDefinition(std::move(o.geometryDefinition))
+        , store_(std::move(o.store_))
+    {}
+
     const Store& store() const { return *store_; }
 
     bool hasGeometry() const { return !geometryData.empty(); }
 
+    allocator_type get_allocator() const { return id.get_allocator(); }
+
     NodeReference reference() const {
-        NodeReference nr;
+        NodeReference nr(get_allocator());
         nr.id = id;
         nr.version = version;
         nr.mbs = mbs;
@@ -555,7 +703,7 @@ struct Node {
         return sharedResource && !geometryData.empty();
     }
 
-    typedef std::map<std::string, Node> map;
+    typedef typename Containers::template map<BasicNode> map;
 
 private:
     /** Reference to shared store.
@@ -563,6 +711,8 @@ private:
     Store::pointer store_;
 };
 
+typedef BasicNode<std::allocator<char>> Node;
+
 UTILITY_GENERATE_ENUM_CI(MaterialType,
                          ((standard))
                          ((water))
@@ -592,48 +742,63 @@ UTILITY_GENERATE_ENUM_CI(Wrap,
 
 typedef std::array<double, 3> Color;
 
-struct Material {
-    typedef std::vector<Material> list;
-    std::string key; // key in serialized object
+struct MaterialParams {
+    bool vertexRegions;
+    bool vertexColors;
+    bool useVertexColorAlpha;
+    double transparency;
+    double reflectivity;
+    double shininess;
+    Color ambient;
+    Color difuse;
+    Color specular;
+    RenderMode renderMode;
+    bool castShadows;
+    bool receiveShadows;
+    CullFace cullFace;
+
+    MaterialParams()
+        : vertexRegions(), vertexColors(), useVertexColorAlpha()
+        , transparency(), reflectivity(), shininess()
+        , ambient{{ 0.0, 0.0, 0.0 }}
+        , difuse{{ 1.0, 1.0, 1.0 }}
+        , specular{{ 0.0, 0.0, 0.0 }}
+        , renderMode(RenderMode::textured)
+        , castShadows(), receiveShadows()
+        , cullFace(CullFace::none)
+    {}
+};
 
-    std::string name;
+template <typename Allocator>
+struct BasicMaterial {
+    typedef Allocator allocator_type;
+    typedef ContainerTraits<Allocator> Containers;
+
+    typedef typename Containers::template vector<BasicMaterial> list;
+    typename Containers::string key; // key in serialized object
+
+    typename Containers::string name;
     MaterialType type;
-    std::string ref;
+    typename Containers::string ref;
 
-    struct Params {
-        bool vertexRegions;
-        bool vertexColors;
-        bool useVertexColorAlpha;
-        double transparency;
-        double reflectivity;
-        double shininess;
-        Color ambient;
-        Color difuse;
-        Color specular;
-        RenderMode renderMode;
-        bool castShadows;
-        bool receiveShadows;
-        CullFace cullFace;
-
-        Params()
-            : vertexRegions(), vertexColors(), useVertexColorAlpha()
-            , transparency(), reflectivity(), shininess()
-            , ambient{{ 0.0, 0.0, 0.0 }}
-            , difuse{{ 1.0, 1.0, 1.0 }}
-            , specular{{ 0.0, 0.0, 0.0 }}
-            , renderMode(RenderMode::textured)
-            , castShadows(), receiveShadows()
-            , cullFace(CullFace::none)
-        {}
-    };
+    typedef MaterialParams Params;
 
     Params params;
 
-    Material(const std::string &key)
-        : key(key), type(MaterialType::standard)
+    BasicMaterial(const std::string &key
+                  , const allocator_type &alloc = allocator_type())
+        : key(key.data(), key.size(), alloc), name(alloc)
+        , type(MaterialType::standard), ref(alloc)
+    {}
+
+    BasicMaterial(BasicMaterial &&o, const allocator_type &alloc)
+        : key(std::move(o.key), alloc), name(std::move(o.name), alloc)
+        , type(o.type), ref(std::move(o.ref), alloc), params(o.params)
     {}
 };
 
+typedef BasicMaterial<std::allocator<char>> Material;
+
 struct Image {
     std::string id;
     std::size_t size;
@@ -673,13 +838,34 @@ struct Texture {
     {}
 };
 
-struct SharedResource {
-    Material::list materialDefinitions;
-    Texture::list textureDefinitions;
+/** Shared resource document. Texture definitions (not read by the reader)
+ *  keep their own heap allocated strings.
+ */
+template <typename Allocator>
+struct BasicSharedResource {
+    typedef Allocator allocator_type;
+    typedef BasicMaterial<Allocator> Material;
+
+    typename Material::list materialDefinitions;
+    typename ContainerTraits<Allocator>::template vector<Texture>
+        textureDefinitions;
+
+    BasicSharedResource() {}
 
-    using optional = boost::optional<SharedResource>;
+    explicit BasicSharedResource(const allocator_type &alloc)
+        : materialDefinitions(alloc), textureDefinitions(alloc)
+    {}
+
+    BasicSharedResource(BasicSharedResource &&o, const allocator_type &alloc)
+        : materialDefinitions(std::move(o.materialDefinitions), alloc)
+        , textureDefinitions(std::move(o.textureDefinitions), alloc)
+    {}
+
+    using optional = boost::optional<BasicSharedResource>;
 };
 
+typedef BasicSharedResource<std::allocator<char>> SharedResource;
+
 /** Geometry reference
  */
 struct GeometryReference {
@@ -749,37 +935,69 @@ struct NodeInfo {
     typedef std::vector<NodeInfo> list;
 };
 
-struct TreeNode {
+template <typename Allocator>
+struct BasicTreeNode {
+    typedef Allocator allocator_type;
+    typedef BasicNode<Allocator> Node;
+    typedef BasicSharedResource<Allocator> SharedResource;
+
     Node node;
-    SharedResource::optional sharedResource;
+    typename SharedResource::optional sharedResource;
 
-    TreeNode(Node &&node, SharedResource::optional &&sharedResource)
+    BasicTreeNode(Node &&node
+                  , typename SharedResource::optional &&sharedResource)
         : node(std::move(node)), sharedResource(std::move(sharedResource))
     {}
 
-    using map = std::map<std::string, TreeNode>;
+    BasicTreeNode(BasicTreeNode &&o, const allocator_type &alloc)
+        : node(std::move(o.node), alloc)
+        , sharedResource(detail::moveOptional(o.sharedResource, alloc))
+    {}
+
+    using map = typename ContainerTraits<Allocator>::template map
+        <BasicTreeNode>;
 };
 
-struct Tree {
-    std::string rootNodeId;
+typedef BasicTreeNode<std::allocator<char>> TreeNode;
+
+template <typename Allocator>
+struct BasicTree {
+    typedef Allocator allocator_type;
+    typedef ContainerTraits<Allocator> Containers;
+    typedef BasicNode<Allocator> Node;
+    typedef BasicSharedResource<Allocator> SharedResource;
+    typedef BasicTreeNode<Allocator> TreeNode;
+    typedef typename Containers::key key;
+
+    typename Containers::string rootNodeId;
+
+    typename TreeNode::map nodes;
 
-    TreeNode::map nodes;
+    BasicTree() {}
 
-    const Node* node(const std::string &id) const {
+    explicit BasicTree(const allocator_type &alloc)
+        : rootNodeId(alloc), nodes(alloc)
+    {}
+
+    allocator_type get_allocator() const {
+        return rootNodeId.get_allocator();
+    }
+
+    const Node* node(const key &id) const {
         if (auto *tn = find(id)) {
             return &tn->node;
         }
         return nullptr;
     }
 
-    const SharedResource* sharedResource(const std::string &id) const {
+    const SharedResource* sharedResource(const key &id) const {
         if (auto *tn = find(id)) {
             if (tn->sharedResource) { return &*tn->sharedResource; }
         }
         return nullptr;
     }
 
-    const TreeNode* find(const std::string &id) const {
+    const TreeNode* find(const key &id) const {
         auto fnodes(nodes.find(id));
         if (fnodes == nodes.end()) { return nullptr; }
         return &fnodes->second;
@@ -787,6 +1005,8 @@ struct Tree {
 
 };
 
+typedef BasicTree<std::allocator<char>> Tree;
+
 // inlines
 
 inline bool has(const GeometryAttribute::list &gal, const std::string &name)
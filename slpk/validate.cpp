@@ -0,0 +1,547 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <set>
+#include <thread>
+#include <memory>
+#include <sstream>
+#include <ostream>
+#include <istream>
+#include <iterator>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include <boost/optional.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "dbglog/dbglog.hpp"
+
+#include "utility/openmp.hpp"
+
+#include "jsoncpp/json.hpp"
+#include "jsoncpp/io.hpp"
+
+#include "validate.hpp"
+#include "detail/files.hpp"
+#include "detail/geometry.hpp"
+#include "detail/zip.hpp"
+#include "detail/entryreader.hpp"
+#include "detail/decode.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace slpk {
+
+namespace {
+
+typedef detail::decode::Inflater Inflater;
+
+/** Node to be visited: its directory, id in the reference and id of the
+ *  referencing node (both empty for the root).
+ */
+struct Pending {
+    std::string href;
+    std::string id;
+    std::string parent;
+
+    Pending(const std::string &href = "", const std::string &id = ""
+            , const std::string &parent = "")
+        : href(href), id(id), parent(parent)
+    {}
+
+    typedef std::vector<Pending> list;
+};
+
+/** Result of node visit.
+ */
+struct Visited {
+    boost::optional<Node> node;
+    ValidationIssue::list issues;
+    std::size_t resourceCount;
+
+    Visited() : resourceCount() {}
+
+    void add(IssueSeverity severity, const std::string &node
+             , const std::string &path, const std::string &message)
+    {
+        issues.emplace_back(severity, node, path, message);
+    }
+};
+
+/** Per-thread state.
+ */
+struct Worker {
+    Inflater inflater;
+    std::vector<char> buffer;
+};
+
+bool gzipped(const fs::path &path)
+{
+    return path.extension() == detail::constants::ext::gz;
+}
+
+std::size_t byteCount(const GeometryAttribute::list &attributes)
+{
+    std::size_t size(0);
+    for (const auto &ga : attributes) {
+        size += detail::byteCount(ga);
+    }
+    return size;
+}
+
+/** Checks geometry buffer against the schema.
+ */
+void checkBuffer(Visited &v, const Node &node, const std::string &path
+                 , const GeometrySchema &schema
+                 , const char *data, std::size_t size)
+{
+    std::size_t headerSize(0);
+    for (const auto &ha : schema.header) {
+        headerSize += detail::byteCount(ha.type);
+    }
+
+    if (size < headerSize) {
+        std::ostringstream os;
+        os << "Geometry buffer (" << size << " bytes) is shorter than its "
+            "header (" << headerSize << " bytes).";
+        v.add(IssueSeverity::error, node.id, path, os.str());
+        return;
+    }
+
+    detail::decode::ArrayBuf buf;
+    buf.reset(data, size);
+    std::istream in(&buf);
+    const auto header(detail::loadHeader(in, schema.header));
+
+    if ((schema.geometryType == GeometryType::triangles)
+        && (header.vertexCount % 3))
+    {
+        std::ostringstream os;
+        os << "Vertex count " << header.vertexCount
+           << " of triangle geometry is not a multiple of 3.";
+        v.add(IssueSeverity::error, node.id, path, os.str());
+    }
+
+    // check counts before multiplying, corrupted header can hold anything
+    const auto vertexSize(byteCount(schema.vertexAttributes));
+    const auto featureSize(byteCount(schema.featureAttributes));
+    const auto available(size - headerSize);
+    const bool fits
+        ((!vertexSize || (header.vertexCount <= available / vertexSize))
+         && (!featureSize || (header.featureCount <= available / featureSize)));
+
+    const auto expected
+        (fits ? (headerSize + header.vertexCount * vertexSize
+                 + header.featureCount * featureSize)
+         : std::size_t(-1));
+
+    if (size == expected) { return; }
+
+    std::ostringstream os;
+    os << "Geometry buffer has " << size << " bytes but header (vertexCount="
+       << header.vertexCount << ", featureCount=" << header.featureCount
+       << ") ";
+    if (!fits) {
+        os << "requires more.";
+    } else {
+        os << "requires " << expected << " bytes.";
+    }
+    v.add((size < expected) ? IssueSeverity::error : IssueSeverity::warning
+          , node.id, path, os.str());
+}
+
+void checkGeometry(Visited &v, Worker &worker, const Archive &archive
+                   , const Node &node)
+{
+    const auto &schema(node.store().defaultGeometrySchema);
+
+    for (const auto &resource : node.geometryData) {
+        ++v.resourceCount;
+        const auto path(resource.href + ".bin");
+
+        try {
+            const auto realPath(archive.realPath(path));
+            std::error_code ec;
+            auto is(archive.rawistream(realPath, ec));
+            if (!is) {
+                v.add(IssueSeverity::error, node.id, path
+                      , "Missing geometry resource.");
+                continue;
+            }
+
+            const auto raw(is->read());
+            const char *data(raw.data());
+            std::size_t size(raw.size());
+            if (gzipped(realPath)) {
+                size = worker.inflater.inflate
+                    (raw.data(), raw.size(), worker.buffer, path.c_str());
+                data = worker.buffer.data();
+            }
+
+            if (schema) {
+                checkBuffer(v, node, realPath.string(), *schema, data, size);
+            }
+        } catch (const std::exception &e) {
+            v.add(IssueSeverity::error, node.id, path, e.what());
+        }
+    }
+}
+
+void checkTextures(Visited &v, const Archive &archive, const Node &node)
+{
+    for (const auto &resource : node.textureData) {
+        ++v.resourceCount;
+        const auto *encoding(resource.encoding);
+
+        try {
+            std::error_code ec;
+            auto is((encoding && !encoding->ext.empty())
+                    ? archive.istream(resource.href
+                                      , { ".bin", encoding->ext.c_str() }
+                                      , ec)
+                    : archive.istream(resource.href, { ".bin" }, ec));
+            if (!is) {
+                v.add(IssueSeverity::error, node.id, resource.href
+                      , "Missing texture resource.");
+                continue;
+            }
+            // read through to catch broken gzip streams
+            is->read();
+        } catch (const std::exception &e) {
+            v.add(IssueSeverity::error, node.id, resource.href, e.what());
+        }
+    }
+}
+
+void checkFeatures(Visited &v, const Archive &archive, const Node &node)
+{
+    for (const auto &resource : node.featureData) {
+        ++v.resourceCount;
+
+        try {
+            std::error_code ec;
+            auto is(archive.istream(resource.href, { ".json" }, ec));
+            if (!is) {
+                v.add(IssueSeverity::error, node.id, resource.href
+                      , "Missing feature data resource.");
+                continue;
+            }
+            is->read();
+        } catch (const std::exception &e) {
+            v.add(IssueSeverity::error, node.id, resource.href, e.what());
+        }
+    }
+}
+
+void visit(Visited &v, Worker &worker, const Archive &archive
+           , const Pending &pending, const ValidationOptions &options)
+{
+    try {
+        v.node = archive.loadNodeIndex(pending.href);
+    } catch (const std::exception &e) {
+        v.add(IssueSeverity::error, pending.id, pending.href
+              , std::string("Cannot load node index: ") + e.what());
+        return;
+    }
+    const auto &node(*v.node);
+
+    if (!pending.id.empty() && (node.id != pending.id)) {
+        v.add(IssueSeverity::error, node.id, pending.href
+              , "Node id does not match id <" + pending.id
+              + "> in reference from node <" + pending.parent + ">.");
+    }
+
+    if (!pending.parent.empty()) {
+        if (!node.parentNode) {
+            v.add(IssueSeverity::warning, node.id, pending.href
+                  , "Missing parent node reference.");
+        } else if (node.parentNode->id != pending.parent) {
+            v.add(IssueSeverity::error, node.id, pending.href
+                  , "Parent node reference <" + node.parentNode->id
+                  + "> does not match referencing node <"
+                  + pending.parent + ">.");
+        }
+    }
+
+    if (node.sharedResource) {
+        ++v.resourceCount;
+        try {
+            archive.loadSharedResource(node.sharedResource->href);
+        } catch (const std::exception &e) {
+            v.add(IssueSeverity::error, node.id, node.sharedResource->href
+                  , std::string("Cannot load shared resource: ")
+                  + e.what());
+        }
+    }
+
+    if (options.checkGeometry) { checkGeometry(v, worker, archive, node); }
+    if (options.checkTextures) { checkTextures(v, archive, node); }
+    if (options.checkFeatures) { checkFeatures(v, archive, node); }
+}
+
+/** Walks the tree level by level; nodes of one level are visited in
+ *  parallel, only one level is held in memory.
+ */
+void validateTree(ValidationReport &report, const Archive &archive
+                  , const ValidationOptions &options, int threads)
+{
+    Pending::list level;
+    level.emplace_back(archive.sceneLayerInfo().store->rootNode);
+
+    std::set<std::string> seen;
+
+    for (int depth(0); !level.empty(); ++depth) {
+        std::vector<Visited> visited(level.size());
+
+        UTILITY_OMP(parallel num_threads(threads)
+                    shared(level, visited, archive, options))
+        {
+            Worker worker;
+
+            UTILITY_OMP(for schedule(dynamic))
+            for (std::size_t i = 0; i < level.size(); ++i) {
+                visit(visited[i], worker, archive, level[i], options);
+            }
+        }
+
+        Pending::list next;
+        for (auto &v : visited) {
+            report.resourceCount += v.resourceCount;
+            std::move(v.issues.begin(), v.issues.end()
+                      , std::back_inserter(report.issues));
+            if (!v.node) { continue; }
+
+            const auto &node(*v.node);
+            if (!seen.insert(node.id).second) {
+                // do not descend twice (and never loop forever)
+                report.issues.emplace_back
+                    (IssueSeverity::error, node.id, ""
+                     , "Node is referenced more than once.");
+                continue;
+            }
+            ++report.nodeCount;
+
+            for (const auto &child : node.children) {
+                next.emplace_back(child.href, child.id, node.id);
+            }
+        }
+
+        LOG(info3) << "Validated " << level.size() << " nodes at depth "
+                   << depth << ".";
+        level.swap(next);
+    }
+}
+
+void checkGzip(ValidationIssue::list &issues, Worker &worker
+               , const std::string &path, const char *data, std::size_t size)
+{
+    try {
+        worker.inflater.inflate(data, size, worker.buffer, path.c_str());
+    } catch (const std::exception &e) {
+        issues.emplace_back(IssueSeverity::error, "", path, e.what());
+    }
+}
+
+std::uint32_t crc32(const std::vector<char> &data)
+{
+    // zlib takes 32-bit lengths
+    const std::size_t chunk(std::size_t(1) << 30);
+
+    uLong crc(::crc32(0, Z_NULL, 0));
+    for (std::size_t offset(0); offset < data.size(); offset += chunk) {
+        const auto size(std::min(chunk, data.size() - offset));
+        crc = ::crc32(crc, reinterpret_cast<const Bytef*>
+                      (data.data() + offset), uInt(size));
+    }
+    return std::uint32_t(crc);
+}
+
+void checkZipEntry(ValidationIssue::list &issues, Worker &worker
+                   , std::unique_ptr<detail::EntryReader> &reader
+                   , const fs::path &zipPath
+                   , const detail::zip::Entry &entry)
+{
+    try {
+        if (!reader) { reader.reset(new detail::EntryReader(zipPath, 1)); }
+        const auto data(std::move(reader->read({ &entry }).front()));
+
+        if (data.size() != entry.uncompressedSize) {
+            std::ostringstream os;
+            os << "Zip entry inflates to " << data.size()
+               << " bytes but directory states " << entry.uncompressedSize
+               << " bytes.";
+            issues.emplace_back(IssueSeverity::error, "", entry.path
+                                , os.str());
+        }
+
+        const auto crc(crc32(data));
+        if (crc != entry.crc32) {
+            std::ostringstream os;
+            os << "Zip entry CRC mismatch (" << std::hex << crc
+               << " instead of " << entry.crc32 << ").";
+            issues.emplace_back(IssueSeverity::error, "", entry.path
+                                , os.str());
+        }
+
+        if (gzipped(entry.path)) {
+            checkGzip(issues, worker, entry.path, data.data(), data.size());
+        }
+    } catch (const std::exception &e) {
+        issues.emplace_back(IssueSeverity::error, "", entry.path, e.what());
+    }
+}
+
+/** Checks all zip entries (zip archives opened from a path) or all gzipped
+ *  files (other archives) in parallel.
+ */
+void validateEntries(ValidationReport &report, const Archive &archive
+                     , int threads)
+{
+    const auto &root(archive.root());
+    const bool zip(!root.empty() && fs::is_regular_file(root));
+
+    detail::zip::Entry::list entries;
+    std::vector<fs::path> files;
+    try {
+        if (zip) {
+            for (auto &entry : detail::zip::readCentralDirectory(root)) {
+                // skip directories
+                if (entry.path.empty() || (entry.path.back() == '/')) {
+                    continue;
+                }
+                entries.push_back(std::move(entry));
+            }
+        } else {
+            for (const auto &path : archive.fileList()) {
+                if (gzipped(path)) { files.push_back(path); }
+            }
+        }
+    } catch (const std::exception &e) {
+        report.issues.emplace_back(IssueSeverity::error, "", root.string()
+                                   , e.what());
+        return;
+    }
+
+    const auto count(zip ? entries.size() : files.size());
+    std::vector<ValidationIssue::list> issues(count);
+
+    UTILITY_OMP(parallel num_threads(threads)
+                shared(entries, files, issues, archive))
+    {
+        Worker worker;
+        std::unique_ptr<detail::EntryReader> reader;
+
+        UTILITY_OMP(for schedule(dynamic))
+        for (std::size_t i = 0; i < count; ++i) {
+            if (zip) {
+                checkZipEntry(issues[i], worker, reader, root, entries[i]);
+                continue;
+            }
+
+            const auto path(files[i].string());
+            try {
+                std::error_code ec;
+                auto is(archive.rawistream(files[i], ec));
+                if (!is) {
+                    issues[i].emplace_back(IssueSeverity::error, "", path
+                                           , "File not found.");
+                    continue;
+                }
+                const auto data(is->read());
+                checkGzip(issues[i], worker, path, data.data(), data.size());
+            } catch (const std::exception &e) {
+                issues[i].emplace_back(IssueSeverity::error, "", path
+                                       , e.what());
+            }
+        }
+    }
+
+    report.entryCount += count;
+    for (auto &list : issues) {
+        std::move(list.begin(), list.end()
+                  , std::back_inserter(report.issues));
+    }
+}
+
+} // namespace
+
+std::size_t ValidationReport::count(IssueSeverity severity) const
+{
+    return std::count_if(issues.begin(), issues.end()
+                         , [&](const ValidationIssue &issue)
+    {
+        return issue.severity == severity;
+    });
+}
+
+ValidationReport validate(const Archive &archive
+                          , const ValidationOptions &options)
+{
+    auto threads(options.threads);
+    if (threads <= 0) { threads = std::thread::hardware_concurrency(); }
+    if (threads <= 0) { threads = 1; }
+
+    ValidationReport report;
+
+    LOG(info3) << "Validating node tree.";
+    validateTree(report, archive, options, threads);
+
+    if (options.checkEntries) {
+        LOG(info3) << "Validating archive entries.";
+        validateEntries(report, archive, threads);
+    }
+
+    return report;
+}
+
+void saveJson(std::ostream &os, const ValidationReport &report)
+{
+    Json::Value value(Json::objectValue);
+    value["ok"] = report.ok();
+    value["nodeCount"] = Json::UInt64(report.nodeCount);
+    value["resourceCount"] = Json::UInt64(report.resourceCount);
+    value["entryCount"] = Json::UInt64(report.entryCount);
+    value["errorCount"] = Json::UInt64(report.count(IssueSeverity::error));
+    value["warningCount"]
+        = Json::UInt64(report.count(IssueSeverity::warning));
+
+    auto &jissues(value["issues"] = Json::arrayValue);
+    for (const auto &issue : report.issues) {
+        auto &jissue(jissues.append(Json::objectValue));
+        jissue["severity"]
+            = boost::lexical_cast<std::string>(issue.severity);
+        if (!issue.node.empty()) { jissue["node"] = issue.node; }
+        if (!issue.path.empty()) { jissue["path"] = issue.path; }
+        jissue["message"] = issue.message;
+    }
+
+    Json::write(os, value, true);
+}
+
+} // namespace slpk
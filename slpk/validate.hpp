@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef slpk_validate_hpp_included_
+#define slpk_validate_hpp_included_
+
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+#include "utility/enum-io.hpp"
+
+#include "reader.hpp"
+
+/** Integrity validation of an archive.
+ */
+
+namespace slpk {
+
+UTILITY_GENERATE_ENUM_CI(IssueSeverity,
+                         ((warning))
+                         ((error))
+                         )
+
+struct ValidationIssue {
+    IssueSeverity severity;
+
+    /** Id of node the issue belongs to, empty for archive-wide issues.
+     */
+    std::string node;
+
+    /** Path inside the archive (zip entry, resource or node directory).
+     */
+    std::string path;
+
+    std::string message;
+
+    ValidationIssue(IssueSeverity severity = IssueSeverity::error
+                    , const std::string &node = ""
+                    , const std::string &path = ""
+                    , const std::string &message = "")
+        : severity(severity), node(node), path(path), message(message)
+    {}
+
+    typedef std::vector<ValidationIssue> list;
+};
+
+struct ValidationOptions {
+    /** Number of threads, 0 means number of CPUs.
+     */
+    int threads;
+
+    /** Check zip entries (CRC and size) of archives opened from a zip file
+     *  and integrity of all gzipped files.
+     */
+    bool checkEntries;
+
+    /** Read geometry resources and check their headers and sizes against
+     *  the default geometry schema.
+     */
+    bool checkGeometry;
+
+    /** Check that textures and feature data resolve and are readable.
+     */
+    bool checkTextures;
+    bool checkFeatures;
+
+    ValidationOptions()
+        : threads(), checkEntries(true), checkGeometry(true)
+        , checkTextures(true), checkFeatures(true)
+    {}
+};
+
+struct ValidationReport {
+    /** Number of reachable (loaded) nodes.
+     */
+    std::size_t nodeCount;
+
+    /** Number of checked node resources and archive entries.
+     */
+    std::size_t resourceCount;
+    std::size_t entryCount;
+
+    /** All found issues: node tree in traversal order followed by archive
+     *  entries.
+     */
+    ValidationIssue::list issues;
+
+    ValidationReport() : nodeCount(), resourceCount(), entryCount() {}
+
+    std::size_t count(IssueSeverity severity) const;
+
+    /** No errors found (warnings are allowed).
+     */
+    bool ok() const { return !count(IssueSeverity::error); }
+};
+
+/** Validates archive: walks the node tree from the root (node indices of
+ *  one level are loaded in parallel), checks that node references, shared
+ *  resources, geometries, textures and features resolve, geometry buffers
+ *  match the schema, and zip entries and gzip streams are intact.
+ *
+ *  Nothing is thrown on broken data: every problem is recorded in the report
+ *  and validation goes on.
+ */
+ValidationReport validate(const Archive &archive
+                          , const ValidationOptions &options
+                          = ValidationOptions());
+
+/** Writes report as JSON.
+ */
+void saveJson(std::ostream &os, const ValidationReport &report);
+
+} // namespace slpk
+
+#endif // slpk_validate_hpp_included_
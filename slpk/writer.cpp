@@ -59,6 +59,8 @@
 #include "writer.hpp"
 #include "restapi.hpp"
 #include "detail/files.hpp"
+#include "detail/document.hpp"
+#include "trace.hpp"
 
 namespace fs = boost::filesystem;
 namespace bio = boost::iostreams;
@@ -826,8 +828,43 @@ const GeometrySchema& getGeometrySchema(const SceneLayerInfo &sli)
     return gs;
 }
 
+bool isNodeIndex(const fs::path &path)
+{
+    auto name(path.filename());
+    if (name.extension() == detail::constants::ext::gz) {
+        name = name.stem();
+    }
+    return name == detail::constants::NodeIndex;
+}
+
 } // namespace
 
+void detail::build(Json::Value &value, const Node &node
+                   , bool standardSharedResource)
+{
+    slpk::build(value, node, standardSharedResource);
+}
+
+void detail::build(Json::Value &value, const SharedResource &sr)
+{
+    slpk::build(value, sr);
+}
+
+void detail::build(Json::Value &value, const SceneLayerInfo &sli
+                   , const Metadata &metadata)
+{
+    slpk::build(value, sli, metadata);
+}
+
+void detail::saveMesh(std::ostream &os, const Node &node
+                      , const MeshSaver &meshSaver
+                      , const GeometrySchema &gs
+                      , FeatureData::Feature &feature
+                      , ArrayBufferView &arrayBufferView)
+{
+    slpk::saveMesh(os, node, meshSaver, gs, feature, arrayBufferView);
+}
+
 struct Writer::Detail {
     Detail(const boost::filesystem::path &path
            , const Metadata &metadata, const SceneLayerInfo &sli
@@ -848,6 +885,16 @@ struct Writer::Detail {
     template <typename T>
     void store(const T &value, const fs::path &path, bool raw = false);
 
+    void copy(const utility::zip::Writer::OStream::pointer &os
+              , const fs::path &path, std::istream &is);
+
+    /** Locks zip writer, records lock wait in trace.
+     */
+    std::unique_lock<std::mutex> acquire() {
+        trace::Span span("writer.lock", "writer");
+        return std::unique_lock<std::mutex>(mutex);
+    }
+
     SceneLayerInfo sli;
     const GeometrySchema &gs;
     utility::zip::Writer zip;
@@ -864,7 +911,8 @@ void Writer::Detail::store(const T &value, const fs::path &path, bool raw)
     Json::Value jValue;
     build(jValue, value);
 
-    std::unique_lock<std::mutex> lock(mutex);
+    auto lock(acquire());
+    trace::Span span("zip.write", "writer");
     auto os(ostream( path, raw));
     Json::write(os->get(), jValue, false);
     os->close();
@@ -911,6 +959,18 @@ Writer::Detail::ostream(const fs::path &path, bool raw)
     return zip.ostream(path, compression);
 }
 
+void Writer::Detail::copy(const utility::zip::Writer::OStream::pointer &os
+                          , const fs::path &path, std::istream &is)
+{
+    // inserting empty stream buffer would set failbit
+    if (is.rdbuf()->sgetc() != std::char_traits<char>::eof()) {
+        os->get() << is.rdbuf();
+    }
+    os->close();
+
+    if (isNodeIndex(path)) { ++nodeCount; }
+}
+
 std::uint64_t buildId(std::uint64_t id, const math::Size2 &size
                       , unsigned int l, unsigned int al)
 {
@@ -974,7 +1034,8 @@ void Writer::Detail::write(Node &node, SharedResource &sharedResource
         const fs::path texturePath
             (detail::constants::Nodes / node.id / (href + ".bin"));
 
-        std::unique_lock<std::mutex> lock(mutex);
+        auto lock(acquire());
+        trace::Span span("zip.write", "writer");
         // TODO: do not report DDS as raw (if ever used)
         auto os(ostream(texturePath, true));
         textureSaver.save(os->get(), encoding.mime);
@@ -1007,6 +1068,7 @@ void Writer::Detail::write(Node &node, SharedResource &sharedResource
         auto &gd(utility::append(featureData.geometryData, 0));
 
         // only per-attribute array geometry type
+        trace::Span span("geometry.encode", "writer");
         saveMesh(tmp, node, meshSaver, gs, fd, gd);
 
         // store references to material and textures
@@ -1016,7 +1078,8 @@ void Writer::Detail::write(Node &node, SharedResource &sharedResource
     }
 
     {
-        std::unique_lock<std::mutex> lock(mutex);
+        auto lock(acquire());
+        trace::Span span("zip.write", "writer");
         auto os(ostream(geometryPath));
         os->get() << tmp.rdbuf();
         os->close();
@@ -1054,6 +1117,32 @@ void Writer::write(Node &node, SharedResource &sharedResource
     return detail_->write(node, sharedResource, meshSaver, textureSaver);
 }
 
+void Writer::write(const boost::filesystem::path &path, std::istream &is)
+{
+    auto lock(detail_->acquire());
+    trace::Span span("zip.write", "writer");
+    detail_->copy(detail_->ostream(path), path, is);
+}
+
+void Writer::copy(const boost::filesystem::path &path, std::istream &is)
+{
+    const bool gzipped(path.extension() == detail::constants::ext::gz);
+    const utility::zip::Compression compression
+        ((!gzipped && (detail_->metadata.archiveCompressionType
+                       != ArchiveCompressionType::store))
+         ? utility::zip::Compression::deflate
+         : utility::zip::Compression::store);
+
+    auto lock(detail_->acquire());
+    trace::Span span("zip.write", "writer");
+    detail_->copy(detail_->zip.ostream(path, compression), path, is);
+}
+
+const Metadata& Writer::metadata() const
+{
+    return detail_->metadata;
+}
+
 void Writer::flush(const SceneLayerInfoCallback &callback)
 {
     detail_->flush(callback);
@@ -27,6 +27,7 @@
 #ifndef slpk_writer_hpp_included_
 #define slpk_writer_hpp_included_
 
+#include <istream>
 #include <ostream>
 
 #include "utility/zip.hpp"
@@ -90,6 +91,27 @@ public:
                , const MeshSaver &meshSaver
                , const TextureSaver &textureSaver);
 
+    /** Writes arbitrary file. Content is compressed according to resource
+     *  compression type in metadata (.gz is appended to the path when
+     *  gzipped) and archive compression type.
+     *
+     *  Node index documents are counted in metadata.
+     */
+    void write(const boost::filesystem::path &path, std::istream &is);
+
+    /** Copies already encoded file content as is, path is the final path
+     *  inside the archive. Nothing is decompressed nor recompressed at the
+     *  resource level; content is deflated by zip according to archive
+     *  compression type unless it is already gzipped.
+     *
+     *  Node index documents are counted in metadata.
+     */
+    void copy(const boost::filesystem::path &path, std::istream &is);
+
+    /** Output metadata (node count is updated on flush).
+     */
+    const Metadata& metadata() const;
+
     typedef std::function<void(SceneLayerInfo&)> SceneLayerInfoCallback;
 
     /** Saves metadata, 3dSceneLayerInfo and flushes output archive.